@@ -0,0 +1,139 @@
+#include "affine.h"
+
+#include <math.h>
+
+#ifdef AFFINE_SSE
+// Sines and cosines of four angles in degrees: brought to -90..90 once,
+// then a series for each
+static void affine_sin_cos(__m128 degrees, __m128& sines, __m128& cosines) {
+  // to -180..180, less the nearest whole turn
+  __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(degrees, _mm_set1_ps(1.0f / 360.0f))));
+  __m128 x     = _mm_sub_ps(degrees, _mm_mul_ps(turns, _mm_set1_ps(360.0f)));
+
+  // sin(x) = sin(180 - x) and cos(x) = -cos(180 - x) fold the rest in
+  __m128 sign = _mm_and_ps(x, _mm_set1_ps(-0.0f));
+  __m128 size = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+  __m128 over = _mm_cmpgt_ps(size, _mm_set1_ps(90.0f));
+  size = _mm_or_ps(_mm_and_ps(over, _mm_sub_ps(_mm_set1_ps(180.0f), size)),
+                   _mm_andnot_ps(over, size));
+
+  x = _mm_mul_ps(_mm_or_ps(size, sign), _mm_set1_ps(3.14159265f / 180.0f));
+  __m128 x2 = _mm_mul_ps(x, x);
+
+  // to x^11 and x^12, under a ten millionth out by 90 degrees
+  __m128 sum = _mm_set1_ps(-1.0f / 39916800.0f);
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps( 1.0f / 362880.0f));
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(-1.0f / 5040.0f));
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps( 1.0f / 120.0f));
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(-1.0f / 6.0f));
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps( 1.0f));
+  sines = _mm_mul_ps(sum, x);
+
+  sum = _mm_set1_ps(1.0f / 479001600.0f);
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(-1.0f / 3628800.0f));
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps( 1.0f / 40320.0f));
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(-1.0f / 720.0f));
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps( 1.0f / 24.0f));
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(-1.0f / 2.0f));
+  sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps( 1.0f));
+  cosines = _mm_xor_ps(sum, _mm_and_ps(over, _mm_set1_ps(-0.0f)));
+}
+#endif
+
+void Affine::sinCos(const float* degrees, float* sines, float* cosines, size_t count) {
+#ifdef AFFINE_SSE
+  for (size_t i = 0; i < count; i += 4) {
+    __m128 s;
+    __m128 c;
+    affine_sin_cos(_mm_loadu_ps(degrees + i), s, c);
+    _mm_storeu_ps(sines + i,   s);
+    _mm_storeu_ps(cosines + i, c);
+  }
+#else
+  for (size_t i = 0; i < count; i++) {
+    // whole turns off first, exactly, so big angles keep their precision
+    float radians = fmodf(degrees[i], 360.0f) * (3.14159265f / 180.0f);
+    sines[i]   = sinf(radians);
+    cosines[i] = cosf(radians);
+  }
+#endif
+}
+
+void Affine::rotateX(glm::mat4& m, float degrees) {
+  float angles[4] = { degrees, 0.0f, 0.0f, 0.0f };
+  float sines[4];
+  float cosines[4];
+  sinCos(angles, sines, cosines, 1);
+
+  _mix(&m[1][0], &m[2][0], cosines[0], sines[0]);
+}
+
+void Affine::rotateY(glm::mat4& m, float degrees) {
+  float angles[4] = { degrees, 0.0f, 0.0f, 0.0f };
+  float sines[4];
+  float cosines[4];
+  sinCos(angles, sines, cosines, 1);
+
+  _mix(&m[2][0], &m[0][0], cosines[0], sines[0]);
+}
+
+void Affine::rotateZ(glm::mat4& m, float degrees) {
+  float angles[4] = { degrees, 0.0f, 0.0f, 0.0f };
+  float sines[4];
+  float cosines[4];
+  sinCos(angles, sines, cosines, 1);
+
+  _mix(&m[0][0], &m[1][0], cosines[0], sines[0]);
+}
+
+void Affine::rotateXYZ(glm::mat4& m, float x, float y, float z) {
+  float angles[4] = { x, y, z, 0.0f };
+  float sines[4];
+  float cosines[4];
+  sinCos(angles, sines, cosines, 3);
+
+  rotateXYZ(m, sines, cosines);
+}
+
+void Affine::place(const glm::mat4& m, const float* positions, float s,
+                   glm::mat4* out, size_t count) {
+  const float* c = &m[0][0];
+
+#ifdef AFFINE_SSE
+  __m128 c0 = _mm_loadu_ps(c);
+  __m128 c1 = _mm_loadu_ps(c + 4);
+  __m128 c2 = _mm_loadu_ps(c + 8);
+  __m128 c3 = _mm_loadu_ps(c + 12);
+
+  __m128 scale = _mm_set1_ps(s);
+  __m128 s0 = _mm_mul_ps(c0, scale);
+  __m128 s1 = _mm_mul_ps(c1, scale);
+  __m128 s2 = _mm_mul_ps(c2, scale);
+
+  for (size_t i = 0; i < count; i++) {
+    const float* p = positions + i * 3;
+    float*       o = &out[i][0][0];
+
+    __m128 moved = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p[0])),
+                              _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+    moved = _mm_add_ps(moved, _mm_mul_ps(c2, _mm_set1_ps(p[2])));
+
+    _mm_storeu_ps(o,      s0);
+    _mm_storeu_ps(o + 4,  s1);
+    _mm_storeu_ps(o + 8,  s2);
+    _mm_storeu_ps(o + 12, _mm_add_ps(moved, c3));
+  }
+#else
+  for (size_t i = 0; i < count; i++) {
+    const float* p = positions + i * 3;
+    float*       o = &out[i][0][0];
+
+    for (int r = 0; r < 4; r++) {
+      o[r]      = c[r] * s;
+      o[4 + r]  = c[4 + r] * s;
+      o[8 + r]  = c[8 + r] * s;
+      o[12 + r] = c[r] * p[0] + c[4 + r] * p[1] + c[8 + r] * p[2] + c[12 + r];
+    }
+  }
+#endif
+}
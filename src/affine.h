@@ -0,0 +1,189 @@
+#ifndef AFFINE_INCLUDED
+#define AFFINE_INCLUDED
+
+#include "main.h"
+
+#include "glm/glm.hpp"
+
+// SSE2 where every x86-64 has it; plain floats anywhere else
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AFFINE_SSE
+#include <emmintrin.h>
+#endif
+
+/*
+ * Builds model matrices the way glm::rotate, glm::translate and
+ * glm::scale chains do (angles in degrees, as this glm takes them), for
+ * the paths that build one per block, digit or flame particle.
+ *
+ * Each call changes the matrix in place, as m = m * T would. As every
+ * T only rotates, scales or moves, only the columns it touches are
+ * worked: a rotation mixes two columns, a move adds to the last, a
+ * scale multiplies the first three. glm multiplies all 4x4 every time,
+ * and every rotation works out a sine, a cosine and a normalised axis.
+ * The matrices stay glm::mat4s, so they upload as they are.
+ */
+class Affine {
+public:
+  // m = m * translate(x, y, z)
+  static void translate(glm::mat4& m, float x, float y, float z) {
+    float* c = &m[0][0];
+#ifdef AFFINE_SSE
+    __m128 moved = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(c),     _mm_set1_ps(x)),
+                              _mm_mul_ps(_mm_loadu_ps(c + 4), _mm_set1_ps(y)));
+    moved = _mm_add_ps(moved, _mm_mul_ps(_mm_loadu_ps(c + 8), _mm_set1_ps(z)));
+    _mm_storeu_ps(c + 12, _mm_add_ps(moved, _mm_loadu_ps(c + 12)));
+#else
+    for (int i = 0; i < 4; i++) {
+      c[12 + i] += c[i] * x + c[4 + i] * y + c[8 + i] * z;
+    }
+#endif
+  }
+
+  // m = m * scale(x, y, z)
+  static void scale(glm::mat4& m, float x, float y, float z) {
+    float* c = &m[0][0];
+    _scaleColumn(c,     x);
+    _scaleColumn(c + 4, y);
+    _scaleColumn(c + 8, z);
+  }
+
+  static void scale(glm::mat4& m, float s) {
+    scale(m, s, s, s);
+  }
+
+  // m = m * rotate(degrees, axis)
+  static void rotateX(glm::mat4& m, float degrees);
+  static void rotateY(glm::mat4& m, float degrees);
+  static void rotateZ(glm::mat4& m, float degrees);
+
+  /*
+   * m = m * rotateX(x) * rotateY(y) * rotateZ(z), with the three sines
+   * and cosines worked out together.
+   */
+  static void rotateXYZ(glm::mat4& m, float x, float y, float z);
+
+  /*
+   * The same, given the sines and cosines of x, y and z, as from a
+   * sinCos() over many at once.
+   */
+  static void rotateXYZ(glm::mat4& m, const float* sines, const float* cosines) {
+    _mix(&m[1][0], &m[2][0], cosines[0], sines[0]);
+    _mix(&m[2][0], &m[0][0], cosines[1], sines[1]);
+    _mix(&m[0][0], &m[1][0], cosines[2], sines[2]);
+  }
+
+  /*
+   * out = m * translate(x, y, z) * scale(s) * rotateXYZ(sines, cosines)
+   * in one go, for the flame blocks that share one m per heading. Each
+   * column of out is made straight from m's and kept in registers
+   * through the three rotations; the scale rides on the first.
+   */
+  static void placeRotated(const glm::mat4& m, float x, float y, float z, float s,
+                           const float* sines, const float* cosines, glm::mat4& out) {
+    const float* c = &m[0][0];
+    float*       o = &out[0][0];
+#ifdef AFFINE_SSE
+    __m128 c0 = _mm_loadu_ps(c);
+    __m128 c1 = _mm_loadu_ps(c + 4);
+    __m128 c2 = _mm_loadu_ps(c + 8);
+
+    __m128 moved = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(x)),
+                              _mm_mul_ps(c1, _mm_set1_ps(y)));
+    moved = _mm_add_ps(moved, _mm_mul_ps(c2, _mm_set1_ps(z)));
+    _mm_storeu_ps(o + 12, _mm_add_ps(moved, _mm_loadu_ps(c + 12)));
+
+    c0 = _mm_mul_ps(c0, _mm_set1_ps(s));
+    _mixHeld(c1, c2, cosines[0] * s, sines[0] * s);
+    _mixHeld(c2, c0, cosines[1], sines[1]);
+    _mixHeld(c0, c1, cosines[2], sines[2]);
+
+    _mm_storeu_ps(o,     c0);
+    _mm_storeu_ps(o + 4, c1);
+    _mm_storeu_ps(o + 8, c2);
+#else
+    // every row on its own, as the columns only mix within one
+    for (int i = 0; i < 4; i++) {
+      float c0 = c[i];
+      float c1 = c[4 + i];
+      float c2 = c[8 + i];
+
+      o[12 + i] = c0 * x + c1 * y + c2 * z + c[12 + i];
+
+      c0 *= s;
+      _mixHeld(c1, c2, cosines[0] * s, sines[0] * s);
+      _mixHeld(c2, c0, cosines[1], sines[1]);
+      _mixHeld(c0, c1, cosines[2], sines[2]);
+
+      o[i]     = c0;
+      o[4 + i] = c1;
+      o[8 + i] = c2;
+    }
+#endif
+  }
+
+  /*
+   * For each of count positions (x, y, z in turn), out = m *
+   * translate(position) * scale(s): the same cube placed all over one
+   * board. The first three columns are the same for all of them, so
+   * only the last is worked out each time.
+   */
+  static void place(const glm::mat4& m, const float* positions, float s,
+                    glm::mat4* out, size_t count);
+
+  /*
+   * The sines and cosines of count angles in degrees, good to about a
+   * millionth. Four at a time, so the arrays must have room for count
+   * rounded up to a multiple of four; one call over a whole list is
+   * much quicker than one per angle.
+   */
+  static void sinCos(const float* degrees, float* sines, float* cosines, size_t count);
+
+private:
+  static void _scaleColumn(float* column, float s) {
+#ifdef AFFINE_SSE
+    _mm_storeu_ps(column, _mm_mul_ps(_mm_loadu_ps(column), _mm_set1_ps(s)));
+#else
+    for (int i = 0; i < 4; i++) {
+      column[i] *= s;
+    }
+#endif
+  }
+
+  // _mix on columns held in registers (or one row of them)
+#ifdef AFFINE_SSE
+  static void _mixHeld(__m128& a, __m128& b, float cosine, float sine) {
+    __m128 c = _mm_set1_ps(cosine);
+    __m128 s = _mm_set1_ps(sine);
+    __m128 mixed = _mm_add_ps(_mm_mul_ps(a, c), _mm_mul_ps(b, s));
+    b = _mm_sub_ps(_mm_mul_ps(b, c), _mm_mul_ps(a, s));
+    a = mixed;
+  }
+#else
+  static void _mixHeld(float& a, float& b, float cosine, float sine) {
+    float mixed = a * cosine + b * sine;
+    b = b * cosine - a * sine;
+    a = mixed;
+  }
+#endif
+
+  // a, b = a * cos + b * sin, b * cos - a * sin
+  static void _mix(float* a, float* b, float cosine, float sine) {
+#ifdef AFFINE_SSE
+    __m128 ca = _mm_loadu_ps(a);
+    __m128 cb = _mm_loadu_ps(b);
+    __m128 c  = _mm_set1_ps(cosine);
+    __m128 s  = _mm_set1_ps(sine);
+    _mm_storeu_ps(a, _mm_add_ps(_mm_mul_ps(ca, c), _mm_mul_ps(cb, s)));
+    _mm_storeu_ps(b, _mm_sub_ps(_mm_mul_ps(cb, c), _mm_mul_ps(ca, s)));
+#else
+    for (int i = 0; i < 4; i++) {
+      float ai = a[i];
+      a[i] = ai * cosine + b[i] * sine;
+      b[i] = b[i] * cosine - ai * sine;
+    }
+#endif
+  }
+};
+
+#endif
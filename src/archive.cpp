@@ -0,0 +1,154 @@
+#include "archive.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if !defined(WIN32) && !defined(EMSCRIPTEN)
+#define ARCHIVE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+Archive::Archive()
+  : _base(NULL),
+    _length(0),
+    _mapped(false),
+    _entries(NULL),
+    _count(0) {
+}
+
+Archive::~Archive() {
+  close();
+}
+
+bool Archive::open(const char* path) {
+  close();
+
+#ifdef ARCHIVE_MMAP
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(ArchiveHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  void* base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (base == MAP_FAILED) {
+    printf("archive: cannot map '%s'\n", path);
+    return false;
+  }
+
+  _base   = (const Uint8*)base;
+  _length = (size_t)info.st_size;
+  _mapped = true;
+#else
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if (length < (long)sizeof(ArchiveHeader)) {
+    fclose(file);
+    return false;
+  }
+
+  Uint8* base = new Uint8[length];
+  size_t read = fread(base, 1, (size_t)length, file);
+  fclose(file);
+
+  if (read != (size_t)length) {
+    delete [] base;
+    return false;
+  }
+
+  _base   = base;
+  _length = (size_t)length;
+  _mapped = false;
+#endif
+
+  const ArchiveHeader* header = (const ArchiveHeader*)_base;
+  size_t index_end = sizeof(ArchiveHeader) + (size_t)header->count * sizeof(ArchiveEntry);
+
+  if (memcmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != ARCHIVE_VERSION || index_end > _length) {
+    printf("archive: '%s' is not an archive of this version\n", path);
+    close();
+    return false;
+  }
+
+  _entries = (const ArchiveEntry*)(_base + sizeof(ArchiveHeader));
+  _count   = header->count;
+
+  // a truncated file must not hand out pointers past its end
+  for (Uint32 i = 0; i < _count; i++) {
+    if ((size_t)_entries[i].offset + _entries[i].size > _length) {
+      printf("archive: '%s' is truncated\n", path);
+      close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void Archive::close() {
+  if (!_base) {
+    return;
+  }
+
+#ifdef ARCHIVE_MMAP
+  if (_mapped) {
+    munmap((void*)_base, _length);
+  }
+#endif
+  if (!_mapped) {
+    delete [] _base;
+  }
+
+  _base    = NULL;
+  _length  = 0;
+  _mapped  = false;
+  _entries = NULL;
+  _count   = 0;
+}
+
+bool Archive::opened() {
+  return _base != NULL;
+}
+
+const ArchiveEntry* Archive::find(const char* name) {
+  // a few dozen entries, looked up once each at startup
+  for (Uint32 i = 0; i < _count; i++) {
+    if (strncmp(_entries[i].name, name, ARCHIVE_NAME_LENGTH) != 0) {
+      continue;
+    }
+
+    // no file there at all (shipped without sources, emscripten) is fine
+    struct stat info;
+    if (stat(name, &info) == 0 &&
+        ((Uint32)info.st_size  != _entries[i].source_size ||
+         (Uint32)info.st_mtime != _entries[i].source_time)) {
+      printf("archive: '%s' changed since it was packed\n", name);
+      return NULL;
+    }
+
+    return &_entries[i];
+  }
+
+  return NULL;
+}
+
+const Uint8* Archive::data(const ArchiveEntry* entry) {
+  return _base + entry->offset;
+}
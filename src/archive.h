@@ -0,0 +1,94 @@
+#ifndef ARCHIVE_INCLUDED
+#define ARCHIVE_INCLUDED
+
+#include "main.h"
+
+#define ARCHIVE_MAGIC   "OMGPAK01"
+#define ARCHIVE_VERSION 4
+
+// Blobs start on this boundary, so they can be used where they lie
+#define ARCHIVE_ALIGN 16
+
+#define ARCHIVE_NAME_LENGTH 64
+
+/*
+ * The file starts with a header, then the index, then the blobs. Numbers
+ * are native endian: the packer runs on the machine that plays.
+ */
+struct ArchiveHeader {
+  char   magic[8];
+  Uint32 version;
+  Uint32 count;          // entries in the index that follows
+};
+
+struct ArchiveEntry {
+  char   name[ARCHIVE_NAME_LENGTH];  // the path the game asks for
+  Uint32 type;                       // ASSET_*
+  Uint32 offset;                     // from the start of the file
+  Uint32 size;
+
+  // the file it was packed from, as it was then
+  Uint32 source_size;
+  Uint32 source_time;
+
+  // ASSET_IMAGE: a KTX file with the full mip chain (see texture.h)
+  Uint32 width;
+  Uint32 height;
+
+  // ASSET_SOUND: samples as the mixer wants them
+  Uint32 rate;
+  Uint32 channels;
+  Uint32 format;                     // also the GL format of an image
+
+  // ASSET_MESH: interleaved floats, then (aligned) 32 bit elements
+  Uint32 floats;
+  Uint32 elements;
+  Uint32 elements_offset;            // from the start of the blob
+};
+
+/*
+ * Reads the archive written by the packer (see packer.cpp).
+ *
+ * The file is mapped, not read: blobs are already in the form GL and the
+ * mixer take, so pointers into the mapping go straight to glTexImage2D
+ * (or glCompressedTexImage2D), glBufferData and Mix_QuickLoad_RAW. Where
+ * there is no mmap (Windows, emscripten) the file is read into memory
+ * once instead.
+ */
+class Archive {
+public:
+  Archive();
+  ~Archive();
+
+  /*
+   * Maps the archive. False (and the game loads files) if it is missing
+   * or does not look like one of ours.
+   */
+  bool open(const char* path);
+
+  void close();
+
+  bool opened();
+
+  /*
+   * The entry packed from the given path, or NULL. Also NULL when the
+   * file there has changed size or time since it was packed, so the
+   * game loads the file rather than what is stale in the archive.
+   */
+  const ArchiveEntry* find(const char* name);
+
+  /*
+   * The bytes of an entry.
+   */
+  const Uint8* data(const ArchiveEntry* entry);
+
+private:
+  const Uint8*        _base;
+  size_t              _length;
+  bool                _mapped;
+
+  const ArchiveEntry* _entries;
+  Uint32              _count;
+};
+
+#endif
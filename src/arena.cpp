@@ -0,0 +1,96 @@
+#include "arena.h"
+
+#include "profiler.h"
+
+// Rounds up to a multiple of ARENA_ALIGN
+static size_t arena_align(size_t bytes) {
+  return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+FrameArena::FrameArena() {
+  for (int i = 0; i < 2; i++) {
+    _halves[i].base       = new char[ARENA_CAPACITY];
+    _halves[i].capacity   = ARENA_CAPACITY;
+    _halves[i].used       = 0;
+    _halves[i].overflowed = 0;
+    _halves[i].overflow   = NULL;
+  }
+
+  _current    = 0;
+  _high_water = 0;
+}
+
+FrameArena::~FrameArena() {
+  for (int i = 0; i < 2; i++) {
+    _clear(_halves[i]);
+    delete [] _halves[i].base;
+  }
+}
+
+void* FrameArena::allocate(size_t bytes) {
+  Half& half = _halves[_current];
+
+  bytes = arena_align(bytes);
+
+  if (half.used + bytes <= half.capacity) {
+    void* block = half.base + half.used;
+    half.used += bytes;
+    return block;
+  }
+
+  // out of room: from the heap, given back when this half is reset
+  char* block = new char[arena_align(sizeof(Overflow)) + bytes];
+
+  Overflow* overflow = (Overflow*)block;
+  overflow->next = half.overflow;
+  half.overflow  = overflow;
+
+  half.overflowed += bytes;
+  return block + arena_align(sizeof(Overflow));
+}
+
+void FrameArena::reset() {
+  Half& half = _halves[_current];
+
+  size_t total = half.used + half.overflowed;
+  if (total > _high_water) {
+    _high_water = total;
+  }
+  Profiler::count(PROFILE_ARENA, (int)total);
+
+  // the next frame gets the other half, as this one may still be read
+  _current = 1 - _current;
+  _clear(_halves[_current]);
+
+  // grow both halves to what the busiest frame needed
+  Half& next = _halves[_current];
+  if (next.capacity < _high_water) {
+    delete [] next.base;
+
+    next.capacity = arena_align(_high_water + _high_water / 2);
+    next.base     = new char[next.capacity];
+  }
+}
+
+size_t FrameArena::used() {
+  return _halves[_current].used + _halves[_current].overflowed;
+}
+
+size_t FrameArena::highWater() {
+  return _high_water;
+}
+
+size_t FrameArena::capacity() {
+  return _halves[_current].capacity;
+}
+
+void FrameArena::_clear(Half& half) {
+  while (half.overflow) {
+    Overflow* next = half.overflow->next;
+    delete [] (char*)half.overflow;
+    half.overflow = next;
+  }
+
+  half.used       = 0;
+  half.overflowed = 0;
+}
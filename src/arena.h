@@ -0,0 +1,132 @@
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+#include "main.h"
+
+// Bytes each half of the frame arena starts with
+#define ARENA_CAPACITY (256 * 1024)
+
+// Every allocation starts on a multiple of this
+#define ARENA_ALIGN 16
+
+/*
+ * A run of items in the frame arena: room for a fixed number, of which
+ * the first size() are in use. Copies refer to the same items.
+ */
+template <typename T>
+class FrameSpan {
+public:
+  FrameSpan() : _data(NULL), _size(0), _capacity(0) {
+  }
+
+  FrameSpan(T* data, size_t capacity) : _data(data), _size(0), _capacity(capacity) {
+  }
+
+  /*
+   * Adds an item at the end; returns false if it is full.
+   */
+  bool push(const T& item) {
+    if (_size == _capacity) {
+      return false;
+    }
+    _data[_size++] = item;
+    return true;
+  }
+
+  T& operator[](size_t index) {
+    return _data[index];
+  }
+
+  T*     begin()    { return _data; }
+  T*     end()      { return _data + _size; }
+  size_t size()     { return _size; }
+  size_t capacity() { return _capacity; }
+  bool   empty()    { return _size == 0; }
+
+private:
+  T*     _data;
+  size_t _size;
+  size_t _capacity;
+};
+
+/*
+ * Scratch memory for what is drawn in a frame: draw lists, matrices,
+ * quads.
+ *
+ * Allocating moves a pointer along; nothing is freed by itself. reset()
+ * ends the frame and switches to the other half, so what a frame
+ * allocated stays good through the next one as well (for whoever draws
+ * it later) and is written over in the one after that.
+ *
+ * Should a frame ask for more than there is, the rest comes from the
+ * heap and that half grows to fit the next time it is reset. Only items
+ * that need no destructor belong here: none are run.
+ */
+class FrameArena {
+public:
+  FrameArena();
+  ~FrameArena();
+
+  /*
+   * Returns room for the given number of bytes.
+   */
+  void* allocate(size_t bytes);
+
+  /*
+   * Returns room for the given number of items, not constructed.
+   */
+  template <typename T>
+  T* allocate(size_t count) {
+    return (T*)allocate(sizeof(T) * count);
+  }
+
+  /*
+   * Returns an empty span with room for the given number of items.
+   */
+  template <typename T>
+  FrameSpan<T> span(size_t capacity) {
+    return FrameSpan<T>(allocate<T>(capacity), capacity);
+  }
+
+  /*
+   * Ends the frame; the one before it is forgotten.
+   */
+  void reset();
+
+  /*
+   * Bytes allocated so far this frame.
+   */
+  size_t used();
+
+  /*
+   * The most bytes any frame has allocated.
+   */
+  size_t highWater();
+
+  /*
+   * Bytes a frame can allocate without going to the heap.
+   */
+  size_t capacity();
+
+private:
+  struct Overflow {
+    Overflow* next;
+  };
+
+  struct Half {
+    char*     base;
+    size_t    capacity;
+    size_t    used;
+    size_t    overflowed;   // bytes that went to the heap
+    Overflow* overflow;
+  };
+
+  void _clear(Half& half);
+
+  Half   _halves[2];
+  int    _current;
+
+  size_t _high_water;
+};
+
+#endif
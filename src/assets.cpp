@@ -0,0 +1,279 @@
+#include "assets.h"
+#include "trace.h"
+
+AssetLoader::AssetLoader()
+  : _count(0),
+    _done(0),
+    _archive(NULL),
+    _finish(NULL),
+    _finish_data(NULL),
+    _jobs(NULL),
+    _background(false),
+    _pending(0),
+    _lock(NULL),
+    _decoded(NULL) {
+}
+
+AssetLoader::~AssetLoader() {
+  stop();
+}
+
+void AssetLoader::start(AssetFinish finish, void* data, JobSystem* jobs) {
+  _finish      = finish;
+  _finish_data = data;
+
+  _jobs       = jobs;
+  _background = jobs && jobs->workers() > 0;
+
+  _lock    = SDL_CreateMutex();
+  _decoded = SDL_CreateCond();
+}
+
+void AssetLoader::stop() {
+  if (!_lock) {
+    return;
+  }
+
+  // they hold this loader
+  SDL_LockMutex(_lock);
+  while (_pending > 0) {
+    SDL_CondWait(_decoded, _lock);
+  }
+  SDL_UnlockMutex(_lock);
+
+  SDL_DestroyCond(_decoded);
+  SDL_DestroyMutex(_lock);
+  _lock = NULL;
+}
+
+void AssetLoader::useArchive(Archive* archive) {
+  _archive = archive;
+}
+
+int AssetLoader::request(int type, const char* path, int slot, bool packed) {
+  if (_count == ASSETS_MAX) {
+    printf("assets: too many assets, not loading '%s'\n", path);
+    return -1;
+  }
+
+  SDL_LockMutex(_lock);
+
+  int handle = _count;
+  Asset& asset = _assets[handle];
+
+  asset.type  = type;
+  asset.slot  = slot;
+  strncpy(asset.path, path, sizeof(asset.path) - 1);
+  asset.path[sizeof(asset.path) - 1] = '\0';
+  asset.state = ASSET_QUEUED;
+
+  asset.packed = NULL;
+  asset.bytes  = NULL;
+
+  // already in the form it is used in: nothing to decode
+  if (packed && _archive) {
+    const ArchiveEntry* entry = _archive->find(path);
+    if (entry && (int)entry->type == type) {
+      asset.packed = entry;
+      asset.bytes  = _archive->data(entry);
+      asset.state  = ASSET_DECODED;
+    }
+  }
+
+  asset.surface = NULL;
+  asset.chunk   = NULL;
+  asset.mesh    = NULL;
+
+  _count++;
+
+  bool decode = _background && asset.state == ASSET_QUEUED;
+  if (decode) {
+    _pending++;
+  }
+  SDL_UnlockMutex(_lock);
+
+  if (decode) {
+    _jobs->run(_jobs->create(_decodeJob, this));
+  }
+
+  return handle;
+}
+
+void AssetLoader::_decodeJob(void* data) {
+  ((AssetLoader*)data)->_decodeNext();
+}
+
+int AssetLoader::_take() {
+  // oldest first: the order of the requests is the order of need
+  for (int i = 0; i < _count; i++) {
+    if (_assets[i].state == ASSET_QUEUED) {
+      _assets[i].state = ASSET_DECODING;
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+void AssetLoader::_decodeNext() {
+  SDL_LockMutex(_lock);
+  // require() may have got to it first, leaving this job another
+  int handle = _take();
+  SDL_UnlockMutex(_lock);
+
+  if (handle >= 0) {
+    TRACE_BEGIN("decode");
+    _decode(_assets[handle]);
+    TRACE_END("decode");
+  }
+
+  SDL_LockMutex(_lock);
+  _pending--;
+  SDL_CondBroadcast(_decoded);
+  SDL_UnlockMutex(_lock);
+}
+
+void AssetLoader::_decode(Asset& asset) {
+  bool ok = false;
+
+  switch (asset.type) {
+    case ASSET_IMAGE:
+      asset.surface = IMG_Load(asset.path);
+      if (!asset.surface) {
+        printf("SDL could not load texture: %s\n", IMG_GetError());
+      }
+      ok = asset.surface != NULL;
+      break;
+
+    case ASSET_SOUND:
+      // converted to the device format here, so the mixer only adds
+      asset.chunk = Mix_LoadWAV(asset.path);
+      if (!asset.chunk) {
+        printf("Cannot load sound '%s': %s\n", asset.path, Mix_GetError());
+      }
+      ok = asset.chunk != NULL;
+      break;
+
+    case ASSET_MESH:
+      asset.mesh = new MeshData();
+      ok = Mesh::load(asset.path, *asset.mesh);
+      if (!ok) {
+        delete asset.mesh;
+        asset.mesh = NULL;
+      }
+      break;
+  }
+
+  SDL_LockMutex(_lock);
+  asset.state = ok ? ASSET_DECODED : ASSET_FAILED;
+  if (!ok) {
+    _done++;
+  }
+  SDL_UnlockMutex(_lock);
+}
+
+void AssetLoader::_finishAsset(Asset& asset) {
+  _finish(asset, _finish_data);
+
+  SDL_LockMutex(_lock);
+  asset.state = ASSET_READY;
+  _done++;
+  SDL_UnlockMutex(_lock);
+}
+
+int AssetLoader::pump(int budget) {
+  int finished = 0;
+
+  while (finished < budget) {
+    SDL_LockMutex(_lock);
+
+    int handle = -1;
+    for (int i = 0; i < _count; i++) {
+      if (_assets[i].state == ASSET_DECODED) {
+        handle = i;
+        break;
+      }
+    }
+
+    // without workers, decoding is our job too
+    if (handle < 0 && !_background) {
+      int queued = _take();
+      if (queued >= 0) {
+        SDL_UnlockMutex(_lock);
+        _decode(_assets[queued]);
+        continue;
+      }
+    }
+
+    SDL_UnlockMutex(_lock);
+
+    if (handle < 0) {
+      break;
+    }
+
+    _finishAsset(_assets[handle]);
+    finished++;
+  }
+
+  return finished;
+}
+
+bool AssetLoader::require(int handle) {
+  if (handle < 0 || handle >= _count) {
+    return false;
+  }
+
+  Asset& asset = _assets[handle];
+
+  SDL_LockMutex(_lock);
+
+  // nobody has started on it: quicker to decode it than to wait
+  if (asset.state == ASSET_QUEUED) {
+    asset.state = ASSET_DECODING;
+    SDL_UnlockMutex(_lock);
+    _decode(asset);
+    SDL_LockMutex(_lock);
+  }
+
+  while (asset.state == ASSET_DECODING) {
+    SDL_CondWait(_decoded, _lock);
+  }
+
+  int state = asset.state;
+  SDL_UnlockMutex(_lock);
+
+  if (state == ASSET_DECODED) {
+    _finishAsset(asset);
+    state = ASSET_READY;
+  }
+
+  return state == ASSET_READY;
+}
+
+int AssetLoader::state(int handle) {
+  if (handle < 0 || handle >= _count) {
+    return ASSET_FAILED;
+  }
+
+  SDL_LockMutex(_lock);
+  int state = _assets[handle].state;
+  SDL_UnlockMutex(_lock);
+
+  return state;
+}
+
+bool AssetLoader::loading() {
+  return done() < total();
+}
+
+int AssetLoader::total() {
+  return _count;
+}
+
+int AssetLoader::done() {
+  SDL_LockMutex(_lock);
+  int done = _done;
+  SDL_UnlockMutex(_lock);
+
+  return done;
+}
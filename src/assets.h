@@ -0,0 +1,129 @@
+#ifndef ASSETS_INCLUDED
+#define ASSETS_INCLUDED
+
+#include "main.h"
+#include "mesh.h"
+#include "archive.h"
+#include "jobs.h"
+
+// Asset types
+#define ASSET_IMAGE 0
+#define ASSET_SOUND 1
+#define ASSET_MESH  2
+
+// Asset states
+#define ASSET_QUEUED   0    // waiting for a decode job
+#define ASSET_DECODING 1
+#define ASSET_DECODED  2    // waiting for the GL thread
+#define ASSET_READY    3
+#define ASSET_FAILED   4
+
+#define ASSETS_MAX 64
+
+struct Asset {
+  int    type;
+  int    slot;          // where the result goes: texture, sound or mesh index
+  char   path[256];
+  int    state;
+
+  // ready to use where it lies in the archive, if it was packed
+  const ArchiveEntry* packed;
+  const Uint8*        bytes;
+
+  // decoded, until the GL thread takes it
+  SDL_Surface* surface;
+  Mix_Chunk*   chunk;
+  MeshData*    mesh;
+};
+
+// Hands a decoded asset over on the GL thread; takes ownership of its data
+typedef void (*AssetFinish)(Asset& asset, void* data);
+
+/*
+ * Loads images, sounds and meshes in parallel.
+ *
+ * Each request queues a job that decodes the oldest request not yet
+ * taken (IMG_Load, Mix_LoadWAV, OBJ parsing), so they are decoded in
+ * order, as many at once as there are job workers. Anything needing the
+ * GL context is left for pump(), which
+ * the main thread calls each frame and which hands each decoded asset to
+ * the finish function. A request returns a handle at once; require() is
+ * for code that cannot go on without the asset, and decodes it right
+ * there if no worker has got to it yet.
+ *
+ * Given an archive, requests for packed files skip decoding altogether:
+ * the asset is handed to the finish function pointing into the archive.
+ */
+class AssetLoader {
+public:
+  AssetLoader();
+  ~AssetLoader();
+
+  /*
+   * Decodes on the given job system from now on; without workers there,
+   * pump() decodes. Everything the decoders need (the audio device,
+   * SDL_image) must be set up first.
+   */
+  void start(AssetFinish finish, void* data, JobSystem* jobs);
+
+  /*
+   * Waits for the decode jobs still running.
+   */
+  void stop();
+
+  /*
+   * Takes packed files from this archive from now on.
+   */
+  void useArchive(Archive* archive);
+
+  /*
+   * Queues a file; returns its handle, or -1. If packed, the archive's
+   * copy is used when it has one.
+   */
+  int request(int type, const char* path, int slot, bool packed);
+
+  /*
+   * Finishes up to budget decoded assets on this (the GL) thread.
+   * Returns how many.
+   */
+  int pump(int budget);
+
+  /*
+   * Waits for the asset and finishes it here. False if it failed.
+   */
+  bool require(int handle);
+
+  int state(int handle);
+
+  // any asset not yet ready (or failed)
+  bool loading();
+
+  // assets requested, and how many of those are done
+  int total();
+  int done();
+
+private:
+  static void _decodeJob(void* data);
+  void _decodeNext();
+  int  _take();
+  void _decode(Asset& asset);
+  void _finishAsset(Asset& asset);
+
+  Asset         _assets[ASSETS_MAX];
+  int           _count;
+  int           _done;
+
+  Archive*      _archive;
+
+  AssetFinish   _finish;
+  void*         _finish_data;
+
+  JobSystem*    _jobs;
+  bool          _background;  // decode jobs have workers to run on
+  int           _pending;     // decode jobs not yet done
+
+  SDL_mutex*    _lock;
+  SDL_cond*     _decoded;     // signalled as each decode job ends
+};
+
+#endif
@@ -2,26 +2,72 @@
 #include "audio.h"
 #include "components.h"
 
+// Orders the queue slot against the index that publishes it
+#define AUDIO_BARRIER() __sync_synchronize()
+
 Audio::Audio() {
   music = NULL;
+  _buffer_frames = AUDIO_BUFFER_FRAMES;
+  _frequency = 44100;
+
+  _underruns_reported = 0;
+  _since_report = 0.0f;
 }
 
 Audio::~Audio() {
-  if (!music) {
+  if (music) {
     Mix_FreeMusic(music);
   }
 }
 
+void Audio::setBufferFrames(int frames) {
+  // SDL wants a power of two
+  int buffer = 64;
+  while (buffer < frames && buffer < 8192) {
+    buffer <<= 1;
+  }
+
+  _buffer_frames = buffer;
+}
+
 void Audio::init() {
-  int audio_rate = 44100;
-  Uint16 audio_format = AUDIO_S16SYS; /* 16-bit stereo */
-  int audio_channels = 2;
-  int audio_buffers = 2048;
+  int audio_rate = AUDIO_RATE;
+  Uint16 audio_format = AUDIO_FORMAT; /* 16-bit stereo */
+  int audio_channels = AUDIO_CHANNELS;
+  int audio_buffers = _buffer_frames;
+
+  if (Mix_OpenAudio(audio_rate, audio_format, audio_channels, audio_buffers) == -1) {
+    printf("Mix_OpenAudio: %s\n", Mix_GetError());
+    return;
+  }
+
+  for (int i = 0; i < AUDIO_VOICES; i++) {
+    _voices[i].sound = -1;
+  }
 
-  Mix_OpenAudio(audio_rate, audio_format, audio_channels, audio_buffers);
+#ifndef EMSCRIPTEN
+  int channels;
+  Uint16 format;
+  Mix_QuerySpec(&_frequency, &format, &channels);
+
+  if (format == AUDIO_S16SYS && channels == 2) {
+    _mixing = true;
+    Mix_SetPostMix(_postMix, NULL);
+  }
+  else {
+    printf("audio: device format %x, mixing with SDL_mixer\n", format);
+  }
+#endif
 }
 
 void Audio::loadMusic(const char* fname) {
+  if (_mixing) {
+    // returns at once; the worker opens the file
+    _stream.open(fname, _frequency);
+    _stream.volume(100);
+    return;
+  }
+
   music=Mix_LoadMUS(fname);
   if(!music) {
     printf("Mix_LoadMUS(\"%s\"): %s\n", fname, Mix_GetError());
@@ -34,27 +80,162 @@ void Audio::loadMusic(const char* fname) {
 void Audio::playMusic() {
   // play music forever
 
+  if (_mixing) {
+    Mix_HookMusic(MusicStream::mix, &_stream);
+    return;
+  }
+
   if(Mix_PlayMusic(music, -1)==-1) {
     printf("Mix_PlayMusic: %s\n", Mix_GetError());
     // well, there's no music, but most games don't break without music...
   }
 }
 
+void Audio::update(float deltatime) {
+  _since_report += deltatime;
+  if (_since_report < 1.0f) {
+    return;
+  }
+  _since_report = 0.0f;
+
+  int underruns = _stream.underruns();
+  if (underruns != _underruns_reported) {
+    printf("audio: music underran %d times (%d total), %d of %d samples buffered\n",
+           underruns - _underruns_reported, underruns,
+           _stream.buffered(), _stream.capacity());
+    _underruns_reported = underruns;
+  }
+}
+
+int Audio::musicBuffered() {
+  return _stream.buffered();
+}
+
+int Audio::musicCapacity() {
+  return _stream.capacity();
+}
+
+int Audio::musicUnderruns() {
+  return _stream.underruns();
+}
+
 void Audio::playSound(int soundIndex) {
-  if (soundIndex >= soundcount) {
+  if (soundIndex >= soundcount || !sounds[soundIndex]) {
+    return;
+  }
+
+  if (!_mixing) {
+    Mix_PlayChannel(-1, sounds[soundIndex], 0);
+    return;
+  }
+
+  Uint32 tail = _trigger_tail;
+  if (tail - _trigger_head == AUDIO_TRIGGERS) {
+    // the mixer is not running; nobody would hear it anyway
     return;
   }
 
-  Mix_PlayChannel(1, sounds[soundIndex], 0);
+  _triggers[tail & (AUDIO_TRIGGERS - 1)] = soundIndex;
+  AUDIO_BARRIER();
+  _trigger_tail = tail + 1;
 }
 
+void Audio::_startVoice(int sound) {
+  int priority = priorities[sound];
+  int chosen   = -1;
+
+  Uint32 chosen_left = 0;
+
+  for (int i = 0; i < AUDIO_VOICES; i++) {
+    Voice& voice = _voices[i];
+
+    if (voice.sound < 0) {
+      chosen = i;
+      break;
+    }
+
+    // steal the least important, and of those the nearest its end
+    if (voice.priority > priority) {
+      continue;
+    }
+
+    Uint32 left = sounds[voice.sound]->alen / sizeof(Sint16) - voice.position;
+
+    if (chosen < 0 ||
+        voice.priority < _voices[chosen].priority ||
+        (voice.priority == _voices[chosen].priority && left < chosen_left)) {
+      chosen      = i;
+      chosen_left = left;
+    }
+  }
+
+  if (chosen < 0) {
+    return;
+  }
+
+  _voices[chosen].sound    = sound;
+  _voices[chosen].priority = priority;
+  _voices[chosen].position = 0;
+}
+
+void Audio::_postMix(void* udata, Uint8* stream, int len) {
+  // new sounds start at the top of this buffer
+  Uint32 head = _trigger_head;
+  while (head != _trigger_tail) {
+    AUDIO_BARRIER();
+    _startVoice(_triggers[head & (AUDIO_TRIGGERS - 1)]);
+    head++;
+  }
+  AUDIO_BARRIER();
+  _trigger_head = head;
+
+  Sint16* out   = (Sint16*)stream;
+  Uint32 count  = (Uint32)len / sizeof(Sint16);
+
+  for (int i = 0; i < AUDIO_VOICES; i++) {
+    Voice& voice = _voices[i];
+    if (voice.sound < 0) {
+      continue;
+    }
+
+    Mix_Chunk* chunk = sounds[voice.sound];
+    const Sint16* in = (const Sint16*)chunk->abuf;
+    Uint32 length    = chunk->alen / sizeof(Sint16);
+
+    Uint32 todo = length - voice.position;
+    if (todo > count) {
+      todo = count;
+    }
+
+    in += voice.position;
+    for (Uint32 s = 0; s < todo; s++) {
+      int sample = (int)out[s] + (int)in[s];
+
+      if (sample > 32767)       { sample = 32767; }
+      else if (sample < -32768) { sample = -32768; }
+
+      out[s] = (Sint16)sample;
+    }
+
+    voice.position += todo;
+    if (voice.position >= length) {
+      voice.sound = -1;
+    }
+  }
+}
 
 int Audio::loadSound(const char *file) {
+  return loadSound(file, AUDIO_PRIORITY_NORMAL);
+}
+
+int Audio::loadSound(const char *file, int priority) {
   if (soundcount == NUM_SOUNDS) {
     return -1;
   }
 
+  // converted to the device format here, so the mixer only adds
   sounds[soundcount] = Mix_LoadWAV(file);
+  priorities[soundcount] = priority;
 
   if (!sounds[soundcount]) {
     printf("Cannot load sound '%s': %s\n", file, Mix_GetError());
@@ -65,5 +246,42 @@ int Audio::loadSound(const char *file) {
   return 0;
 }
 
+int Audio::reserveSound(int priority) {
+  if (soundcount == NUM_SOUNDS) {
+    return -1;
+  }
+
+  sounds[soundcount] = NULL;
+  priorities[soundcount] = priority;
+
+  return soundcount++;
+}
+
+void Audio::setSound(int soundIndex, Mix_Chunk* chunk) {
+  // the mixer only looks at sounds it was told to play, and this one
+  // could not be played before now
+  sounds[soundIndex] = chunk;
+}
+
+bool Audio::accepts(int rate, int channels, int format) {
+  int frequency, device_channels;
+  Uint16 device_format;
+
+  if (!Mix_QuerySpec(&frequency, &device_format, &device_channels)) {
+    return false;
+  }
+
+  return rate == frequency && channels == device_channels && format == device_format;
+}
+
 Mix_Chunk* Audio::sounds[NUM_SOUNDS] = {0};
+int Audio::priorities[NUM_SOUNDS] = {0};
 int Audio::soundcount = 0;
+
+bool Audio::_mixing = false;
+
+Audio::Voice Audio::_voices[AUDIO_VOICES];
+
+int             Audio::_triggers[AUDIO_TRIGGERS];
+volatile Uint32 Audio::_trigger_head = 0;
+volatile Uint32 Audio::_trigger_tail = 0;
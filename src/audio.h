@@ -1,8 +1,46 @@
 #ifndef AUDIO_INCLUDED
 #define AUDIO_INCLUDED
 
+#include "musicstream.h"
+
 #define NUM_SOUNDS 10
 
+// The device format we ask for
+#define AUDIO_RATE     44100
+#define AUDIO_FORMAT   AUDIO_S16SYS
+#define AUDIO_CHANNELS 2
+
+// Device buffer in sample frames: 256 is 5.8ms at 44.1kHz
+#define AUDIO_BUFFER_FRAMES 256
+
+// Sounds that may play at once
+#define AUDIO_VOICES 16
+
+// Triggers that may wait for the mixer (a power of two)
+#define AUDIO_TRIGGERS 64
+
+// Sound priorities; a sound only steals a voice of equal or lower priority
+#define AUDIO_PRIORITY_LOW    0
+#define AUDIO_PRIORITY_NORMAL 1
+#define AUDIO_PRIORITY_HIGH   2
+
+/*
+ * Sound effects are mixed by us, in SDL_mixer's post-mix hook, over the
+ * music SDL_mixer plays. Mix_LoadWAV already converts every sample to the
+ * device format when it is loaded, so mixing is adding 16-bit samples.
+ *
+ * playSound only posts a trigger to a single producer, single consumer
+ * queue; the mixer takes it at the start of its next buffer and gives it
+ * a voice, stealing the lowest priority voice (the one furthest along)
+ * when all are busy. Nothing is locked, so a small buffer does not
+ * underrun waiting on the game thread.
+ *
+ * Music streams from a worker thread (see MusicStream) into SDL_mixer's
+ * music hook, so decoding never happens in the audio callback.
+ *
+ * Where the device is not 16-bit (or under emscripten) sounds go to
+ * SDL_mixer's own channels and music to Mix_PlayMusic instead.
+ */
 class Audio {
 public:
   Audio();
@@ -11,17 +49,74 @@ public:
   void loadMusic(const char* fname);
   void playMusic();
 
+  /*
+   * Sets the device buffer (in sample frames) for init to ask for.
+   */
+  void setBufferFrames(int frames);
+
   void init();
 
+  /*
+   * Reports music underruns, at most once a second. Call once a frame.
+   */
+  void update(float deltatime);
+
+  // music samples decoded ahead, of how many may be
+  int musicBuffered();
+  int musicCapacity();
+
+  // audio buffers the music could not fill in time
+  int musicUnderruns();
+
   void playSound(int soundIndex);
 
   int loadSound(const char *file);
+  int loadSound(const char *file, int priority);
+
+  /*
+   * Sets aside a sound index for a sample decoded elsewhere; playing it
+   * does nothing until setSound hands the sample over.
+   */
+  int reserveSound(int priority);
+  void setSound(int soundIndex, Mix_Chunk* chunk);
+
+  /*
+   * Whether samples in this format can be played as they are.
+   */
+  bool accepts(int rate, int channels, int format);
 
   // sounds
   static Mix_Chunk* sounds[NUM_SOUNDS];
+  static int priorities[NUM_SOUNDS];
   static int soundcount;
 
   // music file
   Mix_Music *music;
+
+private:
+  struct Voice {
+    int    sound;      // -1 when free
+    int    priority;
+    Uint32 position;   // in samples
+  };
+
+  static void _postMix(void* udata, Uint8* stream, int len);
+  static void _startVoice(int sound);
+
+  int _buffer_frames;
+  int _frequency;
+
+  MusicStream _stream;
+  int         _underruns_reported;
+  float       _since_report;
+
+  static bool   _mixing;
+
+  static Voice  _voices[AUDIO_VOICES];
+
+  // written by the game thread at the tail, read by the mixer at the head
+  static int             _triggers[AUDIO_TRIGGERS];
+  static volatile Uint32 _trigger_head;
+  static volatile Uint32 _trigger_tail;
 };
 #endif //#ifndef AUDIO_INCLUDED
@@ -0,0 +1,999 @@
+/*
+ * Times the simulation and loading code on fixed inputs, without a
+ * window or GL context.
+ *
+ * Only code that stands on its own is linked in: the Tetris and BreakOut
+ * rules, flame updates, the board hashes and wire encoding, the motion
+ * buffer, the frame arena, the job system, the matrix kernels, model and
+ * image loading, and tracing. Nothing here needs the engine; what the
+ * rules report (see rules.h) goes nowhere, and of SDL only threads and
+ * SDL_image are used. Drawing is timed by the game's --benchmark.
+ *
+ * Each benchmark is run in samples of enough operations to take about
+ * BENCH_SAMPLE_NS, and is reported as the mean ns per operation with its
+ * standard deviation across samples. Those that change a board put a
+ * copy of it back every operation, which is counted in.
+ *
+ * Usage: omgwtfadd-bench [--json out.json] [--baseline old.json]
+ *                        [--threshold percent] [--samples n] [filter]
+ *
+ * With --baseline, any benchmark whose mean is more than threshold
+ * percent (default 10) over the baseline's is marked, and the exit
+ * status is 1. Run it from where the game runs, for the images and
+ * models.
+ *
+ * Before timing anything it checks that Affine builds the flame and
+ * board matrices as the glm chains did, to within BENCH_TOLERANCE, at
+ * awkward angles; if not, it says which and the exit status is 1.
+ *
+ * The jobs.transforms benchmarks run the same work on 1, 2, 4 ... cores,
+ * up to all of them, and print how much faster each is than one core.
+ *
+ * Built with -DENABLE_TRACE (make bench CFLAGS=-DENABLE_TRACE), it also
+ * times trace.event, one event recorded.
+ */
+
+#include "main.h"
+#include "tetris.h"
+#include "breakout.h"
+#include "flame.h"
+#include "rules.h"
+#include "zobrist.h"
+#include "boardsync.h"
+#include "jitter.h"
+#include "arena.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "jobs.h"
+#include "affine.h"
+#include "trace.h"
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#define BENCH_MAX         48
+#define BENCH_SAMPLES     25
+#define BENCH_SAMPLE_NS   2000000ULL
+
+// Fixed inputs, made the same way every run
+#define BENCH_BOARDS      8
+
+// Board updates sent, one after another, for boardsync.decode
+#define BENCH_SYNCS       64
+
+// Jobs run at once, and the flame matrices each places, for the scaling runs
+#define BENCH_JOBS        16
+#define BENCH_JOB_MATRICES 1024
+
+// Flame blocks and board cells placed per operation in transform.*
+#define BENCH_TRANSFORMS  256
+
+// Furthest any Affine matrix may be from glm's before the bench fails
+#define BENCH_TOLERANCE   6e-6
+
+typedef void (*BenchFunction)(int ops);
+
+struct BenchResult {
+  const char* name;
+  double      mean;      // ns per operation
+  double      stddev;
+  double      min;
+  int         samples;
+  int         ops;       // per sample
+};
+
+static BenchResult results[BENCH_MAX];
+static int         result_count = 0;
+
+static int         samples = BENCH_SAMPLES;
+static const char* filter  = NULL;
+
+// keeps results alive, so the work is not optimised away
+static volatile int sink;
+
+/*
+ * A small generator of our own, so the boards do not depend on rand().
+ */
+static Uint32 bench_seed = 1;
+
+static Uint32 bench_random() {
+  bench_seed = bench_seed * 1664525u + 1013904223u;
+  return bench_seed >> 8;
+}
+
+/*
+ * Fills rows top..23 (the bottom of the well), each cell with the given
+ * chance in 100, leaving any row listed in full.
+ */
+static void fillBoard(game_info& gi, int top, int chance, int full) {
+  memset(&gi, 0, sizeof(gi));
+  memset(gi.board, -1, sizeof(gi.board));
+
+  for (int j = top; j < 24; j++) {
+    for (int i = 0; i < 10; i++) {
+      if (j >= 24 - full || (int)(bench_random() % 100) < chance) {
+        gi.board[i][j] = (char)(bench_random() % 7);
+      }
+    }
+  }
+
+  gi.pos      = 5;
+  gi.fine     = 1.0f;
+  gi.curpiece = 0;
+  gi.curdir   = 1;
+
+  Zobrist::rebuild(&gi);
+}
+
+static game_info boards[BENCH_BOARDS];     // empty to nearly full
+static game_info lines[BENCH_BOARDS];      // 0 to 4 complete lines
+static game_info breakout_board;           // a wall of blocks, fast ball
+
+struct CollisionCase {
+  int   board;
+  int   piece;
+  int   dir;
+  float x;
+  float y;
+};
+
+static std::vector<CollisionCase> collisions;
+static std::vector<CollisionCase> drops;
+
+/*
+ * A piece landing: four cells of a colour, somewhere on the stack.
+ */
+static void landPiece(game_info& gi, int n) {
+  int i = n % 7;
+  int j = 23 - n % 6;
+  char type = (char)(n % 7);
+
+  Zobrist::set(&gi, i,     j,     type);
+  Zobrist::set(&gi, i + 1, j,     type);
+  Zobrist::set(&gi, i + 2, j,     type);
+  Zobrist::set(&gi, i + 1, j - 1, type);
+}
+
+static void makeCorpus() {
+  bench_seed = 1;
+
+  for (int k = 0; k < BENCH_BOARDS; k++) {
+    fillBoard(boards[k], 24 - k * 3, 80, 0);
+    fillBoard(lines[k], 14, 70, k % 5);
+  }
+
+  for (int k = 0; k < BENCH_BOARDS; k++) {
+    for (int piece = 0; piece < 7; piece++) {
+      for (int dir = 0; dir < 4; dir++) {
+        for (int pos = 2; pos <= 7; pos++) {
+          CollisionCase drop = { k, piece, dir, 0.5f * pos, 1.0f };
+          drops.push_back(drop);
+
+          for (float y = 1.0f; y <= 10.0f; y += 0.5f) {
+            CollisionCase test = { k, piece, dir, 0.5f * pos, y };
+            collisions.push_back(test);
+          }
+        }
+      }
+    }
+  }
+
+  // the upper half of the well, seen from below in breakout
+  fillBoard(breakout_board, 12, 85, 0);
+  breakout_board.fine     = 2.5f;
+  breakout_board.curpiece = 3;
+  breakout_board.ball_x   = 2.25f;
+  breakout_board.ball_y   = 2.0f;
+  breakout_board.ball_dx  = BREAKOUT_BALL_SPEED_X * 4.0f;
+  breakout_board.ball_dy  = BREAKOUT_BALL_SPEED_Y * 4.0f;
+}
+
+// what the rules report, which the game would play and send
+
+void Rules::playSound(int) {
+}
+
+void Rules::appendScore(unsigned char, unsigned char) {
+}
+
+void Rules::sendAttack(int) {
+}
+
+void Rules::gameOver() {
+}
+
+static void benchTestCollision(int ops) {
+  size_t count = collisions.size();
+  size_t index = 0;
+
+  for (int n = 0; n < ops; n++) {
+    const CollisionCase& test = collisions[index];
+    game_info& gi = boards[test.board];
+    gi.curpiece = test.piece;
+    gi.curdir   = test.dir;
+
+    sink += Tetris::testCollision(&gi, test.x, test.y);
+
+    if (++index == count) { index = 0; }
+  }
+}
+
+static void benchDropPosition(int ops) {
+  size_t count = drops.size();
+  size_t index = 0;
+
+  for (int n = 0; n < ops; n++) {
+    const CollisionCase& drop = drops[index];
+    game_info& gi = boards[drop.board];
+    gi.curpiece = drop.piece;
+    gi.curdir   = drop.dir;
+    gi.pos      = (int)(drop.x * 2.0f);
+    gi.fine     = drop.y;
+
+    sink += (int)Tetris::determineDropPosition(&gi);
+
+    if (++index == count) { index = 0; }
+  }
+}
+
+static void benchClearLines(int ops) {
+  game_info gi;
+
+  for (int n = 0; n < ops; n++) {
+    gi = lines[n % BENCH_BOARDS];
+    sink += Tetris::clearLines(&gi);
+  }
+}
+
+static void benchAttack(int severity, int ops) {
+  game_info gi;
+  srand(1);
+
+  // only the boards low enough to take it without losing
+  for (int n = 0; n < ops; n++) {
+    gi = boards[n % (BENCH_BOARDS - 2)];
+    Tetris::receiveAttack(&gi, severity);
+    sink += gi.board[0][23];
+  }
+}
+
+static void benchAttackOne(int ops) {
+  benchAttack(1, ops);
+}
+
+static void benchAttackTwo(int ops) {
+  benchAttack(2, ops);
+}
+
+static void benchMoveBall(int ops) {
+  game_info gi;
+  srand(1);
+
+  // a quarter second at once, as after a hitch: many bounces
+  for (int n = 0; n < ops; n++) {
+    gi = breakout_board;
+    BreakOut::moveBall(&gi, 0.25f, 0);
+    sink += (int)gi.ball_x;
+  }
+}
+
+static Flame* flame = NULL;
+
+static void benchFlame(int ops) {
+  for (int n = 0; n < ops; n++) {
+    flame->update(1.0f / 60.0f);
+  }
+}
+
+static void benchFlameGame(int ops) {
+  static Flame game_flame(0.0f, 0.0f, 0.0f);
+  flame = &game_flame;
+  benchFlame(ops);
+}
+
+static void benchFlameMany(int ops) {
+  static Flame many_flame(0.0f, 0.0f, 0.0f);
+  static bool  warm = false;
+
+  // 4000 blocks once it has run long enough for the first to burn out
+  if (!warm) {
+    many_flame.setInterval(0.0005f);
+    for (int i = 0; i < 180; i++) {
+      many_flame.update(1.0f / 60.0f);
+    }
+    warm = true;
+  }
+
+  flame = &many_flame;
+  benchFlame(ops);
+}
+
+static void benchZobristSet(int ops) {
+  game_info gi;
+
+  for (int n = 0; n < ops; n++) {
+    gi = boards[n % BENCH_BOARDS];
+    landPiece(gi, n);
+    sink += (int)gi.board_hash;
+  }
+}
+
+static void benchZobristDropLine(int ops) {
+  game_info gi;
+
+  for (int n = 0; n < ops; n++) {
+    gi = boards[n % BENCH_BOARDS];
+    Zobrist::dropLine(&gi, 23);
+    sink += (int)gi.board_hash;
+  }
+}
+
+static void benchZobristCompute(int ops) {
+  for (int n = 0; n < ops; n++) {
+    sink += (int)Zobrist::compute(&boards[n % BENCH_BOARDS]);
+  }
+}
+
+/*
+ * Boards sent as the game sends them: each a piece on from the last,
+ * acknowledged at once, with a keyframe every BOARDSYNC_KEYFRAME_INTERVAL.
+ */
+static unsigned char sync_payloads[BENCH_SYNCS][MSG_PAYLOAD_MAX];
+static size_t        sync_lengths[BENCH_SYNCS];
+
+static void makeSyncs() {
+  BoardSync sender;
+  game_info gi = boards[BENCH_BOARDS / 2];
+
+  for (int n = 0; n < BENCH_SYNCS; n++) {
+    landPiece(gi, n);
+    sync_lengths[n] = sender.encode(&gi, 1.0f / 60.0f, sync_payloads[n], MSG_PAYLOAD_MAX);
+    sender.acknowledge(sender.sequence(), 0);
+  }
+}
+
+static void benchBoardSyncEncode(int ops) {
+  static BoardSync sender;
+  static game_info gi = boards[BENCH_BOARDS / 2];
+  unsigned char payload[MSG_PAYLOAD_MAX];
+
+  for (int n = 0; n < ops; n++) {
+    landPiece(gi, n);
+    sink += (int)sender.encode(&gi, 1.0f / 60.0f, payload, sizeof(payload));
+    sender.acknowledge(sender.sequence(), 0);
+  }
+}
+
+static void benchBoardSyncKeyframe(int ops) {
+  static BoardSync sender;
+  unsigned char payload[MSG_PAYLOAD_MAX];
+
+  for (int n = 0; n < ops; n++) {
+    sender.requestKeyframe();
+    sink += (int)sender.encode(&boards[n % BENCH_BOARDS], 1.0f / 60.0f,
+                               payload, sizeof(payload));
+  }
+}
+
+static void benchBoardSyncDecode(int ops) {
+  static BoardSync receiver;
+  game_info gi;
+  unsigned char seq;
+
+  // in order from the first, a keyframe, so every base is there
+  for (int n = 0; n < ops; n++) {
+    int index = n % BENCH_SYNCS;
+    sink += receiver.decode(&gi, sync_payloads[index], sync_lengths[index], &seq);
+  }
+}
+
+/*
+ * A remote player's motion at 60 frames a second, samples arriving
+ * every JITTER_SEND_INTERVAL. Operations are per frame.
+ */
+static void benchJitter(int ops) {
+  static JitterBuffer buffer;
+  static Uint32       frame = 0;
+
+  RemoteSample sample;
+  memset(&sample, 0, sizeof(sample));
+  sample.curpiece = 3;
+  sample.pos      = 5;
+  sample.ball_dx  = 1.5f;
+  sample.ball_dy  = 2.0f;
+
+  game_info gi = boards[0];
+
+  for (int n = 0; n < ops; n++) {
+    Uint32 now = frame++ * 16;
+
+    // a frame in three has a sample, 20 ms late
+    if (frame % 3 == 0) {
+      sample.time   = now - 20;
+      sample.fine   = (float)(frame % 40) * 0.25f;
+      sample.rot    = (float)(frame % 360);
+      sample.ball_x = (float)(frame % 18) * 0.25f;
+      sample.ball_y = (float)(frame % 44) * 0.25f;
+      buffer.push(sample, now);
+    }
+
+    sink += buffer.apply(&gi, now);
+  }
+}
+
+/*
+ * The draw lists of a frame: small allocations, then a reset.
+ */
+static void benchArena(int ops) {
+  static FrameArena arena;
+
+  for (int n = 0; n < ops; n++) {
+    if ((n & 255) == 0) {
+      arena.reset();
+    }
+    sink += (int)(size_t)arena.allocate(48 + (n & 3) * 16);
+  }
+}
+
+/*
+ * A flame block's matrix, spun and placed, and a board cell's, both as
+ * glm chains did and as Affine does now. Operations are per matrix.
+ */
+static float     transform_angles[BENCH_TRANSFORMS * 3 + 3];   // room for sinCos
+static float     transform_positions[BENCH_TRANSFORMS * 3];
+static glm::mat4 transform_out[BENCH_TRANSFORMS];
+
+static void makeTransforms() {
+  for (int i = 0; i < BENCH_TRANSFORMS; i++) {
+    for (int a = 0; a < 3; a++) {
+      transform_angles[i * 3 + a] = (float)(bench_random() % 72000) / 100.0f;
+    }
+
+    transform_positions[i * 3 + 0] = -2.25f + (i % 10) * 0.5f;
+    transform_positions[i * 3 + 1] = 6.375f - (i / 10 % 24) * 0.5f;
+    transform_positions[i * 3 + 2] = 0.4f;
+  }
+}
+
+static void benchTransformFlameGlm(int ops) {
+  // the heading once, as benchTransformFlame has it
+  glm::mat4 base = glm::mat4(1.0f);
+  base = glm::rotate(base, 0.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+  base = glm::rotate(base, 30.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+  base = glm::rotate(base, 0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+
+  for (int n = 0; n < ops; n++) {
+    const float* a = transform_angles + (n % BENCH_TRANSFORMS) * 3;
+
+    glm::mat4 model = base;
+    model = glm::translate(model, glm::vec3(a[0] / 100.0f, -0.5f, 0.0f));
+    model = glm::scale(model, glm::vec3(0.08f, 0.08f, 0.08f));
+    model = glm::rotate(model, a[0], glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::rotate(model, a[1], glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::rotate(model, a[2], glm::vec3(0.0f, 0.0f, 1.0f));
+
+    transform_out[n % BENCH_TRANSFORMS] = model;
+  }
+}
+
+static void benchTransformFlame(int ops) {
+  // as Flame::draw does it: every sine at once, then each matrix
+  static float sines[BENCH_TRANSFORMS * 3 + 3];
+  static float cosines[BENCH_TRANSFORMS * 3 + 3];
+
+  glm::mat4 base = glm::mat4(1.0f);
+  Affine::rotateXYZ(base, 0.0f, 30.0f, 0.0f);
+
+  for (int n = 0; n < ops; n += BENCH_TRANSFORMS) {
+    int count = ops - n < BENCH_TRANSFORMS ? ops - n : BENCH_TRANSFORMS;
+    Affine::sinCos(transform_angles, sines, cosines, count * 3);
+
+    for (int i = 0; i < count; i++) {
+      Affine::placeRotated(base, transform_angles[i * 3] / 100.0f, -0.5f, 0.0f, 0.08f,
+                           sines + i * 3, cosines + i * 3, transform_out[i]);
+    }
+  }
+}
+
+static void benchTransformCellGlm(int ops) {
+  for (int n = 0; n < ops; n++) {
+    const float* p = transform_positions + (n % BENCH_TRANSFORMS) * 3;
+
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::rotate(model, 30.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::rotate(model, -10.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::scale(model, glm::vec3(1.3f, 1.3f, 1.3f));
+    model = glm::translate(model, glm::vec3(p[0], p[1], p[2]));
+    model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
+
+    transform_out[n % BENCH_TRANSFORMS] = model;
+  }
+}
+
+static void benchTransformCell(int ops) {
+  // as Tetris::drawBackgroundBlocks does it: the board once, then a pass
+  glm::mat4 base = glm::mat4(1.0f);
+  Affine::rotateY(base, 30.0f);
+  Affine::rotateX(base, -10.0f);
+  Affine::scale(base, 1.3f);
+
+  for (int n = 0; n < ops; n += BENCH_TRANSFORMS) {
+    int count = ops - n < BENCH_TRANSFORMS ? ops - n : BENCH_TRANSFORMS;
+    Affine::place(base, transform_positions, 0.25f, transform_out, count);
+  }
+}
+
+/*
+ * Angles the check tries: quarter turns and either side of them, either
+ * side of +-180 where sinCos folds, and many turns out, as a spin that
+ * has gone on a long while.
+ */
+static const float check_angles[] = {
+  0.0f, 0.01f, 89.99f, 90.0f, 90.01f, -90.0f, 179.99f, 180.0f, 180.01f,
+  -179.99f, -180.0f, -180.01f, 270.0f, 359.99f, 360.0f, 720.5f,
+  -1234.56f, 3600.25f, -3600.25f, 36000.7f, 100000.3f, -100000.3f
+};
+
+#define CHECK_ANGLES (int)(sizeof(check_angles) / sizeof(float))
+
+/*
+ * The glm chains, worked in double: in float, glm's own rounding of
+ * large angles to radians is well past the tolerance.
+ */
+static glm::dmat4 flameGlm(double heading, const float* a) {
+  glm::dmat4 model = glm::dmat4(1.0);
+  model = glm::rotate(model, heading, glm::dvec3(0.0, 1.0, 0.0));
+  model = glm::translate(model, glm::dvec3(1.5, -3.0, 0.4));
+  model = glm::scale(model, glm::dvec3(0.1, 0.1, 0.1));
+  model = glm::rotate(model, (double)a[0], glm::dvec3(1.0, 0.0, 0.0));
+  model = glm::rotate(model, (double)a[1], glm::dvec3(0.0, 1.0, 0.0));
+  model = glm::rotate(model, (double)a[2], glm::dvec3(0.0, 0.0, 1.0));
+  return model;
+}
+
+static glm::dmat4 cellGlm(double rot, double rot2, const float* p) {
+  glm::dmat4 model = glm::dmat4(1.0);
+  model = glm::rotate(model, rot, glm::dvec3(0.0, 1.0, 0.0));
+  model = glm::rotate(model, -rot2, glm::dvec3(1.0, 0.0, 0.0));
+  model = glm::scale(model, glm::dvec3(1.3, 1.3, 1.3));
+  model = glm::translate(model, glm::dvec3(p[0], p[1], p[2]));
+  model = glm::scale(model, glm::dvec3(0.25, 0.25, 0.25));
+  return model;
+}
+
+static double difference(const glm::mat4& m, const glm::dmat4& reference) {
+  double most = 0.0;
+  for (int c = 0; c < 4; c++) {
+    for (int r = 0; r < 4; r++) {
+      double d = fabs((double)m[c][r] - reference[c][r]);
+      if (d > most) {
+        most = d;
+      }
+    }
+  }
+  return most;
+}
+
+/*
+ * Builds flame and board matrices as Flame::draw and Tetris do, and
+ * with glm, for every pair of check_angles. False if any are further
+ * apart than BENCH_TOLERANCE.
+ */
+static bool checkTransforms() {
+  double flame_most = 0.0;
+  double cell_most  = 0.0;
+  int    failures   = 0;
+
+  // every cell of the board, in front
+  float positions[10 * 24 * 3];
+  for (int i = 0; i < 10 * 24; i++) {
+    positions[i * 3 + 0] = -2.25f + (i % 10) * 0.5f;
+    positions[i * 3 + 1] = 6.375f - (i / 10) * 0.5f;
+    positions[i * 3 + 2] = 0.8f;
+  }
+  glm::mat4 cells[10 * 24];
+
+  for (int i = 0; i < CHECK_ANGLES; i++) {
+    for (int j = 0; j < CHECK_ANGLES; j++) {
+      float a[4] = { check_angles[i], check_angles[j],
+                     check_angles[(i + j) % CHECK_ANGLES], 0.0f };
+      float sines[4];
+      float cosines[4];
+      Affine::sinCos(a, sines, cosines, 4);
+
+      glm::mat4 heading = glm::mat4(1.0f);
+      Affine::rotateXYZ(heading, 0.0f, check_angles[j], 0.0f);
+
+      glm::mat4 flame;
+      Affine::placeRotated(heading, 1.5f, -3.0f, 0.4f, 0.1f, sines, cosines, flame);
+
+      double d = difference(flame, flameGlm(check_angles[j], a));
+      flame_most = std::max(flame_most, d);
+      if (d > BENCH_TOLERANCE && failures++ < 10) {
+        printf("check: flame at %g, %g, %g is %g off\n", a[0], a[1], a[2], d);
+      }
+
+      glm::mat4 base = glm::mat4(1.0f);
+      Affine::rotateY(base, check_angles[i]);
+      Affine::rotateX(base, -check_angles[j]);
+      Affine::scale(base, 1.3f);
+      Affine::place(base, positions, 0.25f, cells, 10 * 24);
+
+      for (int k = 0; k < 10 * 24; k++) {
+        d = difference(cells[k], cellGlm(check_angles[i], check_angles[j], positions + k * 3));
+        cell_most = std::max(cell_most, d);
+        if (d > BENCH_TOLERANCE && failures++ < 10) {
+          printf("check: cell %d at %g, %g is %g off\n", k, check_angles[i], check_angles[j], d);
+        }
+      }
+    }
+  }
+
+  printf("check: flame matrices within %.1e of glm, board cells within %.1e (tolerance %.0e)\n",
+         flame_most, cell_most, BENCH_TOLERANCE);
+
+  return failures == 0;
+}
+
+static JobSystem jobs;
+static glm::mat4 job_matrices[BENCH_JOBS][BENCH_JOB_MATRICES];
+
+/*
+ * A flame's worth of matrices, as Flame::draw places them.
+ */
+static void placeMatrices(void* data) {
+  glm::mat4* out = (glm::mat4*)data;
+
+  glm::mat4 base = glm::mat4(1.0f);
+  Affine::rotateXYZ(base, 0.0f, 30.0f, 0.0f);
+
+  float sines[BENCH_TRANSFORMS * 3 + 3];
+  float cosines[BENCH_TRANSFORMS * 3 + 3];
+
+  for (int n = 0; n < BENCH_JOB_MATRICES; n += BENCH_TRANSFORMS) {
+    Affine::sinCos(transform_angles, sines, cosines, BENCH_TRANSFORMS * 3);
+
+    for (int i = 0; i < BENCH_TRANSFORMS; i++) {
+      Affine::placeRotated(base, transform_angles[i * 3] / 100.0f, -0.5f, 0.0f, 0.08f,
+                           sines + i * 3, cosines + i * 3, out[n + i]);
+    }
+  }
+}
+
+static void benchJobsTransforms(int ops) {
+  for (int n = 0; n < ops; n++) {
+    Job* all = jobs.create(NULL, NULL);
+    for (int i = 0; i < BENCH_JOBS; i++) {
+      jobs.run(jobs.create(placeMatrices, job_matrices[i], all));
+    }
+    jobs.run(all);
+    jobs.wait(all);
+  }
+}
+
+static void benchJobsEmpty(int ops) {
+  for (int n = 0; n < ops; n++) {
+    Job* job = jobs.create(NULL, NULL);
+    jobs.run(job);
+    jobs.wait(job);
+  }
+}
+
+static void benchMeshParse(int ops) {
+  for (int n = 0; n < ops; n++) {
+    MeshData mesh;
+    Mesh::parse("assets/ship_final.obj", mesh, false);
+    sink += (int)mesh.elements.size();
+  }
+}
+
+static void benchMeshLoad(int ops) {
+  for (int n = 0; n < ops; n++) {
+    MeshData mesh;
+    Mesh::load("assets/ship_final.obj", mesh);
+    sink += (int)mesh.elements.size();
+  }
+}
+
+static void loadImage(const char* path, int ops) {
+  for (int n = 0; n < ops; n++) {
+    SDL_Surface* surface = IMG_Load(path);
+    if (surface) {
+      sink += surface->w;
+      SDL_FreeSurface(surface);
+    }
+  }
+}
+
+static void benchPngLarge(int ops) {
+  loadImage("images/nebula-layer.png", ops);
+}
+
+static void benchPngSmall(int ops) {
+  loadImage("images/hud_spritesheet.png", ops);
+}
+
+#ifdef ENABLE_TRACE
+/*
+ * What tracing costs each event, into a ring that has long since
+ * wrapped, as it will have in a long game.
+ */
+static void benchTraceEvent(int ops) {
+  for (int n = 0; n < ops; n++) {
+    TRACE_INSTANT("bench", n);
+  }
+}
+#endif
+
+static void run(const char* name, BenchFunction function) {
+  if (filter && !strstr(name, filter)) {
+    return;
+  }
+
+  if (result_count == BENCH_MAX) {
+    printf("bench: too many benchmarks, skipping %s\n", name);
+    return;
+  }
+
+  // once for any setup and the caches, then find how many fill a sample
+  function(1);
+
+  int ops = 1;
+  for (;;) {
+    Uint64 start = Profiler::now();
+    function(ops);
+    Uint64 elapsed = Profiler::now() - start;
+
+    if (elapsed >= BENCH_SAMPLE_NS || ops >= (1 << 24)) {
+      break;
+    }
+
+    ops = elapsed < BENCH_SAMPLE_NS / 16 ? ops * 16 : ops * 2;
+  }
+
+  std::vector<double> times(samples);
+  for (int s = 0; s < samples; s++) {
+    Uint64 start = Profiler::now();
+    function(ops);
+    times[s] = (double)(Profiler::now() - start) / ops;
+  }
+
+  BenchResult& result = results[result_count++];
+  result.name    = name;
+  result.samples = samples;
+  result.ops     = ops;
+  result.min     = times[0];
+
+  double total = 0.0;
+  for (int s = 0; s < samples; s++) {
+    total += times[s];
+    if (times[s] < result.min) {
+      result.min = times[s];
+    }
+  }
+  result.mean = total / samples;
+
+  double variance = 0.0;
+  for (int s = 0; s < samples; s++) {
+    variance += (times[s] - result.mean) * (times[s] - result.mean);
+  }
+  result.stddev = samples > 1 ? sqrt(variance / (samples - 1)) : 0.0;
+
+  printf("%-32s %12.1f ns/op  +- %5.1f%%  min %12.1f  (%d x %d)\n",
+         name, result.mean, 100.0 * result.stddev / result.mean, result.min,
+         samples, ops);
+}
+
+/*
+ * Runs the matrix jobs on 1, 2, 4 ... cores and the cores there are,
+ * then prints each against one core.
+ */
+static void runJobs() {
+  static char names[JOBS_THREADS][32];
+
+  int cores = JobSystem::cores();
+  if (cores > JOBS_THREADS - 1) {
+    cores = JOBS_THREADS - 1;
+  }
+
+  int    counts[JOBS_THREADS];
+  double means[JOBS_THREADS];
+  int    runs = 0;
+
+  for (int n = 1; ; n *= 2) {
+    if (n > cores) {
+      n = cores;
+    }
+
+    sprintf(names[runs], "jobs.transforms.%d", n);
+
+    jobs.start(n - 1);
+    int before = result_count;
+    run(names[runs], benchJobsTransforms);
+    if (result_count > before) {
+      counts[runs] = n;
+      means[runs]  = results[before].mean;
+      runs++;
+    }
+
+    if (n == cores) {
+      run("jobs.empty", benchJobsEmpty);
+    }
+    jobs.stop();
+
+    if (n == cores) {
+      break;
+    }
+  }
+
+  if (runs < 2 || counts[0] != 1) {
+    return;
+  }
+
+  for (int i = 1; i < runs; i++) {
+    printf("jobs.transforms on %2d cores: %5.2fx one core\n", counts[i], means[0] / means[i]);
+  }
+}
+
+static bool writeJson(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    printf("bench: cannot write '%s'\n", path);
+    return false;
+  }
+
+  fprintf(file, "{\"benchmarks\":[\n");
+  for (int i = 0; i < result_count; i++) {
+    const BenchResult& result = results[i];
+    fprintf(file, "  {\"name\":\"%s\",\"ns_per_op\":%.2f,\"stddev\":%.2f,\"min\":%.2f,"
+                  "\"samples\":%d,\"ops\":%d}%s\n",
+            result.name, result.mean, result.stddev, result.min,
+            result.samples, result.ops, i + 1 < result_count ? "," : "");
+  }
+  fprintf(file, "]}\n");
+
+  fclose(file);
+  return true;
+}
+
+/*
+ * Finds the mean for the given name in a file writeJson() made.
+ */
+static bool baselineMean(const std::vector<char>& json, const char* name, double& mean) {
+  char key[128];
+  snprintf(key, sizeof(key), "\"name\":\"%s\"", name);
+
+  const char* found = strstr(&json[0], key);
+  if (!found) {
+    return false;
+  }
+
+  const char* value = strstr(found, "\"ns_per_op\":");
+  if (!value) {
+    return false;
+  }
+
+  mean = atof(value + strlen("\"ns_per_op\":"));
+  return true;
+}
+
+static int compare(const char* path, double threshold) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    printf("bench: cannot read baseline '%s'\n", path);
+    return 1;
+  }
+
+  std::vector<char> json;
+  char chunk[4096];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    json.insert(json.end(), chunk, chunk + read);
+  }
+  json.push_back('\0');
+  fclose(file);
+
+  printf("\nagainst %s (threshold %.0f%%):\n", path, threshold);
+
+  int regressions = 0;
+  for (int i = 0; i < result_count; i++) {
+    const BenchResult& result = results[i];
+
+    double mean;
+    if (!baselineMean(json, result.name, mean) || mean <= 0.0) {
+      printf("%-32s new\n", result.name);
+      continue;
+    }
+
+    double change = 100.0 * (result.mean - mean) / mean;
+    bool regressed = change > threshold;
+    if (regressed) {
+      regressions++;
+    }
+
+    printf("%-32s %12.1f -> %12.1f ns/op  %+6.1f%%%s\n", result.name, mean,
+           result.mean, change, regressed ? "  REGRESSION" : "");
+  }
+
+  return regressions ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  const char* json      = NULL;
+  const char* baseline  = NULL;
+  double      threshold = 10.0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json = argv[++i];
+    }
+    else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baseline = argv[++i];
+    }
+    else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      samples = atoi(argv[++i]);
+      if (samples < 2) { samples = 2; }
+    }
+    else if (argv[i][0] == '-') {
+      printf("usage: %s [--json out.json] [--baseline old.json] [--threshold percent] "
+             "[--samples n] [filter]\n", argv[0]);
+      return 1;
+    }
+    else {
+      filter = argv[i];
+    }
+  }
+
+  if (!checkTransforms()) {
+    return 1;
+  }
+
+  makeCorpus();
+  makeSyncs();
+  makeTransforms();
+
+  run("tetris.testCollision",         benchTestCollision);
+  run("tetris.determineDropPosition", benchDropPosition);
+  run("tetris.clearLines",            benchClearLines);
+  run("tetris.attack.1",              benchAttackOne);
+  run("tetris.attack.2",              benchAttackTwo);
+  run("breakout.moveBall",            benchMoveBall);
+  run("flame.update.game",            benchFlameGame);
+  run("flame.update.4000",            benchFlameMany);
+  run("zobrist.set",                  benchZobristSet);
+  run("zobrist.dropLine",             benchZobristDropLine);
+  run("zobrist.compute",              benchZobristCompute);
+  run("boardsync.encode",             benchBoardSyncEncode);
+  run("boardsync.keyframe",           benchBoardSyncKeyframe);
+  run("boardsync.decode",             benchBoardSyncDecode);
+  run("jitter.frame",                 benchJitter);
+  run("arena.allocate",               benchArena);
+  run("transform.flame.glm",          benchTransformFlameGlm);
+  run("transform.flame",              benchTransformFlame);
+  run("transform.cell.glm",           benchTransformCellGlm);
+  run("transform.cell",               benchTransformCell);
+  runJobs();
+  run("mesh.parse",                   benchMeshParse);
+  run("mesh.load",                    benchMeshLoad);
+  run("png.nebula-layer",             benchPngLarge);
+  run("png.hud_spritesheet",          benchPngSmall);
+#ifdef ENABLE_TRACE
+  run("trace.event",                  benchTraceEvent);
+#endif
+
+  if (json && !writeJson(json)) {
+    return 1;
+  }
+
+  if (baseline) {
+    return compare(baseline, threshold);
+  }
+
+  return 0;
+}
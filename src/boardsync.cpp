@@ -0,0 +1,438 @@
+#include "boardsync.h"
+#include "zobrist.h"
+
+#include <string.h>
+
+// Row runs
+#define RUN_SAME    0
+#define RUN_COPY    1
+#define RUN_DIFF    2
+#define RUN_LITERAL 3
+
+#define RUN_MAX 32
+
+// Cell colour code for an empty cell
+#define CELL_EMPTY 7
+
+// Copy offsets, tried in order
+static const int copy_offsets[] = { -1, 1, -2, 2, -3, -4, 3 };
+
+class BitWriter {
+public:
+  BitWriter(unsigned char* buffer, size_t capacity)
+    : _buffer(buffer), _capacity(capacity), _bits(0), _failed(false) {
+    memset(_buffer, 0, _capacity);
+  }
+
+  void write(unsigned int value, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+      if ((_bits >> 3) >= _capacity) {
+        _failed = true;
+        return;
+      }
+      if (value & (1u << i)) {
+        _buffer[_bits >> 3] |= (unsigned char)(0x80 >> (_bits & 7));
+      }
+      _bits++;
+    }
+  }
+
+  size_t length() { return (_bits + 7) >> 3; }
+  bool failed()   { return _failed; }
+
+private:
+  unsigned char* _buffer;
+  size_t         _capacity;
+  size_t         _bits;
+  bool           _failed;
+};
+
+class BitReader {
+public:
+  BitReader(const unsigned char* buffer, size_t length)
+    : _buffer(buffer), _length(length), _bits(0), _failed(false) {
+  }
+
+  unsigned int read(int count) {
+    unsigned int value = 0;
+
+    for (int i = 0; i < count; i++) {
+      if ((_bits >> 3) >= _length) {
+        _failed = true;
+        return 0;
+      }
+      value = (value << 1) |
+              ((_buffer[_bits >> 3] >> (7 - (_bits & 7))) & 1);
+      _bits++;
+    }
+
+    return value;
+  }
+
+  bool failed() { return _failed; }
+
+private:
+  const unsigned char* _buffer;
+  size_t               _length;
+  size_t               _bits;
+  bool                 _failed;
+};
+
+static unsigned int cell_code(char cell) {
+  if (cell < 0 || cell > 6) {
+    return CELL_EMPTY;
+  }
+  return (unsigned int)cell;
+}
+
+static char cell_value(unsigned int code) {
+  if (code == CELL_EMPTY) {
+    return -1;
+  }
+  return (char)code;
+}
+
+static bool rows_equal(const char* a, const char* b) {
+  return memcmp(a, b, 10) == 0;
+}
+
+// Bits needed to send a row as a diff against the base row
+static int diff_cost(const char* row, const char* base) {
+  int cost = 10;
+  for (int i = 0; i < 10; i++) {
+    if (row[i] != base[i]) { cost += 3; }
+  }
+  return cost;
+}
+
+// Bits needed to send a row as-is
+static int literal_cost(const char* row) {
+  int cost = 10;
+  for (int i = 0; i < 10; i++) {
+    if (row[i] != -1) { cost += 3; }
+  }
+  return cost;
+}
+
+BoardSync::BoardSync() {
+  memset(_empty.cells, -1, sizeof(_empty.cells));
+  _empty.valid = true;
+  _empty.seq = 0;
+
+  reset();
+}
+
+void BoardSync::reset() {
+  for (int i = 0; i < BOARDSYNC_HISTORY; i++) {
+    _history[i].valid = false;
+  }
+
+  _seq            = 0;
+  _acked          = 0;
+  _has_ack        = false;
+  _force_keyframe = true;
+  _since_keyframe = 0.0f;
+}
+
+void BoardSync::requestKeyframe() {
+  _force_keyframe = true;
+}
+
+void BoardSync::acknowledge(unsigned char seq, unsigned char flags) {
+  if (flags & BOARDSYNC_ACK_RESYNC) {
+    _force_keyframe = true;
+    return;
+  }
+
+  // Acknowledgements arrive in order; ignore anything older than we know
+  if (_has_ack && (unsigned char)(seq - _acked) >= BOARDSYNC_HISTORY) {
+    return;
+  }
+
+  _acked   = seq;
+  _has_ack = true;
+}
+
+void BoardSync::_capture(game_info* gi, Board& board) {
+  for (int j = 0; j < 24; j++) {
+    for (int i = 0; i < 10; i++) {
+      board.cells[j][i] = gi->board[i][j];
+    }
+  }
+}
+
+size_t BoardSync::encode(game_info* gi, float deltatime,
+                         unsigned char* payload, size_t capacity) {
+  Board board;
+  _capture(gi, board);
+
+  _since_keyframe += deltatime;
+
+  bool keyframe = _force_keyframe ||
+                  _since_keyframe >= BOARDSYNC_KEYFRAME_INTERVAL;
+
+  Board& last = _history[_seq % BOARDSYNC_HISTORY];
+  if (!keyframe && last.valid && last.seq == _seq &&
+      memcmp(last.cells, board.cells, sizeof(board.cells)) == 0) {
+    return 0;
+  }
+
+  // The receiver can only decode against a board it has acknowledged
+  Board* base = &_empty;
+  if (!keyframe && _has_ack) {
+    Board& acked = _history[_acked % BOARDSYNC_HISTORY];
+    if (acked.valid && acked.seq == _acked &&
+        (unsigned char)(_seq - _acked) < BOARDSYNC_HISTORY - 1) {
+      base = &acked;
+    }
+  }
+
+  if (base == &_empty) {
+    keyframe = true;
+  }
+
+  unsigned char seq = (unsigned char)(_seq + 1);
+
+  size_t length = _write(board, *base, seq, keyframe ? 0 : _acked,
+                         keyframe ? BOARDSYNC_KEYFRAME : 0, payload, capacity);
+  if (length == 0) {
+    return 0;
+  }
+
+  _seq = seq;
+
+  Board& entry = _history[_seq % BOARDSYNC_HISTORY];
+  memcpy(entry.cells, board.cells, sizeof(board.cells));
+  entry.valid = true;
+  entry.seq   = _seq;
+
+  if (keyframe) {
+    _force_keyframe = false;
+    _since_keyframe = 0.0f;
+  }
+
+  return length;
+}
+
+size_t BoardSync::encodeRemembered(int index, unsigned char* payload, size_t capacity) {
+  for (int k = BOARDSYNC_HISTORY - 1; k >= 0; k--) {
+    unsigned char seq = (unsigned char)(_seq - k);
+    Board& entry = _history[seq % BOARDSYNC_HISTORY];
+
+    if (!entry.valid || entry.seq != seq) {
+      continue;
+    }
+
+    if (index-- == 0) {
+      return _write(entry, _empty, seq, 0, BOARDSYNC_KEYFRAME, payload, capacity);
+    }
+  }
+
+  return 0;
+}
+
+size_t BoardSync::_write(const Board& board, const Board& base_board,
+                         unsigned char seq, unsigned char base_seq, unsigned char flags,
+                         unsigned char* payload, size_t capacity) {
+  const Board* base = &base_board;
+
+  if (capacity < 3) {
+    return 0;
+  }
+
+  payload[0] = seq;
+  payload[1] = base_seq;
+  payload[2] = flags;
+
+  BitWriter bits(payload + 3, capacity - 3);
+
+  // Choose how to send each row
+  int ops[24];
+  int offsets[24];
+  int last_offset = copy_offsets[0];
+
+  for (int j = 0; j < 24; j++) {
+    const char* row = board.cells[j];
+
+    offsets[j] = 0;
+
+    if (rows_equal(row, base->cells[j])) {
+      ops[j] = RUN_SAME;
+      continue;
+    }
+
+    // Prefer continuing the shift we are in the middle of
+    int found = 0;
+    if (j + last_offset >= 0 && j + last_offset < 24 &&
+        rows_equal(row, base->cells[j + last_offset])) {
+      found = last_offset;
+    }
+    for (size_t k = 0; !found && k < sizeof(copy_offsets) / sizeof(int); k++) {
+      int d = copy_offsets[k];
+      if (j + d >= 0 && j + d < 24 && rows_equal(row, base->cells[j + d])) {
+        found = d;
+      }
+    }
+
+    if (found) {
+      ops[j]      = RUN_COPY;
+      offsets[j]  = found;
+      last_offset = found;
+    }
+    else if (diff_cost(row, base->cells[j]) <= literal_cost(row)) {
+      ops[j] = RUN_DIFF;
+    }
+    else {
+      ops[j] = RUN_LITERAL;
+    }
+  }
+
+  // Write runs of rows that share an operation
+  int j = 0;
+  while (j < 24) {
+    int count = 1;
+    while (j + count < 24 && count < RUN_MAX &&
+           ops[j + count] == ops[j] && offsets[j + count] == offsets[j]) {
+      count++;
+    }
+
+    bits.write(ops[j], 2);
+    bits.write(count - 1, 5);
+
+    if (ops[j] == RUN_COPY) {
+      bits.write(offsets[j] + 4, 3);
+    }
+
+    for (int r = j; r < j + count; r++) {
+      const char* row = board.cells[r];
+
+      if (ops[j] == RUN_DIFF) {
+        unsigned int mask = 0;
+        for (int i = 0; i < 10; i++) {
+          if (row[i] != base->cells[r][i]) { mask |= 1u << i; }
+        }
+        bits.write(mask, 10);
+        for (int i = 0; i < 10; i++) {
+          if (mask & (1u << i)) { bits.write(cell_code(row[i]), 3); }
+        }
+      }
+      else if (ops[j] == RUN_LITERAL) {
+        unsigned int mask = 0;
+        for (int i = 0; i < 10; i++) {
+          if (row[i] != -1) { mask |= 1u << i; }
+        }
+        bits.write(mask, 10);
+        for (int i = 0; i < 10; i++) {
+          if (mask & (1u << i)) { bits.write(cell_code(row[i]), 3); }
+        }
+      }
+    }
+
+    j += count;
+  }
+
+  if (bits.failed()) {
+    printf("boardsync: payload too small\n");
+    return 0;
+  }
+
+  return 3 + bits.length();
+}
+
+bool BoardSync::decode(game_info* gi, const unsigned char* payload, size_t length,
+                       unsigned char* seq) {
+  if (length < 3) {
+    return false;
+  }
+
+  *seq = payload[0];
+  unsigned char base_seq = payload[1];
+  unsigned char flags    = payload[2];
+
+  Board* base = &_empty;
+  if (!(flags & BOARDSYNC_KEYFRAME)) {
+    base = &_history[base_seq % BOARDSYNC_HISTORY];
+    if (!base->valid || base->seq != base_seq) {
+      return false;
+    }
+  }
+
+  Board board;
+  BitReader bits(payload + 3, length - 3);
+
+  int j = 0;
+  while (j < 24) {
+    int op    = (int)bits.read(2);
+    int count = (int)bits.read(5) + 1;
+    int d     = 0;
+
+    if (op == RUN_COPY) {
+      d = (int)bits.read(3) - 4;
+    }
+
+    if (bits.failed() || j + count > 24) {
+      return false;
+    }
+
+    for (int r = j; r < j + count; r++) {
+      char* row = board.cells[r];
+
+      switch (op) {
+        case RUN_SAME:
+          memcpy(row, base->cells[r], 10);
+          break;
+
+        case RUN_COPY:
+          if (r + d < 0 || r + d >= 24) {
+            return false;
+          }
+          memcpy(row, base->cells[r + d], 10);
+          break;
+
+        case RUN_DIFF: {
+          memcpy(row, base->cells[r], 10);
+          unsigned int mask = bits.read(10);
+          for (int i = 0; i < 10; i++) {
+            if (mask & (1u << i)) { row[i] = cell_value(bits.read(3)); }
+          }
+          break;
+        }
+
+        case RUN_LITERAL: {
+          memset(row, -1, 10);
+          unsigned int mask = bits.read(10);
+          for (int i = 0; i < 10; i++) {
+            if (mask & (1u << i)) { row[i] = cell_value(bits.read(3)); }
+          }
+          break;
+        }
+      }
+    }
+
+    j += count;
+  }
+
+  if (bits.failed()) {
+    return false;
+  }
+
+  for (int r = 0; r < 24; r++) {
+    for (int i = 0; i < 10; i++) {
+      gi->board[i][r] = board.cells[r][i];
+    }
+  }
+  Zobrist::rebuild(gi);
+
+  Board& entry = _history[*seq % BOARDSYNC_HISTORY];
+  memcpy(entry.cells, board.cells, sizeof(board.cells));
+  entry.valid = true;
+  entry.seq   = *seq;
+
+  _seq = *seq;
+
+  return true;
+}
+
+unsigned char BoardSync::sequence() {
+  return _seq;
+}
@@ -0,0 +1,104 @@
+#ifndef BOARDSYNC_INCLUDED
+#define BOARDSYNC_INCLUDED
+
+#include "main.h"
+
+// Boards remembered on each side, indexed by sequence number
+#define BOARDSYNC_HISTORY 16
+
+// Seconds between full boards, so any drift heals itself
+#define BOARDSYNC_KEYFRAME_INTERVAL 2.0f
+
+// Payload flags
+#define BOARDSYNC_KEYFRAME 1
+
+// Acknowledgement flags
+#define BOARDSYNC_ACK_RESYNC 1
+#define BOARDSYNC_ACK_DESYNC 2   // our copy disagreed with MSG_BOARDHASH
+
+/*
+ * Keeps a remote copy of a board in sync with as few bytes as possible.
+ *
+ * The sender encodes its board against the last board the receiver
+ * acknowledged. The board is walked top to bottom in runs of rows:
+ *
+ *   SAME    rows equal to the base board
+ *   COPY    rows equal to the base board shifted by -4..+3 rows
+ *           (line clears and garbage lines are just shifts)
+ *   DIFF    a 10-bit mask of changed cells, then a 3-bit colour per cell
+ *   LITERAL a 10-bit occupancy mask, then a 3-bit colour per block
+ *
+ * A keyframe is encoded against an empty board and needs no base, so it
+ * is sent periodically and whenever the receiver asks to resync.
+ */
+class BoardSync {
+public:
+  BoardSync();
+
+  /*
+   * Forgets all history; the next update is a keyframe.
+   */
+  void reset();
+
+  /*
+   * Encodes the given board if it changed (or a keyframe is due).
+   * Returns the payload length, or 0 when there is nothing to send.
+   */
+  size_t encode(game_info* gi, float deltatime,
+                unsigned char* payload, size_t capacity);
+
+  /*
+   * Encodes the index'th board still remembered, oldest first, as a
+   * keyframe under its own sequence number; sends nothing and changes
+   * nothing. Returns 0 past the last. A receiver that joins late and
+   * decodes all of them has every board an update may build on.
+   */
+  size_t encodeRemembered(int index, unsigned char* payload, size_t capacity);
+
+  /*
+   * Handles the receiver's acknowledgement of an update.
+   */
+  void acknowledge(unsigned char seq, unsigned char flags);
+
+  /*
+   * Forces the next update to be a keyframe.
+   */
+  void requestKeyframe();
+
+  /*
+   * Applies a received update to the given board. Returns false when the
+   * update refers to a board we never saw; the sender should resync.
+   */
+  bool decode(game_info* gi, const unsigned char* payload, size_t length,
+              unsigned char* seq);
+
+  /*
+   * The last board sent (or, receiving, decoded); 0 before the first.
+   */
+  unsigned char sequence();
+
+private:
+  struct Board {
+    char cells[24][10];      // row major, unlike game_info
+    bool valid;
+    unsigned char seq;
+  };
+
+  static void _capture(game_info* gi, Board& board);
+
+  // a board against a base, as a payload; 0 if it does not fit
+  static size_t _write(const Board& board, const Board& base,
+                       unsigned char seq, unsigned char base_seq, unsigned char flags,
+                       unsigned char* payload, size_t capacity);
+
+  Board         _history[BOARDSYNC_HISTORY];
+  Board         _empty;
+
+  unsigned char _seq;        // last sequence number sent or decoded
+  unsigned char _acked;      // last sequence number acknowledged
+  bool          _has_ack;
+  bool          _force_keyframe;
+  float         _since_keyframe;
+};
+
+#endif
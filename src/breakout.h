@@ -28,13 +28,16 @@ public:
   float getRightBounds(game_info* gi);
 
   void drawBall(Context* context, game_info* gi);
-  void moveBall(game_info* gi, float t, int last_type);
 
-  float checkBallAgainst(game_info* gi,
-                         float t, float x1, float y1, float x2, float y2);
-  bool checkBallAgainstBlock(game_info* gi,
-                             float t, float &cur_t, int &type_t,
-                             int last_type, float x, float y, int isPaddle);
+  // rules (breakoutrules.cpp), which need only the game_info:
+
+  static void moveBall(game_info* gi, float t, int last_type);
+
+  static float checkBallAgainst(game_info* gi,
+                                float t, float x1, float y1, float x2, float y2);
+  static bool checkBallAgainstBlock(game_info* gi,
+                                    float t, float &cur_t, int &type_t,
+                                    int last_type, float x, float y, int isPaddle);
 
 };
 #endif //BREAKOUT_INCLUDED
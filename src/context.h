@@ -2,6 +2,8 @@
 #define CONTEXT_INCLUDED
 
 #include "main.h"
+#include "shaders.h"
+#include "gpu.h"
 
 #include "glm/glm.hpp"
 
@@ -23,9 +25,25 @@ public:
   void useOrthographic();
 
   /*
-   * Establishes the gpu programs and matrices.
+   * Switches to one of the GPU programs (PROGRAM_*).
    */
-  void establish(int id);
+  void useProgram(int program);
+
+  /*
+   * Sets the time shaders see, once a frame.
+   */
+  void setTime(float seconds);
+
+  /*
+   * Points the vertex attributes at the given vertex buffer. Handles,
+   * unlike GL names, are never the same for two buffers.
+   */
+  void establish(GpuHandle buffer);
+
+  /*
+   * Releases the programs.
+   */
+  ~Context();
 
   /*
    * Sets the model matrix for the next render.
@@ -40,22 +58,14 @@ public:
 private:
   bool _in_perspective_mode;
 
-  GLuint _model_uniform;
-  GLuint _view_uniform;
-  GLuint _projection_uniform;
-
-  GLuint _opacity_uniform;
-
-  float _opacity;
-
   glm::mat4 _perspective;
   glm::mat4 _view;
   glm::mat4 _orthographic;
   glm::mat4 _viewOrtho;
 
-  GLuint _program;
+  ShaderManager _shaders;
 
-  int _id;
+  GpuHandle _id;
 };
 
 #endif
@@ -1,14 +1,24 @@
 #include "main.h"
 #include "engine.h"
+#include "rules.h"
 #include "components.h"
+#include "zobrist.h"
+#include "texture.h"
+#include "profiler.h"
+#include "trace.h"
+#include "affine.h"
 
 #include <math.h>
 #include <vector>
+#include <algorithm>
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+// Orders the input queue's slot before its index
+#define ENGINE_BARRIER() __sync_synchronize()
+
 static void gl_check_errors(const char* msg) {
   GLenum error = glGetError();
   if (error != GL_NO_ERROR) {
@@ -28,33 +38,9 @@ static void gl_check_errors(const char* msg) {
   }
 }
 
-#ifndef NO_NETWORK
-// threading code for networking
-int thread_func(void *unused) {
-  for (;;) {
-    // receive some text from sock
-    //TCPsocket sock;
-    int result;
-    unsigned char msg[4];
-
-    result=SDLNet_TCP_Recv(engine.client_tcpsock,msg,4);
-    if(result<=0) {
-      // An error may have occured, but sometimes you can just ignore it
-      // It may be good to disconnect sock because it is likely invalid now.
-      //break;
-      //printf("socket error\n");
-    }
-    else {
-      //printf("recv: %d\n", result);
-      engine.processMessage(msg);
-    }
-  }
-
-  return(0);
-}
-#endif
-
-Engine::Engine() {
+Engine::Engine()
+  : _event_head(0),
+    _event_tail(0) {
 }
 
 Engine::~Engine() {
@@ -216,6 +202,35 @@ const GLushort _hud_elements[] = {
   38, 39, 36
 };
 
+// A vertex: position, normal, texture coordinate
+#define VERTEX_FLOATS 8
+#define VERTEX_BYTES  (VERTEX_FLOATS * sizeof(float))
+
+// Six vertices, as stream_quad writes them
+#define QUAD_BYTES    (6 * VERTEX_BYTES)
+
+/*
+ * Writes out the quad six elements of a mesh make, as translate(x, y, z)
+ * * scale(w, h, 1) would place it. Returns where the next one goes.
+ */
+static float* stream_quad(float* out, const GLfloat* data, const GLushort* elements,
+                          float x, float y, float z, float w, float h) {
+  for (int e = 0; e < 6; e++) {
+    const GLfloat* vertex = data + elements[e] * VERTEX_FLOATS;
+
+    out[0] = x + vertex[0] * w;
+    out[1] = y + vertex[1] * h;
+    out[2] = z + vertex[2];
+    for (int f = 3; f < VERTEX_FLOATS; f++) {
+      out[f] = vertex[f];
+    }
+
+    out += VERTEX_FLOATS;
+  }
+
+  return out;
+}
+
 void Engine::init() {
   inplay = true;
 
@@ -229,6 +244,13 @@ void Engine::init() {
   }
 #endif
 
+#ifndef EMSCRIPTEN
+  _s3tc = GLEW_EXT_texture_compression_s3tc != 0;
+#else
+  const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+  _s3tc = extensions && strstr(extensions, "texture_compression_s3tc");
+#endif
+
   // clear color
   glClearColor(0,1,0,1);
   gl_check_errors("glClearColor");
@@ -247,6 +269,26 @@ void Engine::init() {
 
   srand(SDL_GetTicks());
 
+  // sounds are converted to the device format as they are decoded
+  audio.init();
+
+#ifndef EMSCRIPTEN
+  // loads libpng now, rather than in whichever worker gets there first
+  IMG_Init(IMG_INIT_PNG);
+#endif
+
+  // everything below decodes in the background; the first frames show
+  // progress until it is all in
+  jobs.start(JobSystem::cores() - 1);
+  assets.start(_finishAsset, this, &jobs);
+
+  // packed assets need no decoding (see packer.cpp)
+  if (use_archive && archive.open("assets.pak")) {
+    assets.useArchive(&archive);
+  }
+  _loading = true;
+  _loading_shown = 0;
+
   addTexture("images/block_01.png");
   addTexture("images/block_02.png");
   addTexture("images/block_03.png");
@@ -276,13 +318,14 @@ void Engine::init() {
 
   addTexture("images/hud_spritesheet.png");
 
-  audio.init();
+  addSound("sounds/addline.wav", AUDIO_PRIORITY_HIGH);
+  addSound("sounds/tink.wav", AUDIO_PRIORITY_LOW);
+  addSound("sounds/penguin-short.wav", AUDIO_PRIORITY_HIGH);
+  addSound("sounds/bounce.wav", AUDIO_PRIORITY_LOW);
+  addSound("sounds/changeview.wav", AUDIO_PRIORITY_NORMAL);
 
-  audio.loadSound("sounds/addline.wav");
-  audio.loadSound("sounds/tink.wav");
-  audio.loadSound("sounds/penguin-short.wav");
-  audio.loadSound("sounds/bounce.wav");
-  audio.loadSound("sounds/changeview.wav");
+  _ship_mesh = NULL;
+  assets.request(ASSET_MESH, "assets/ship_final.obj", 0, true);
 
   audio.loadMusic("music/bsh.ogg");
   audio.playMusic();
@@ -303,13 +346,10 @@ void Engine::init() {
 
   _cube_mesh = new Mesh(_cube_data, sizeof(_cube_data)/sizeof(float),
                         _cube_elements, sizeof(_cube_elements)/sizeof(short));
-  _hud_mesh  = new Mesh(_hud_data, sizeof(_hud_data)/sizeof(float),
-                        _hud_elements, sizeof(_hud_elements)/sizeof(short));
-  _ship_mesh = new Mesh("assets/ship_final.obj");
+  // digits are written to the stream as they are drawn
+  _stream.init(STREAM_CAPACITY);
 
   glActiveTexture(GL_TEXTURE0 + 0);
-  glBindTexture(GL_TEXTURE_2D, textures[0]);
-  gl_check_errors("glBindTexture");
   glDisable(GL_CULL_FACE);
 
   _ship_engine_one = new Flame(-9.0, -0.5, 0.0);
@@ -337,9 +377,33 @@ void Engine::performAttack(int severity) {
   games[player1.curgame]->attack(&player1, severity);
 }
 
+int Engine::shutdown() {
+  for (size_t i = 0; i < textures.size(); i++) {
+    GpuResources::release(textures[i].handle);
+    textures[i].handle = 0;
+  }
+
+  delete _cube_mesh;
+  delete _ship_mesh;
+  _cube_mesh = _ship_mesh = NULL;
+
+  if (_stream.stalls() > 0) {
+    printf("stream: waited on the GPU %d times\n", _stream.stalls());
+  }
+  _stream.destroy();
+
+  // the programs
+  delete _context;
+  _context = NULL;
+
+  return GpuResources::shutdown();
+}
+
 void Engine::quit() {
+#ifdef EMSCRIPTEN
   SDL_Quit();
-  _quit = 1;
+#endif
+  __atomic_store_n(&_quit, 1, __ATOMIC_RELEASE);
 }
 
 #ifdef EMSCRIPTEN
@@ -358,7 +422,26 @@ void Engine::gameLoop() {
   _c_this = this;
   emscripten_set_main_loop(Engine::_c_iterate, 30, 0);
 #else
-  while(_iterate()) {}
+  // loading uploads textures, so it happens here, on the GL thread
+  while (_loading) {
+    if (!_iterate()) { return; }
+  }
+
+  if (!threaded) {
+    while(_iterate()) {}
+    return;
+  }
+
+  SDL_Thread* simulation = SDL_CreateThread(_c_simulate, this);
+  if (!simulation) {
+    printf("engine: no simulation thread (%s), running single threaded\n", SDL_GetError());
+    while(_iterate()) {}
+    return;
+  }
+
+  while(_render()) {}
+
+  SDL_WaitThread(simulation, NULL);
 #endif
 }
 
@@ -372,24 +455,8 @@ bool Engine::_iterate() {
 
   if (!_quit) {
     while(SDL_PollEvent(&event)) {
-      switch(event.type) {
-        case SDL_KEYDOWN:
-          keyDown(event.key.keysym.sym);
-          break;
-        case SDL_KEYUP:
-          keyUp(event.key.keysym.sym);
-          break;
-        case SDL_MOUSEMOTION:
-          mouseMovement(event.motion.x, event.motion.y);
-          break;
-        case SDL_MOUSEBUTTONDOWN:
-          mouseDown();
-          break;
-        case SDL_MOUSEBUTTONUP:
-          break;
-        case SDL_QUIT:
-          quit();
-          return false;
+      if (!_handleEvent(event)) {
+        return false;
       }
     }
 
@@ -402,8 +469,13 @@ bool Engine::_iterate() {
     deltatime = (float)(curtime - lasttime) / 1000.0f;
 
     // CALL ENGINE
+    TRACE_BEGIN("frame");
     update(deltatime);
+    _publish();
     draw();
+    TRACE_END("frame");
+
+    Profiler::frame();
 
     lasttime = curtime;
   }
@@ -411,52 +483,187 @@ bool Engine::_iterate() {
   return true;
 }
 
-void Engine::drawMesh(int count) {
-  glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, 0);
-  gl_check_errors("glDrawElements mesh");
+bool Engine::_handleEvent(const SDL_Event& event) {
+  switch(event.type) {
+    case SDL_KEYDOWN:
+      keyDown(event.key.keysym.sym);
+      break;
+    case SDL_KEYUP:
+      keyUp(event.key.keysym.sym);
+      break;
+    case SDL_MOUSEMOTION:
+      mouseMovement(event.motion.x, event.motion.y);
+      break;
+    case SDL_MOUSEBUTTONDOWN:
+      mouseDown();
+      break;
+    case SDL_MOUSEBUTTONUP:
+      break;
+    case SDL_QUIT:
+      quit();
+      return false;
+  }
+
+  return true;
 }
 
-void Engine::update(float deltatime) {
-  // scroll background
-  bg1x += BG1_SPEED_X * deltatime;
-  bg1y += BG1_SPEED_Y * deltatime;
+bool Engine::_render() {
+  SDL_Event event;
 
-  bg2x += BG2_SPEED_X * deltatime;
-  bg2y += BG2_SPEED_Y * deltatime;
+  // SDL only gives events to the thread with the window: pass them on
+  while(SDL_PollEvent(&event)) {
+    Uint32 tail = _event_tail;
+    if (tail - _event_head == ENGINE_EVENTS) {
+      // the simulation is stuck; it would not act on it anyway
+      continue;
+    }
 
-  while (bg1x > SCROLL_CONSTRAINT) {
-    bg1x -= 30;
+    _events[tail & (ENGINE_EVENTS - 1)] = event;
+    ENGINE_BARRIER();
+    _event_tail = tail + 1;
   }
 
-  while (bg1x < -SCROLL_CONSTRAINT) {
-    bg1x += 30;
-  }
+  if (__atomic_load_n(&_quit, __ATOMIC_ACQUIRE)) { return false; }
 
-  while (bg1y > SCROLL_CONSTRAINT) {
-    bg1y -= 30;
-  }
+  TRACE_BEGIN("frame");
+  draw();
+  TRACE_END("frame");
 
-  while (bg1y < -SCROLL_CONSTRAINT) {
-    bg1y += 30;
-  }
+  Profiler::frame();
 
-  while (bg2x > SCROLL_CONSTRAINT) {
-    bg2x -= 30;
+  return true;
+}
+
+int Engine::_c_simulate(void* data) {
+  ((Engine*)data)->_simulate();
+  return 0;
+}
+
+void Engine::_simulate() {
+  TRACE_THREAD("simulation");
+  Profiler::track();
+
+  // flames are split up from here
+  jobs.attach();
+
+  const float  tick    = 1.0f / ENGINE_TICK_RATE;
+  const Uint64 tick_ns = 1000000000ULL / ENGINE_TICK_RATE;
+
+  Uint64 next = Profiler::now();
+
+  while (!__atomic_load_n(&_quit, __ATOMIC_ACQUIRE)) {
+    // input first, in the order it came
+    while (_event_head != _event_tail) {
+      SDL_Event event = _events[_event_head & (ENGINE_EVENTS - 1)];
+      ENGINE_BARRIER();
+      _event_head = _event_head + 1;
+
+      _handleEvent(event);
+    }
+
+    TRACE_BEGIN("tick");
+    update(tick);
+    _publish();
+    TRACE_END("tick");
+
+    next += tick_ns;
+
+    Uint64 now = Profiler::now();
+    if (now < next) {
+      SDL_Delay((Uint32)((next - now) / 1000000));
+    }
+    else if (now - next > ENGINE_TICK_RATE * tick_ns / 4) {
+      // a quarter of a second behind (a breakpoint, a stall): start over
+      // rather than race to catch up
+      next = now;
+    }
   }
 
-  while (bg2x < -SCROLL_CONSTRAINT) {
-    bg2x += 30;
+  TRACE_THREAD_END();
+}
+
+RenderSnapshot& Engine::drawing() {
+  return _snapshots.front();
+}
+
+void Engine::_publish() {
+  RenderSnapshot& scene = _snapshots.back();
+
+  scene.player1 = player1;
+  scene.player2 = player2;
+
+  scene.bg1x = bg1x;
+  scene.bg1y = bg1y;
+  scene.bg_tile_opacity = bg_tile_opacity;
+
+  scene.both_boards = session.active() || benchmark;
+
+  scene.lobby         = inLobby();
+  scene.lobby_waiting = session.waiting();
+  scene.lobby_port    = session.hosting() ? session.port() : -1;
+
+  scene.ship_engine_one.copy(*_ship_engine_one);
+  scene.ship_engine_two.copy(*_ship_engine_two);
+
+  scene.show_netgraph = show_netgraph != 0;
+  scene.show_profiler = show_profiler != 0;
+
+  if (scene.show_netgraph) {
+    scene.net_stats = net_stats;
   }
 
-  while (bg2y > SCROLL_CONSTRAINT) {
-    bg2y -= 30;
+  _snapshots.publish();
+}
+
+void Engine::drawMesh(int count) {
+  glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, 0);
+  gl_check_errors("glDrawElements mesh");
+}
+
+void Engine::update(float deltatime) {
+  PROFILE_SCOPE(PROFILE_UPDATE);
+  TRACE_SCOPE("update");
+
+  // hear from the peer before we simulate anything
+  session.update(deltatime);
+
+  audio.update(deltatime);
+
+  if (_loading) {
+    // upload whatever the workers have decoded
+    assets.pump(ASSETS_MAX);
+    if (assets.loading()) {
+      return;
+    }
+
+    _loading = false;
+    printf("startup: loading frame after %ums, first frame after %ums (%d assets from %s, %uKB of textures)\n",
+           (unsigned int)_loading_shown, (unsigned int)SDL_GetTicks(), assets.total(),
+           archive.opened() ? "assets.pak" : "files",
+           (unsigned int)(GpuResources::bytes(GPU_TEXTURE) / 1024));
   }
 
-  while (bg2y < -SCROLL_CONSTRAINT) {
-    bg2y += 30;
+  _scrollBackground(deltatime);
+
+  if (inLobby()) {
+    // nothing to play until the peer shows up
+    _updateFlames(deltatime);
+
+    relay.flush();
+    _updateNetStats(deltatime);
+    return;
   }
 
-  if (repeatTime < 0.35) {
+  if (spectating) {
+    // mirrors only, but the game over explosion still needs to play out
+    if (player1.state == STATE_GAMEOVER) {
+      tetris.update(&player1, deltatime);
+    }
+    if (player2.state == STATE_GAMEOVER) {
+      tetris.update(&player2, deltatime);
+    }
+  }
+  else if (repeatTime < 0.35) {
     repeatTime += deltatime;
   }
   else {
@@ -486,10 +693,112 @@ void Engine::update(float deltatime) {
   }
 
   // update current game
-  games[player1.curgame]->update(&player1, deltatime);
+  if (!spectating) {
+    games[player1.curgame]->update(&player1, deltatime);
+  }
+
+  _updateFlames(deltatime);
+
+  if (!spectating) {
+    _syncBoard(deltatime);
+    _sendMotion(deltatime);
+  }
+
+  // mirrored players move at the pace their samples describe
+  Uint32 now = SDL_GetTicks();
+  if (spectating) {
+    player1_motion.apply(&player1, now);
+  }
+  player2_motion.apply(&player2, now);
+
+  // tell the opponent when their key press became visible here
+  unsigned char input;
+  if (!spectating && player2_motion.shownInput(&input)) {
+    passMessage(MSG_INPUTECHO, input, 0, 0);
+  }
+
+  // everything this frame said goes out to the spectators at once
+  relay.flush();
+  _updateNetStats(deltatime);
+}
+
+// A flame to move on, as a job
+struct FlameUpdate {
+  Flame* flame;
+  float  deltatime;
+};
+
+static void flame_update(void* data) {
+  FlameUpdate* update = (FlameUpdate*)data;
+  update->flame->update(update->deltatime);
+}
+
+void Engine::_updateFlames(float deltatime) {
+  PROFILE_SCOPE(PROFILE_FLAME_UPDATE);
+
+  // new blocks take the level's colour and go the way the ships face
+  _ship_engine_one->setColor(LEVEL);
+  _ship_engine_one->setRotationY(-player1.rot);
+
+  _ship_engine_two->setColor(LEVEL);
+  _ship_engine_two->setRotationY(-player1.rot);
+
+  // the engines share nothing: one goes to a worker while we do the other
+  FlameUpdate update = { _ship_engine_two, deltatime };
+  Job* job = jobs.create(flame_update, &update);
+  jobs.run(job);
 
   _ship_engine_one->update(deltatime);
-  _ship_engine_two->update(deltatime);
+
+  jobs.wait(job);
+}
+
+void Engine::_scrollBackground(float deltatime) {
+  bg1x += BG1_SPEED_X * deltatime;
+  bg1y += BG1_SPEED_Y * deltatime;
+
+  bg2x += BG2_SPEED_X * deltatime;
+  bg2y += BG2_SPEED_Y * deltatime;
+
+  while (bg1x > SCROLL_CONSTRAINT) {
+    bg1x -= 30;
+  }
+
+  while (bg1x < -SCROLL_CONSTRAINT) {
+    bg1x += 30;
+  }
+
+  while (bg1y > SCROLL_CONSTRAINT) {
+    bg1y -= 30;
+  }
+
+  while (bg1y < -SCROLL_CONSTRAINT) {
+    bg1y += 30;
+  }
+
+  while (bg2x > SCROLL_CONSTRAINT) {
+    bg2x -= 30;
+  }
+
+  while (bg2x < -SCROLL_CONSTRAINT) {
+    bg2x += 30;
+  }
+
+  while (bg2y > SCROLL_CONSTRAINT) {
+    bg2y -= 30;
+  }
+
+  while (bg2y < -SCROLL_CONSTRAINT) {
+    bg2y += 30;
+  }
+}
+
+void Engine::_updateNetStats(float deltatime) {
+  net_stats.sampleQueues(session.buffered(), relay.queueDepth(),
+                         player2_motion.depth());
+
+  // only log matches that actually use the network
+  net_stats.update(deltatime, session.active() || relay.spectatorCount() > 0);
 }
 
 int Engine::intLength(int i) {
@@ -509,34 +818,37 @@ int Engine::drawInt(int i, int color, float x, float y) {
   static int hud_heights[] = {38.0f, 37.0f, 38.0f, 38.0f, 38.0f,
                               38.0f, 38.0f, 39.0f, 40.0f, 39.0f};
 
-  int length = 0;
   int width = 0;
 
   float scale = 0.5f;
 
+  // digits, last first; an int has no more than ten
+  FrameSpan<int> digits = frame_arena.span<int>(10);
+
   int tmp = i;
   do {
     int digit = tmp % 10;
-    length += 1;
+    digits.push(digit);
     width += hud_widths[digit]*scale;
     tmp /= 10;
   } while (tmp > 0);
 
-  tmp = i;
-  do {
-    int digit = tmp % 10;
-    width -= hud_widths[digit]*scale;
+  // every digit in one draw
+  StreamAllocation vertices = _stream.allocate(digits.size() * QUAD_BYTES, VERTEX_BYTES);
+  if (!vertices.data) {
+    return 0;
+  }
 
-    glm::mat4 model = glm::scale(
-        glm::translate(
-          glm::mat4(1.0f),
-          glm::vec3(x+width, y, 1.0f)),
-        glm::vec3(hud_widths[digit]*scale, hud_heights[digit]*scale, 1.0f));
+  float* out = (float*)vertices.data;
+  for (size_t d = 0; d < digits.size(); d++) {
+    int digit = digits[d];
+    width -= hud_widths[digit]*scale;
 
-    _hud_mesh->drawSubset(_context, model, digit * 6, 6);
+    out = stream_quad(out, _hud_data, _hud_elements + digit * 6, x+width, y, 1.0f,
+                      hud_widths[digit]*scale, hud_heights[digit]*scale);
+  }
 
-    tmp /= 10;
-  } while (width > 0);
+  drawStream(vertices, (int)digits.size() * 6);
 
   return 0;
 }
@@ -550,21 +862,41 @@ void Engine::displayMessage(int stringIndex) {
 }
 
 void Engine::draw() {
+  TRACE_SCOPE("draw");
+
+  if (_loading) {
+    _drawLoading();
+    frame_arena.reset();
+    _stream.endFrame();
+    GpuResources::endFrame();
+    return;
+  }
+
+  // up to the swap, which may wait on vsync
+  Profiler::begin(PROFILE_DRAW);
+
+  // the newest the simulation has; else the last one again
+  _snapshots.take();
+  RenderSnapshot& scene = _snapshots.front();
+
   // clear buffer
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   glEnable(GL_DEPTH_TEST);
 
+  _context->setTime(SDL_GetTicks() / 1000.0f);
+
   // Perspective
   _context->usePerspective();
 
   // BACKGROUND!!!
+  _context->useProgram(PROGRAM_SPRITE);
   useTexture(TEXTURE_BG1);
 
-  drawQuadXY(bg1x, bg1y, -12.3f, 30, 30);
-  drawQuadXY(bg1x - 30, bg1y, -12.3f, 30, 30);
-  drawQuadXY(bg1x, bg1y-30, -12.3f, 30, 30);
-  drawQuadXY(bg1x - 30, bg1y-30, -12.3f, 30, 30);
+  drawQuadXY(scene.bg1x, scene.bg1y, -12.3f, 30, 30);
+  drawQuadXY(scene.bg1x - 30, scene.bg1y, -12.3f, 30, 30);
+  drawQuadXY(scene.bg1x, scene.bg1y-30, -12.3f, 30, 30);
+  drawQuadXY(scene.bg1x - 30, scene.bg1y-30, -12.3f, 30, 30);
 
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -572,14 +904,19 @@ void Engine::draw() {
   useTexture(TEXTURE_BG2);
 
   // draw current game
-  games[player1.curgame]->draw(_context, &player1);
-  games[player2.curgame]->draw(_context, &player2);
+  _context->useProgram(PROGRAM_BLOCK);
+  bool lobby = scene.lobby;
+  if (!lobby) {
+    games[scene.player1.curgame]->draw(_context, &scene.player1);
+    games[scene.player2.curgame]->draw(_context, &scene.player2);
+  }
 
   // Ship left
+  _context->useProgram(PROGRAM_MESH);
   useTexture(TEXTURE_BLOCK1);
   glm::mat4 model = glm::mat4(1.0f);
 
-  model = glm::rotate(model, -player1.rot, glm::vec3(0.0f, 1.0f, 0.0f));
+  model = glm::rotate(model, -scene.player1.rot, glm::vec3(0.0f, 1.0f, 0.0f));
   model = glm::translate(model, glm::vec3(-3.8f, -1.0f, 0.0f));
   model = glm::scale(model, glm::vec3(1.3f, 1.3f, 1.3f));
   model = glm::rotate(model, 90.0f, glm::vec3(1.0f, 0.0f, 0.0f));
@@ -589,7 +926,7 @@ void Engine::draw() {
   // Ship right
   model = glm::mat4(1.0f);
 
-  model = glm::rotate(model, -player1.rot, glm::vec3(0.0f, 1.0f, 0.0f));
+  model = glm::rotate(model, -scene.player1.rot, glm::vec3(0.0f, 1.0f, 0.0f));
   model = glm::translate(model, glm::vec3(3.8f, -1.0f, 0.0f));
   model = glm::scale(model, glm::vec3(1.3f, 1.3f, 1.3f));
   model = glm::rotate(model, 90.0f, glm::vec3(1.0f, 0.0f, 0.0f));
@@ -598,37 +935,82 @@ void Engine::draw() {
   _ship_mesh->draw(_context, model);
 
   // Ship engines
-  _ship_engine_one->setColor(LEVEL);
-  _ship_engine_one->setRotationY(-player1.rot);
-  _ship_engine_one->draw(_context);
-
-  _ship_engine_two->setColor(LEVEL);
-  _ship_engine_two->setRotationY(-player1.rot);
-  _ship_engine_two->draw(_context);
+  _context->useProgram(PROGRAM_PARTICLE);
+  scene.ship_engine_one.draw(_context);
+  scene.ship_engine_two.draw(_context);
 
   // Orthographic (UI)
 
   _context->useOrthographic();
+  _context->useProgram(PROGRAM_SPRITE);
 
-  gl_check_errors("glUniformMatrix4fv orthographic");
+  gl_check_errors("useOrthographic");
+
+  if (lobby) {
+    _drawLobby();
+  }
+  else {
+    games[scene.player1.curgame]->drawOrtho(_context, &scene.player1);
+    games[scene.player2.curgame]->drawOrtho(_context, &scene.player2);
 
-  games[player1.curgame]->drawOrtho(_context, &player1);
-  games[player2.curgame]->drawOrtho(_context, &player2);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    drawInt(scene.player1.score, 0, -(float)WIDTH/2.0f + 30, (float)HEIGHT/2.0f - 30);
+  }
 
-  drawInt(player1.score, 0, -(float)WIDTH/2.0f + 30, (float)HEIGHT/2.0f - 30);
+  if (scene.show_netgraph) {
+    _drawNetgraph();
+  }
+
+  if (scene.show_profiler) {
+    _drawProfiler();
+  }
+
+  Profiler::end(PROFILE_DRAW);
 
+  TRACE_BEGIN("swap");
   SDL_GL_SwapBuffers();
+  TRACE_END("swap");
+
+  frame_arena.reset();
+  _stream.endFrame();
+  GpuResources::endFrame();
 }
 
 void Engine::keyDown(Uint32 key) {
-  bool gameover = !inplay;
-#ifndef NO_NETWORK
-  gameover = gameover && !client_tcpsock;
+  if (key == SDLK_F3) {
+    show_netgraph = !show_netgraph;
+    return;
+  }
+
+  if (key == SDLK_F2) {
+    show_profiler = !show_profiler;
+    return;
+  }
+
+#ifdef ENABLE_TRACE
+  if (key == SDLK_F4) {
+    TRACE_WRITE("trace.json");
+    return;
+  }
 #endif
 
+  // nothing to play yet
+  if (_loading) {
+    return;
+  }
+
+  if (spectating || inLobby()) {
+    if (key == SDLK_ESCAPE) {
+      quit();
+    }
+    return;
+  }
+
+  // a networked match is not restarted by one side alone
+  bool gameover = !inplay && !session.active();
+
   if (gameover) {
     if (player1.gameover_position > 1.0f) {
       clearGameData(&player1);
@@ -653,6 +1035,10 @@ void Engine::keyDown(Uint32 key) {
 
   if (!inplay) { return; }
 
+  if (session.connected()) {
+    _input_marker = net_stats.input(SDL_GetTicks());
+  }
+
   games[player1.curgame]->keyDown(&player1, key);
   games[player1.curgame]->keyRepeat(&player1);
 }
@@ -668,10 +1054,8 @@ void Engine::keyUp(Uint32 key) {
 }
 
 void Engine::mouseDown() {
-  bool gameover = !inplay;
-#ifndef NO_NETWORK
-  gameover = gameover && !client_tcpsock;
-#endif
+  // a networked match is not restarted by one side alone
+  bool gameover = !inplay && !session.active();
 
   if (gameover) {
     if (player1.gameover_position > 1.0f) {
@@ -681,6 +1065,8 @@ void Engine::mouseDown() {
 }
 
 void Engine::mouseMovement(Uint32 x, Uint32 y) {
+  if (spectating || inLobby()) { return; }
+
   games[player1.curgame]->mouseMovement(&player1, x,y);
 }
 
@@ -694,11 +1080,9 @@ void Engine::gameOver() {
 }
 
 void Engine::drawQuadXY(float x, float y, float z, float w, float h) {
-  glm::mat4 model = glm::scale(
-                      glm::translate(
-                        glm::mat4(1.0f),
-                        glm::vec3(x, y, z)),
-                      glm::vec3(w, h, 1.0f));
+  glm::mat4 model = glm::mat4(1.0f);
+  Affine::translate(model, x, y, z);
+  Affine::scale(model, w, h, 1.0f);
 
   _cube_mesh->drawSubset(_context, model, 0, 6);
 }
@@ -711,14 +1095,33 @@ void Engine::drawCube(glm::mat4& model) {
   _cube_mesh->draw(_context, model);
 }
 
-void Engine::clearGameData(game_info* player) {
-  int i, j;
+void Engine::drawStream(StreamAllocation& vertices, int count) {
+  static glm::mat4 identity = glm::mat4(1.0f);
 
-  for (i=0; i<10; i++) {
-    for(j=0;j<24;j++) {
-      player->board[i][j] = -1;
-    }
+  if (!vertices.data || count == 0) {
+    return;
+  }
+
+  _stream.bind();
+  _context->establish(_stream.buffer());
+  _context->setModel(identity);
+
+  glDrawArrays(GL_TRIANGLES, (GLint)(vertices.offset / VERTEX_BYTES), count);
+  gl_check_errors("glDrawArrays stream");
+
+  Profiler::count(PROFILE_DRAW_CALLS, 1);
+  Profiler::count(PROFILE_TRIANGLES,  count / 3);
+}
+
+void Engine::clearGameData(game_info* player) {
+  int i, j;
+
+  for (i=0; i<10; i++) {
+    for(j=0;j<24;j++) {
+      player->board[i][j] = -1;
+    }
   }
+  Zobrist::rebuild(player);
 
   player->gameover_position = 0.0f;
 
@@ -772,292 +1175,1118 @@ void Engine::uninitState(game_info* gi) {
 }
 
 void Engine::useTexture(int textureIndex) {
-  if (textureIndex < 0 || textureIndex >= texture_count) { return; }
+  if (textureIndex < 0 || textureIndex >= (int)textures.size()) { return; }
+
+  // not uploaded yet: wait for it rather than draw without it
+  GLuint texture = GpuResources::object(textures[textureIndex].handle);
+  if (texture == 0) {
+    assets.require(textures[textureIndex].asset);
+    texture = GpuResources::object(textures[textureIndex].handle);
+  }
 
-  glBindTexture(GL_TEXTURE_2D, textures[textureIndex]);
+  glBindTexture(GL_TEXTURE_2D, texture);
   gl_check_errors("glBindTexture");
+  Profiler::count(PROFILE_TEXTURE_BINDS, 1);
 }
 
-// from tutorial on interwebz:
 int Engine::addTexture(const char* fname) {
-  GLuint texture;  // This is a handle to our texture object
-  SDL_Surface *surface; // This surface will tell us the details of the image
+  int textureIndex = _reserveTexture(fname);
+  textures[textureIndex].asset = assets.request(ASSET_IMAGE, fname, textureIndex, true);
+
+  return textureIndex;
+}
+
+int Engine::_reserveTexture(const char* name) {
+  // no texture object until the image arrives
+  TextureSlot slot;
+  slot.handle = 0;
+  slot.width  = 0;
+  slot.height = 0;
+  slot.asset  = -1;
+  slot.name   = name;
+
+  textures.push_back(slot);
+  return (int)textures.size() - 1;
+}
+
+// from tutorial on interwebz:
+void Engine::_uploadTexture(int textureIndex, SDL_Surface* surface) {
   GLenum texture_format;
+  GLint  internal_format;
   GLint  nOfColors;
 
-  if ( (surface = IMG_Load(fname)) ) {
-    // Check that the image's width is a power of 2
-    if ( (surface->w & (surface->w - 1)) != 0 ) {
+  // Check that the image's width is a power of 2
+  if ( (surface->w & (surface->w - 1)) != 0 ) {
 //      printf("warning: image.bmp's width is not a power of 2\n");
-    }
+  }
 
-    // Also check if the height is a power of 2
-    if ( (surface->h & (surface->h - 1)) != 0 ) {
+  // Also check if the height is a power of 2
+  if ( (surface->h & (surface->h - 1)) != 0 ) {
 //      printf("warning: image.bmp's height is not a power of 2\n");
-    }
+  }
 
-    // get the number of channels in the SDL surface
-    nOfColors = surface->format->BytesPerPixel;
-    if (nOfColors == 4) {    // contains an alpha channel
-      if (surface->format->Rmask == 0x000000ff)
-        texture_format = GL_RGBA;
-      else
-        texture_format = GL_BGRA;
-    }
-    else if (nOfColors == 3) {    // no alpha channel
-      if (surface->format->Rmask == 0x000000ff)
-        texture_format = GL_RGB;
-      else
-        texture_format = GL_BGR;
-    }
-    else {
-      printf("warning: the image is not truecolor..  this will probably break\n");
-      // this error should not go unhandled
-    }
+  // get the number of channels in the SDL surface
+  nOfColors = surface->format->BytesPerPixel;
+  if (nOfColors == 4) {    // contains an alpha channel
+    internal_format = GL_RGBA8;
+    if (surface->format->Rmask == 0x000000ff)
+      texture_format = GL_RGBA;
+    else
+      texture_format = GL_BGRA;
+  }
+  else if (nOfColors == 3) {    // no alpha channel
+    internal_format = GL_RGB8;
+    if (surface->format->Rmask == 0x000000ff)
+      texture_format = GL_RGB;
+    else
+      texture_format = GL_BGR;
+  }
+  else {
+    printf("warning: the image is not truecolor..  this will probably break\n");
+    // this error should not go unhandled
+  }
+
+#ifdef EMSCRIPTEN
+  // WebGL 1 wants the internal format to be the format
+  internal_format = GL_RGBA;
+  texture_format  = GL_RGBA;
+#endif
+
+  _uploadPixels(textureIndex, surface->w, surface->h,
+                internal_format, texture_format, surface->pixels);
+
+  SDL_FreeSurface( surface );
+}
+
+GLuint Engine::_createTexture(int textureIndex, int width, int height, bool mipmapped) {
+  TextureSlot& slot = textures[textureIndex];
+
+  // Have OpenGL generate a texture object handle for us; one loaded
+  // again lets go of the last
+  GpuResources::release(slot.handle);
+  slot.handle = GpuResources::create(GPU_TEXTURE, slot.name);
+
+  GLuint texture = GpuResources::object(slot.handle);
+  gl_check_errors("glGenTextures");
+
+  // Bind the texture object
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture( GL_TEXTURE_2D, texture );
+  gl_check_errors("glBindTexture");
+
+  // Set the texture's stretching properties; boards and cubes seen from
+  // afar read from the smaller levels rather than shimmering
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                   mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+  gl_check_errors("glTexParameteri");
 
-    // Have OpenGL generate a texture object handle for us
-    glGenTextures( 1, &texture );
-    gl_check_errors("glGenTextures");
+  slot.width  = width;
+  slot.height = height;
 
-    // Bind the texture object
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture( GL_TEXTURE_2D, texture );
-    gl_check_errors("glBindTexture");
+  return texture;
+}
+
+void Engine::_uploadPixels(int textureIndex, int width, int height,
+                           GLint internal_format, GLenum format, const void* pixels) {
+  // loose images get their levels made here; WebGL 1 only makes them
+  // for powers of two
+  bool power_of_two = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+#ifndef EMSCRIPTEN
+  bool mipmapped = power_of_two && glGenerateMipmap != NULL;
+#else
+  bool mipmapped = power_of_two;
+#endif
+
+  _createTexture(textureIndex, width, height, mipmapped);
+
+  // Edit the texture object's image data using the information SDL_Surface gives us
+  glTexImage2D( GL_TEXTURE_2D, 0, internal_format, width, height, 0,
+      format, GL_UNSIGNED_BYTE, pixels );
+  gl_check_errors("glTexImage2D");
+
+  size_t bytes = width * height * (internal_format == GL_RGB8 ? 3 : 4);
+  if (mipmapped) {
+    glGenerateMipmap(GL_TEXTURE_2D);
+    gl_check_errors("glGenerateMipmap");
+    bytes += bytes / 3;
+  }
+  GpuResources::addBytes(textures[textureIndex].handle, bytes);
+}
+
+bool Engine::_uploadKtx(int textureIndex, const Uint8* bytes, size_t size) {
+  TextureImage image;
+  if (!Texture::readKtx(bytes, size, image)) {
+    return false;
+  }
 
-    // Set the texture's stretching properties
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-    gl_check_errors("glTexParameteri");
+  _createTexture(textureIndex, image.level[0].width, image.level[0].height,
+                 image.levels > 1);
+
+  bool compressed = Texture::compressed(image.internal_format);
+  std::vector<Uint8> decoded;
+
+  for (int i = 0; i < image.levels; i++) {
+    const TextureLevel& level = image.level[i];
+
+    if (compressed && _s3tc) {
+      glCompressedTexImage2D(GL_TEXTURE_2D, i, image.internal_format,
+                             level.width, level.height, 0, level.size, level.data);
+      gl_check_errors("glCompressedTexImage2D");
+      GpuResources::addBytes(textures[textureIndex].handle, level.size);
+      continue;
+    }
+
+    const void* pixels = level.data;
+    if (compressed) {
+      // no S3TC here: still the levels, at four times the memory
+      Texture::decompress(image.internal_format, level.data,
+                          level.width, level.height, decoded);
+      pixels = &decoded[0];
+    }
 
-    // Edit the texture object's image data using the information SDL_Surface gives us
 #ifdef EMSCRIPTEN
-    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, surface->w, surface->h, 0,
-        GL_RGBA, GL_UNSIGNED_BYTE, surface->pixels );
+    GLint internal_format = GL_RGBA;
 #else
-    glTexImage2D( GL_TEXTURE_2D, 0, nOfColors, surface->w, surface->h, 0,
-        texture_format, GL_UNSIGNED_BYTE, surface->pixels );
+    GLint internal_format = GL_RGBA8;
 #endif
+    glTexImage2D(GL_TEXTURE_2D, i, internal_format, level.width, level.height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, pixels);
     gl_check_errors("glTexImage2D");
+    GpuResources::addBytes(textures[textureIndex].handle, level.width * level.height * 4);
   }
-  else {
-    printf("SDL could not load texture: %s\n", SDL_GetError());
+
+  return true;
+}
+
+int Engine::addSound(const char* fname, int priority) {
+  int soundIndex = audio.reserveSound(priority);
+  if (soundIndex < 0) {
     return -1;
   }
 
-  // ADD TEXTURE
+  // packed samples only do if the device came out as we asked
+  const ArchiveEntry* entry = archive.find(fname);
+  bool packed = entry && audio.accepts(entry->rate, entry->channels, entry->format);
+
+  assets.request(ASSET_SOUND, fname, soundIndex, packed);
+
+  return soundIndex;
+}
+
+void Engine::_finishAsset(Asset& asset, void* data) {
+  Engine* self = (Engine*)data;
+
+  // straight from the archive mapping, no decoding and no copies
+  if (asset.packed) {
+    const ArchiveEntry* entry = asset.packed;
+
+    switch (asset.type) {
+      case ASSET_IMAGE:
+        if (!self->_uploadKtx(asset.slot, asset.bytes, entry->size)) {
+          printf("%s: not a texture this build can read; run make pack\n", asset.path);
+        }
+        break;
+
+      case ASSET_SOUND:
+        audio.setSound(asset.slot, Mix_QuickLoad_RAW((Uint8*)asset.bytes, entry->size));
+        break;
+
+      case ASSET_MESH:
+        self->_ship_mesh = new Mesh((const float*)asset.bytes, entry->floats,
+                                    (const Uint32*)(asset.bytes + entry->elements_offset),
+                                    entry->elements);
+        break;
+    }
+    return;
+  }
+
+  switch (asset.type) {
+    case ASSET_IMAGE:
+      self->_uploadTexture(asset.slot, asset.surface);
+      break;
+
+    case ASSET_SOUND:
+      audio.setSound(asset.slot, asset.chunk);
+      break;
 
-  if (textures == NULL) {
-    textures = new GLuint[texture_capacity];
-    texture_widths = new int[texture_capacity];
-    texture_heights = new int[texture_capacity];
-    texture_count = 0;
+    case ASSET_MESH:
+      // the ship is the only mesh on disk
+      self->_ship_mesh = new Mesh(*asset.mesh);
+      delete asset.mesh;
+      break;
   }
 
-  if (texture_count == texture_capacity) {
-    GLuint* tmp = textures;
-    int* tmp2 = texture_widths;
-    int* tmp3 = texture_heights;
+  asset.surface = NULL;
+  asset.chunk   = NULL;
+  asset.mesh    = NULL;
+}
+
+// networking
+
+void Engine::runServer(int port) {
+  session.host(port);
+}
+
+void Engine::runClient(char* ipname, int port) {
+  session.join(ipname, port);
+}
+
+void Engine::runSpectator(char* ipname, int port) {
+  spectating = 1;
+  _spectate_target = &player1;
 
-    texture_capacity *= 2;
+  // Spectators are an ordinary client of the relay, they just never talk
+  session.watch(ipname, port);
+}
+
+bool Engine::inLobby() {
+  return session.active() && !session.connected();
+}
 
-    textures = new GLuint[texture_capacity];
-    texture_widths = new int[texture_capacity];
-    texture_heights = new int[texture_capacity];
+void Engine::resumeSession() {
+  // Whatever either side knew of the other's boards may be stale
+  board_sync.reset();
+  remote_board_sync.reset();
+  player1_motion.reset();
+  player2_motion.reset();
 
-    memcpy(textures, tmp, sizeof(GLuint) * texture_count);
-    memcpy(texture_widths, tmp2, sizeof(int) * texture_count);
-    memcpy(texture_heights, tmp3, sizeof(int) * texture_count);
+  // the relay sends spectators a snapshot of its own
+  if (spectating) { return; }
 
-    delete tmp;
-    delete tmp2;
-    delete tmp3;
+  unsigned char payload[MSG_PAYLOAD_MAX];
+  Packet packet(payload, sizeof(payload));
+  writeSnapshot(&player1, packet);
+
+  passPayload(MSG_SNAPSHOT, 0, payload, packet.length());
+}
+
+void Engine::_drawLobby() {
+  useTexture(TEXTURE_BLOCK1);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  RenderSnapshot& scene = _snapshots.front();
+
+  // a row of blocks lighting up in turn while we wait
+  float waiting = scene.lobby_waiting;
+  for (int i = 0; i < 3; i++) {
+    float pulse = 0.5f + 0.5f * sinf(waiting * 4.0f - i * 1.2f);
+
+    _context->setOpacity(0.2f + 0.8f * pulse);
+    drawQuadXY(-80.0f + i * 80.0f, 0.0f, 0.0f, 24.0f, 24.0f);
   }
 
-  textures[texture_count] = texture;
-  texture_widths[texture_count] = surface->w;
-  texture_heights[texture_count] = surface->h;
-  texture_count++;
+  _context->setOpacity(1.0f);
 
-  // Free the SDL_Surface only if it was successfully created
-  if ( surface ) {
-    SDL_FreeSurface( surface );
+  // hosts show the port to give to their opponent
+  if (scene.lobby_port >= 0) {
+    drawInt(scene.lobby_port, 0, -40.0f, -70.0f);
   }
+}
 
-  return 0;
+void Engine::_drawLoading() {
+  if (_loading_shown == 0) {
+    _loading_shown = SDL_GetTicks();
+  }
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  _context->useOrthographic();
+  _context->useProgram(PROGRAM_SPRITE);
+
+  useTexture(TEXTURE_BLOCK1);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  // a block lights up for every tenth of the assets in
+  int lit = (assets.total() > 0) ? assets.done() * 10 / assets.total() : 10;
+  for (int i = 0; i < 10; i++) {
+    _context->setOpacity(i < lit ? 1.0f : 0.2f);
+    drawQuadXY(-180.0f + i * 40.0f, 0.0f, 0.0f, 24.0f, 24.0f);
+  }
+
+  _context->setOpacity(1.0f);
+
+  SDL_GL_SwapBuffers();
 }
 
-// networking
+void Engine::_drawNetgraph() {
+  NetStats& stats = _snapshots.front().net_stats;
 
-void Engine::runServer(int port) {
-#ifndef NO_NETWORK
-  // create a listening TCP socket on port 9999 (server)
+  float left   = -(float)WIDTH  / 2.0f + 20.0f;
+  float bottom = -(float)HEIGHT / 2.0f + 20.0f;
 
-  if(SDLNet_ResolveHost(&ip,NULL,port)==-1) {
-    printf("SDLNet_ResolveHost: %s\n", SDLNet_GetError());
-    return;
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  _context->setOpacity(0.8f);
+
+  // bytes per frame, a pixel per 4 bytes: received above, sent below
+  for (int pass = 0; pass < 2; pass++) {
+    float base = bottom + (pass == 0 ? 110.0f : 0.0f);
+
+    useTexture(pass == 0 ? TEXTURE_BLOCK2 : TEXTURE_BLOCK5);
+
+    // every bar in one draw
+    StreamAllocation bars = _stream.allocate(NETSTATS_HISTORY * QUAD_BYTES, VERTEX_BYTES);
+    if (!bars.data) {
+      break;
+    }
+
+    float* out   = (float*)bars.data;
+    int    drawn = 0;
+    for (int i = 0; i < NETSTATS_HISTORY; i++) {
+      int bytes = (pass == 0) ? stats.historyIn(i) : stats.historyOut(i);
+      if (bytes == 0) { continue; }
+
+      float height = (float)bytes / 4.0f;
+      if (height > 100.0f) { height = 100.0f; }
+
+      out = stream_quad(out, _cube_data, _cube_elements,
+                        left + i * 2.0f, base + height / 2.0f, 0.0f, 1.0f, height / 2.0f);
+      drawn++;
+    }
+
+    drawStream(bars, drawn * 6);
   }
 
-  tcpsock=SDLNet_TCP_Open(&ip);
-  if(!tcpsock) {
-    printf("SDLNet_TCP_Open: %s\n", SDLNet_GetError());
-    return;
+  _context->setOpacity(1.0f);
+
+  // round trip, jitter, input delay (ms) and bytes per second in and out
+  float x = left + NETSTATS_HISTORY * 2.0f + 40.0f;
+
+  int figures[5] = {
+    (int)(stats.smoothedRtt() + 0.5f),
+    (int)(stats.jitter() + 0.5f),
+    (int)(stats.inputDelay() + 0.5f),
+    stats.bytesInPerSecond(),
+    stats.bytesOutPerSecond(),
+  };
+
+  int legend[5] = { TEXTURE_BLOCK1, TEXTURE_BLOCK3, TEXTURE_BLOCK4,
+                    TEXTURE_BLOCK2, TEXTURE_BLOCK5 };
+
+  for (int i = 0; i < 5; i++) {
+    float y = bottom + 200.0f - i * 30.0f;
+
+    useTexture(legend[i]);
+    drawQuadXY(x, y, 0.0f, 6.0f, 6.0f);
+
+    drawInt(figures[i], 0, x + 20.0f, y);
+  }
+}
+
+void Engine::_drawProfiler() {
+  float right  = (float)WIDTH   / 2.0f - 20.0f;
+  float bottom = -(float)HEIGHT / 2.0f + 20.0f;
+  float left   = right - PROFILE_HISTORY * 2.0f;
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  _context->setOpacity(0.8f);
+
+  // frame times, a pixel per quarter millisecond, with a line at 60Hz
+  useTexture(TEXTURE_BLOCK2);
+
+  StreamAllocation bars = _stream.allocate(PROFILE_HISTORY * QUAD_BYTES, VERTEX_BYTES);
+  if (bars.data) {
+    float* out   = (float*)bars.data;
+    int    drawn = 0;
+    for (int i = 0; i < PROFILE_HISTORY; i++) {
+      float height = Profiler::history(i) * 4.0f;
+      if (height == 0.0f) { continue; }
+      if (height > 100.0f) { height = 100.0f; }
+
+      out = stream_quad(out, _cube_data, _cube_elements,
+                        left + i * 2.0f, bottom + height / 2.0f, 0.0f, 1.0f, height / 2.0f);
+      drawn++;
+    }
+
+    drawStream(bars, drawn * 6);
   }
 
-  // WAIT FOR CONNECTION
-  printf("waiting for client to connect...\n");
+  useTexture(TEXTURE_BLOCK7);
+  drawQuadXY(left + PROFILE_HISTORY - 1.0f, bottom + 1000.0f / 60.0f * 4.0f, 0.0f,
+             PROFILE_HISTORY, 0.5f);
+
+  _context->setOpacity(1.0f);
+
+  // columns: frame min, avg, p99 (us); each scope (us); allocations in
+  // each scope; each counter
+  const ProfileFrame& frame = Profiler::last();
+
+  float frame_ms[3];
+  Profiler::frameTimes(frame_ms[0], frame_ms[1], frame_ms[2]);
+
+  int legend[8] = { TEXTURE_BLOCK1, TEXTURE_BLOCK3, TEXTURE_BLOCK4,
+                    TEXTURE_BLOCK5, TEXTURE_BLOCK6, TEXTURE_BLOCK2,
+                    TEXTURE_BLOCK7, TEXTURE_BALL };
 
-  // accept a connection coming in on tcpsock
+  for (int column = 0; column < 4; column++) {
+    float x = left + (column - 1) * 160.0f;
+
+    int rows = column == 0 ? 3 : (column < 3 ? PROFILE_SCOPES : PROFILE_COUNTERS);
+    for (int i = 0; i < rows; i++) {
+      float y = bottom + 350.0f - i * 30.0f;
+
+      int value;
+      if (column == 0) {
+        value = (int)(frame_ms[i] * 1000.0f + 0.5f);
+      }
+      else if (column == 1) {
+        value = (int)(frame.scope_ms[i] * 1000.0f + 0.5f);
+      }
+      else if (column == 2) {
+        value = frame.scope_allocs[i];
+      }
+      else {
+        value = frame.counters[i];
+      }
 
-  for (;;) {
-    client_tcpsock=SDLNet_TCP_Accept(tcpsock);
-    if(client_tcpsock) {
+      useTexture(legend[i]);
+      drawQuadXY(x, y, 0.0f, 6.0f, 6.0f);
+
+      drawInt(value, 0, x + 20.0f, y);
+    }
+  }
+}
+
+// Scenes for --benchmark, each as heavy as a part of the game gets
+#define BENCHMARK_BOARDS     0    // two full boards
+#define BENCHMARK_GAMEOVER   1    // both boards blowing apart
+#define BENCHMARK_FLAMES     2    // both engines as thick as they go
+#define BENCHMARK_ATTACK     3    // both boards turning from an attack
+#define BENCHMARK_WORST      4    // full, turning boards and thick flames
+
+#define BENCHMARK_SCENES     5
+
+#define BENCHMARK_WARMUP     30     // frames drawn before the clock starts
+#define BENCHMARK_QUERIES    4      // frames a GPU time is read behind
+#define BENCHMARK_EXPLOSION  9.0f   // how far the explosion goes, then again
+#define BENCHMARK_FLAME_RATE 0.002f // seconds between flame blocks
+
+static const char* benchmark_scenes[BENCHMARK_SCENES] = {
+  "boards", "gameover", "flames", "attack", "worst"
+};
+
+static float benchmark_percentile(std::vector<float> values, float fraction) {
+  if (values.empty()) {
+    return 0.0f;
+  }
+
+  std::sort(values.begin(), values.end());
+  return values[(size_t)((values.size() - 1) * fraction + 0.5f)];
+}
+
+static float benchmark_mean(const std::vector<float>& values) {
+  if (values.empty()) {
+    return 0.0f;
+  }
+
+  double total = 0.0;
+  for (size_t i = 0; i < values.size(); i++) {
+    total += values[i];
+  }
+  return (float)(total / values.size());
+}
+
+bool Engine::runBenchmark(int frames) {
+  // everything in before the clock starts
+  while (assets.loading()) {
+    assets.pump(ASSETS_MAX);
+    SDL_Delay(1);
+  }
+  _loading = false;
+
+  benchmark = 1;
+
+  // GPU time from timer queries where there are any; otherwise the time
+  // glFinish waits, which is what is left after the CPU is done
+#ifndef EMSCRIPTEN
+  bool timer_query = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+#else
+  bool timer_query = false;
+#endif
+
+  GLuint queries[BENCHMARK_QUERIES];
+  if (timer_query) {
+    glGenQueries(BENCHMARK_QUERIES, queries);
+  }
+
+  printf("benchmark: renderer=\"%s\" version=\"%s\" frames=%d gpu_time=%s\n",
+         (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION),
+         frames, timer_query ? "timer_query" : "finish");
+
+  const float deltatime = 1.0f / 60.0f;
+  bool quit = false;
+
+  for (int scene = 0; scene < BENCHMARK_SCENES && !quit; scene++) {
+    _benchmarkSetup(scene);
+    Profiler::warmUp(BENCHMARK_WARMUP);
+
+    for (int i = 0; i < BENCHMARK_WARMUP; i++) {
+      _benchmarkStep(deltatime);
+      draw();
+      Profiler::frame();
+    }
+    glFinish();
+
+    // room for all of them now, so timed frames do not allocate
+    std::vector<float> frame_ms, cpu_ms, gpu_ms;
+    frame_ms.reserve(frames);
+    cpu_ms.reserve(frames);
+    gpu_ms.reserve(frames);
+    double counters[PROFILE_COUNTERS] = {0};
+
+    Profiler::frame();
+
+    for (int i = 0; i < frames + BENCHMARK_QUERIES && !quit; i++) {
+      int query = i % BENCHMARK_QUERIES;
+
+#ifndef EMSCRIPTEN
+      if (timer_query && i >= BENCHMARK_QUERIES) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &elapsed);
+        gpu_ms.push_back(elapsed / 1e6f);
+      }
+#endif
+
+      // the last few only finish the queries off
+      if (i >= frames) {
+        continue;
+      }
+
+#ifndef EMSCRIPTEN
+      if (timer_query) {
+        glBeginQuery(GL_TIME_ELAPSED, queries[query]);
+      }
+#endif
+
+      _benchmarkStep(deltatime);
+      draw();
+
+#ifndef EMSCRIPTEN
+      if (timer_query) {
+        glEndQuery(GL_TIME_ELAPSED);
+      }
+      else
+#endif
+      {
+        Uint64 start = Profiler::now();
+        glFinish();
+        gpu_ms.push_back((Profiler::now() - start) / 1e6f);
+      }
+
+      Profiler::frame();
+
+      const ProfileFrame& frame = Profiler::last();
+      frame_ms.push_back(frame.frame_ms);
+      cpu_ms.push_back(frame.scope_ms[PROFILE_DRAW]);
+      for (int c = 0; c < PROFILE_COUNTERS; c++) {
+        counters[c] += frame.counters[c];
+      }
+
+      SDL_Event event;
+      while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT ||
+            (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)) {
+          quit = true;
+        }
+      }
+    }
+
+    int count = (int)frame_ms.size();
+    if (count == 0) {
       break;
     }
+
+    float mean = benchmark_mean(frame_ms);
+
+    // cpu is drawing up to the swap; gpu is the GPU's own time for it
+    printf("benchmark: scene=%s frames=%d fps=%.1f frame_ms=%.2f p50=%.2f p90=%.2f p99=%.2f max=%.2f "
+           "cpu_ms=%.2f cpu_p99=%.2f gpu_ms=%.2f gpu_p99=%.2f",
+           benchmark_scenes[scene], count, 1000.0f / mean, mean,
+           benchmark_percentile(frame_ms, 0.5f), benchmark_percentile(frame_ms, 0.9f),
+           benchmark_percentile(frame_ms, 0.99f), benchmark_percentile(frame_ms, 1.0f),
+           benchmark_mean(cpu_ms), benchmark_percentile(cpu_ms, 0.99f),
+           benchmark_mean(gpu_ms), benchmark_percentile(gpu_ms, 0.99f));
+    for (int c = 0; c < PROFILE_COUNTERS; c++) {
+      printf(" %s=%.0f", Profiler::counterName(c), counters[c] / count);
+    }
+    printf("\n");
   }
 
-  network_thread = SDL_CreateThread(thread_func, NULL);
+#ifndef EMSCRIPTEN
+  if (timer_query) {
+    glDeleteQueries(BENCHMARK_QUERIES, queries);
+  }
 #endif
+
+  benchmark = 0;
+  return !quit;
 }
 
-void Engine::runClient(char* ipname, int port) {
-#ifndef NO_NETWORK
-  if(SDLNet_ResolveHost(&ip,ipname,port)==-1) {
-    printf("SDLNet_ResolveHost: %s\n", SDLNet_GetError());
-    return;
+/*
+ * Fills both boards (below the two hidden rows) and sets them as the
+ * scene has them. rand() and the flames are seeded the same every time,
+ * so each run draws the same blocks.
+ */
+void Engine::_benchmarkSetup(int scene) {
+  srand(1);
+
+  game_info* players[2] = { &player1, &player2 };
+  for (int p = 0; p < 2; p++) {
+    game_info* gi = players[p];
+
+    for (int i = 0; i < 10; i++) {
+      for (int j = 0; j < 24; j++) {
+        gi->board[i][j] = (j >= 2 && rand() % 100 < 85) ? (char)(rand() % 7) : -1;
+      }
+    }
+    Zobrist::rebuild(gi);
+
+    gi->state             = scene == BENCHMARK_GAMEOVER ? STATE_GAMEOVER : STATE_TETRIS;
+    gi->curgame           = 0;
+    gi->curpiece          = rand() % 7;
+    gi->curdir            = 1;
+    gi->pos               = 5;
+    gi->fine              = 1.0f;
+    gi->rot               = -BOARD_NORMAL_ROT;
+    gi->rot2              = 0.0f;
+    gi->attacking         = scene == BENCHMARK_ATTACK || scene == BENCHMARK_WORST;
+    gi->attack_rot        = 0.0f;
+    gi->gameover_position = 0.0f;
   }
 
-  client_tcpsock=SDLNet_TCP_Open(&ip);
-  if(!client_tcpsock) {
-    printf("SDLNet_TCP_Open: %s\n", SDLNet_GetError());
-    return;
+  float rate = (scene == BENCHMARK_FLAMES || scene == BENCHMARK_WORST) ?
+               BENCHMARK_FLAME_RATE : FLAME_INTERVAL;
+  _ship_engine_one->setInterval(rate);
+  _ship_engine_two->setInterval(rate);
+  _ship_engine_one->seed(1);
+  _ship_engine_two->seed(2);
+
+  // long enough for the first blocks to burn out: as thick as it gets
+  for (int i = 0; i < 300; i++) {
+    _ship_engine_one->update(1.0f / 60.0f);
+    _ship_engine_two->update(1.0f / 60.0f);
   }
+}
 
-  printf("connected...\n");
+/*
+ * Moves a scene on by a frame. Only what is on show moves: no input,
+ * no falling pieces, so nothing ends the scene.
+ */
+void Engine::_benchmarkStep(float deltatime) {
+  _scrollBackground(deltatime);
 
-  // start a thread
-  // which will receive and receive!!
+  _updateFlames(deltatime);
 
-  network_thread = SDL_CreateThread(thread_func, NULL);
-#endif
+  game_info* players[2] = { &player1, &player2 };
+  for (int p = 0; p < 2; p++) {
+    game_info* gi = players[p];
+
+    if (gi->state == STATE_GAMEOVER) {
+      tetris.update(gi, deltatime);
+      if (gi->gameover_position > BENCHMARK_EXPLOSION) {
+        gi->gameover_position = 0.0f;
+      }
+    }
+
+    if (gi->attacking) {
+      gi->attack_rot = fmodf(gi->attack_rot + TETRIS_ATTACK_ROT_SPEED * deltatime, 360.0f);
+      gi->rot        = -BOARD_NORMAL_ROT + gi->attack_rot;
+    }
+  }
+
+  _publish();
+}
+
+size_t Engine::payloadLength(const unsigned char msg[4]) {
+  switch (msg[0]) {
+    case MSG_SNAPSHOT:
+    case MSG_BOARDSYNC:
+    case MSG_MOTION:
+    case MSG_BOARDHASH:
+      return ((size_t)msg[2] << 8) | (size_t)msg[3];
+  }
+
+  return 0;
 }
 
 void Engine::processMessage(unsigned char msg[4]) {
+  processMessage(msg, NULL, 0);
+}
+
+void Engine::processMessage(unsigned char msg[4], const unsigned char* payload, size_t length) {
   unsigned char msgID = msg[0];
 
   //printf("Msg Recv: %d, %d, %d, %d\n", msgID, msg[1], msg[2], msg[3]);
 
+  relay.capture(RELAY_REMOTE, msg, payload, length);
+
+  if (spectating) {
+    switch (msgID) {
+      case MSG_RELAY_PLAYER:
+        _spectate_target = (msg[1] == RELAY_LOCAL) ? &player1 : &player2;
+        break;
+      case MSG_ATTACK:
+        // the damage arrives as board messages of its own
+        break;
+      case MSG_GAMEOVER:
+        _spectate_target->state = STATE_GAMEOVER;
+        break;
+      default:
+        applyMessage(_spectate_target, msg, payload, length);
+        break;
+    }
+    return;
+  }
+
+  switch (msgID) {
+    case MSG_ATTACK:
+      // ATTACK!!!
+      performAttack(msg[1]);
+      break;
+
+    case MSG_GAMEOVER:
+      inplay = false;
+      displayMessage(STR_YOUWIN);
+      break;
+
+    case MSG_BOARDACK:
+      if (msg[2] & BOARDSYNC_ACK_DESYNC) {
+        // the other half of the report is in the opponent's log
+        Zobrist::dump("desync: our board", &player1);
+      }
+      board_sync.acknowledge(msg[1], msg[2]);
+      break;
+
+    case MSG_BOARDHASH: {
+      Packet packet(payload, length);
+      Uint64 hash = (Uint64)packet.read32() << 32;
+      hash |= (Uint64)packet.read32();
+
+      // only comparable once we hold the board the hash was taken of
+      if (packet.failed() || msg[1] != remote_board_sync.sequence()) {
+        break;
+      }
+
+      if (hash != player2.board_hash) {
+        printf("desync: board %d hashes to %08x%08x remotely\n", msg[1],
+               (unsigned int)(hash >> 32), (unsigned int)hash);
+        Zobrist::dump("desync: their board", &player2);
+
+        passMessage(MSG_BOARDACK, 0, BOARDSYNC_ACK_RESYNC | BOARDSYNC_ACK_DESYNC, 0);
+      }
+      break;
+    }
+
+    case MSG_INPUTECHO:
+      net_stats.inputShown(msg[1], SDL_GetTicks());
+      break;
+
+    default:
+      applyMessage(&player2, msg, payload, length);
+      break;
+  }
+}
+
+void Engine::applyMessage(game_info* gi, unsigned char msg[4], const unsigned char* payload, size_t length) {
+  unsigned char msgID = msg[0];
+
   switch (msgID) {
     case MSG_ADDPIECE: // add piece to tetris Board
       //printf("Msg: ADDPIECE\n");
 
-      tetris.addPiece(&player2, msg[1], msg[2]);
+      tetris.addPiece(gi, msg[1], msg[2]);
       break;
     case MSG_DROPLINE:
-      tetris.dropLine(&player2, msg[1]);
-      break;
-    case MSG_ATTACK:
-      // ATTACK!!!
-      performAttack(msg[1]);
+      tetris.dropLine(gi, msg[1]);
       break;
     case MSG_PUSHUP:
-      tetris.pushUp(&player2, msg[1]);
+      tetris.pushUp(gi, msg[1]);
       break;
     case MSG_ADDBLOCKS_A:
-      tetris.addBlock(&player2, 0, 23, msg[1]);
-      tetris.addBlock(&player2, 1, 23, msg[2]);
-      tetris.addBlock(&player2, 2, 23, msg[3]);
+      tetris.addBlock(gi, 0, 23, msg[1]);
+      tetris.addBlock(gi, 1, 23, msg[2]);
+      tetris.addBlock(gi, 2, 23, msg[3]);
       break;
     case MSG_ADDBLOCKS_B:
-      tetris.addBlock(&player2, 3, 23, msg[1]);
-      tetris.addBlock(&player2, 4, 23, msg[2]);
-      tetris.addBlock(&player2, 5, 23, msg[3]);
+      tetris.addBlock(gi, 3, 23, msg[1]);
+      tetris.addBlock(gi, 4, 23, msg[2]);
+      tetris.addBlock(gi, 5, 23, msg[3]);
       break;
     case MSG_ADDBLOCKS_C:
-      tetris.addBlock(&player2, 6, 23, msg[1]);
-      tetris.addBlock(&player2, 7, 23, msg[2]);
-      tetris.addBlock(&player2, 8, 23, msg[3]);
+      tetris.addBlock(gi, 6, 23, msg[1]);
+      tetris.addBlock(gi, 7, 23, msg[2]);
+      tetris.addBlock(gi, 8, 23, msg[3]);
       break;
     case MSG_ADDBLOCKS_D:
-      tetris.addBlock(&player2, 9, 23, msg[1]);
+      tetris.addBlock(gi, 9, 23, msg[1]);
       break;
     case MSG_ADDBLOCKS2_A:
-      tetris.addBlock(&player2, 0, 22, msg[1]);
-      tetris.addBlock(&player2, 1, 22, msg[2]);
-      tetris.addBlock(&player2, 2, 22, msg[3]);
+      tetris.addBlock(gi, 0, 22, msg[1]);
+      tetris.addBlock(gi, 1, 22, msg[2]);
+      tetris.addBlock(gi, 2, 22, msg[3]);
       break;
     case MSG_ADDBLOCKS2_B:
-      tetris.addBlock(&player2, 3, 22, msg[1]);
-      tetris.addBlock(&player2, 4, 22, msg[2]);
-      tetris.addBlock(&player2, 5, 22, msg[3]);
+      tetris.addBlock(gi, 3, 22, msg[1]);
+      tetris.addBlock(gi, 4, 22, msg[2]);
+      tetris.addBlock(gi, 5, 22, msg[3]);
       break;
     case MSG_ADDBLOCKS2_C:
-      tetris.addBlock(&player2, 6, 22, msg[1]);
-      tetris.addBlock(&player2, 7, 22, msg[2]);
-      tetris.addBlock(&player2, 8, 22, msg[3]);
+      tetris.addBlock(gi, 6, 22, msg[1]);
+      tetris.addBlock(gi, 7, 22, msg[2]);
+      tetris.addBlock(gi, 8, 22, msg[3]);
       break;
     case MSG_ADDBLOCKS2_D:
-      tetris.addBlock(&player2, 9, 22, msg[1]);
+      tetris.addBlock(gi, 9, 22, msg[1]);
       break;
     case MSG_UPDATEPIECE:
-      player2.pos = msg[1];
-      player2.curdir = msg[2];
-      player2.curpiece = msg[3];
+      gi->pos = msg[1];
+      gi->curdir = msg[2];
+      gi->curpiece = msg[3];
       break;
 
     case MSG_UPDATEPIECEY:
-      player2.fine = ((float)msg[1] / 255.0f) * 11.0f;
+      gi->fine = ((float)msg[1] / 255.0f) * 11.0f;
       break;
 
     case MSG_ROT_BOARD:
-      player2.rot = ((float)msg[1] / 255.0f) * 360.0f;
+      gi->rot = ((float)msg[1] / 255.0f) * 360.0f;
       break;
 
     case MSG_CHANGE_STATE:
-      changeState(&player2, msg[1]);
+      // the remote side initializes its own state
+      uninitState(gi);
+      gi->state = msg[1];
+
+      if (gi->state == STATE_BREAKOUT) {
+        gi->curgame = 1;
+      }
+      else if (gi->state == STATE_TETRIS) {
+        gi->curgame = 0;
+      }
       break;
 
     case MSG_ROT_BOARD2:
-      player2.rot2 = ((float)msg[1] / 255.0f) * 180.0f;
+      gi->rot2 = ((float)msg[1] / 255.0f) * 180.0f;
       break;
 
     case MSG_UPDATEBALL:
-      player2.ball_x = ((float)msg[1] / 255.0f) * 20.0f;
-      player2.ball_y = ((float)msg[2] / 255.0f) * 20.0f;
+      gi->ball_x = ((float)msg[1] / 255.0f) * 20.0f;
+      gi->ball_y = ((float)msg[2] / 255.0f) * 20.0f;
       break;
 
     case MSG_UPDATEPADDLE:
-      player2.fine = ((float)msg[1] / 255.0f) * 11.0f;
+      gi->fine = ((float)msg[1] / 255.0f) * 11.0f;
       break;
 
     case MSG_REMOVEBLOCK:
-      player2.board[msg[1]][msg[2]] = -1;
+      tetris.removeBlock(gi, msg[1], msg[2]);
       break;
 
-    case MSG_GAMEOVER:
-      inplay = false;
-      displayMessage(STR_YOUWIN);
+    case MSG_APPENDSCORE:
+      gi->score += ((int)msg[1] * (int)msg[2]);
       break;
 
-    case MSG_APPENDSCORE:
-      player2.score += ((int)msg[1] * (int)msg[2]);
+    case MSG_SNAPSHOT: {
+      Packet packet(payload, length);
+      readSnapshot(gi, packet);
+      break;
+    }
+
+    case MSG_BOARDSYNC: {
+      BoardSync& sync = (gi == &player1) ? board_sync : remote_board_sync;
+      unsigned char seq;
+
+      if (sync.decode(gi, payload, length, &seq)) {
+        // the piece that just landed should not still be seen falling
+        _motionFor(gi).snap();
+
+        passMessage(MSG_BOARDACK, seq, 0, 0);
+      }
+      else {
+        // we are missing the board this update builds on
+        passMessage(MSG_BOARDACK, 0, BOARDSYNC_ACK_RESYNC, 0);
+      }
+      break;
+    }
+
+    case MSG_MOTION: {
+      Packet packet(payload, length);
+      RemoteSample sample;
+
+      if (JitterBuffer::readSample(packet, sample)) {
+        _motionFor(gi).push(sample, SDL_GetTicks());
+      }
       break;
+    }
   }
 }
 
-void Engine::passMessage(unsigned char msgID, unsigned char p1, unsigned char p2, unsigned char p3) {
-#ifndef NO_NETWORK
-  if (!client_tcpsock) { return; }
+JitterBuffer& Engine::_motionFor(game_info* gi) {
+  return (gi == &player1) ? player1_motion : player2_motion;
+}
+
+void Engine::_sendMotion(float deltatime) {
+  _motion_time += deltatime;
+  if (_motion_time < JITTER_SEND_INTERVAL) { return; }
+  _motion_time = 0.0f;
+
+  // nobody is watching us move
+  if (!session.connected() && relay.spectatorCount() == 0) { return; }
 
-  int len,result;
-  char msg[4]={msgID,p1,p2,p3};
+  unsigned char payload[MSG_PAYLOAD_MAX];
+  Packet packet(payload, sizeof(payload));
+  JitterBuffer::writeSample(&player1, SDL_GetTicks(), _input_marker, packet);
 
-  len=(int)strlen(msg)+1; // add one for the terminating NULL
-  result=SDLNet_TCP_Send(client_tcpsock,msg,4);
-  if(result<len) {
-    //printf("SDLNet_TCP_Send: %s\n", SDLNet_GetError());
-    // It may be good to disconnect sock because it is likely invalid now.
+  passPayload(MSG_MOTION, 0, payload, packet.length());
+}
+
+void Engine::_syncBoard(float deltatime) {
+  // nobody is watching our board
+  if (!session.connected() && relay.spectatorCount() == 0) { return; }
+
+  unsigned char payload[MSG_PAYLOAD_MAX];
+  size_t length = board_sync.encode(&player1, deltatime, payload, sizeof(payload));
+
+  if (length > 0) {
+    passPayload(MSG_BOARDSYNC, 0, payload, length);
   }
-#endif
+
+  _checkBoard();
+}
+
+void Engine::_checkBoard() {
+  if (++_hash_ticks < ZOBRIST_CHECK_INTERVAL) { return; }
+  _hash_ticks = 0;
+
+  // spectators have no say in our board, and nothing is synced yet
+  if (!session.connected() || board_sync.sequence() == 0) { return; }
+
+  // sent right behind the board it describes, so the two arrive together
+  unsigned char payload[8];
+  Packet packet(payload, sizeof(payload));
+  packet.write32((Uint32)(player1.board_hash >> 32));
+  packet.write32((Uint32)player1.board_hash);
+
+  passPayload(MSG_BOARDHASH, board_sync.sequence(), payload, packet.length());
+}
+
+void Engine::writeSnapshot(game_info* gi, Packet& packet) {
+  int i, j;
+
+  for (i=0; i<10; i++) {
+    for (j=0; j<24; j++) {
+      packet.write8((unsigned char)gi->board[i][j]);
+    }
+  }
+
+  packet.write8(gi->state);
+  packet.write8(gi->curgame);
+  packet.write8(gi->curpiece);
+  packet.write8(gi->curdir);
+  packet.write8(gi->pos);
+  packet.write8(gi->attacking);
+
+  packet.writeFloat(gi->fine);
+  packet.writeFloat(gi->rot);
+  packet.writeFloat(gi->rot2);
+  packet.writeFloat(gi->attack_rot);
+
+  packet.write32(gi->score);
+  packet.write32(gi->total_lines);
+  packet.write32(gi->state_lines);
+
+  packet.writeFloat(gi->ball_x);
+  packet.writeFloat(gi->ball_y);
+  packet.writeFloat(gi->ball_dx);
+  packet.writeFloat(gi->ball_dy);
+
+  packet.writeFloat(gi->gameover_position);
+}
+
+void Engine::readSnapshot(game_info* gi, Packet& packet) {
+  int i, j;
+
+  for (i=0; i<10; i++) {
+    for (j=0; j<24; j++) {
+      gi->board[i][j] = (char)packet.read8();
+    }
+  }
+
+  gi->state     = packet.read8();
+  gi->curgame   = packet.read8();
+  gi->curpiece  = packet.read8();
+  gi->curdir    = packet.read8();
+  gi->pos       = packet.read8();
+  gi->attacking = packet.read8();
+
+  gi->fine       = packet.readFloat();
+  gi->rot        = packet.readFloat();
+  gi->rot2       = packet.readFloat();
+  gi->attack_rot = packet.readFloat();
+
+  gi->score       = (int)packet.read32();
+  gi->total_lines = (int)packet.read32();
+  gi->state_lines = (int)packet.read32();
+
+  gi->ball_x  = packet.readFloat();
+  gi->ball_y  = packet.readFloat();
+  gi->ball_dx = packet.readFloat();
+  gi->ball_dy = packet.readFloat();
+
+  gi->gameover_position = packet.readFloat();
+
+  Zobrist::rebuild(gi);
+
+  if (packet.failed()) {
+    printf("snapshot: truncated\n");
+  }
+}
+
+void Engine::passMessage(unsigned char msgID, unsigned char p1, unsigned char p2, unsigned char p3) {
+  unsigned char msg[4]={msgID,p1,p2,p3};
+
+  _sendMessage(msg, NULL, 0);
+}
+
+void Engine::passPayload(unsigned char msgID, unsigned char p1, const unsigned char* payload, size_t length) {
+  unsigned char msg[4]={msgID,p1,(unsigned char)(length >> 8),(unsigned char)length};
+
+  _sendMessage(msg, payload, length);
+}
+
+void Engine::_sendMessage(unsigned char msg[4], const unsigned char* payload, size_t length) {
+  // spectators only listen
+  if (spectating) { return; }
+
+  relay.capture(RELAY_LOCAL, msg, payload, length);
+
+  session.send(msg, payload, length);
+}
+
+// what the board rules report
+
+void Rules::playSound(int sound) {
+  engine.audio.playSound(sound);
+}
+
+void Rules::appendScore(unsigned char points, unsigned char times) {
+  engine.passMessage(MSG_APPENDSCORE, points, times, 0);
+}
+
+void Rules::sendAttack(int severity) {
+  engine.sendAttack(severity);
+}
+
+void Rules::gameOver() {
+  engine.gameOver();
 }
 
 // classes
@@ -1069,17 +2298,31 @@ Tetris Engine::tetris = Tetris();
 BreakOut Engine::breakout = BreakOut();
 
 Audio Engine::audio = Audio();
+// before the loader, so it is still there while the loader stops
+JobSystem Engine::jobs;
+AssetLoader Engine::assets;
+Archive Engine::archive;
+FrameArena Engine::frame_arena;
+int Engine::use_archive = 1;
+Relay Engine::relay;
+Session Engine::session;
+NetStats Engine::net_stats;
+
+BoardSync Engine::board_sync;
+BoardSync Engine::remote_board_sync;
+
+JitterBuffer Engine::player1_motion;
+JitterBuffer Engine::player2_motion;
+int Engine::_hash_ticks = 0;
+float Engine::_motion_time = 0.0f;
+unsigned char Engine::_input_marker = 0;
 
 game_info Engine::player2 = {0};
 game_info Engine::player1 = {0};
 
 int Engine::_quit = 0;
 
-GLuint* Engine::textures = NULL;
-int* Engine::texture_widths = NULL;
-int* Engine::texture_heights = NULL;
-int Engine::texture_count = 0;
-int Engine::texture_capacity = 10;
+std::vector<TextureSlot> Engine::textures;
 
 GLfloat Engine::tu[2] = {0.0f, 1.0f};
 GLfloat Engine::tv[2] = {0.0f, 1.0f};
@@ -1098,12 +2341,15 @@ float Engine::bg2y = 0;
 float Engine::bg_tile_opacity = 0.2f;
 bool  Engine::bg_tile_opacity_direction = true;
 
-#ifndef NO_NETWORK
-IPaddress Engine::ip = {0};
-TCPsocket Engine::tcpsock = NULL;
-TCPsocket Engine::client_tcpsock = NULL;
-#endif
-
-SDL_Thread *Engine::network_thread = NULL;
-
 int Engine::inplay = 1;
+
+int Engine::spectating = 0;
+int Engine::show_netgraph = 0;
+int Engine::show_profiler = 0;
+int Engine::benchmark = 0;
+#ifdef EMSCRIPTEN
+int Engine::threaded = 0;
+#else
+int Engine::threaded = 1;
+#endif
+game_info* Engine::_spectate_target = &Engine::player1;
@@ -10,9 +10,43 @@
 #include "breakout.h"
 
 #include "audio.h"
+#include "arena.h"
+#include "stream.h"
+#include "gpu.h"
+#include "assets.h"
+#include "jobs.h"
+#include "relay.h"
+#include "session.h"
+#include "netstats.h"
+#include "boardsync.h"
+#include "jitter.h"
+#include "packet.h"
+#include "snapshot.h"
 
 #include "glm/glm.hpp"
 
+#include <vector>
+
+// Frames drawn of each scene by --benchmark, unless it is given a number
+#define BENCHMARK_FRAMES 300
+
+// Simulation ticks a second, when it has a thread of its own
+#define ENGINE_TICK_RATE 120
+
+// Input events waiting for the simulation thread; a power of two
+#define ENGINE_EVENTS 256
+
+/*
+ * A texture asked for with addTexture, at its index.
+ */
+struct TextureSlot {
+  GpuHandle   handle;   // 0 until the image arrives
+  int         width;
+  int         height;
+  int         asset;    // what it is loaded from
+  const char* name;
+};
+
 class Engine {
 public:
   /*
@@ -35,6 +69,13 @@ public:
    */
   void quit();
 
+  /*
+   * Lets go of what the engine holds on the GPU, before the context
+   * goes, and reports what is left over. Returns the number of GL
+   * objects nobody released.
+   */
+  int shutdown();
+
   /*
    * Starts a multiplayer server which listens.
    */
@@ -45,21 +86,72 @@ public:
    */
   void runClient(char* ip, int port);
 
+  /*
+   * Starts a spectator that watches a match through a relay.
+   */
+  void runSpectator(char* ip, int port);
+
+  /*
+   * Called whenever the peer (re)connects: catch it up on our game.
+   */
+  void resumeSession();
+
+  /*
+   * Whether we are waiting for a peer before there is anything to play.
+   */
+  bool inLobby();
+
   /*
    * Processes a network message.
    */
   void processMessage(unsigned char msg[4]);
+  void processMessage(unsigned char msg[4], const unsigned char* payload, size_t length);
+
+  /*
+   * Applies a message describing the given (remote) player's game.
+   */
+  void applyMessage(game_info* gi, unsigned char msg[4], const unsigned char* payload, size_t length);
 
   /*
    * Sends a network message.
    */
   void passMessage(unsigned char msgID, unsigned char p1, unsigned char p2, unsigned char p3);
 
+  /*
+   * Sends a network message followed by a payload.
+   */
+  void passPayload(unsigned char msgID, unsigned char p1, const unsigned char* payload, size_t length);
+
+  /*
+   * Returns the size of the payload following the given message header.
+   */
+  static size_t payloadLength(const unsigned char msg[4]);
+
+  /*
+   * Serializes the full state of a player's game.
+   */
+  void writeSnapshot(game_info* gi, Packet& packet);
+  void readSnapshot(game_info* gi, Packet& packet);
+
   /*
    * Runs the game loop.
+   *
+   * Once everything is loaded, the game is simulated on a thread of its
+   * own (unless threaded is 0), at ENGINE_TICK_RATE. This thread then
+   * only polls input, which it passes on, and draws the latest
+   * snapshot the simulation published. Single threaded, it does all of
+   * it in turn, once a frame.
    */
   void gameLoop();
 
+  /*
+   * Draws each scripted scene (see engine.cpp) for the given number of
+   * frames, as fast as it can, and prints frame times, CPU and GPU
+   * time, and the draw calls and so on of an average frame. Returns
+   * false if it was stopped.
+   */
+  bool runBenchmark(int frames);
+
   /*
    * Transition the game to the game over state.
    */
@@ -71,6 +163,11 @@ public:
   void update(float deltatime);
   void draw();
 
+  /*
+   * The state of the game being drawn: only this is read while drawing.
+   */
+  RenderSnapshot& drawing();
+
   void drawMesh(int count);
 
   // key processing
@@ -89,6 +186,11 @@ public:
   void drawQuadXY(float x, float y, float z, float w, float h);
   void drawQuad(glm::mat4& model, int side);
 
+  /*
+   * Draws vertices written to the stream buffer, as they are.
+   */
+  void drawStream(StreamAllocation& vertices, int count);
+
   // state
 
   int state;
@@ -107,8 +209,17 @@ public:
   void useTextureUpsideDown(int textureIndex, int startx, int starty, int width, int height);
   void enableTextures();
   void disableTextures();
+  /*
+   * Queues an image for loading; returns its texture index at once.
+   * useTexture waits for it should it be needed before it is ready.
+   */
   int addTexture(const char* fname);
 
+  /*
+   * Queues a sound for loading; returns its sound index at once.
+   */
+  int addSound(const char* fname, int priority);
+
   void sendAttack(int severity);
   void performAttack(int severity);
 
@@ -122,6 +233,27 @@ public:
   static Tetris tetris;
   static BreakOut breakout;
   static Audio audio;
+  // small jobs on every core: flames, asset decoding
+  static JobSystem jobs;
+  static AssetLoader assets;
+  static Archive archive;
+
+  // scratch memory for drawing, good until the frame after next
+  static FrameArena frame_arena;
+
+  // load from assets.pak when there is one
+  static int use_archive;
+  static Relay relay;
+  static Session session;
+  static NetStats net_stats;
+
+  // our board going out, the opponent's coming in
+  static BoardSync board_sync;
+  static BoardSync remote_board_sync;
+
+  // motion of mirrored players, played back smoothly
+  static JitterBuffer player1_motion;
+  static JitterBuffer player2_motion;
 
   static game_info player1;
   static game_info player2;
@@ -130,11 +262,22 @@ public:
 
   static int inplay;
 
-  static GLuint* textures;
-  static int* texture_widths;
-  static int* texture_heights;
-  static int texture_count;
-  static int texture_capacity;
+  // only mirrors the match from a relay, no local player
+  static int spectating;
+
+  // network graph overlay (F3)
+  static int show_netgraph;
+
+  // frame profiler overlay (F2)
+  static int show_profiler;
+
+  // drawing scripted scenes (--benchmark): both boards are shown
+  static int benchmark;
+
+  // simulating on a thread of its own (no with --single-thread)
+  static int threaded;
+
+  static std::vector<TextureSlot> textures;
 
   static GLfloat tu[2];
   static GLfloat tv[2];
@@ -155,26 +298,77 @@ public:
   static float bg_tile_opacity;
   static bool bg_tile_opacity_direction;
 
-  // networking
-
-#ifndef NO_NETWORK
-  static IPaddress ip;
-  static TCPsocket tcpsock;
-  static TCPsocket client_tcpsock;
-#endif
-  static SDL_Thread *network_thread;
-
 private:
+  void _sendMessage(unsigned char msg[4], const unsigned char* payload, size_t length);
+  void _syncBoard(float deltatime);
+  void _checkBoard();
+  void _sendMotion(float deltatime);
+  void _drawLobby();
+  void _updateNetStats(float deltatime);
+  void _drawNetgraph();
+  void _drawProfiler();
+  void _scrollBackground(float deltatime);
+  void _updateFlames(float deltatime);
+  void _publish();
+  void _benchmarkSetup(int scene);
+  void _benchmarkStep(float deltatime);
+  void _drawLoading();
+
+  int  _reserveTexture(const char* name);
+  void _uploadTexture(int textureIndex, SDL_Surface* surface);
+  void _uploadPixels(int textureIndex, int width, int height,
+                     GLint internal_format, GLenum format, const void* pixels);
+  bool _uploadKtx(int textureIndex, const Uint8* bytes, size_t size);
+  GLuint _createTexture(int textureIndex, int width, int height, bool mipmapped);
+  static void _finishAsset(Asset& asset, void* data);
+
+  // until everything asked for in init is loaded
+  bool   _loading;
+  Uint32 _loading_shown;
+
+  // S3TC textures go to GL as they are; without it they are decoded
+  bool   _s3tc;
+
+  static JitterBuffer& _motionFor(game_info* gi);
+
+  // frames since we last sent our board hash
+  static int _hash_ticks;
+
+  // seconds since we last sent our motion
+  static float _motion_time;
+
+  // marker of our latest key press, for measuring input delay
+  static unsigned char _input_marker;
+
+  // game the relay stream is currently describing
+  static game_info* _spectate_target;
+
   // Iterate functions
   bool _iterate();
   static void _c_iterate();
+  bool _handleEvent(const SDL_Event& event);
+
+  // the two halves of the threaded loop
+  bool _render();
+  void _simulate();
+  static int _c_simulate(void* data);
+
+  // what the simulation last published
+  TripleBuffer<RenderSnapshot> _snapshots;
+
+  // input from the main thread to the simulation thread
+  SDL_Event     _events[ENGINE_EVENTS];
+  volatile Uint32 _event_head;
+  volatile Uint32 _event_tail;
 
   Context* _context;
 
   Mesh*    _cube_mesh;
-  Mesh*    _hud_mesh;
   Mesh*    _ship_mesh;
 
+  // HUD figures and graphs, made up as they are drawn
+  StreamBuffer _stream;
+
   Flame*   _ship_engine_one;
   Flame*   _ship_engine_two;
 };
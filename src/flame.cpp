@@ -2,62 +2,73 @@
 
 #include "main.h"
 #include "components.h"
+#include "affine.h"
 
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
-// How fast the flames move
-#define FLAME_SPEED 0.5f
-
-// How fast the flame blocks shrink
-#define FLAME_BURN  0.2f
-
-Flame::Flame(float x, float y, float z)
-  : _position_x(x),
-    _position_y(y),
-    _position_z(z) {
-  _rate = 20;
-  _min_freq = 0.03;
-
-  _rotation_y = 0.0;
-  _rotation_z = 0.0;
-  _rotation_x = 0.0;
-
-  _color = 4;
-
-  _addBlock(0.0f);
-  _addBlock(0.33f);
-  _addBlock(0.66f);
-  _addBlock(1.0f);
-}
-
-void Flame::update(float elapsed) {
-  for (size_t i = 0; i < _blocks.size(); i++) {
-    _updateBlock(elapsed, _blocks[i]);
-
-    if (_blocks[i].size < 0 || _blocks[i].life < 0) {
-      _blocks.erase(_blocks.begin() + i);
-      i--;
+void Flame::draw(Context* context) {
+  // every block placed first, then drawn in order, binding the texture
+  // only when it changes
+  size_t count = _blocks.size();
+  FrameSpan<BlockQuad> quads = engine.frame_arena.span<BlockQuad>(count);
+
+  // every block's spin in one go, three angles to a block, and room for
+  // sinCos to finish its last four
+  size_t spins   = count * 3;
+  float* angles  = engine.frame_arena.allocate<float>(spins + 3);
+  float* sines   = engine.frame_arena.allocate<float>(spins + 3);
+  float* cosines = engine.frame_arena.allocate<float>(spins + 3);
+
+  for (size_t i = 0; i < count; i++) {
+    angles[i * 3 + 0] = _blocks[i].rotx;
+    angles[i * 3 + 1] = _blocks[i].roty;
+    angles[i * 3 + 2] = _blocks[i].rotz;
+  }
+  angles[spins] = angles[spins + 1] = angles[spins + 2] = 0.0f;
+  Affine::sinCos(angles, sines, cosines, spins);
+
+  // blocks keep the ship's heading from when they left it, so runs of
+  // them share one
+  glm::mat4 base;
+  float base_x = 0.0f;
+  float base_y = 0.0f;
+  float base_z = 0.0f;
+
+  for (size_t i = 0; i < count; i++) {
+    BlockInfo& block = _blocks[i];
+
+    if (i == 0 || block.base_rot_x != base_x || block.base_rot_y != base_y ||
+                  block.base_rot_z != base_z) {
+      base_x = block.base_rot_x;
+      base_y = block.base_rot_y;
+      base_z = block.base_rot_z;
+
+      base = glm::mat4(1.0f);
+      Affine::rotateXYZ(base, base_x, base_y, base_z);
     }
+
+    BlockQuad quad;
+    _placeBlock(block, base, sines + i * 3, cosines + i * 3, quad);
+    quads.push(quad);
   }
 
-  _elapsed += elapsed;
+  int texture = -1;
+  for (size_t i = 0; i < quads.size(); i++) {
+    if (quads[i].texture != texture) {
+      texture = quads[i].texture;
+      engine.useTexture(texture);
+    }
 
-  while(_elapsed > _min_freq) {
-    _elapsed -= _min_freq;
-    _addBlock((float)(rand() % 1000) / 1000.0f);
+    context->setOpacity(quads[i].opacity);
+    engine.drawCube(quads[i].model);
   }
-}
 
-void Flame::draw(Context* context) {
-  for (size_t i = 0; i < _blocks.size(); i++) {
-    _drawBlock(context, _blocks[i]);
-  }
+  context->setOpacity(1.0f);
 }
 
-void Flame::_drawBlock(Context* context, BlockInfo& block) {
-  context->setOpacity(block.life);
-
+void Flame::_placeBlock(BlockInfo& block, glm::mat4& base,
+                        const float* sines, const float* cosines, BlockQuad& quad) {
   float _width    = 2.0f;
   float _length   = 7.0f;
   float _size     = 0.1;
@@ -70,72 +81,10 @@ void Flame::_drawBlock(Context* context, BlockInfo& block) {
 
   float scale    = _size * block.size;
 
-  glm::mat4 model = glm::mat4(1.0f);
-  model = glm::rotate(model, block.base_rot_x, glm::vec3(1.0f, 0.0f, 0.0f));
-  model = glm::rotate(model, block.base_rot_y, glm::vec3(0.0f, 1.0f, 0.0f));
-  model = glm::rotate(model, block.base_rot_z, glm::vec3(0.0f, 0.0f, 1.0f));
-  model = glm::translate(model, glm::vec3(position_x, position_y, position_z));
-  model = glm::scale(model, glm::vec3(scale, scale, scale));
-  model = glm::rotate(model, block.rotx, glm::vec3(1.0f, 0.0f, 0.0f));
-  model = glm::rotate(model, block.roty, glm::vec3(0.0f, 1.0f, 0.0f));
-  model = glm::rotate(model, block.rotz, glm::vec3(0.0f, 0.0f, 1.0f));
-
-  engine.useTexture(block.color);
-  engine.drawCube(model);
-
-  context->setOpacity(1.0f);
-}
-
-void Flame::_addBlock(float position) {
-  BlockInfo bi;
-
-  bi.position = position;
-  bi.life = 1.0f;
-
-  bi.rotvx = (float)(rand() % 360);
-  bi.rotvy = (float)(rand() % 360);
-  bi.rotvz = (float)(rand() % 360);
-
-  bi.rotx = 0.0f;
-  bi.roty = 0.0f;
-  bi.rotz = 0.0f;
-
-  bi.start_x = _position_x;
-  bi.start_y = _position_y;
-  bi.start_z = _position_z;
-
-  bi.base_rot_x = _rotation_x;
-  bi.base_rot_y = _rotation_y;
-  bi.base_rot_z = _rotation_z;
-
-  bi.size = 1.0f;
-
-  bi.color = _color;
-
-  _blocks.push_back(bi);
-}
-
-void Flame::_updateBlock(float elapsed, BlockInfo& block) {
-  block.rotx += block.rotvx * elapsed;
-  block.roty += block.rotvy * elapsed;
-  block.rotz += block.rotvz * elapsed;
-
-  block.life -= FLAME_SPEED * elapsed;
-  block.size -= FLAME_BURN  * elapsed;
-}
-
-void Flame::setRotationX(float rotation) {
-  _rotation_x = rotation;
-}
-
-void Flame::setRotationY(float rotation) {
-  _rotation_y = rotation;
-}
-
-void Flame::setRotationZ(float rotation) {
-  _rotation_z = rotation;
-}
+  // base * translate * scale * rotate x, y, z
+  Affine::placeRotated(base, position_x, position_y, position_z, scale,
+                       sines, cosines, quad.model);
 
-void Flame::setColor(int color) {
-  _color = (color + 4) % 7;
+  quad.opacity = block.life;
+  quad.texture = (int)block.color;
 }
@@ -6,6 +6,8 @@
 
 #include <vector>
 
+// Seconds between blocks, normally
+#define FLAME_INTERVAL 0.03f
 
 /*
  *     OO   OO   OO
@@ -34,12 +36,34 @@ public:
    */
   Flame(float x, float y, float z);
 
+  /*
+   * Constructs an empty engine, to copy() another into.
+   */
+  Flame();
+
+  /*
+   * Takes on another engine's blocks and settings. Once it has had the
+   * other's most blocks, it no longer allocates.
+   */
+  void copy(const Flame& flame);
+
   void setRotationX(float rotation);
   void setRotationY(float rotation);
   void setRotationZ(float rotation);
 
   void setColor(int color);
 
+  /*
+   * Sets how often a block is added, in seconds.
+   */
+  void setInterval(float seconds);
+
+  /*
+   * Starts the engine's own random numbers over, so what follows is the
+   * same every time.
+   */
+  void seed(unsigned int seed);
+
   void update(float elapsed);
   void draw(Context* context);
 
@@ -65,9 +89,18 @@ private:
     float base_rot_x;
   };
 
+  // A block as it is drawn this frame
+  struct BlockQuad {
+    glm::mat4 model;
+    float     opacity;
+    int       texture;
+  };
+
   void _addBlock(float position);
   void _updateBlock(float elapsed, BlockInfo& block);
-  void _drawBlock(Context* context, BlockInfo& block);
+  void _placeBlock(BlockInfo& block, glm::mat4& base,
+                   const float* sines, const float* cosines, BlockQuad& quad);
+  unsigned int _rand();
 
   std::vector<BlockInfo> _blocks;
 
@@ -85,6 +118,9 @@ private:
   float _rotation_x;
 
   int   _color;
+
+  // not rand(): engines are updated on different threads at once
+  unsigned int _random;
 };
 
 #endif
@@ -0,0 +1,158 @@
+#include "flame.h"
+
+#include "main.h"
+#include "trace.h"
+
+// How fast the flames move
+#define FLAME_SPEED 0.5f
+
+// How fast the flame blocks shrink
+#define FLAME_BURN  0.2f
+
+Flame::Flame(float x, float y, float z)
+  : _position_x(x),
+    _position_y(y),
+    _position_z(z) {
+  _rate = 20;
+  _elapsed = 0.0f;
+
+  setInterval(FLAME_INTERVAL);
+
+  _rotation_y = 0.0;
+  _rotation_z = 0.0;
+  _rotation_x = 0.0;
+
+  _color = 4;
+
+  _random = (unsigned int)rand();
+
+  _addBlock(0.0f);
+  _addBlock(0.33f);
+  _addBlock(0.66f);
+  _addBlock(1.0f);
+}
+
+Flame::Flame()
+  : _position_x(0.0f),
+    _position_y(0.0f),
+    _position_z(0.0f) {
+  _rate = 20;
+  _min_freq = FLAME_INTERVAL;
+  _elapsed = 0.0f;
+
+  _rotation_y = 0.0;
+  _rotation_z = 0.0;
+  _rotation_x = 0.0;
+
+  _color = 4;
+
+  _random = 1;
+}
+
+void Flame::copy(const Flame& flame) {
+  // assignment keeps our storage when it is big enough
+  _blocks.reserve(flame._blocks.capacity());
+  *this = flame;
+}
+
+void Flame::update(float elapsed) {
+  TRACE_SCOPE("flames");
+
+  // burnt out blocks are dropped by moving the rest down, in order
+  size_t kept = 0;
+  for (size_t i = 0; i < _blocks.size(); i++) {
+    _updateBlock(elapsed, _blocks[i]);
+
+    if (_blocks[i].size < 0 || _blocks[i].life < 0) {
+      continue;
+    }
+
+    if (kept != i) {
+      _blocks[kept] = _blocks[i];
+    }
+    kept++;
+  }
+  _blocks.resize(kept);
+
+  _elapsed += elapsed;
+
+  while(_elapsed > _min_freq) {
+    _elapsed -= _min_freq;
+    _addBlock((float)(_rand() % 1000) / 1000.0f);
+  }
+}
+
+void Flame::_addBlock(float position) {
+  // after a long frame there can be more due than ever burn at once
+  if (_blocks.size() == _blocks.capacity()) {
+    return;
+  }
+
+  BlockInfo bi;
+
+  bi.position = position;
+  bi.life = 1.0f;
+
+  bi.rotvx = (float)(_rand() % 360);
+  bi.rotvy = (float)(_rand() % 360);
+  bi.rotvz = (float)(_rand() % 360);
+
+  bi.rotx = 0.0f;
+  bi.roty = 0.0f;
+  bi.rotz = 0.0f;
+
+  bi.start_x = _position_x;
+  bi.start_y = _position_y;
+  bi.start_z = _position_z;
+
+  bi.base_rot_x = _rotation_x;
+  bi.base_rot_y = _rotation_y;
+  bi.base_rot_z = _rotation_z;
+
+  bi.size = 1.0f;
+
+  bi.color = _color;
+
+  _blocks.push_back(bi);
+}
+
+unsigned int Flame::_rand() {
+  _random = _random * 1103515245u + 12345u;
+  return (_random >> 16) & 0x7fff;
+}
+
+void Flame::_updateBlock(float elapsed, BlockInfo& block) {
+  block.rotx += block.rotvx * elapsed;
+  block.roty += block.rotvy * elapsed;
+  block.rotz += block.rotvz * elapsed;
+
+  block.life -= FLAME_SPEED * elapsed;
+  block.size -= FLAME_BURN  * elapsed;
+}
+
+void Flame::setRotationX(float rotation) {
+  _rotation_x = rotation;
+}
+
+void Flame::setRotationY(float rotation) {
+  _rotation_y = rotation;
+}
+
+void Flame::setRotationZ(float rotation) {
+  _rotation_z = rotation;
+}
+
+void Flame::seed(unsigned int seed) {
+  _random = seed;
+}
+
+void Flame::setInterval(float seconds) {
+  _min_freq = seconds;
+
+  // room for every block alive at once, so none are allocated later
+  _blocks.reserve((size_t)(1.0f / FLAME_SPEED / seconds) + 8);
+}
+
+void Flame::setColor(int color) {
+  _color = (color + 4) % 7;
+}
@@ -0,0 +1,232 @@
+#include "gpu.h"
+
+static const char* kind_names[GPU_KINDS] = {
+  "textures", "buffers", "programs"
+};
+
+GLuint      GpuResources::_object[GPU_RESOURCES];
+Uint16      GpuResources::_generation[GPU_RESOURCES];
+int         GpuResources::_kind[GPU_RESOURCES];
+size_t      GpuResources::_bytes[GPU_RESOURCES];
+const char* GpuResources::_name[GPU_RESOURCES];
+int         GpuResources::_released[GPU_RESOURCES];
+
+int         GpuResources::_free[GPU_RESOURCES];
+int         GpuResources::_free_count = 0;
+int         GpuResources::_used = 0;
+
+int         GpuResources::_pending[GPU_RESOURCES];
+int         GpuResources::_pending_count = 0;
+
+int         GpuResources::_count[GPU_KINDS];
+size_t      GpuResources::_kind_bytes[GPU_KINDS];
+size_t      GpuResources::_kind_peak[GPU_KINDS];
+
+int         GpuResources::_frame = 0;
+size_t      GpuResources::_peak = 0;
+size_t      GpuResources::_budget = GPU_BUDGET;
+bool        GpuResources::_over = false;
+
+static Uint16 next_generation(Uint16 generation) {
+  generation++;
+  return generation == 0 ? 1 : generation;
+}
+
+GpuHandle GpuResources::create(int kind, const char* name) {
+  int slot;
+  if (_free_count > 0) {
+    slot = _free[--_free_count];
+  }
+  else if (_used < GPU_RESOURCES) {
+    slot = _used++;
+  }
+  else {
+    printf("gpu: no slot for %s (%d in use)\n", name, GPU_RESOURCES);
+    return 0;
+  }
+
+  GLuint object = 0;
+  switch (kind) {
+    case GPU_TEXTURE: glGenTextures(1, &object); break;
+    case GPU_BUFFER:  glGenBuffers(1, &object);  break;
+    case GPU_PROGRAM: object = glCreateProgram(); break;
+  }
+
+  if (object == 0) {
+    printf("gpu: could not make %s\n", name);
+    _free[_free_count++] = slot;
+    return 0;
+  }
+
+  _object[slot]     = object;
+  _generation[slot] = next_generation(_generation[slot]);
+  _kind[slot]       = kind;
+  _bytes[slot]      = 0;
+  _name[slot]       = name;
+  _released[slot]   = -1;
+
+  _count[kind]++;
+
+  return ((GpuHandle)_generation[slot] << 16) | (GpuHandle)slot;
+}
+
+void GpuResources::release(GpuHandle handle) {
+  if (object(handle) == 0) {
+    return;
+  }
+
+  int slot = handle & 0xffff;
+
+  // the handle is done with now; the object once nothing uses it
+  _generation[slot] = next_generation(_generation[slot]);
+  _released[slot]   = _frame;
+  _pending[_pending_count++] = slot;
+}
+
+void GpuResources::setBytes(GpuHandle handle, size_t bytes) {
+  if (object(handle) == 0) {
+    return;
+  }
+
+  int slot = handle & 0xffff;
+  int kind = _kind[slot];
+
+  _kind_bytes[kind] -= _bytes[slot];
+  _kind_bytes[kind] += bytes;
+  _bytes[slot] = bytes;
+
+  if (_kind_bytes[kind] > _kind_peak[kind]) {
+    _kind_peak[kind] = _kind_bytes[kind];
+  }
+
+  size_t used = total();
+  if (used > _peak) {
+    _peak = used;
+  }
+}
+
+void GpuResources::addBytes(GpuHandle handle, size_t bytes) {
+  if (object(handle) == 0) {
+    return;
+  }
+
+  setBytes(handle, _bytes[handle & 0xffff] + bytes);
+}
+
+void GpuResources::endFrame() {
+  _frame++;
+
+  // released in order, so the old enough ones come first
+  int done = 0;
+  while (done < _pending_count &&
+         _frame - _released[_pending[done]] >= GPU_RELEASE_FRAMES) {
+    _delete(_pending[done]);
+    done++;
+  }
+
+  if (done > 0) {
+    _pending_count -= done;
+    memmove(_pending, _pending + done, _pending_count * sizeof(int));
+  }
+
+  size_t used = total();
+  if (used > _budget && !_over) {
+    printf("gpu: over budget, %u KB of %u KB\n",
+           (unsigned int)(used / 1024), (unsigned int)(_budget / 1024));
+  }
+  _over = used > _budget;
+}
+
+void GpuResources::setBudget(size_t bytes) {
+  _budget = bytes;
+}
+
+size_t GpuResources::budget() {
+  return _budget;
+}
+
+int GpuResources::count(int kind) {
+  return _count[kind];
+}
+
+size_t GpuResources::bytes(int kind) {
+  return _kind_bytes[kind];
+}
+
+size_t GpuResources::peak(int kind) {
+  return _kind_peak[kind];
+}
+
+size_t GpuResources::peak() {
+  return _peak;
+}
+
+size_t GpuResources::total() {
+  size_t sum = 0;
+  for (int i = 0; i < GPU_KINDS; i++) {
+    sum += _kind_bytes[i];
+  }
+  return sum;
+}
+
+void GpuResources::report() {
+  printf("gpu:");
+  for (int i = 0; i < GPU_KINDS; i++) {
+    printf(" %d %s %u KB (peak %u KB),", _count[i], kind_names[i],
+           (unsigned int)(_kind_bytes[i] / 1024), (unsigned int)(_kind_peak[i] / 1024));
+  }
+  printf(" all %u KB (peak %u KB) of a %u KB budget\n", (unsigned int)(total() / 1024),
+         (unsigned int)(_peak / 1024), (unsigned int)(_budget / 1024));
+}
+
+int GpuResources::shutdown() {
+  report();
+
+  for (int i = 0; i < _pending_count; i++) {
+    _delete(_pending[i]);
+  }
+  _pending_count = 0;
+
+  int leaks = 0;
+  for (int slot = 0; slot < _used; slot++) {
+    if (_object[slot] == 0) {
+      continue;
+    }
+
+    printf("gpu: never released: %s (%s, %u KB)\n", _name[slot], kind_names[_kind[slot]],
+           (unsigned int)(_bytes[slot] / 1024));
+    leaks++;
+
+    _generation[slot] = next_generation(_generation[slot]);
+    _delete(slot);
+  }
+
+  if (leaks > 0) {
+    printf("gpu: %d objects never released\n", leaks);
+  }
+
+  return leaks;
+}
+
+const char* GpuResources::kindName(int kind) {
+  return kind_names[kind];
+}
+
+void GpuResources::_delete(int slot) {
+  int kind = _kind[slot];
+
+  switch (kind) {
+    case GPU_TEXTURE: glDeleteTextures(1, &_object[slot]); break;
+    case GPU_BUFFER:  glDeleteBuffers(1, &_object[slot]);  break;
+    case GPU_PROGRAM: glDeleteProgram(_object[slot]);      break;
+  }
+
+  _count[kind]--;
+  _kind_bytes[kind] -= _bytes[slot];
+
+  _object[slot] = 0;
+  _bytes[slot]  = 0;
+  _name[slot]   = NULL;
+
+  _free[_free_count++] = slot;
+}
@@ -0,0 +1,140 @@
+#ifndef GPU_INCLUDED
+#define GPU_INCLUDED
+
+#include "main.h"
+
+// Kinds of GL object
+#define GPU_TEXTURE 0
+#define GPU_BUFFER  1
+#define GPU_PROGRAM 2
+
+#define GPU_KINDS   3
+
+// GL objects alive (or waiting to be deleted) at once
+#define GPU_RESOURCES 1024
+
+// Frames a released object is kept for, as draws queued with it finish
+#define GPU_RELEASE_FRAMES 2
+
+// Estimated bytes the game should stay under, unless told otherwise
+#define GPU_BUDGET (64 * 1024 * 1024)
+
+/*
+ * A GL object: its slot in the low 16 bits, the slot's generation above.
+ * 0 is no object.
+ */
+typedef Uint32 GpuHandle;
+
+/*
+ * Owns the game's GL textures, buffers and programs, and keeps count of
+ * the memory they take.
+ *
+ * create() makes an object and hands back a handle, which object()
+ * turns into the GL name for as long as it is alive. release() ends it
+ * at once for the handle (object() gives 0 from then on, and the slot
+ * comes back with a new generation, so a handle kept too long never
+ * finds someone else's object) but the GL object itself is deleted
+ * GPU_RELEASE_FRAMES later, once nothing drawn with it is in flight.
+ *
+ * The bytes each object takes are what its owner says it uploaded,
+ * every mip level and so on, counted until the object is deleted. Going
+ * over the budget prints once, until back under. shutdown() prints the
+ * totals and every object never released.
+ *
+ * All on the GL thread.
+ */
+class GpuResources {
+public:
+  /*
+   * Makes a texture, buffer or program (GPU_*). The name is kept, not
+   * copied, for the report: a literal, or something that outlives it.
+   * Returns 0 when every slot is in use.
+   */
+  static GpuHandle create(int kind, const char* name);
+
+  /*
+   * Lets go of the object; deleted GPU_RELEASE_FRAMES frames from now.
+   * Does nothing given 0 or a handle already released.
+   */
+  static void release(GpuHandle handle);
+
+  /*
+   * The GL name of the object, or 0 if the handle is no longer good.
+   */
+  static GLuint object(GpuHandle handle) {
+    int slot = handle & 0xffff;
+    if (handle == 0 || slot >= GPU_RESOURCES ||
+        _generation[slot] != (Uint16)(handle >> 16)) {
+      return 0;
+    }
+    return _object[slot];
+  }
+
+  /*
+   * What the object takes on the GPU, as estimated by the caller.
+   */
+  static void setBytes(GpuHandle handle, size_t bytes);
+  static void addBytes(GpuHandle handle, size_t bytes);
+
+  /*
+   * Ends a frame: deletes what was released long enough ago.
+   */
+  static void endFrame();
+
+  static void   setBudget(size_t bytes);
+  static size_t budget();
+
+  // of a kind (GPU_*) alive now; bytes now and at most
+  static int    count(int kind);
+  static size_t bytes(int kind);
+  static size_t peak(int kind);
+
+  // all kinds together, now and at most
+  static size_t total();
+  static size_t peak();
+
+  /*
+   * Prints the objects and bytes of each kind against the budget.
+   */
+  static void report();
+
+  /*
+   * Reports, then deletes everything: what was released, and then
+   * whatever was not, each of which it prints as a leak. Returns the
+   * number of leaks. Before the GL context goes.
+   */
+  static int shutdown();
+
+  static const char* kindName(int kind);
+
+private:
+  static void _delete(int slot);
+
+  // by slot
+  static GLuint      _object[GPU_RESOURCES];
+  static Uint16      _generation[GPU_RESOURCES];
+  static int         _kind[GPU_RESOURCES];
+  static size_t      _bytes[GPU_RESOURCES];
+  static const char* _name[GPU_RESOURCES];
+  static int         _released[GPU_RESOURCES];   // frame, or -1 if alive
+
+  // slots deleted, to use again; _used have ever been handed out
+  static int         _free[GPU_RESOURCES];
+  static int         _free_count;
+  static int         _used;
+
+  // released, oldest first
+  static int         _pending[GPU_RESOURCES];
+  static int         _pending_count;
+
+  static int         _count[GPU_KINDS];
+  static size_t      _kind_bytes[GPU_KINDS];
+  static size_t      _kind_peak[GPU_KINDS];
+  static size_t      _peak;
+
+  static int         _frame;
+  static size_t      _budget;
+  static bool        _over;
+};
+
+#endif
@@ -0,0 +1,243 @@
+#include "jitter.h"
+
+#include <math.h>
+
+// Jumps larger than this are teleports (new piece, ball reset), not motion
+#define JITTER_MAX_STEP 2.0f
+
+static float lerp(float a, float b, float t) {
+  return a + (b - a) * t;
+}
+
+// Interpolates across 360, the short way round
+static float lerp_angle(float a, float b, float t) {
+  float delta = fmodf(b - a, 360.0f);
+
+  if (delta > 180.0f) {
+    delta -= 360.0f;
+  }
+  else if (delta < -180.0f) {
+    delta += 360.0f;
+  }
+
+  return a + delta * t;
+}
+
+static float lerp_motion(float a, float b, float t) {
+  if (fabsf(b - a) > JITTER_MAX_STEP) {
+    return a;
+  }
+
+  return lerp(a, b, t);
+}
+
+static unsigned short to_angle(float degrees) {
+  float wrapped = fmodf(degrees, 360.0f);
+  if (wrapped < 0.0f) {
+    wrapped += 360.0f;
+  }
+
+  return (unsigned short)((int)(wrapped * FIXED_ANGLE + 0.5f) & 0xffff);
+}
+
+static unsigned short to_position(float value) {
+  return (unsigned short)(short)floorf(value * FIXED_POSITION + 0.5f);
+}
+
+static float from_angle(unsigned short value) {
+  return (float)value / FIXED_ANGLE;
+}
+
+static float from_position(unsigned short value) {
+  return (float)(short)value / FIXED_POSITION;
+}
+
+JitterBuffer::JitterBuffer() {
+  reset();
+}
+
+void JitterBuffer::reset() {
+  _head       = 0;
+  _count      = 0;
+  _offset        = 0;
+  _window_best   = 0;
+  _previous_best = 0;
+  _window_start  = 0;
+  _has_offset    = false;
+
+  _shown_input   = 0;
+  _input_pending = false;
+}
+
+RemoteSample& JitterBuffer::_at(int index) {
+  return _samples[(_head + index) % JITTER_SAMPLES];
+}
+
+void JitterBuffer::push(const RemoteSample& sample, Uint32 now) {
+  // Stale or duplicate samples are of no use
+  if (_count > 0 && (Sint32)(sample.time - _at(_count - 1).time) <= 0) {
+    return;
+  }
+
+  Sint32 offset = (Sint32)(sample.time - now);
+  if (!_has_offset) {
+    _window_best   = offset;
+    _previous_best = offset;
+    _window_start  = now;
+    _has_offset    = true;
+  }
+
+  // A sample only counts for two windows, so an early one can't hold the
+  // estimate forever when the clocks drift or the route gets slower
+  if ((Sint32)(now - _window_start) >= JITTER_OFFSET_WINDOW) {
+    _previous_best = _window_best;
+    _window_best   = offset;
+    _window_start  = now;
+  }
+  else if (offset > _window_best) {
+    _window_best = offset;
+  }
+
+  _offset = _window_best > _previous_best ? _window_best : _previous_best;
+
+  if (_count == JITTER_SAMPLES) {
+    _head = (_head + 1) % JITTER_SAMPLES;
+    _count--;
+  }
+
+  _at(_count) = sample;
+  _count++;
+}
+
+int JitterBuffer::depth() {
+  return _count;
+}
+
+bool JitterBuffer::shownInput(unsigned char* input) {
+  if (!_input_pending) {
+    return false;
+  }
+
+  _input_pending = false;
+  *input = _shown_input;
+  return true;
+}
+
+void JitterBuffer::snap() {
+  if (_count > 0) {
+    _head  = (_head + _count - 1) % JITTER_SAMPLES;
+    _count = 1;
+  }
+}
+
+bool JitterBuffer::apply(game_info* gi, Uint32 now) {
+  if (_count == 0) {
+    return false;
+  }
+
+  Uint32 time = now + _offset - JITTER_DELAY;
+
+  // Drop samples we have already played past, but keep one behind us
+  while (_count > 1 && (Sint32)(_at(1).time - time) <= 0) {
+    _head = (_head + 1) % JITTER_SAMPLES;
+    _count--;
+  }
+
+  RemoteSample& a = _at(0);
+
+  if (a.input != _shown_input) {
+    _shown_input   = a.input;
+    _input_pending = true;
+  }
+
+  gi->curpiece = a.curpiece;
+  gi->curdir   = a.curdir;
+  gi->pos      = a.pos;
+
+  if (_count > 1 && (Sint32)(time - a.time) > 0) {
+    RemoteSample& b = _at(1);
+
+    float t = (float)(Sint32)(time - a.time) / (float)(Sint32)(b.time - a.time);
+
+    // A new piece (or rotation) is a different shape, don't slide into it
+    bool same_piece = a.curpiece == b.curpiece && a.pos == b.pos &&
+                      a.curdir == b.curdir;
+
+    gi->fine    = same_piece ? lerp_motion(a.fine, b.fine, t) : a.fine;
+    gi->rot     = lerp_angle(a.rot, b.rot, t);
+    gi->rot2    = lerp(a.rot2, b.rot2, t);
+    gi->ball_x  = lerp_motion(a.ball_x, b.ball_x, t);
+    gi->ball_y  = lerp_motion(a.ball_y, b.ball_y, t);
+    gi->ball_dx = b.ball_dx;
+    gi->ball_dy = b.ball_dy;
+
+    return true;
+  }
+
+  gi->fine    = a.fine;
+  gi->rot     = a.rot;
+  gi->rot2    = a.rot2;
+  gi->ball_dx = a.ball_dx;
+  gi->ball_dy = a.ball_dy;
+
+  // Ran dry: dead reckon the ball for a little while
+  Sint32 ahead = (Sint32)(time - a.time);
+  if (ahead < 0) {
+    ahead = 0;
+  }
+  if (ahead > JITTER_EXTRAPOLATE) {
+    ahead = JITTER_EXTRAPOLATE;
+  }
+
+  float dt = (float)ahead / 1000.0f;
+
+  gi->ball_x = a.ball_x + a.ball_dx * dt;
+  gi->ball_y = a.ball_y + a.ball_dy * dt;
+
+  // The walls of the breakout board
+  if (gi->ball_x < 0.0f) { gi->ball_x = 0.0f; }
+  if (gi->ball_x > 4.5f) { gi->ball_x = 4.5f; }
+  if (gi->ball_y < 0.5f) { gi->ball_y = 0.5f; }
+  if (gi->ball_y > 11.75f) { gi->ball_y = 11.75f; }
+
+  return true;
+}
+
+void JitterBuffer::writeSample(game_info* gi, Uint32 time, unsigned char input,
+                               Packet& packet) {
+  packet.write32(time);
+  packet.write8(input);
+
+  packet.write8((unsigned char)gi->curpiece);
+  packet.write8((unsigned char)gi->curdir);
+  packet.write8((unsigned char)gi->pos);
+
+  packet.write16(to_position(gi->fine));
+  packet.write16(to_angle(gi->rot));
+  packet.write16(to_angle(gi->rot2));
+
+  packet.write16(to_position(gi->ball_x));
+  packet.write16(to_position(gi->ball_y));
+  packet.write16(to_position(gi->ball_dx));
+  packet.write16(to_position(gi->ball_dy));
+}
+
+bool JitterBuffer::readSample(Packet& packet, RemoteSample& sample) {
+  sample.time  = packet.read32();
+  sample.input = packet.read8();
+
+  sample.curpiece = packet.read8();
+  sample.curdir   = packet.read8();
+  sample.pos      = packet.read8();
+
+  sample.fine = from_position(packet.read16());
+  sample.rot  = from_angle(packet.read16());
+  sample.rot2 = from_angle(packet.read16());
+
+  sample.ball_x  = from_position(packet.read16());
+  sample.ball_y  = from_position(packet.read16());
+  sample.ball_dx = from_position(packet.read16());
+  sample.ball_dy = from_position(packet.read16());
+
+  return !packet.failed();
+}
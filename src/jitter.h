@@ -0,0 +1,123 @@
+#ifndef JITTER_INCLUDED
+#define JITTER_INCLUDED
+
+#include "main.h"
+#include "packet.h"
+
+// Seconds between motion updates we send
+#define JITTER_SEND_INTERVAL 0.05f
+
+// Samples kept per remote player
+#define JITTER_SAMPLES 32
+
+// How far behind the newest sample we render (ms)
+#define JITTER_DELAY 90
+
+// How long the ball may be extrapolated past the newest sample (ms)
+#define JITTER_EXTRAPOLATE 250
+
+// The clock estimate goes by the least delayed sample of the last two
+// windows this long (ms), so it follows drift and a slower route
+#define JITTER_OFFSET_WINDOW 2000
+
+// Fixed point scales on the wire
+#define FIXED_POSITION 1024.0f
+#define FIXED_ANGLE    (65536.0f / 360.0f)
+
+/*
+ * A moment of a remote player's motion, as sent in MSG_MOTION.
+ */
+struct RemoteSample {
+  Uint32 time;      // sender's clock, ms
+
+  unsigned char input;  // marker of the sender's latest key press
+
+  int    curpiece;
+  int    curdir;
+  int    pos;
+
+  float  fine;
+  float  rot;
+  float  rot2;
+
+  float  ball_x;
+  float  ball_y;
+  float  ball_dx;
+  float  ball_dy;
+};
+
+/*
+ * Buffers a remote player's motion samples and plays them back smoothly.
+ *
+ * Samples are rendered a fixed delay behind the sender's clock so there
+ * is (almost) always a pair to interpolate between. When the buffer runs
+ * dry the ball keeps moving along its velocity for a short while.
+ */
+class JitterBuffer {
+public:
+  JitterBuffer();
+
+  /*
+   * Drops all samples and the clock estimate.
+   */
+  void reset();
+
+  /*
+   * Adds a received sample. Now is the local clock on arrival.
+   */
+  void push(const RemoteSample& sample, Uint32 now);
+
+  /*
+   * Jumps to the newest sample, when something discrete (like the board)
+   * changed and the motion should catch up with it.
+   */
+  void snap();
+
+  /*
+   * Writes the remote player's motion at local time now into the game.
+   * Returns false if there is nothing to play back yet.
+   */
+  bool apply(game_info* gi, Uint32 now);
+
+  /*
+   * Samples waiting to be played back.
+   */
+  int depth();
+
+  /*
+   * True, once, when apply() first showed a sample with a new input
+   * marker; the marker is written to input.
+   */
+  bool shownInput(unsigned char* input);
+
+  /*
+   * Encodes the local player's motion.
+   */
+  static void writeSample(game_info* gi, Uint32 time, unsigned char input,
+                          Packet& packet);
+
+  /*
+   * Decodes a sample; false if the payload was short.
+   */
+  static bool readSample(Packet& packet, RemoteSample& sample);
+
+private:
+  RemoteSample& _at(int index);
+
+  RemoteSample _samples[JITTER_SAMPLES];
+  int          _head;
+  int          _count;
+
+  // sender clock minus our clock, for the least delayed recent sample:
+  // the best of this window and of the one before it
+  Sint32       _offset;
+  Sint32       _window_best;
+  Sint32       _previous_best;
+  Uint32       _window_start;
+  bool         _has_offset;
+
+  unsigned char _shown_input;
+  bool          _input_pending;
+};
+
+#endif
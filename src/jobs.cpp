@@ -0,0 +1,295 @@
+#include "jobs.h"
+
+#include "profiler.h"
+#include "trace.h"
+
+#if defined(WIN32)
+#include <windows.h>
+#elif !defined(EMSCRIPTEN)
+#include <unistd.h>
+#endif
+
+// the system and queue of the calling thread (see attach())
+static __thread JobSystem* job_system = NULL;
+static __thread int        job_queue  = -1;
+
+JobQueue::JobQueue() {
+  clear();
+}
+
+void JobQueue::clear() {
+  _top    = 0;
+  _bottom = 0;
+}
+
+bool JobQueue::push(Job* job) {
+  int bottom = __atomic_load_n(&_bottom, __ATOMIC_RELAXED);
+  int top    = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+
+  if (bottom - top >= JOBS_MAX) {
+    return false;
+  }
+
+  __atomic_store_n(&_jobs[bottom & (JOBS_MAX - 1)], job, __ATOMIC_RELAXED);
+  __atomic_store_n(&_bottom, bottom + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+Job* JobQueue::pop() {
+  int bottom = __atomic_load_n(&_bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&_bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int top = __atomic_load_n(&_top, __ATOMIC_RELAXED);
+
+  if (top > bottom) {
+    // empty
+    __atomic_store_n(&_bottom, bottom + 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  Job* job = __atomic_load_n(&_jobs[bottom & (JOBS_MAX - 1)], __ATOMIC_RELAXED);
+
+  if (top == bottom) {
+    // the last one: a thief may be after it too
+    if (!__atomic_compare_exchange_n(&_top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      job = NULL;
+    }
+    __atomic_store_n(&_bottom, bottom + 1, __ATOMIC_RELAXED);
+  }
+
+  return job;
+}
+
+Job* JobQueue::steal() {
+  int top = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int bottom = __atomic_load_n(&_bottom, __ATOMIC_ACQUIRE);
+
+  if (top >= bottom) {
+    return NULL;
+  }
+
+  Job* job = __atomic_load_n(&_jobs[top & (JOBS_MAX - 1)], __ATOMIC_RELAXED);
+
+  // lost to the owner or another thief
+  if (!__atomic_compare_exchange_n(&_top, &top, top + 1, false,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+
+  return job;
+}
+
+JobSystem::JobSystem()
+  : _attached(0),
+    _workers(0),
+    _wake(NULL),
+    _running(0) {
+}
+
+JobSystem::~JobSystem() {
+  stop();
+}
+
+void JobSystem::start(int workers) {
+#ifdef EMSCRIPTEN
+  workers = 0;
+#endif
+
+  // room for this thread and one more to attach
+  if (workers > JOBS_THREADS - 2) {
+    workers = JOBS_THREADS - 2;
+  }
+  if (workers < 0) {
+    workers = 0;
+  }
+
+  // every queue empty before anyone can look in one
+  for (int i = 0; i < JOBS_THREADS; i++) {
+    _queues[i].clear();
+    _created[i] = 0;
+  }
+
+  _attached = 0;
+  attach();
+
+  if (workers == 0) {
+    return;
+  }
+
+  _wake    = SDL_CreateSemaphore(0);
+  _running = 1;
+
+  for (int i = 0; i < workers; i++) {
+    SDL_Thread* thread = SDL_CreateThread(_worker, this);
+    if (!thread) {
+      printf("jobs: cannot start a worker: %s\n", SDL_GetError());
+      break;
+    }
+
+    _threads[_workers++] = thread;
+  }
+}
+
+void JobSystem::stop() {
+  if (!_wake) {
+    return;
+  }
+
+  __atomic_store_n(&_running, 0, __ATOMIC_RELEASE);
+  for (int i = 0; i < _workers; i++) {
+    SDL_SemPost(_wake);
+  }
+
+  for (int i = 0; i < _workers; i++) {
+    SDL_WaitThread(_threads[i], NULL);
+  }
+  _workers = 0;
+
+  SDL_DestroySemaphore(_wake);
+  _wake = NULL;
+}
+
+void JobSystem::attach() {
+  int index = __sync_fetch_and_add(&_attached, 1);
+  if (index >= JOBS_THREADS) {
+    printf("jobs: no queue left for another thread; its jobs run as they come\n");
+    return;
+  }
+
+  job_system = this;
+  job_queue  = index;
+}
+
+Job* JobSystem::create(JobFunction function, void* data, Job* parent) {
+  static __thread Job spare;
+
+  Job* job;
+  if (job_system == this) {
+    job = &_jobs[job_queue][_created[job_queue]++ & (JOBS_MAX - 1)];
+  }
+  else {
+    // no queue, so it will be run at once: one at a time is enough
+    job = &spare;
+  }
+
+  job->function   = function;
+  job->data       = data;
+  job->parent     = parent;
+  job->unfinished = 1;
+
+  if (parent) {
+    __sync_fetch_and_add(&parent->unfinished, 1);
+  }
+
+  return job;
+}
+
+void JobSystem::run(Job* job) {
+  if (job_system != this || !_queues[job_queue].push(job)) {
+    _execute(job);
+    return;
+  }
+
+  if (_wake) {
+    SDL_SemPost(_wake);
+  }
+}
+
+void JobSystem::wait(Job* job) {
+  while (__atomic_load_n(&job->unfinished, __ATOMIC_ACQUIRE) > 0) {
+    Job* next = _next();
+    if (next) {
+      _execute(next);
+    }
+    else {
+      // what is left is running elsewhere
+      SDL_Delay(0);
+    }
+  }
+}
+
+int JobSystem::workers() {
+  return _workers;
+}
+
+int JobSystem::cores() {
+#if defined(WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#elif defined(EMSCRIPTEN)
+  return 1;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+#endif
+}
+
+int JobSystem::_worker(void* data) {
+  ((JobSystem*)data)->_work();
+  return 0;
+}
+
+void JobSystem::_work() {
+  TRACE_THREAD("jobs");
+  Profiler::track();
+
+  attach();
+
+  while (__atomic_load_n(&_running, __ATOMIC_ACQUIRE)) {
+    Job* job = _next();
+    if (job) {
+      _execute(job);
+    }
+    else {
+      SDL_SemWait(_wake);
+    }
+  }
+
+  TRACE_THREAD_END();
+}
+
+Job* JobSystem::_next() {
+  if (job_system != this) {
+    return NULL;
+  }
+
+  Job* job = _queues[job_queue].pop();
+  if (job) {
+    return job;
+  }
+
+  // the oldest of someone else's, starting with the next thread along
+  int count = __atomic_load_n(&_attached, __ATOMIC_ACQUIRE);
+  if (count > JOBS_THREADS) {
+    count = JOBS_THREADS;
+  }
+
+  for (int i = 1; i < count; i++) {
+    job = _queues[(job_queue + i) % count].steal();
+    if (job) {
+      return job;
+    }
+  }
+
+  return NULL;
+}
+
+void JobSystem::_execute(Job* job) {
+  if (job->function) {
+    job->function(job->data);
+  }
+
+  _finish(job);
+}
+
+void JobSystem::_finish(Job* job) {
+  // once it is done it may be reused at once, so read this first
+  Job* parent = job->parent;
+
+  if (__sync_sub_and_fetch(&job->unfinished, 1) == 0 && parent) {
+    _finish(parent);
+  }
+}
@@ -0,0 +1,131 @@
+#ifndef JOBS_INCLUDED
+#define JOBS_INCLUDED
+
+#include "main.h"
+
+// Threads with a queue: the workers, and the main and simulation threads
+#define JOBS_THREADS 16
+
+// Jobs a thread can have on the go at once; a power of two
+#define JOBS_MAX 1024
+
+typedef void (*JobFunction)(void* data);
+
+struct Job {
+  JobFunction function;   // may be NULL, to only gather children
+  void*       data;
+  Job*        parent;
+
+  // itself and its children not yet done
+  int         unfinished;
+};
+
+/*
+ * A thread's jobs, as a Chase-Lev deque: the owner pushes and pops at
+ * the bottom, newest first; other threads steal from the top, oldest
+ * first.
+ */
+class JobQueue {
+public:
+  JobQueue();
+
+  void clear();
+
+  // the owner's; false if it is full
+  bool push(Job* job);
+  Job* pop();
+
+  // anyone's
+  Job* steal();
+
+private:
+  Job* _jobs[JOBS_MAX];
+
+  int  _top;
+  int  _bottom;
+};
+
+/*
+ * Runs small jobs on every core.
+ *
+ * Each thread that makes jobs has a queue of its own: the thread that
+ * called start() and any that attach(). run() puts a job on the calling
+ * thread's queue; idle workers take from there (and from each other)
+ * when their own are empty. wait() runs jobs, its own first, until the
+ * one waited on is done, so waiting is never wasted and never blocks on
+ * a worker that is asleep.
+ *
+ * A job created with a parent keeps it from finishing until the child
+ * has, so waiting on the parent waits on all of them. Jobs come from a
+ * ring per thread and are reused after JOBS_MAX more: a job must be done
+ * with by then.
+ *
+ * With no workers (or no threads, in the browser) all of it runs in
+ * wait(), in turn.
+ */
+class JobSystem {
+public:
+  JobSystem();
+  ~JobSystem();
+
+  /*
+   * Starts the given number of workers; the calling thread gets the
+   * first queue.
+   */
+  void start(int workers);
+
+  /*
+   * Stops the workers once they finish what they are running. Jobs not
+   * yet started are dropped.
+   */
+  void stop();
+
+  /*
+   * Gives the calling thread a queue, so it can run and wait on jobs.
+   */
+  void attach();
+
+  /*
+   * A job to run() (or to give children, then run()). A parent is done
+   * once it has run and all its children are done.
+   */
+  Job* create(JobFunction function, void* data, Job* parent = NULL);
+
+  /*
+   * Queues the job; it runs right here if this thread has no queue or
+   * its queue is full.
+   */
+  void run(Job* job);
+
+  /*
+   * Runs jobs until this one is done.
+   */
+  void wait(Job* job);
+
+  int workers();
+
+  /*
+   * Cores the machine has, or 1 if it does not say.
+   */
+  static int cores();
+
+private:
+  static int _worker(void* data);
+  void _work();
+  Job* _next();
+  void _execute(Job* job);
+  void _finish(Job* job);
+
+  JobQueue    _queues[JOBS_THREADS];
+  Job         _jobs[JOBS_THREADS][JOBS_MAX];
+  Uint32      _created[JOBS_THREADS];
+  int         _attached;
+
+  SDL_Thread* _threads[JOBS_THREADS];
+  int         _workers;
+
+  SDL_sem*    _wake;          // posted for every job queued
+  int         _running;
+};
+
+#endif
@@ -2,6 +2,8 @@
 #include "main.h"
 
 #include "components.h"
+#include "profiler.h"
+#include "trace.h"
 
 const char* strings[] = {
   "ATTACK",
@@ -13,13 +15,28 @@ const char* strings[] = {
   "YOU SURVIVED",
 };
 
+// whether --alloc-check found frames that allocated
+static bool main_allocated() {
+  int failures = Profiler::allocationFailures();
+  if (failures) {
+    printf("alloc: %d frames allocated after warm-up\n", failures);
+  }
+  return failures != 0;
+}
+
 int main(int argc, char** argv) {
   int port;
   int isServer = 0;
+  int isSpectator = 0;
+  int relayPort = 0;
   char* ip=NULL;
+  char* netsim=NULL;
+  int audioBuffer=0;
+  char* traceFile=NULL;
+  int benchmarkFrames=0;
 
-  SDL_Init(SDL_INIT_EVERYTHING);
-  SDL_WM_SetCaption("OMGWTFADD", NULL);
+  TRACE_THREAD("main");
+  Profiler::track();
 
   if (argc > 1) {
     int i;
@@ -34,6 +51,77 @@ int main(int argc, char** argv) {
         printf("hosting...\n");
         isServer = 1;
       }
+      else if (strcmp(argv[i], "-w") == 0) {
+        printf("spectating...\n");
+        isSpectator = 1;
+      }
+      else if (strcmp(argv[i], "-r") == 0) {
+        i++;
+        if (i==argc) {break;}
+
+        relayPort = atoi(argv[i]);
+      }
+      else if (strcmp(argv[i], "--netsim") == 0) {
+        i++;
+        if (i==argc) {break;}
+
+        netsim = argv[i];
+      }
+      else if (strcmp(argv[i], "--no-pack") == 0) {
+        // load the loose files even if there is an assets.pak
+        engine.use_archive = 0;
+      }
+      else if (strcmp(argv[i], "--single-thread") == 0) {
+        // simulate and draw in turn on one thread
+        engine.threaded = 0;
+      }
+      else if (strcmp(argv[i], "--audio-buffer") == 0) {
+        i++;
+        if (i==argc) {break;}
+
+        audioBuffer = atoi(argv[i]);
+      }
+      else if (strcmp(argv[i], "--profile") == 0) {
+        i++;
+        if (i==argc) {break;}
+
+        // per-frame timings and counters, written out on exit
+        Profiler::record(argv[i]);
+      }
+      else if (strcmp(argv[i], "--trace") == 0) {
+        i++;
+        if (i==argc) {break;}
+
+#ifdef ENABLE_TRACE
+        traceFile = argv[i];
+#else
+        printf("--trace needs a build with -DENABLE_TRACE\n");
+#endif
+      }
+      else if (strcmp(argv[i], "--gpu-budget") == 0) {
+        i++;
+        if (i==argc) {break;}
+
+        // megabytes of textures, buffers and programs before it warns
+        GpuResources::setBudget((size_t)atoi(argv[i]) * 1024 * 1024);
+      }
+      else if (strcmp(argv[i], "--alloc-check") == 0) {
+        // fail if a frame allocates after the first few, e.g. --alloc-check 600
+        int warmup = PROFILE_ALLOC_WARMUP;
+        if (i+1 < argc && atoi(argv[i+1]) > 0) {
+          i++;
+          warmup = atoi(argv[i]);
+        }
+        Profiler::checkAllocations(warmup);
+      }
+      else if (strcmp(argv[i], "--benchmark") == 0) {
+        // scripted scenes, e.g. --benchmark 600 for frames per scene
+        benchmarkFrames = BENCHMARK_FRAMES;
+        if (i+1 < argc && atoi(argv[i+1]) > 0) {
+          i++;
+          benchmarkFrames = atoi(argv[i]);
+        }
+      }
       else {
         ip = argv[i];
       }
@@ -44,37 +132,96 @@ int main(int argc, char** argv) {
       printf("Invalid Parameters, ignoring ip\n");
     }
 
+    if (isSpectator && (isServer || relayPort)) {
+      // spectators neither host nor relay
+      printf("Invalid Parameters, ignoring -s and -r\n");
+      isServer = 0;
+      relayPort = 0;
+    }
+
 #ifndef NO_NETWORK
     if(SDLNet_Init()==-1) {
       printf("SDLNet_Init: %s\n", SDLNet_GetError());
       return -1;
     }
+#endif
+  }
 
-    if (isServer==0) {
-      printf("connecting to port %d\n", port);
-      printf("connecting to %s\n", ip);
-
-      // Try to make a connection
-      engine.runClient(ip, port);
-    }
-    else {
-      engine.runServer(port);
+  if (benchmarkFrames) {
+    // no waiting for vblank (Mesa, NVIDIA) and nothing to hear
+    SDL_putenv((char*)"vblank_mode=0");
+    SDL_putenv((char*)"__GL_SYNC_TO_VBLANK=0");
+    if (!SDL_getenv("SDL_AUDIODRIVER")) {
+      SDL_putenv((char*)"SDL_AUDIODRIVER=dummy");
     }
-#endif
   }
 
+  SDL_Init(SDL_INIT_EVERYTHING);
+  SDL_WM_SetCaption("OMGWTFADD", NULL);
+
   // Create a double-buffered draw context
   SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+  if (benchmarkFrames) {
+    SDL_GL_SetAttribute(SDL_GL_SWAP_CONTROL, 0);
+  }
 
   SDL_SetVideoMode(WIDTH, HEIGHT, 0, SDL_OPENGL);// | SDL_FULLSCREEN);
 
+  if (audioBuffer) {
+    engine.audio.setBufferFrames(audioBuffer);
+  }
+
   engine.init();
 
+#ifndef EMSCRIPTEN
+  if (benchmarkFrames) {
+    bool finished = engine.runBenchmark(benchmarkFrames);
+
+    Profiler::finish();
+    int leaks = engine.shutdown();
+    SDL_Quit();
+    return (finished && !main_allocated() && leaks == 0) ? 0 : 1;
+  }
+#endif
+
+#ifndef NO_NETWORK
+  // Simulated bad link, e.g. --netsim latency=80,jitter=20,loss=0.01,seed=7
+  if (netsim && !engine.session.impair(netsim)) {
+    return -1;
+  }
+
+  // None of this blocks; the lobby shows until the peer is there
+  if (relayPort) {
+    engine.relay.listen(relayPort);
+  }
+
+  if (isSpectator) {
+    printf("watching %s on port %d\n", ip, port);
+
+    engine.runSpectator(ip, port);
+  }
+  else if (isServer) {
+    engine.runServer(port);
+  }
+  else if (ip != NULL) {
+    printf("connecting to %s on port %d\n", ip, port);
+
+    engine.runClient(ip, port);
+  }
+#endif
+
   engine.gameLoop();
 
+  Profiler::finish();
+
+  if (traceFile) {
+    TRACE_WRITE(traceFile);
+  }
+
 #ifndef EMSCRIPTEN
+  engine.shutdown();
   SDL_Quit();
 #endif
 
-  return 0;
+  return main_allocated() ? 1 : 0;
 }
@@ -141,6 +141,36 @@ extern const char* strings[7];
 
 #define MSG_APPENDSCORE 21
 
+// messages followed by a payload (length in bytes 2 and 3, big endian)
+#define MSG_SNAPSHOT 22
+
+// relay stream: following messages belong to player p1 (0: host, 1: peer)
+#define MSG_RELAY_PLAYER 23
+
+// board contents, encoded by BoardSync (payload)
+#define MSG_BOARDSYNC 24
+// acknowledges board p1, p2 holds BOARDSYNC_ACK_* flags
+#define MSG_BOARDACK 25
+
+// timestamped, fixed point piece/paddle/ball/board motion (payload)
+#define MSG_MOTION 26
+
+// keeps an idle connection from looking dead
+#define MSG_KEEPALIVE 27
+
+// round trip measurement: p1 is a sequence number the pong echoes
+#define MSG_PING 28
+#define MSG_PONG 29
+
+// the motion sample carrying input marker p1 is now on screen
+#define MSG_INPUTECHO 30
+
+// Zobrist hash of the board last synced as p1 (payload)
+#define MSG_BOARDHASH 31
+
+#define MSG_HEADER_SIZE 4
+#define MSG_PAYLOAD_MAX 1024
+
 // sounds
 #define SND_ADDLINE 0
 #define SND_TINK 1
@@ -153,6 +183,10 @@ struct game_info {
   // board
   char board[10][24];
 
+  // Zobrist hashes of the board, kept current by Zobrist
+  Uint64 row_hash[24];
+  Uint64 board_hash;
+
   int pos; // column/row position
   float fine; // a floating position
 
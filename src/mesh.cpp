@@ -1,10 +1,7 @@
 #include "mesh.h"
+#include "profiler.h"
 
 #include <vector>
-#include <ios>
-#include <iostream>
-#include <sstream>
-#include <fstream>
 
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
@@ -28,104 +25,79 @@ static void gl_check_errors(const char* msg) {
   }
 }
 
+
 Mesh::Mesh(const char* filename) {
-  std::vector<glm::vec3> vertices;
-  std::vector<glm::vec3> normals;
-  std::vector<glm::vec2> texcoords;
-  std::vector<GLushort>  elements;
-
-  std::ifstream in(filename, std::ios::in);
-  if (!in) { std::cerr << "Cannot open " << filename << std::endl; exit(1); }
-
-  std::string line;
-  while (getline(in, line)) {
-    if (line.substr(0,2) == "v ") {
-      std::istringstream s(line.substr(2));
-      glm::vec3 v; s >> v.x; s >> v.y; s >> v.z;
-      vertices.push_back(v);
-    }
-    else if (line.substr(0, 3) == "vn ") {
-      std::istringstream s(line.substr(3));
-      glm::vec3 v; s >> v.x; s >> v.y; s >> v.z;
-      normals.push_back(v);
-    }
-    else if (line.substr(0, 3) == "vt ") {
-      std::istringstream s(line.substr(3));
-      glm::vec2 v; s >> v.x; s >> v.y;
-      texcoords.push_back(v);
-    }
-    else if (line.substr(0, 2) == "f ") {
-      std::istringstream s(line.substr(2));
-      GLushort a,b,c;
+  MeshData mesh;
+  if (!load(filename, mesh)) { exit(1); }
 
-      s >> a; s.get(); s >> b; s.get(); s >> c;
-      a--; b--; c--;
-      elements.push_back(a); elements.push_back(b); elements.push_back(c);
+  _construct(&mesh.data[0],     mesh.data.size(),
+             &mesh.elements[0], mesh.elements.size());
+}
 
-      s >> a; s.get(); s >> b; s.get(); s >> c;
-      a--; b--; c--;
-      elements.push_back(a); elements.push_back(b); elements.push_back(c);
+Mesh::Mesh(const MeshData& mesh) {
+  _construct(&mesh.data[0],     mesh.data.size(),
+             &mesh.elements[0], mesh.elements.size());
+}
 
-      s >> a; s.get(); s >> b; s.get(); s >> c;
-      a--; b--; c--;
-      elements.push_back(a); elements.push_back(b); elements.push_back(c);
-    }
-    else if (line[0] == '#') { /* ignoring this line */ }
-    else { /* ignoring this line */ }
-  }
+Mesh::Mesh(const float* data, size_t data_count,
+           const unsigned short* elements, size_t elements_count) {
+  _construct(data,     data_count,
+             elements, elements_count, GL_UNSIGNED_SHORT);
+}
 
-  // Interleave
-  float* data = new float[(elements.size()/3) * 8];
-  size_t k = 0;
-  for(size_t i = 0; i < elements.size(); i+=3) {
-    data[k+0] = vertices[elements[i+0]].x;
-    data[k+1] = vertices[elements[i+0]].y;
-    data[k+2] = vertices[elements[i+0]].z;
-    data[k+3] = normals[elements[i+2]].x;
-    data[k+4] = normals[elements[i+2]].y;
-    data[k+5] = normals[elements[i+2]].z;
-    data[k+6] = texcoords[elements[i+1]].x;
-    data[k+7] = texcoords[elements[i+1]].y;
-    k+=8;
-  }
+Mesh::Mesh(const float* data,      size_t data_count,
+           const Uint32* elements, size_t elements_count) {
+  _construct(data,     data_count,
+             elements, elements_count);
+}
 
-  unsigned short* element_data = new unsigned short[elements.size()/3];
-  for(size_t i = 0; i < elements.size()/3; i++) {
-    element_data[i] = i;
+void Mesh::_construct(const float* data,      size_t data_count,
+                      const Uint32* elements, size_t elements_count) {
+  Uint32 highest = 0;
+  for (size_t i = 0; i < elements_count; i++) {
+    if (elements[i] > highest) {
+      highest = elements[i];
+    }
   }
 
-  _construct(data,         elements.size() / 3 * 8,
-             element_data, elements.size() / 3);
+  if (highest > 0xffff) {
+    _construct(data,     data_count,
+               elements, elements_count, GL_UNSIGNED_INT);
+    return;
+  }
 
-  delete [] data;
-  delete [] element_data;
+  // half the size, and all that WebGL draws without an extension
+  std::vector<unsigned short> shorts(elements, elements + elements_count);
+  _construct(data,       data_count,
+             &shorts[0], elements_count, GL_UNSIGNED_SHORT);
 }
 
-Mesh::Mesh(const float* data, size_t data_count,
-           const unsigned short* elements, size_t elements_count) {
-  _construct(data,     data_count,
-             elements, elements_count);
-}
+void Mesh::_construct(const float* data,      size_t data_count,
+                      const void*  elements,  size_t elements_count,
+                      GLenum type) {
+  size_t element_size = type == GL_UNSIGNED_INT ? sizeof(Uint32) : sizeof(unsigned short);
 
-void Mesh::_construct(const float* data,              size_t data_count,
-                      const unsigned short* elements, size_t elements_count) {
-  glGenBuffers(1, &_vbo_data);
-  glGenBuffers(1, &_vbo_elements);
+  _vbo_data     = GpuResources::create(GPU_BUFFER, "mesh vertices");
+  _vbo_elements = GpuResources::create(GPU_BUFFER, "mesh elements");
   gl_check_errors("glGenBuffers");
 
-  glBindBuffer(GL_ARRAY_BUFFER, _vbo_data);
+  glBindBuffer(GL_ARRAY_BUFFER, GpuResources::object(_vbo_data));
   glBufferData(GL_ARRAY_BUFFER, data_count * sizeof(float), data, GL_STATIC_DRAW);
   gl_check_errors("glBufferData cube_data");
+  GpuResources::setBytes(_vbo_data, data_count * sizeof(float));
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vbo_elements);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements_count * sizeof(unsigned short), elements, GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GpuResources::object(_vbo_elements));
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements_count * element_size, elements, GL_STATIC_DRAW);
   gl_check_errors("glBufferData cube_elements");
+  GpuResources::setBytes(_vbo_elements, elements_count * element_size);
 
   _count = elements_count;
+  _type  = type;
 }
 
 Mesh::~Mesh() {
-  // TODO: Delete buffers
+  GpuResources::release(_vbo_data);
+  GpuResources::release(_vbo_elements);
 }
 
 void Mesh::draw(Context* context, glm::mat4& model) {
@@ -134,16 +106,21 @@ void Mesh::draw(Context* context, glm::mat4& model) {
 
 void Mesh::drawSubset(Context* context, glm::mat4& model,
                       size_t start,     size_t count) {
-  glBindBuffer(GL_ARRAY_BUFFER,         _vbo_data);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vbo_elements);
+  glBindBuffer(GL_ARRAY_BUFFER,         GpuResources::object(_vbo_data));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GpuResources::object(_vbo_elements));
 
   context->establish(_vbo_data);
 
   context->setModel(model);
 
+  size_t element_size = _type == GL_UNSIGNED_INT ? sizeof(Uint32) : sizeof(unsigned short);
+
   glDrawElements(GL_TRIANGLES,       // Render a list of triangles
                  count,              // Number of elements in the buffer
-                 GL_UNSIGNED_SHORT,  // Elements are shorts
-                 (GLvoid*)(start * sizeof(unsigned short))); // Start index
+                 _type,              // Elements are shorts, or ints if big
+                 (GLvoid*)(start * element_size)); // Start index
   gl_check_errors("glDrawElements");
+
+  Profiler::count(PROFILE_DRAW_CALLS, 1);
+  Profiler::count(PROFILE_TRIANGLES,  (int)(count / 3));
 }
@@ -3,16 +3,58 @@
 
 #include "main.h"
 #include "context.h"
+#include "gpu.h"
 
 #include "glm/glm.hpp"
 
+#include <vector>
+
+// Floats per vertex: position, normal, texcoord
+#define MESH_STRIDE 8
+
+// Written next to each .obj the first time it is parsed
+#define MESH_CACHE_MAGIC   "OMGMESH1"
+#define MESH_CACHE_VERSION 1
+
+// Vertices the post-transform cache is assumed to hold when ordering
+#define MESH_VERTEX_CACHE 32
+
+/*
+ * Vertices (position, normal, texcoord interleaved) and elements, parsed
+ * but not yet on the GPU.
+ */
+struct MeshData {
+  std::vector<float>  data;
+  std::vector<Uint32> elements;
+};
+
 class Mesh {
 public:
+  /*
+   * Reads the given .obj file, from its .meshbin cache when that is
+   * up to date. Otherwise parses it (welding shared corners into one
+   * vertex and ordering triangles for the vertex cache) and writes the
+   * cache. Needs no GL context, so it can run on any thread. Returns
+   * false if the file cannot be read.
+   */
+  static bool load(const char* filename, MeshData& mesh);
+
+  /*
+   * Parses the given .obj file as load() does, without the cache.
+   * Unless asked not to, prints how well it suits the vertex cache.
+   */
+  static bool parse(const char* filename, MeshData& mesh, bool report = true);
+
   /*
    * Constructs a Mesh from the given .obj file.
    */
   Mesh(const char* filename);
 
+  /*
+   * Constructs a Mesh from parsed data.
+   */
+  Mesh(const MeshData& mesh);
+
   /*
    * Constructs a Mesh with the given data.
    */
@@ -20,7 +62,14 @@ public:
        const unsigned short* elements, size_t elements_count);
 
   /*
-   * Destructs.
+   * Constructs a Mesh with the given data. Elements are kept as shorts
+   * when every vertex can be reached with one.
+   */
+  Mesh(const float* data,      size_t data_count,
+       const Uint32* elements, size_t elements_count);
+
+  /*
+   * Releases the buffers.
    */
   ~Mesh();
 
@@ -38,12 +87,24 @@ public:
                   size_t count);
 
 private:
-  void _construct(const float* data,              size_t data_count,
-                  const unsigned short* elements, size_t elements_count);
+  // one owner for the buffers
+  Mesh(const Mesh&);
+  Mesh& operator=(const Mesh&);
+
+  static bool _readCache(const char* filename, MeshData& mesh);
+  static void _writeCache(const char* filename, const MeshData& mesh);
+  static void _optimize(MeshData& mesh);
+
+  void _construct(const float* data,      size_t data_count,
+                  const Uint32* elements, size_t elements_count);
+  void _construct(const float* data,      size_t data_count,
+                  const void*  elements,  size_t elements_count,
+                  GLenum type);
 
-  GLuint _vbo_data;
-  GLuint _vbo_elements;
+  GpuHandle _vbo_data;
+  GpuHandle _vbo_elements;
   GLuint _count;
+  GLenum _type;         // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
 };
 
 #endif
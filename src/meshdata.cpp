@@ -0,0 +1,697 @@
+#include "mesh.h"
+
+#include <vector>
+#include <string>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if !defined(WIN32) && !defined(EMSCRIPTEN)
+#define MESH_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+ * The .meshbin cache: this header, the floats, then the elements. Stale
+ * once the .obj it was made from changes size or time.
+ */
+struct MeshCacheHeader {
+  char   magic[8];
+  Uint32 version;
+  Uint32 source_size;
+  Uint32 source_time;
+  Uint32 floats;
+  Uint32 elements;
+};
+
+/*
+ * The whole of a file in memory: mapped where we can, read otherwise.
+ */
+struct MeshFile {
+  const char* begin;
+  const char* end;
+  size_t      length;
+  bool        mapped;
+};
+
+static bool mesh_file_open(const char* filename, MeshFile& file) {
+  file.begin  = NULL;
+  file.end    = NULL;
+  file.length = 0;
+  file.mapped = false;
+
+#ifdef MESH_MMAP
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return false;
+  }
+
+  file.length = (size_t)info.st_size;
+  if (file.length > 0) {
+    void* base = mmap(NULL, file.length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    file.begin  = (const char*)base;
+    file.mapped = true;
+  }
+  close(fd);
+#else
+  FILE* f = fopen(filename, "rb");
+  if (!f) {
+    return false;
+  }
+
+  fseek(f, 0, SEEK_END);
+  long length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  char* base = new char[length > 0 ? length : 1];
+  if (length < 0 || fread(base, 1, (size_t)length, f) != (size_t)length) {
+    delete [] base;
+    fclose(f);
+    return false;
+  }
+  fclose(f);
+
+  file.begin  = base;
+  file.length = (size_t)length;
+#endif
+
+  file.end = file.begin + file.length;
+  return true;
+}
+
+static void mesh_file_close(MeshFile& file) {
+#ifdef MESH_MMAP
+  if (file.mapped) {
+    munmap((void*)file.begin, file.length);
+  }
+#else
+  delete [] file.begin;
+#endif
+  file.begin = NULL;
+  file.end   = NULL;
+}
+
+// assets/ship.obj -> assets/ship.meshbin
+static std::string mesh_cache_path(const char* filename) {
+  std::string path(filename);
+  size_t dot   = path.rfind('.');
+  size_t slash = path.find_last_of("/\\");
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+    path.erase(dot);
+  }
+  return path + ".meshbin";
+}
+
+static bool mesh_source_stat(const char* filename, Uint32& size, Uint32& time) {
+  struct stat info;
+  if (stat(filename, &info) != 0) {
+    return false;
+  }
+  size = (Uint32)info.st_size;
+  time = (Uint32)info.st_mtime;
+  return true;
+}
+
+static inline void skip_blanks(const char*& p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+}
+
+static inline bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+/*
+ * Reads a number like 1, -0.5 or 1.5e-3 where strtod would, but without
+ * needing the text to end in a NUL (a mapped file does not) or looking
+ * at the locale.
+ */
+static bool parse_float(const char*& p, const char* end, float& value) {
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  skip_blanks(p, end);
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  // digits go into an integer mantissa, exact up to 15 of them
+  double mantissa = 0.0;
+  int    exponent = 0;
+  int    digits   = 0;
+
+  for (; p < end && is_digit(*p); p++, digits++) {
+    mantissa = mantissa * 10.0 + (*p - '0');
+  }
+
+  if (p < end && *p == '.') {
+    p++;
+    for (; p < end && is_digit(*p); p++, digits++) {
+      mantissa = mantissa * 10.0 + (*p - '0');
+      exponent--;
+    }
+  }
+
+  if (digits == 0) {
+    return false;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool negative_exponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negative_exponent = *p == '-';
+      p++;
+    }
+    int e = 0;
+    for (; p < end && is_digit(*p); p++) {
+      if (e < 1000) {
+        e = e * 10 + (*p - '0');
+      }
+    }
+    exponent += negative_exponent ? -e : e;
+  }
+
+  if (exponent < 0) {
+    mantissa /= (-exponent <= 22) ? powers[-exponent] : pow(10.0, -exponent);
+  }
+  else if (exponent > 0) {
+    mantissa *= (exponent <= 22) ? powers[exponent] : pow(10.0, exponent);
+  }
+
+  value = (float)(negative ? -mantissa : mantissa);
+  return true;
+}
+
+static bool parse_int(const char*& p, const char* end, int& value) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  if (p >= end || !is_digit(*p)) {
+    return false;
+  }
+
+  int number = 0;
+  for (; p < end && is_digit(*p); p++) {
+    number = number * 10 + (*p - '0');
+  }
+
+  value = negative ? -number : number;
+  return true;
+}
+
+// 1-based, or negative from the end; 0 means absent. -1 if out of range.
+static int resolve_index(int index, size_t count) {
+  if (index > 0 && (size_t)index <= count) {
+    return index - 1;
+  }
+  if (index < 0 && (size_t)-index <= count) {
+    return (int)count + index;
+  }
+  return -1;
+}
+
+/*
+ * Finds the vertex made from a position, texcoord and normal, adding it
+ * if this is the first corner to use them. Open addressing; the table
+ * doubles whenever it is half full.
+ */
+struct MeshWelder {
+  std::vector<Uint32> slots;     // vertex + 1, or 0 for empty
+  std::vector<int>    corners;   // position, texcoord, normal per vertex
+
+  MeshWelder() : slots(1024, 0) {
+  }
+
+  static Uint32 hash(int v, int t, int n) {
+    return ((Uint32)v * 73856093u) ^ ((Uint32)t * 19349663u) ^ ((Uint32)n * 83492791u);
+  }
+
+  void grow() {
+    std::vector<Uint32> bigger(slots.size() * 2, 0);
+    Uint32 mask = bigger.size() - 1;
+    for (size_t i = 0; i < corners.size() / 3; i++) {
+      Uint32 h = hash(corners[i*3], corners[i*3+1], corners[i*3+2]) & mask;
+      while (bigger[h]) {
+        h = (h + 1) & mask;
+      }
+      bigger[h] = i + 1;
+    }
+    slots.swap(bigger);
+  }
+
+  // the vertex, and whether it is new
+  Uint32 weld(int v, int t, int n, bool& added) {
+    if ((corners.size() / 3 + 1) * 2 > slots.size()) {
+      grow();
+    }
+
+    Uint32 mask = slots.size() - 1;
+    Uint32 h = hash(v, t, n) & mask;
+    while (slots[h]) {
+      Uint32 i = slots[h] - 1;
+      if (corners[i*3] == v && corners[i*3+1] == t && corners[i*3+2] == n) {
+        added = false;
+        return i;
+      }
+      h = (h + 1) & mask;
+    }
+
+    Uint32 i = corners.size() / 3;
+    corners.push_back(v);
+    corners.push_back(t);
+    corners.push_back(n);
+    slots[h] = i + 1;
+    added = true;
+    return i;
+  }
+};
+
+/*
+ * Average cache miss ratio: vertices transformed per triangle drawn with
+ * a FIFO post-transform cache. 0.5 is ideal for a regular mesh, 3 is no
+ * reuse at all.
+ */
+static float mesh_acmr(const std::vector<Uint32>& elements, size_t vertices) {
+  std::vector<Uint32> stamp(vertices, 0);
+  Uint32 time = MESH_VERTEX_CACHE + 1;
+  size_t misses = 0;
+
+  for (size_t i = 0; i < elements.size(); i++) {
+    Uint32 v = elements[i];
+    if (time - stamp[v] > MESH_VERTEX_CACHE) {
+      stamp[v] = time++;
+      misses++;
+    }
+  }
+
+  return elements.empty() ? 0.0f : (float)misses / (elements.size() / 3);
+}
+
+/*
+ * Tom Forsyth's score for a vertex: recently used vertices are cheap to
+ * use again, and vertices with few triangles left are worth finishing
+ * off so they can leave the cache.
+ */
+static float vertex_score(int position, int valence) {
+  if (valence == 0) {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (position >= 0) {
+    if (position < 3) {
+      // the triangle just drawn; no better to draw its neighbours at once
+      score = 0.75f;
+    }
+    else {
+      float scale = 1.0f - (float)(position - 3) / (MESH_VERTEX_CACHE - 3);
+      score = powf(scale, 1.5f);
+    }
+  }
+
+  return score + 2.0f * powf((float)valence, -0.5f);
+}
+
+void Mesh::_optimize(MeshData& mesh) {
+  size_t vertices  = mesh.data.size() / MESH_STRIDE;
+  size_t triangles = mesh.elements.size() / 3;
+  const std::vector<Uint32>& in = mesh.elements;
+
+  // the triangles still to draw around each vertex, packed by vertex
+  std::vector<Uint32> offset(vertices + 1, 0);
+  for (size_t i = 0; i < in.size(); i++) {
+    offset[in[i] + 1]++;
+  }
+  for (size_t v = 0; v < vertices; v++) {
+    offset[v + 1] += offset[v];
+  }
+
+  std::vector<Uint32> adjacent(in.size());
+  std::vector<int>    valence(vertices, 0);
+  for (size_t i = 0; i < in.size(); i++) {
+    Uint32 v = in[i];
+    adjacent[offset[v] + valence[v]++] = i / 3;
+  }
+
+  std::vector<int>   position(vertices, -1);
+  std::vector<float> score(vertices);
+  for (size_t v = 0; v < vertices; v++) {
+    score[v] = vertex_score(-1, valence[v]);
+  }
+
+  std::vector<char>   drawn(triangles, 0);
+  std::vector<Uint32> out;
+  out.reserve(in.size());
+
+  Uint32 cache[MESH_VERTEX_CACHE + 3];
+  int    cached = 0;
+
+  int    best = -1;
+  size_t next = 0;
+
+  for (size_t count = 0; count < triangles; count++) {
+    if (best < 0) {
+      // nothing in the cache has triangles left: start somewhere new
+      while (drawn[next]) {
+        next++;
+      }
+      best = next;
+    }
+
+    drawn[best] = 1;
+
+    Uint32 corners[3] = { in[best*3], in[best*3+1], in[best*3+2] };
+    Uint32 updated[MESH_VERTEX_CACHE + 3];
+    int    count_updated = 0;
+
+    for (int k = 0; k < 3; k++) {
+      Uint32 v = corners[k];
+      out.push_back(v);
+
+      // take the triangle out of the vertex's list
+      Uint32* list = &adjacent[offset[v]];
+      for (int j = 0; j < valence[v]; j++) {
+        if (list[j] == (Uint32)best) {
+          list[j] = list[valence[v] - 1];
+          valence[v]--;
+          break;
+        }
+      }
+
+      bool seen = false;
+      for (int j = 0; j < count_updated; j++) {
+        seen = seen || updated[j] == v;
+      }
+      if (!seen) {
+        updated[count_updated++] = v;
+      }
+    }
+
+    // the triangle's vertices go to the front, the rest move back
+    for (int i = 0; i < cached; i++) {
+      Uint32 v = cache[i];
+      if (v != corners[0] && v != corners[1] && v != corners[2]) {
+        updated[count_updated++] = v;
+      }
+    }
+
+    for (int i = 0; i < count_updated; i++) {
+      Uint32 v = updated[i];
+      position[v] = i < MESH_VERTEX_CACHE ? i : -1;
+      score[v]    = vertex_score(position[v], valence[v]);
+    }
+
+    // the next triangle is the best one touching the cache
+    best = -1;
+    float best_score = -1.0f;
+    for (int i = 0; i < count_updated; i++) {
+      Uint32 v = updated[i];
+      for (int j = 0; j < valence[v]; j++) {
+        Uint32 t = adjacent[offset[v] + j];
+        float s = score[in[t*3]] + score[in[t*3+1]] + score[in[t*3+2]];
+        if (s > best_score) {
+          best_score = s;
+          best       = t;
+        }
+      }
+    }
+
+    cached = count_updated < MESH_VERTEX_CACHE ? count_updated : MESH_VERTEX_CACHE;
+    memcpy(cache, updated, cached * sizeof(Uint32));
+  }
+
+  // vertices in the order they are first drawn, so fetches run forward
+  std::vector<Uint32> remap(vertices, 0xffffffff);
+  Uint32 used = 0;
+  for (size_t i = 0; i < out.size(); i++) {
+    if (remap[out[i]] == 0xffffffff) {
+      remap[out[i]] = used++;
+    }
+    out[i] = remap[out[i]];
+  }
+
+  std::vector<float> data(used * MESH_STRIDE);
+  for (size_t v = 0; v < vertices; v++) {
+    if (remap[v] != 0xffffffff) {
+      memcpy(&data[remap[v] * MESH_STRIDE], &mesh.data[v * MESH_STRIDE],
+             MESH_STRIDE * sizeof(float));
+    }
+  }
+
+  mesh.data.swap(data);
+  mesh.elements.swap(out);
+}
+
+bool Mesh::parse(const char* filename, MeshData& mesh, bool report) {
+  MeshFile file;
+  if (!mesh_file_open(filename, file)) {
+    fprintf(stderr, "Cannot open %s\n", filename);
+    return false;
+  }
+
+  std::vector<float> positions;
+  std::vector<float> normals;
+  std::vector<float> texcoords;
+  MeshWelder         welder;
+
+  mesh.data.clear();
+  mesh.elements.clear();
+
+  const char* p   = file.begin;
+  const char* end = file.end;
+  int line = 1;
+  bool ok = true;
+
+  while (ok && p < end) {
+    skip_blanks(p, end);
+
+    if (p + 1 < end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+      p++;
+      float x, y, z;
+      ok = parse_float(p, end, x) && parse_float(p, end, y) && parse_float(p, end, z);
+      positions.push_back(x); positions.push_back(y); positions.push_back(z);
+    }
+    else if (p + 2 < end && p[0] == 'v' && p[1] == 'n') {
+      p += 2;
+      float x, y, z;
+      ok = parse_float(p, end, x) && parse_float(p, end, y) && parse_float(p, end, z);
+      normals.push_back(x); normals.push_back(y); normals.push_back(z);
+    }
+    else if (p + 2 < end && p[0] == 'v' && p[1] == 't') {
+      p += 2;
+      float u, v;
+      ok = parse_float(p, end, u) && parse_float(p, end, v);
+      texcoords.push_back(u); texcoords.push_back(v);
+    }
+    else if (p + 1 < end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+      p++;
+
+      // quads and n-gons become a fan around the first corner
+      Uint32 first    = 0;
+      Uint32 previous = 0;
+      int    corners  = 0;
+
+      for (;;) {
+        skip_blanks(p, end);
+        if (p >= end || *p == '\n' || *p == '\r' || *p == '#') {
+          break;
+        }
+
+        // v, v/t, v//n or v/t/n
+        int v = 0, t = 0, n = 0;
+        ok = parse_int(p, end, v);
+        if (ok && p < end && *p == '/') {
+          p++;
+          if (p < end && *p != '/') {
+            ok = parse_int(p, end, t);
+          }
+          if (ok && p < end && *p == '/') {
+            p++;
+            ok = parse_int(p, end, n);
+          }
+        }
+
+        v = resolve_index(v, positions.size() / 3);
+        t = t ? resolve_index(t, texcoords.size() / 2) : -2;
+        n = n ? resolve_index(n, normals.size()   / 3) : -2;
+        if (!ok || v < 0 || t == -1 || n == -1) {
+          ok = false;
+          break;
+        }
+
+        bool added;
+        Uint32 index = welder.weld(v, t, n, added);
+        if (added) {
+          mesh.data.push_back(positions[v*3+0]);
+          mesh.data.push_back(positions[v*3+1]);
+          mesh.data.push_back(positions[v*3+2]);
+          mesh.data.push_back(n >= 0 ? normals[n*3+0] : 0.0f);
+          mesh.data.push_back(n >= 0 ? normals[n*3+1] : 0.0f);
+          mesh.data.push_back(n >= 0 ? normals[n*3+2] : 0.0f);
+          mesh.data.push_back(t >= 0 ? texcoords[t*2+0] : 0.0f);
+          mesh.data.push_back(t >= 0 ? texcoords[t*2+1] : 0.0f);
+        }
+
+        if (corners == 0) {
+          first = index;
+        }
+        else if (corners >= 2) {
+          mesh.elements.push_back(first);
+          mesh.elements.push_back(previous);
+          mesh.elements.push_back(index);
+        }
+        previous = index;
+        corners++;
+      }
+    }
+    // anything else (comments, groups, materials) is ignored
+
+    // on to the next line
+    while (p < end && *p != '\n') {
+      p++;
+    }
+    p++;
+    line++;
+  }
+
+  mesh_file_close(file);
+
+  if (!ok) {
+    fprintf(stderr, "%s:%d: cannot parse\n", filename, line);
+    return false;
+  }
+
+  if (mesh.elements.empty()) {
+    fprintf(stderr, "%s: no faces\n", filename);
+    return false;
+  }
+
+  if (!report) {
+    _optimize(mesh);
+    return true;
+  }
+
+  size_t corners  = mesh.elements.size();
+  size_t vertices = mesh.data.size() / MESH_STRIDE;
+  float  before   = mesh_acmr(mesh.elements, vertices);
+
+  _optimize(mesh);
+
+  printf("mesh: %s: %d triangles, %d corners welded into %d vertices, ACMR %.2f -> %.2f\n",
+         filename, (int)(corners / 3), (int)corners, (int)vertices,
+         before, mesh_acmr(mesh.elements, mesh.data.size() / MESH_STRIDE));
+  return true;
+}
+
+bool Mesh::_readCache(const char* filename, MeshData& mesh) {
+  Uint32 size, time;
+  if (!mesh_source_stat(filename, size, time)) {
+    return false;
+  }
+
+  FILE* file = fopen(mesh_cache_path(filename).c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+
+  MeshCacheHeader header;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version     == MESH_CACHE_VERSION &&
+            header.source_size == size &&
+            header.source_time == time &&
+            header.floats   > 0 && header.floats % MESH_STRIDE == 0 &&
+            header.elements > 0 && header.elements % 3 == 0;
+
+  if (ok) {
+    mesh.data.resize(header.floats);
+    mesh.elements.resize(header.elements);
+    ok = fread(&mesh.data[0],     sizeof(float),  header.floats,   file) == header.floats &&
+         fread(&mesh.elements[0], sizeof(Uint32), header.elements, file) == header.elements;
+  }
+  fclose(file);
+
+  // a damaged cache must not index past the vertices
+  Uint32 vertices = header.floats / MESH_STRIDE;
+  for (size_t i = 0; ok && i < mesh.elements.size(); i++) {
+    ok = mesh.elements[i] < vertices;
+  }
+
+  return ok;
+}
+
+void Mesh::_writeCache(const char* filename, const MeshData& mesh) {
+  MeshCacheHeader header;
+  memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+  header.version  = MESH_CACHE_VERSION;
+  header.floats   = mesh.data.size();
+  header.elements = mesh.elements.size();
+  if (!mesh_source_stat(filename, header.source_size, header.source_time)) {
+    return;
+  }
+
+  // written aside and renamed, so no one reads half of it
+  std::string path = mesh_cache_path(filename);
+  std::string temp = path + ".tmp";
+
+  FILE* file = fopen(temp.c_str(), "wb");
+  if (!file) {
+    // a read-only install just parses every time
+    return;
+  }
+
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(&mesh.data[0],     sizeof(float),  mesh.data.size(),     file);
+  fwrite(&mesh.elements[0], sizeof(Uint32), mesh.elements.size(), file);
+
+  bool failed = ferror(file) != 0;
+  fclose(file);
+
+  if (failed) {
+    remove(temp.c_str());
+    return;
+  }
+
+  if (rename(temp.c_str(), path.c_str()) != 0) {
+    // Windows will not rename over a file
+    remove(path.c_str());
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+      remove(temp.c_str());
+    }
+  }
+}
+
+bool Mesh::load(const char* filename, MeshData& mesh) {
+  if (_readCache(filename, mesh)) {
+    return true;
+  }
+
+  if (!parse(filename, mesh)) {
+    return false;
+  }
+
+  _writeCache(filename, mesh);
+  return true;
+}
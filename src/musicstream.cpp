@@ -0,0 +1,212 @@
+#include "musicstream.h"
+#include "trace.h"
+
+// Orders ring contents against the index that publishes them
+#define MUSICSTREAM_BARRIER() __sync_synchronize()
+
+MusicStream::MusicStream()
+  : _frequency(44100),
+    _volume(MIX_MAX_VOLUME),
+    _ring(NULL),
+    _head(0),
+    _tail(0),
+    _running(false),
+    _underruns(0),
+    _thread(NULL) {
+  _fname[0] = '\0';
+}
+
+MusicStream::~MusicStream() {
+  close();
+  delete [] _ring;
+}
+
+bool MusicStream::open(const char* fname, int frequency) {
+  close();
+
+  strncpy(_fname, fname, sizeof(_fname) - 1);
+  _fname[sizeof(_fname) - 1] = '\0';
+  _frequency = frequency;
+
+  if (!_ring) {
+    _ring = new Sint16[MUSICSTREAM_RING_SAMPLES];
+  }
+  _head = 0;
+  _tail = 0;
+
+  _running = true;
+  _thread  = SDL_CreateThread(_worker, this);
+  if (!_thread) {
+    printf("music: cannot start the decoder: %s\n", SDL_GetError());
+    _running = false;
+    return false;
+  }
+
+  return true;
+}
+
+void MusicStream::close() {
+  _running = false;
+
+  if (_thread) {
+    SDL_WaitThread(_thread, NULL);
+    _thread = NULL;
+  }
+}
+
+void MusicStream::volume(int volume) {
+  _volume = volume;
+}
+
+int MusicStream::_worker(void* data) {
+  ((MusicStream*)data)->_decode();
+  return 0;
+}
+
+void MusicStream::_decode() {
+#ifndef EMSCRIPTEN
+  OggVorbis_File file;
+  if (ov_fopen(_fname, &file) != 0) {
+    printf("music: cannot open '%s'\n", _fname);
+    _running = false;
+    return;
+  }
+
+  vorbis_info* info = ov_info(&file, -1);
+  int channels = info->channels;
+
+  // 16.16 step through the source per device frame
+  Uint32 step = (Uint32)(((double)info->rate / (double)_frequency) * 65536.0);
+  Uint32 phase = 0;
+
+  Sint16 source[MUSICSTREAM_CHUNK_SAMPLES];
+  Sint16 output[MUSICSTREAM_CHUNK_SAMPLES];
+
+  // source frames whose output still fits, whatever the rates
+  int read_frames = (int)(((double)(MUSICSTREAM_CHUNK_SAMPLES / 2 - 1) * step) / 65536.0);
+  if (read_frames > MUSICSTREAM_CHUNK_SAMPLES / channels) {
+    read_frames = MUSICSTREAM_CHUNK_SAMPLES / channels;
+  }
+  if (read_frames < 1) {
+    read_frames = 1;
+  }
+
+  // the frame before the chunk, for interpolating across its start
+  Sint16 last[2] = {0, 0};
+
+  TRACE_THREAD("music");
+
+  while (_running) {
+    if ((Uint32)MUSICSTREAM_RING_SAMPLES - (_tail - _head) < (Uint32)MUSICSTREAM_CHUNK_SAMPLES) {
+      SDL_Delay(MUSICSTREAM_IDLE);
+      continue;
+    }
+
+    TRACE_SCOPE("decode");
+
+    int section;
+    long bytes = ov_read(&file, (char*)source, read_frames * channels * (int)sizeof(Sint16),
+                         SDL_BYTEORDER == SDL_BIG_ENDIAN, 2, 1, &section);
+
+    if (bytes == 0) {
+      // loop forever
+      ov_pcm_seek(&file, 0);
+      continue;
+    }
+    if (bytes < 0) {
+      // a hole in the stream; carry on after it
+      continue;
+    }
+
+    int frames = (int)(bytes / sizeof(Sint16)) / channels;
+    int count  = 0;
+
+    // phase is where the next output frame falls, counted from last
+    while ((phase >> 16) < (Uint32)frames) {
+      int    index = (int)(phase >> 16);
+      Sint32 frac  = (Sint32)(phase & 0xffff);
+
+      for (int c = 0; c < 2; c++) {
+        int channel = (c < channels) ? c : 0;
+
+        Sint32 a = (index == 0) ? last[c] : source[(index - 1) * channels + channel];
+        Sint32 b = source[index * channels + channel];
+
+        output[count++] = (Sint16)(a + (((b - a) * frac) >> 16));
+      }
+
+      phase += step;
+    }
+    phase -= (Uint32)frames << 16;
+
+    for (int c = 0; c < 2; c++) {
+      int channel = (c < channels) ? c : 0;
+      last[c] = source[(frames - 1) * channels + channel];
+    }
+
+    _write(output, count);
+  }
+
+  ov_clear(&file);
+
+  TRACE_THREAD_END();
+#endif
+}
+
+void MusicStream::_write(const Sint16* samples, int count) {
+  Uint32 tail = _tail;
+
+  for (int i = 0; i < count; i++) {
+    _ring[(tail + i) % MUSICSTREAM_RING_SAMPLES] = samples[i];
+  }
+
+  MUSICSTREAM_BARRIER();
+  _tail = tail + count;
+}
+
+void MusicStream::_read(Sint16* out, int count) {
+  Uint32 head = _head;
+
+  MUSICSTREAM_BARRIER();
+  for (int i = 0; i < count; i++) {
+    out[i] = (Sint16)((_ring[(head + i) % MUSICSTREAM_RING_SAMPLES] * _volume) / MIX_MAX_VOLUME);
+  }
+
+  MUSICSTREAM_BARRIER();
+  _head = head + count;
+}
+
+void MusicStream::mix(void* udata, Uint8* stream, int len) {
+  TRACE_THREAD("audio");
+  TRACE_SCOPE("mix");
+
+  MusicStream* music = (MusicStream*)udata;
+
+  Sint16* out = (Sint16*)stream;
+  int count   = len / (int)sizeof(Sint16);
+
+  int available = (int)(music->_tail - music->_head);
+  if (available > count) {
+    available = count;
+  }
+
+  // the decoder fell behind (rather than is still opening the file)
+  if (available < count && music->_running && music->_tail != 0) {
+    music->_underruns++;
+  }
+
+  music->_read(out, available);
+  memset(out + available, 0, (count - available) * sizeof(Sint16));
+}
+
+int MusicStream::buffered() {
+  return (int)(_tail - _head);
+}
+
+int MusicStream::capacity() {
+  return MUSICSTREAM_RING_SAMPLES;
+}
+
+int MusicStream::underruns() {
+  return _underruns;
+}
@@ -0,0 +1,82 @@
+#ifndef MUSICSTREAM_INCLUDED
+#define MUSICSTREAM_INCLUDED
+
+#include "main.h"
+
+#ifndef EMSCRIPTEN
+#include <vorbis/vorbisfile.h>
+#endif
+
+// Decoded samples held ahead of the mixer: 2^16 stereo frames, 1.5s
+#define MUSICSTREAM_RING_SAMPLES (65536 * 2)
+
+// Samples the worker decodes at a time
+#define MUSICSTREAM_CHUNK_SAMPLES 4096
+
+// Milliseconds the worker sleeps when the ring is full
+#define MUSICSTREAM_IDLE 10
+
+/*
+ * Plays an Ogg Vorbis file, looping, without decoding in the audio
+ * callback.
+ *
+ * A worker thread opens the file and decodes it ahead into a ring buffer
+ * of device-format (16-bit stereo) samples; the mixer callback, hooked in
+ * with Mix_HookMusic, only copies out of it. The worker writes the tail
+ * and the callback the head, so neither waits on the other. Should the
+ * worker fall behind, the callback plays silence and counts an underrun.
+ */
+class MusicStream {
+public:
+  MusicStream();
+  ~MusicStream();
+
+  /*
+   * Starts decoding the file; returns at once. frequency is the device
+   * rate the samples are converted to.
+   */
+  bool open(const char* fname, int frequency);
+
+  /*
+   * Stops the worker and forgets the file.
+   */
+  void close();
+
+  /*
+   * Sets the volume, 0..128 as with SDL_mixer.
+   */
+  void volume(int volume);
+
+  /*
+   * The Mix_HookMusic callback; udata is the stream.
+   */
+  static void mix(void* udata, Uint8* stream, int len);
+
+  // samples decoded but not yet played, and how many fit
+  int buffered();
+  int capacity();
+
+  // buffers the callback could not fill
+  int underruns();
+
+private:
+  static int _worker(void* data);
+  void _decode();
+  void _write(const Sint16* samples, int count);
+  void _read(Sint16* out, int count);
+
+  char               _fname[256];
+  int                _frequency;
+  int                _volume;
+
+  Sint16*            _ring;
+  volatile Uint32    _head;     // next sample the callback reads
+  volatile Uint32    _tail;     // next sample the worker writes
+
+  volatile bool      _running;
+  volatile int       _underruns;
+
+  SDL_Thread*        _thread;
+};
+
+#endif
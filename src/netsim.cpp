@@ -0,0 +1,174 @@
+#include "netsim.h"
+
+NetSim::NetSim()
+  : _enabled(false),
+    _latency(0),
+    _jitter(0),
+    _loss(0.0f),
+    _reorder(0.0f),
+    _bandwidth(0),
+    _seed(1),
+    _state(1),
+    _queue(NULL),
+    _count(0),
+    _seq(0),
+    _last_release(0),
+    _link_free(0.0) {
+}
+
+bool NetSim::configure(const char* spec) {
+  char buffer[256];
+  strncpy(buffer, spec, sizeof(buffer) - 1);
+  buffer[sizeof(buffer) - 1] = '\0';
+
+  for (char* option = strtok(buffer, ","); option; option = strtok(NULL, ",")) {
+    char* value = strchr(option, '=');
+    if (!value) {
+      printf("netsim: expected name=value, got '%s'\n", option);
+      return false;
+    }
+    *value++ = '\0';
+
+    if (strcmp(option, "latency") == 0) {
+      _latency = atoi(value);
+    }
+    else if (strcmp(option, "jitter") == 0) {
+      _jitter = atoi(value);
+    }
+    else if (strcmp(option, "loss") == 0) {
+      _loss = (float)atof(value);
+    }
+    else if (strcmp(option, "reorder") == 0) {
+      _reorder = (float)atof(value);
+    }
+    else if (strcmp(option, "bw") == 0) {
+      _bandwidth = atoi(value);
+    }
+    else if (strcmp(option, "seed") == 0) {
+      _seed = (Uint32)strtoul(value, NULL, 10);
+    }
+    else {
+      printf("netsim: unknown option '%s'\n", option);
+      return false;
+    }
+  }
+
+  // xorshift never leaves zero
+  _state = _seed ? _seed : 1;
+
+  if (!_queue) {
+    _queue = new Message[NETSIM_MAX_QUEUED];
+  }
+
+  _enabled = true;
+  return true;
+}
+
+bool NetSim::enabled() {
+  return _enabled;
+}
+
+void NetSim::describe() {
+  printf("netsim: latency=%dms jitter=%dms loss=%.3f reorder=%.3f bw=%d seed=%u\n",
+         _latency, _jitter, _loss, _reorder, _bandwidth, (unsigned int)_seed);
+}
+
+Uint32 NetSim::_random() {
+  _state ^= _state << 13;
+  _state ^= _state >> 17;
+  _state ^= _state << 5;
+  return _state;
+}
+
+float NetSim::_uniform() {
+  return (float)(_random() >> 8) / 16777216.0f;
+}
+
+bool NetSim::enqueue(const unsigned char* data, size_t length, Uint32 now) {
+  if (_count == NETSIM_MAX_QUEUED || length > sizeof(_queue[0].data)) {
+    printf("netsim: queue full, dropping message %d\n", data[0]);
+    return false;
+  }
+
+  // Time on the wire: the link sends one message at a time
+  double start = (_link_free > (double)now) ? _link_free : (double)now;
+  if (_bandwidth > 0) {
+    _link_free = start + (double)length * 1000.0 / (double)_bandwidth;
+  }
+  else {
+    _link_free = start;
+  }
+
+  int delay = _latency;
+  if (_jitter > 0) {
+    delay += (int)((_uniform() * 2.0f - 1.0f) * (float)_jitter);
+  }
+  if (delay < 0) {
+    delay = 0;
+  }
+
+  if (_uniform() < _loss) {
+    delay += NETSIM_RETRANSMIT + _latency;
+  }
+
+  Uint32 release = (Uint32)_link_free + (Uint32)delay;
+
+  // A stream delivers in order, unless this one is allowed to overtake
+  if (_uniform() >= _reorder) {
+    if ((Sint32)(_last_release - release) > 0) {
+      release = _last_release;
+    }
+    _last_release = release;
+  }
+
+  Message& message = _queue[_count++];
+  message.release = release;
+  message.seq     = _seq++;
+  message.length  = length;
+  memcpy(message.data, data, length);
+
+  return true;
+}
+
+size_t NetSim::release(Uint32 now, unsigned char* data, size_t capacity) {
+  int next = -1;
+
+  for (int i = 0; i < _count; i++) {
+    Message& message = _queue[i];
+    if ((Sint32)(message.release - now) > 0) {
+      continue;
+    }
+
+    if (next < 0 ||
+        (Sint32)(message.release - _queue[next].release) < 0 ||
+        (message.release == _queue[next].release &&
+         (Sint32)(message.seq - _queue[next].seq) < 0)) {
+      next = i;
+    }
+  }
+
+  if (next < 0) {
+    return 0;
+  }
+
+  Message& message = _queue[next];
+  size_t length = message.length;
+
+  if (length > capacity) {
+    length = 0;
+  }
+  else {
+    memcpy(data, message.data, length);
+  }
+
+  _queue[next] = _queue[_count - 1];
+  _count--;
+
+  return length;
+}
+
+void NetSim::clear() {
+  _count        = 0;
+  _last_release = 0;
+  _link_free    = 0.0;
+}
@@ -0,0 +1,93 @@
+#ifndef NETSIM_INCLUDED
+#define NETSIM_INCLUDED
+
+#include "main.h"
+
+// Messages that may be in flight at once
+#define NETSIM_MAX_QUEUED 1024
+
+// Milliseconds a lost segment costs before TCP retransmits it
+#define NETSIM_RETRANSMIT 200
+
+/*
+ * Makes a clean link behave like a bad one, reproducibly.
+ *
+ * Outgoing messages are held back and released later, as decided by a
+ * seeded random number generator:
+ *
+ *   latency=MS   added to every message
+ *   jitter=MS    up to this much more or less
+ *   loss=P       chance a message is "lost"; as with TCP it is not gone,
+ *                it arrives a retransmission timeout late and everything
+ *                behind it waits
+ *   reorder=P    chance a message may overtake those sent before it
+ *   bw=BYTES     bytes per second the link carries; more queues up
+ *   seed=N       random seed
+ *
+ * Each instance impairs what it sends, so give both players the same
+ * options for a symmetric link.
+ */
+class NetSim {
+public:
+  NetSim();
+
+  /*
+   * Parses "latency=80,jitter=20,loss=0.02,...". False on a bad option.
+   */
+  bool configure(const char* spec);
+
+  bool enabled();
+
+  /*
+   * Prints the configuration.
+   */
+  void describe();
+
+  /*
+   * Holds back a message sent at local time now. False if the queue is
+   * full, in which case the message is dropped.
+   */
+  bool enqueue(const unsigned char* data, size_t length, Uint32 now);
+
+  /*
+   * Copies out the next message due by now; returns its length, or 0.
+   */
+  size_t release(Uint32 now, unsigned char* data, size_t capacity);
+
+  /*
+   * Forgets everything in flight (the connection is gone).
+   */
+  void clear();
+
+private:
+  struct Message {
+    Uint32        release;
+    Uint32        seq;
+    size_t        length;
+    unsigned char data[MSG_HEADER_SIZE + MSG_PAYLOAD_MAX];
+  };
+
+  Uint32 _random();
+  float  _uniform();
+
+  bool    _enabled;
+
+  int     _latency;
+  int     _jitter;
+  float   _loss;
+  float   _reorder;
+  int     _bandwidth;
+  Uint32  _seed;
+
+  Uint32  _state;
+
+  Message* _queue;
+  int      _count;
+  Uint32   _seq;
+
+  // the last in-order release, and when the link is next idle (ms)
+  Uint32   _last_release;
+  double   _link_free;
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include "netstats.h"
+
+#include <math.h>
+
+NetStats::NetStats() {
+  memset(_window, 0, sizeof(_window));
+  memset(_rate, 0, sizeof(_rate));
+  memset(&_window_total, 0, sizeof(_window_total));
+  memset(&_rate_total, 0, sizeof(_rate_total));
+
+  _send_calls      = 0;
+  _recv_calls      = 0;
+  _send_calls_rate = 0;
+  _recv_calls_rate = 0;
+
+  _receive_queue_max  = 0;
+  _relay_queue_max    = 0;
+  _motion_queue_max   = 0;
+  _receive_queue_peak = 0;
+  _relay_queue_peak   = 0;
+  _motion_queue_peak  = 0;
+
+  memset(_ping_sent, 0, sizeof(_ping_sent));
+  _ping_seq = 0;
+
+  _rtt     = 0.0f;
+  _srtt    = 0.0f;
+  _jitter  = 0.0f;
+  _has_rtt = false;
+
+  memset(_input_sent, 0, sizeof(_input_sent));
+  _input_seq        = 0;
+  _input_delay      = 0.0f;
+  _input_delay_max  = 0;
+  _input_delay_peak = 0;
+  _has_input_delay  = false;
+
+  _window_time = 0.0f;
+  _log_time    = 0.0f;
+
+  _frame_in  = 0;
+  _frame_out = 0;
+  memset(_history_in, 0, sizeof(_history_in));
+  memset(_history_out, 0, sizeof(_history_out));
+  _history_head = 0;
+}
+
+int NetStats::_slot(unsigned char msgID) {
+  if (msgID >= NETSTATS_TYPES) {
+    return NETSTATS_TYPES - 1;
+  }
+  return msgID;
+}
+
+void NetStats::sent(unsigned char msgID, size_t bytes) {
+  Counters& counters = _window[_slot(msgID)];
+
+  counters.msgs_out++;
+  counters.bytes_out += (int)bytes;
+
+  _window_total.msgs_out++;
+  _window_total.bytes_out += (int)bytes;
+
+  _frame_out += (int)bytes;
+}
+
+void NetStats::received(unsigned char msgID, size_t bytes) {
+  Counters& counters = _window[_slot(msgID)];
+
+  counters.msgs_in++;
+  counters.bytes_in += (int)bytes;
+
+  _window_total.msgs_in++;
+  _window_total.bytes_in += (int)bytes;
+
+  _frame_in += (int)bytes;
+}
+
+void NetStats::sendCall() {
+  _send_calls++;
+}
+
+void NetStats::recvCall() {
+  _recv_calls++;
+}
+
+void NetStats::sampleQueues(int receive, int relay, int motion) {
+  if (receive > _receive_queue_max) { _receive_queue_max = receive; }
+  if (relay   > _relay_queue_max)   { _relay_queue_max   = relay; }
+  if (motion  > _motion_queue_max)  { _motion_queue_max  = motion; }
+}
+
+unsigned char NetStats::ping(Uint32 now) {
+  _ping_seq++;
+  _ping_sent[_ping_seq] = now;
+
+  return _ping_seq;
+}
+
+void NetStats::pong(unsigned char seq, Uint32 now) {
+  if (_ping_sent[seq] == 0) {
+    return;
+  }
+
+  float rtt = (float)(now - _ping_sent[seq]);
+  _ping_sent[seq] = 0;
+
+  if (_has_rtt) {
+    _jitter += (fabsf(rtt - _rtt) - _jitter) / 16.0f;
+    _srtt   += (rtt - _srtt) / 8.0f;
+  }
+  else {
+    _srtt    = rtt;
+    _has_rtt = true;
+  }
+
+  _rtt = rtt;
+}
+
+unsigned char NetStats::input(Uint32 now) {
+  // zero means no input yet
+  _input_seq++;
+  if (_input_seq == 0) {
+    _input_seq++;
+  }
+
+  _input_sent[_input_seq] = now;
+  return _input_seq;
+}
+
+void NetStats::inputShown(unsigned char input, Uint32 now) {
+  if (input == 0 || _input_sent[input] == 0) {
+    return;
+  }
+
+  float delay = (float)(now - _input_sent[input]) - _srtt / 2.0f;
+  _input_sent[input] = 0;
+
+  if (delay < 0.0f) {
+    delay = 0.0f;
+  }
+
+  if (_has_input_delay) {
+    _input_delay += (delay - _input_delay) / 8.0f;
+  }
+  else {
+    _input_delay     = delay;
+    _has_input_delay = true;
+  }
+
+  if ((int)delay > _input_delay_max) {
+    _input_delay_max = (int)delay;
+  }
+}
+
+void NetStats::update(float deltatime, bool log) {
+  _history_in[_history_head]  = _frame_in;
+  _history_out[_history_head] = _frame_out;
+  _history_head = (_history_head + 1) % NETSTATS_HISTORY;
+
+  _frame_in  = 0;
+  _frame_out = 0;
+
+  _window_time += deltatime;
+  if (_window_time >= 1.0f) {
+    // scale to a second, frames rarely line up with it exactly
+    float scale = 1.0f / _window_time;
+
+    for (int i = 0; i < NETSTATS_TYPES; i++) {
+      _rate[i].msgs_in   = (int)(_window[i].msgs_in   * scale + 0.5f);
+      _rate[i].msgs_out  = (int)(_window[i].msgs_out  * scale + 0.5f);
+      _rate[i].bytes_in  = (int)(_window[i].bytes_in  * scale + 0.5f);
+      _rate[i].bytes_out = (int)(_window[i].bytes_out * scale + 0.5f);
+    }
+
+    _rate_total.msgs_in   = (int)(_window_total.msgs_in   * scale + 0.5f);
+    _rate_total.msgs_out  = (int)(_window_total.msgs_out  * scale + 0.5f);
+    _rate_total.bytes_in  = (int)(_window_total.bytes_in  * scale + 0.5f);
+    _rate_total.bytes_out = (int)(_window_total.bytes_out * scale + 0.5f);
+
+    _send_calls_rate = (int)(_send_calls * scale + 0.5f);
+    _recv_calls_rate = (int)(_recv_calls * scale + 0.5f);
+
+    _receive_queue_peak = _receive_queue_max;
+    _relay_queue_peak   = _relay_queue_max;
+    _motion_queue_peak  = _motion_queue_max;
+    _input_delay_peak   = _input_delay_max;
+
+    memset(_window, 0, sizeof(_window));
+    memset(&_window_total, 0, sizeof(_window_total));
+    _send_calls = 0;
+    _recv_calls = 0;
+    _receive_queue_max = 0;
+    _relay_queue_max   = 0;
+    _motion_queue_max  = 0;
+    _input_delay_max   = 0;
+
+    _window_time = 0.0f;
+  }
+
+  if (!log) {
+    _log_time = 0.0f;
+    return;
+  }
+
+  _log_time += deltatime;
+  if (_log_time >= NETSTATS_LOG_INTERVAL) {
+    _log_time = 0.0f;
+    this->log();
+  }
+}
+
+void NetStats::log() {
+  printf("netstats t=%u rtt=%.1f srtt=%.1f jitter=%.1f"
+         " in_msgs=%d in_bytes=%d out_msgs=%d out_bytes=%d"
+         " send_calls=%d recv_calls=%d"
+         " recv_queue=%d relay_queue=%d motion_queue=%d"
+         " input_delay=%.1f input_delay_max=%d",
+         (unsigned int)SDL_GetTicks(), _rtt, _srtt, _jitter,
+         _rate_total.msgs_in, _rate_total.bytes_in,
+         _rate_total.msgs_out, _rate_total.bytes_out,
+         _send_calls_rate, _recv_calls_rate,
+         _receive_queue_peak, _relay_queue_peak, _motion_queue_peak,
+         _input_delay, _input_delay_peak);
+
+  // per type: id:in_msgs/in_bytes/out_msgs/out_bytes
+  printf(" types=");
+  bool first = true;
+  for (int i = 0; i < NETSTATS_TYPES; i++) {
+    Counters& rate = _rate[i];
+    if (rate.msgs_in == 0 && rate.msgs_out == 0) {
+      continue;
+    }
+
+    printf("%s%d:%d/%d/%d/%d", first ? "" : ",", i,
+           rate.msgs_in, rate.bytes_in, rate.msgs_out, rate.bytes_out);
+    first = false;
+  }
+  printf("\n");
+}
+
+float NetStats::rtt() {
+  return _rtt;
+}
+
+float NetStats::smoothedRtt() {
+  return _srtt;
+}
+
+float NetStats::jitter() {
+  return _jitter;
+}
+
+float NetStats::inputDelay() {
+  return _input_delay;
+}
+
+int NetStats::messagesInPerSecond() {
+  return _rate_total.msgs_in;
+}
+
+int NetStats::messagesOutPerSecond() {
+  return _rate_total.msgs_out;
+}
+
+int NetStats::bytesInPerSecond() {
+  return _rate_total.bytes_in;
+}
+
+int NetStats::bytesOutPerSecond() {
+  return _rate_total.bytes_out;
+}
+
+int NetStats::historyIn(int index) {
+  return _history_in[(_history_head + index) % NETSTATS_HISTORY];
+}
+
+int NetStats::historyOut(int index) {
+  return _history_out[(_history_head + index) % NETSTATS_HISTORY];
+}
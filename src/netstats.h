@@ -0,0 +1,151 @@
+#ifndef NETSTATS_INCLUDED
+#define NETSTATS_INCLUDED
+
+#include "main.h"
+
+// Message ids tracked individually; anything above shares the last slot
+#define NETSTATS_TYPES 32
+
+// Frames shown in the netgraph
+#define NETSTATS_HISTORY 128
+
+// Seconds between pings
+#define NETSTATS_PING_INTERVAL 1.0f
+
+// Seconds between log lines
+#define NETSTATS_LOG_INTERVAL 5.0f
+
+/*
+ * Counts what goes over the wire so stutter can be lined up with the
+ * network conditions at the time.
+ *
+ * Traffic is counted per message type over one second windows; the
+ * rates reported are those of the last complete second. Round trip time
+ * comes from MSG_PING/MSG_PONG, with jitter smoothed as in RFC 3550.
+ */
+class NetStats {
+public:
+  NetStats();
+
+  /*
+   * Records a message (header and payload) leaving or arriving.
+   */
+  void sent(unsigned char msgID, size_t bytes);
+  void received(unsigned char msgID, size_t bytes);
+
+  /*
+   * Records a send or recv system call.
+   */
+  void sendCall();
+  void recvCall();
+
+  /*
+   * Samples queue depths: bytes waiting in the receive buffer, frames
+   * queued for the slowest spectator, motion samples buffered.
+   */
+  void sampleQueues(int receive, int relay, int motion);
+
+  /*
+   * Remembers when ping seq went out; returns the seq to send.
+   */
+  unsigned char ping(Uint32 now);
+
+  /*
+   * Takes the pong for ping seq into the RTT and jitter estimates.
+   */
+  void pong(unsigned char seq, Uint32 now);
+
+  /*
+   * Marks a local key press at time now; returns the marker to send
+   * along with our next motion sample.
+   */
+  unsigned char input(Uint32 now);
+
+  /*
+   * The peer has drawn the sample carrying marker input. The echo came
+   * back over the link, so half the smoothed RTT is taken off.
+   */
+  void inputShown(unsigned char input, Uint32 now);
+
+  /*
+   * Ends a frame: advances the graph, rolls the windows and, if asked,
+   * prints the periodic log line.
+   */
+  void update(float deltatime, bool log);
+
+  /*
+   * Prints the current figures as one machine-readable line.
+   */
+  void log();
+
+  // milliseconds
+  float rtt();
+  float smoothedRtt();
+  float jitter();
+
+  // milliseconds from a key press to the opponent seeing it
+  float inputDelay();
+
+  // per second, over the last complete second
+  int messagesInPerSecond();
+  int messagesOutPerSecond();
+  int bytesInPerSecond();
+  int bytesOutPerSecond();
+
+  // bytes per frame for the graph, oldest first
+  int historyIn(int index);
+  int historyOut(int index);
+
+private:
+  struct Counters {
+    int msgs_in;
+    int msgs_out;
+    int bytes_in;
+    int bytes_out;
+  };
+
+  static int _slot(unsigned char msgID);
+
+  Counters _window[NETSTATS_TYPES];
+  Counters _rate[NETSTATS_TYPES];
+  Counters _window_total;
+  Counters _rate_total;
+
+  int      _send_calls;
+  int      _recv_calls;
+  int      _send_calls_rate;
+  int      _recv_calls_rate;
+
+  int      _receive_queue_max;
+  int      _relay_queue_max;
+  int      _motion_queue_max;
+  int      _receive_queue_peak;
+  int      _relay_queue_peak;
+  int      _motion_queue_peak;
+
+  Uint32   _ping_sent[256];
+  unsigned char _ping_seq;
+
+  float    _rtt;
+  float    _srtt;
+  float    _jitter;
+  bool     _has_rtt;
+
+  Uint32   _input_sent[256];
+  unsigned char _input_seq;
+  float    _input_delay;
+  int      _input_delay_max;
+  int      _input_delay_peak;
+  bool     _has_input_delay;
+
+  float    _window_time;
+  float    _log_time;
+
+  int      _frame_in;
+  int      _frame_out;
+  int      _history_in[NETSTATS_HISTORY];
+  int      _history_out[NETSTATS_HISTORY];
+  int      _history_head;
+};
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * Packs images, sounds and meshes into one archive the game maps at
+ * startup (see archive.h). Everything is converted here to what GL and
+ * the mixer take, so the game does no decoding at all:
+ *
+ *   .png  a KTX texture with every mip level: RGBA, 8 bits a channel,
+ *         or S3TC blocks given --compress (see texture.h)
+ *   .wav  PCM in the format Audio::init opens the device with
+ *   .obj  interleaved vertices and elements, as Mesh builds them
+ *
+ * Usage: omgwtfadd-pack [--compress] assets.pak file...  (make pack passes every
+ * image, sound and mesh the game has.)
+ * Paths are stored as given, so run it from where the game runs.
+ */
+
+#include "main.h"
+#include "archive.h"
+#include "assets.h"
+#include "audio.h"
+#include "texture.h"
+
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+struct Blob {
+  ArchiveEntry       entry;
+  std::vector<Uint8> bytes;
+};
+
+static bool compress = false;
+
+static bool packImage(const char* path, Blob& blob) {
+  SDL_Surface* image = IMG_Load(path);
+  if (!image) {
+    printf("%s: %s\n", path, IMG_GetError());
+    return false;
+  }
+
+  // bytes R, G, B, A in memory, whatever the machine
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+  SDL_Surface* rgba = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32,
+                        0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff);
+#else
+  SDL_Surface* rgba = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32,
+                        0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+#endif
+
+  SDL_Surface* converted = SDL_ConvertSurface(image, rgba->format, SDL_SWSURFACE);
+  SDL_FreeSurface(rgba);
+  SDL_FreeSurface(image);
+
+  if (!converted) {
+    printf("%s: %s\n", path, SDL_GetError());
+    return false;
+  }
+
+  int width  = converted->w;
+  int height = converted->h;
+  int row    = width * 4;
+
+  // every level as RGBA first, each filtered from the one above
+  int levels = Texture::levels(width, height);
+  std::vector< std::vector<Uint8> > pixels(levels);
+  pixels[0].resize(row * height);
+
+  SDL_LockSurface(converted);
+  for (int y = 0; y < height; y++) {
+    memcpy(&pixels[0][y * row], (Uint8*)converted->pixels + y * converted->pitch, row);
+  }
+  SDL_UnlockSurface(converted);
+  SDL_FreeSurface(converted);
+
+  bool opaque = true;
+  for (size_t i = 3; i < pixels[0].size(); i += 4) {
+    opaque = opaque && pixels[0][i] == 255;
+  }
+
+  TextureImage texture;
+  texture.internal_format = !compress ? GL_RGBA8
+                        : opaque    ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                                    : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  texture.levels = levels;
+
+  std::vector< std::vector<Uint8> > blocks(levels);
+  int w = width, h = height;
+  for (int i = 0; i < levels; i++) {
+    if (i > 0) {
+      Texture::downsample(&pixels[i - 1][0], texture.level[i - 1].width,
+                          texture.level[i - 1].height, pixels[i]);
+    }
+
+    const std::vector<Uint8>& level = pixels[i];
+    if (compress) {
+      Texture::compress(&level[0], w, h, opaque, blocks[i]);
+    }
+
+    texture.level[i].width  = w;
+    texture.level[i].height = h;
+    texture.level[i].data   = compress ? &blocks[i][0] : &level[0];
+    texture.level[i].size   = Texture::levelSize(texture.internal_format, w, h);
+
+    w = w > 1 ? w / 2 : 1;
+    h = h > 1 ? h / 2 : 1;
+  }
+
+  Texture::writeKtx(texture, blob.bytes);
+
+  blob.entry.width  = width;
+  blob.entry.height = height;
+  blob.entry.format = texture.internal_format;
+  return true;
+}
+
+static bool packSound(const char* path, Blob& blob) {
+  SDL_AudioSpec spec;
+  Uint8* samples;
+  Uint32 length;
+
+  if (!SDL_LoadWAV(path, &spec, &samples, &length)) {
+    printf("%s: %s\n", path, SDL_GetError());
+    return false;
+  }
+
+  SDL_AudioCVT cvt;
+  if (SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq,
+                        AUDIO_FORMAT, AUDIO_CHANNELS, AUDIO_RATE) < 0) {
+    printf("%s: %s\n", path, SDL_GetError());
+    SDL_FreeWAV(samples);
+    return false;
+  }
+
+  std::vector<Uint8> buffer(length * (cvt.len_mult > 0 ? cvt.len_mult : 1));
+  memcpy(&buffer[0], samples, length);
+  SDL_FreeWAV(samples);
+
+  cvt.buf = &buffer[0];
+  cvt.len = length;
+  SDL_ConvertAudio(&cvt);
+
+  blob.bytes.assign(buffer.begin(), buffer.begin() + cvt.len_cvt);
+
+  blob.entry.rate     = AUDIO_RATE;
+  blob.entry.channels = AUDIO_CHANNELS;
+  blob.entry.format   = AUDIO_FORMAT;
+  return true;
+}
+
+static bool packMesh(const char* path, Blob& blob) {
+  MeshData mesh;
+  if (!Mesh::load(path, mesh)) {
+    return false;
+  }
+
+  size_t floats   = mesh.data.size() * sizeof(float);
+  size_t elements = mesh.elements.size() * sizeof(Uint32);
+  size_t aligned  = (floats + ARCHIVE_ALIGN - 1) & ~(size_t)(ARCHIVE_ALIGN - 1);
+
+  blob.bytes.resize(aligned + elements);
+  memcpy(&blob.bytes[0], &mesh.data[0], floats);
+  memcpy(&blob.bytes[aligned], &mesh.elements[0], elements);
+
+  blob.entry.floats          = mesh.data.size();
+  blob.entry.elements        = mesh.elements.size();
+  blob.entry.elements_offset = aligned;
+  return true;
+}
+
+static const char* extension(const char* path) {
+  const char* dot = strrchr(path, '.');
+  return dot ? dot + 1 : "";
+}
+
+int main(int argc, char** argv) {
+  int first = 1;
+  if (argc > 1 && strcmp(argv[1], "--compress") == 0) {
+    compress = true;
+    first++;
+  }
+
+  if (argc < first + 2) {
+    printf("usage: %s [--compress] archive files...\n", argv[0]);
+    return 1;
+  }
+
+  const char* output = argv[first];
+  std::vector<Blob> blobs;
+
+  for (int i = first + 1; i < argc; i++) {
+    const char* path = argv[i];
+
+    if (strlen(path) >= ARCHIVE_NAME_LENGTH) {
+      printf("%s: path too long\n", path);
+      return 1;
+    }
+
+    Blob blob;
+    memset(&blob.entry, 0, sizeof(blob.entry));
+    strncpy(blob.entry.name, path, ARCHIVE_NAME_LENGTH);
+
+    bool ok;
+    const char* ext = extension(path);
+    if (strcmp(ext, "png") == 0) {
+      blob.entry.type = ASSET_IMAGE;
+      ok = packImage(path, blob);
+    }
+    else if (strcmp(ext, "wav") == 0) {
+      blob.entry.type = ASSET_SOUND;
+      ok = packSound(path, blob);
+    }
+    else if (strcmp(ext, "obj") == 0) {
+      blob.entry.type = ASSET_MESH;
+      ok = packMesh(path, blob);
+    }
+    else {
+      printf("%s: don't know how to pack this\n", path);
+      return 1;
+    }
+
+    if (!ok) {
+      return 1;
+    }
+
+    // so the game can tell the file changed after packing
+    struct stat info;
+    if (stat(path, &info) != 0) {
+      printf("%s: cannot stat\n", path);
+      return 1;
+    }
+    blob.entry.source_size = (Uint32)info.st_size;
+    blob.entry.source_time = (Uint32)info.st_mtime;
+
+    blob.entry.size = blob.bytes.size();
+    blobs.push_back(blob);
+  }
+
+  // lay out: header, index, then every blob aligned
+  ArchiveHeader header;
+  memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+  header.version = ARCHIVE_VERSION;
+  header.count   = blobs.size();
+
+  size_t offset = sizeof(ArchiveHeader) + blobs.size() * sizeof(ArchiveEntry);
+  for (size_t i = 0; i < blobs.size(); i++) {
+    offset = (offset + ARCHIVE_ALIGN - 1) & ~(size_t)(ARCHIVE_ALIGN - 1);
+    blobs[i].entry.offset = offset;
+    offset += blobs[i].bytes.size();
+  }
+
+  FILE* file = fopen(output, "wb");
+  if (!file) {
+    printf("%s: cannot write\n", output);
+    return 1;
+  }
+
+  fwrite(&header, sizeof(header), 1, file);
+  for (size_t i = 0; i < blobs.size(); i++) {
+    fwrite(&blobs[i].entry, sizeof(ArchiveEntry), 1, file);
+  }
+
+  static const Uint8 padding[ARCHIVE_ALIGN] = {0};
+  for (size_t i = 0; i < blobs.size(); i++) {
+    long position = ftell(file);
+    fwrite(padding, 1, blobs[i].entry.offset - position, file);
+    if (!blobs[i].bytes.empty()) {
+      fwrite(&blobs[i].bytes[0], 1, blobs[i].bytes.size(), file);
+    }
+  }
+
+  bool failed = ferror(file) != 0;
+  fclose(file);
+
+  if (failed) {
+    printf("%s: write failed\n", output);
+    return 1;
+  }
+
+  printf("packed %d files into %s (%ld bytes)\n", (int)blobs.size(), output, (long)offset);
+  return 0;
+}
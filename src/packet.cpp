@@ -0,0 +1,121 @@
+#include "packet.h"
+
+#include <string.h>
+
+Packet::Packet(unsigned char* buffer, size_t capacity)
+  : _buffer(buffer),
+    _capacity(capacity),
+    _position(0),
+    _failed(false) {
+}
+
+Packet::Packet(const unsigned char* buffer, size_t length)
+  : _buffer(const_cast<unsigned char*>(buffer)),
+    _capacity(length),
+    _position(0),
+    _failed(false) {
+}
+
+bool Packet::_reserve(size_t count) {
+  if (_failed || _position + count > _capacity) {
+    _failed = true;
+    return false;
+  }
+
+  return true;
+}
+
+void Packet::write8(unsigned char value) {
+  if (!_reserve(1)) { return; }
+
+  _buffer[_position++] = value;
+}
+
+void Packet::write16(unsigned short value) {
+  if (!_reserve(2)) { return; }
+
+  _buffer[_position++] = (unsigned char)(value >> 8);
+  _buffer[_position++] = (unsigned char)(value);
+}
+
+void Packet::write32(unsigned int value) {
+  if (!_reserve(4)) { return; }
+
+  _buffer[_position++] = (unsigned char)(value >> 24);
+  _buffer[_position++] = (unsigned char)(value >> 16);
+  _buffer[_position++] = (unsigned char)(value >> 8);
+  _buffer[_position++] = (unsigned char)(value);
+}
+
+void Packet::writeFloat(float value) {
+  unsigned int bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  write32(bits);
+}
+
+void Packet::writeBytes(const unsigned char* bytes, size_t count) {
+  if (!_reserve(count)) { return; }
+
+  memcpy(_buffer + _position, bytes, count);
+  _position += count;
+}
+
+unsigned char Packet::read8() {
+  if (!_reserve(1)) { return 0; }
+
+  return _buffer[_position++];
+}
+
+unsigned short Packet::read16() {
+  if (!_reserve(2)) { return 0; }
+
+  unsigned short value = (unsigned short)((_buffer[_position] << 8) |
+                                           _buffer[_position + 1]);
+  _position += 2;
+
+  return value;
+}
+
+unsigned int Packet::read32() {
+  if (!_reserve(4)) { return 0; }
+
+  unsigned int value = ((unsigned int)_buffer[_position]     << 24) |
+                       ((unsigned int)_buffer[_position + 1] << 16) |
+                       ((unsigned int)_buffer[_position + 2] << 8)  |
+                        (unsigned int)_buffer[_position + 3];
+  _position += 4;
+
+  return value;
+}
+
+float Packet::readFloat() {
+  unsigned int bits = read32();
+
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+
+  return value;
+}
+
+void Packet::readBytes(unsigned char* bytes, size_t count) {
+  if (!_reserve(count)) {
+    memset(bytes, 0, count);
+    return;
+  }
+
+  memcpy(bytes, _buffer + _position, count);
+  _position += count;
+}
+
+size_t Packet::length() {
+  return _position;
+}
+
+const unsigned char* Packet::data() {
+  return _buffer;
+}
+
+bool Packet::failed() {
+  return _failed;
+}
@@ -0,0 +1,60 @@
+#ifndef PACKET_INCLUDED
+#define PACKET_INCLUDED
+
+#include <stddef.h>
+
+/*
+ * Serializes values into (or out of) a fixed buffer in network byte order.
+ *
+ * Reads and writes past the end of the buffer are ignored and mark the
+ * packet as failed, so callers only need to check failed() once at the end.
+ */
+class Packet {
+public:
+  /*
+   * Wraps a buffer to be written into.
+   */
+  Packet(unsigned char* buffer, size_t capacity);
+
+  /*
+   * Wraps a received buffer to be read from.
+   */
+  Packet(const unsigned char* buffer, size_t length);
+
+  void write8(unsigned char value);
+  void write16(unsigned short value);
+  void write32(unsigned int value);
+  void writeFloat(float value);
+  void writeBytes(const unsigned char* bytes, size_t count);
+
+  unsigned char  read8();
+  unsigned short read16();
+  unsigned int   read32();
+  float          readFloat();
+  void           readBytes(unsigned char* bytes, size_t count);
+
+  /*
+   * Returns the number of bytes written or read so far.
+   */
+  size_t length();
+
+  /*
+   * Returns the start of the buffer.
+   */
+  const unsigned char* data();
+
+  /*
+   * Returns true when a read or write ran off the end of the buffer.
+   */
+  bool failed();
+
+private:
+  bool _reserve(size_t count);
+
+  unsigned char* _buffer;
+  size_t         _capacity;
+  size_t         _position;
+  bool           _failed;
+};
+
+#endif
@@ -0,0 +1,329 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <new>
+
+#if defined(WIN32)
+#include <windows.h>
+#elif !defined(EMSCRIPTEN)
+#include <time.h>
+#endif
+
+int           Profiler::_counters[PROFILE_COUNTERS];
+Uint64        Profiler::_elapsed[PROFILE_SCOPES];
+int           Profiler::_scope_allocs[PROFILE_SCOPES];
+
+int           Profiler::_frames = 0;
+int           Profiler::_check_from = -1;
+int           Profiler::_check_failures = 0;
+
+Uint64        Profiler::_frame_start = 0;
+ProfileFrame  Profiler::_last;
+
+float         Profiler::_history[PROFILE_HISTORY];
+int           Profiler::_history_head = 0;
+int           Profiler::_history_count = 0;
+
+ProfileFrame* Profiler::_records = NULL;
+int           Profiler::_record_head = 0;
+int           Profiler::_record_count = 0;
+const char*   Profiler::_record_file = NULL;
+
+static const char* scope_names[PROFILE_SCOPES] = {
+  "update", "draw", "draw_board", "flame_update", "move_ball"
+};
+
+static const char* counter_names[PROFILE_COUNTERS] = {
+  "draw_calls", "triangles", "texture_binds", "uniforms", "state_changes",
+  "allocations", "allocated_bytes", "arena_bytes"
+};
+
+// whether this thread's allocations count (see track())
+static __thread int tracked = 0;
+
+// this thread's open scopes, innermost last
+static __thread int nesting[PROFILE_NESTING];
+static __thread int nested = 0;
+
+// when this thread entered each scope, and how deep it is in it
+static __thread Uint64 scope_start[PROFILE_SCOPES];
+static __thread int    scope_depth[PROFILE_SCOPES];
+
+Uint64 Profiler::now() {
+#if defined(WIN32)
+  static LARGE_INTEGER frequency;
+  if (frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
+  }
+
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (Uint64)(counter.QuadPart / (double)frequency.QuadPart * 1e9);
+#elif defined(EMSCRIPTEN)
+  return (Uint64)(emscripten_get_now() * 1e6);
+#else
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (Uint64)time.tv_sec * 1000000000ULL + time.tv_nsec;
+#endif
+}
+
+void Profiler::begin(int scope) {
+  if (scope_depth[scope]++ == 0) {
+    scope_start[scope] = now();
+  }
+
+  // deeper than that and allocations stay with the last one that fit
+  if (nested < PROFILE_NESTING) {
+    nesting[nested] = scope;
+  }
+  nested++;
+}
+
+void Profiler::end(int scope) {
+  if (--scope_depth[scope] == 0) {
+    __sync_fetch_and_add(&_elapsed[scope], now() - scope_start[scope]);
+  }
+
+  nested--;
+}
+
+void Profiler::track() {
+  tracked = 1;
+}
+
+void Profiler::allocated(size_t bytes) {
+  if (!tracked) {
+    return;
+  }
+
+  // the simulation thread allocates too
+  __sync_fetch_and_add(&_counters[PROFILE_ALLOCATIONS], 1);
+  __sync_fetch_and_add(&_counters[PROFILE_ALLOCATED], (int)bytes);
+
+  if (nested > 0) {
+    __sync_fetch_and_add(&_scope_allocs[nesting[std::min(nested, PROFILE_NESTING) - 1]], 1);
+  }
+}
+
+void Profiler::checkAllocations(int warmup) {
+  _check_from = _frames + warmup;
+}
+
+void Profiler::warmUp(int frames) {
+  if (_check_from >= 0) {
+    _check_from = std::max(_check_from, _frames + frames);
+  }
+}
+
+int Profiler::allocationFailures() {
+  return _check_failures;
+}
+
+void Profiler::frame() {
+  Uint64 time = now();
+
+  // taken and zeroed in one, so nothing another thread adds meanwhile
+  // is lost; it goes to the next frame
+  ProfileFrame taken;
+  for (int i = 0; i < PROFILE_SCOPES; i++) {
+    taken.scope_ms[i]     = __atomic_exchange_n(&_elapsed[i], 0, __ATOMIC_ACQ_REL) / 1e6f;
+    taken.scope_allocs[i] = __atomic_exchange_n(&_scope_allocs[i], 0, __ATOMIC_ACQ_REL);
+  }
+  for (int i = 0; i < PROFILE_COUNTERS; i++) {
+    taken.counters[i] = __atomic_exchange_n(&_counters[i], 0, __ATOMIC_ACQ_REL);
+  }
+
+  // the first call only starts the clock
+  if (_frame_start != 0) {
+    taken.frame_ms = (time - _frame_start) / 1e6f;
+    _last = taken;
+
+    if (_check_from >= 0 && _frames >= _check_from && _last.counters[PROFILE_ALLOCATIONS] > 0) {
+      _check_failures++;
+
+      if (_check_failures <= PROFILE_ALLOC_REPORTS) {
+        printf("alloc: frame %d made %d allocations (%d bytes):", _frames,
+               _last.counters[PROFILE_ALLOCATIONS], _last.counters[PROFILE_ALLOCATED]);
+        for (int i = 0; i < PROFILE_SCOPES; i++) {
+          if (_last.scope_allocs[i]) {
+            printf(" %s=%d", scope_names[i], _last.scope_allocs[i]);
+          }
+        }
+        printf("\n");
+      }
+    }
+
+    _history[_history_head] = _last.frame_ms;
+    _history_head = (_history_head + 1) % PROFILE_HISTORY;
+    if (_history_count < PROFILE_HISTORY) {
+      _history_count++;
+    }
+
+    if (_records) {
+      _records[_record_head] = _last;
+      _record_head = (_record_head + 1) % PROFILE_RECORDS;
+      if (_record_count < PROFILE_RECORDS) {
+        _record_count++;
+      }
+    }
+  }
+
+  _frame_start = time;
+  _frames++;
+}
+
+const ProfileFrame& Profiler::last() {
+  return _last;
+}
+
+void Profiler::frameTimes(float& min, float& avg, float& p99) {
+  min = avg = p99 = 0.0f;
+  if (_history_count == 0) {
+    return;
+  }
+
+  float sorted[PROFILE_HISTORY];
+  float total = 0.0f;
+  for (int i = 0; i < _history_count; i++) {
+    sorted[i] = _history[i];
+    total    += _history[i];
+  }
+  std::sort(sorted, sorted + _history_count);
+
+  min = sorted[0];
+  avg = total / _history_count;
+  p99 = sorted[(int)((_history_count - 1) * 0.99f + 0.5f)];
+}
+
+float Profiler::history(int index) {
+  if (index >= _history_count) {
+    return 0.0f;
+  }
+
+  int oldest = (_history_head - _history_count + PROFILE_HISTORY) % PROFILE_HISTORY;
+  return _history[(oldest + index) % PROFILE_HISTORY];
+}
+
+void Profiler::record(const char* filename) {
+  if (!_records) {
+    _records = new ProfileFrame[PROFILE_RECORDS];
+  }
+  _record_file = filename;
+}
+
+void Profiler::finish() {
+  if (!_records) {
+    return;
+  }
+
+  FILE* file = fopen(_record_file, "w");
+  if (!file) {
+    printf("profile: cannot write '%s'\n", _record_file);
+    return;
+  }
+
+  fprintf(file, "frame,frame_ms");
+  for (int i = 0; i < PROFILE_SCOPES; i++) {
+    fprintf(file, ",%s_ms", scope_names[i]);
+  }
+  for (int i = 0; i < PROFILE_SCOPES; i++) {
+    fprintf(file, ",%s_allocs", scope_names[i]);
+  }
+  for (int i = 0; i < PROFILE_COUNTERS; i++) {
+    fprintf(file, ",%s", counter_names[i]);
+  }
+  fprintf(file, "\n");
+
+  int oldest = (_record_head - _record_count + PROFILE_RECORDS) % PROFILE_RECORDS;
+  for (int n = 0; n < _record_count; n++) {
+    const ProfileFrame& frame = _records[(oldest + n) % PROFILE_RECORDS];
+
+    fprintf(file, "%d,%.3f", n, frame.frame_ms);
+    for (int i = 0; i < PROFILE_SCOPES; i++) {
+      fprintf(file, ",%.3f", frame.scope_ms[i]);
+    }
+    for (int i = 0; i < PROFILE_SCOPES; i++) {
+      fprintf(file, ",%d", frame.scope_allocs[i]);
+    }
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+      fprintf(file, ",%d", frame.counters[i]);
+    }
+    fprintf(file, "\n");
+  }
+
+  fclose(file);
+  printf("profile: %d frames written to %s\n", _record_count, _record_file);
+
+  delete [] _records;
+  _records = NULL;
+}
+
+const char* Profiler::scopeName(int scope) {
+  return scope_names[scope];
+}
+
+const char* Profiler::counterName(int counter) {
+  return counter_names[counter];
+}
+
+// Every operator new and new[] (the nothrow ones too) passes through
+// here on its way to malloc
+
+#if __cplusplus >= 201103L
+#define PROFILE_THROWS
+#define PROFILE_NOTHROW noexcept
+#else
+#define PROFILE_THROWS  throw (std::bad_alloc)
+#define PROFILE_NOTHROW throw ()
+#endif
+
+void* operator new(size_t size) PROFILE_THROWS {
+  Profiler::allocated(size);
+
+  void* block = malloc(size ? size : 1);
+  if (!block) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void* operator new[](size_t size) PROFILE_THROWS {
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) PROFILE_NOTHROW {
+  Profiler::allocated(size);
+
+  return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) PROFILE_NOTHROW {
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void* block) PROFILE_NOTHROW {
+  free(block);
+}
+
+void operator delete[](void* block) PROFILE_NOTHROW {
+  free(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) PROFILE_NOTHROW {
+  free(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) PROFILE_NOTHROW {
+  free(block);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void* block, size_t) noexcept {
+  free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+  free(block);
+}
+#endif
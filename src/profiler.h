@@ -0,0 +1,176 @@
+#ifndef PROFILER_INCLUDED
+#define PROFILER_INCLUDED
+
+#include "main.h"
+
+// Counters, per frame
+#define PROFILE_DRAW_CALLS     0
+#define PROFILE_TRIANGLES      1
+#define PROFILE_TEXTURE_BINDS  2
+#define PROFILE_UNIFORMS       3
+#define PROFILE_STATE_CHANGES  4    // program switches, vertex setups
+#define PROFILE_ALLOCATIONS    5    // operator new, on the main thread
+#define PROFILE_ALLOCATED      6    // bytes asked for by those
+#define PROFILE_ARENA          7    // bytes taken from the frame arena
+
+#define PROFILE_COUNTERS       8
+
+// Timed scopes, per frame
+#define PROFILE_UPDATE         0
+#define PROFILE_DRAW           1
+#define PROFILE_DRAW_BOARD     2
+#define PROFILE_FLAME_UPDATE   3
+#define PROFILE_MOVE_BALL      4
+
+#define PROFILE_SCOPES         5
+
+// Frames behind the rolling figures and the overlay graph
+#define PROFILE_HISTORY 240
+
+// Frames kept for the CSV: ten minutes at 60 a second
+#define PROFILE_RECORDS 36000
+
+// Scopes open at once that allocations are put down to
+#define PROFILE_NESTING 16
+
+// Frames the allocation check lets by first, for loading and such
+#define PROFILE_ALLOC_WARMUP 300
+
+// Frames the allocation check prints before it only counts them
+#define PROFILE_ALLOC_REPORTS 10
+
+struct ProfileFrame {
+  float frame_ms;
+  float scope_ms[PROFILE_SCOPES];
+  int   scope_allocs[PROFILE_SCOPES];
+  int   counters[PROFILE_COUNTERS];
+};
+
+/*
+ * Where frame time goes.
+ *
+ * Counters are bumped at the GL call sites, on the main thread; scopes
+ * time the code inside them (a scope entered again while open, as
+ * moveBall does, counts once). frame() closes the books for the frame,
+ * on the main thread. Scopes may be timed on any thread: each keeps its
+ * own start times and adds what it timed in once the scope ends, so the
+ * time goes to the frame it ends in.
+ *
+ * Allocations are counted by replacing the global operator new. Only
+ * those made by the thread that called track() count; each goes to the
+ * frame and to the innermost open scope.
+ */
+class Profiler {
+public:
+  /*
+   * Nanoseconds since some fixed point.
+   */
+  static Uint64 now();
+
+  static void count(int counter, int n) {
+    _counters[counter] += n;
+  }
+
+  static void begin(int scope);
+  static void end(int scope);
+
+  /*
+   * Counts the calling thread's allocations from now on.
+   */
+  static void track();
+
+  /*
+   * Called for every operator new.
+   */
+  static void allocated(size_t bytes);
+
+  /*
+   * From the given frame on, reports every frame that allocates.
+   */
+  static void checkAllocations(int warmup);
+
+  /*
+   * If allocations are checked, lets the next frames by, as after
+   * setting up a scene.
+   */
+  static void warmUp(int frames);
+
+  /*
+   * Frames that allocated after the warm-up given to checkAllocations().
+   */
+  static int allocationFailures();
+
+  /*
+   * Ends a frame.
+   */
+  static void frame();
+
+  /*
+   * The last complete frame.
+   */
+  static const ProfileFrame& last();
+
+  /*
+   * Over the last PROFILE_HISTORY frames, in milliseconds.
+   */
+  static void frameTimes(float& min, float& avg, float& p99);
+
+  /*
+   * Frame times for the graph, oldest first.
+   */
+  static float history(int index);
+
+  /*
+   * Keeps every frame from now on, to write to the given CSV file when
+   * finish() is called.
+   */
+  static void record(const char* filename);
+
+  static void finish();
+
+  static const char* scopeName(int scope);
+  static const char* counterName(int counter);
+
+private:
+  // added to from any thread, taken (and zeroed) at once by frame()
+  static int          _counters[PROFILE_COUNTERS];
+  static Uint64       _elapsed[PROFILE_SCOPES];
+  static int          _scope_allocs[PROFILE_SCOPES];
+
+  static int          _frames;
+  static int          _check_from;
+  static int          _check_failures;
+
+  static Uint64       _frame_start;
+  static ProfileFrame _last;
+
+  static float        _history[PROFILE_HISTORY];
+  static int          _history_head;
+  static int          _history_count;
+
+  static ProfileFrame* _records;
+  static int          _record_head;
+  static int          _record_count;
+  static const char*  _record_file;
+};
+
+/*
+ * Times the rest of the block it is declared in.
+ */
+class ProfileScope {
+public:
+  ProfileScope(int scope) : _scope(scope) {
+    Profiler::begin(scope);
+  }
+
+  ~ProfileScope() {
+    Profiler::end(_scope);
+  }
+
+private:
+  int _scope;
+};
+
+#define PROFILE_SCOPE(scope) ProfileScope profile_scope(scope)
+
+#endif
@@ -0,0 +1,380 @@
+#include "relay.h"
+#include "packet.h"
+#include "components.h"
+
+#if !defined(NO_NETWORK) && !defined(WIN32)
+#define RELAY_SUPPORTED
+#endif
+
+#ifdef RELAY_SUPPORTED
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+Relay::Relay()
+  : _listen_fd(-1),
+    _lock(SDL_CreateMutex()),
+    _current(NULL),
+    _free(NULL),
+    _spectators(NULL),
+    _spectator_count(0) {
+}
+
+Relay::~Relay() {
+  close();
+
+  SDL_DestroyMutex(_lock);
+}
+
+bool Relay::listen(int port) {
+#ifdef RELAY_SUPPORTED
+  _listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (_listen_fd < 0) {
+    printf("relay: socket: %s\n", strerror(errno));
+    return false;
+  }
+
+  int yes = 1;
+  setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port        = htons((unsigned short)port);
+
+  if (bind(_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      ::listen(_listen_fd, 64) < 0) {
+    printf("relay: cannot listen on port %d: %s\n", port, strerror(errno));
+    ::close(_listen_fd);
+    _listen_fd = -1;
+    return false;
+  }
+
+  fcntl(_listen_fd, F_SETFL, fcntl(_listen_fd, F_GETFL, 0) | O_NONBLOCK);
+
+  _spectators = new Spectator[RELAY_MAX_SPECTATORS];
+
+  printf("relay: accepting spectators on port %d\n", port);
+  return true;
+#else
+  printf("relay: not supported on this platform\n");
+  return false;
+#endif
+}
+
+void Relay::close() {
+#ifdef RELAY_SUPPORTED
+  if (_listen_fd < 0) { return; }
+
+  SDL_mutexP(_lock);
+
+  while (_spectator_count > 0) {
+    _drop(_spectator_count - 1);
+  }
+
+  ::close(_listen_fd);
+  _listen_fd = -1;
+
+  if (_current) {
+    _release(_current);
+    _current = NULL;
+  }
+
+  while (_free) {
+    Frame* next = _free->next;
+    free(_free->data);
+    delete _free;
+    _free = next;
+  }
+
+  delete [] _spectators;
+  _spectators = NULL;
+
+  SDL_mutexV(_lock);
+#endif
+}
+
+int Relay::spectatorCount() {
+  SDL_mutexP(_lock);
+  int count = _spectator_count;
+  SDL_mutexV(_lock);
+
+  return count;
+}
+
+int Relay::queueDepth() {
+  int depth = 0;
+
+  SDL_mutexP(_lock);
+  for (int i = 0; i < _spectator_count; i++) {
+    if (_spectators[i].count > depth) {
+      depth = _spectators[i].count;
+    }
+  }
+  SDL_mutexV(_lock);
+
+  return depth;
+}
+
+void Relay::capture(int player,
+                    const unsigned char msg[MSG_HEADER_SIZE],
+                    const unsigned char* payload, size_t length) {
+  // Nobody to send to; late joiners get a snapshot instead
+  if (_listen_fd < 0) { return; }
+
+  SDL_mutexP(_lock);
+  if (_spectator_count > 0) {
+    if (!_current) {
+      _current = _acquire();
+    }
+
+    _appendMessage(_current, player, msg, payload, length);
+  }
+  SDL_mutexV(_lock);
+}
+
+void Relay::flush() {
+#ifdef RELAY_SUPPORTED
+  if (_listen_fd < 0) { return; }
+
+  SDL_mutexP(_lock);
+
+  Frame* frame = _current;
+  _current = NULL;
+
+  // Share this frame with everyone already watching
+  if (frame) {
+    for (int i = 0; i < _spectator_count; i++) {
+      if (!_enqueue(_spectators[i], frame)) {
+        printf("relay: spectator fell behind, disconnecting\n");
+        _drop(i);
+        i--;
+      }
+    }
+
+    _release(frame);
+  }
+
+  // New spectators start from a snapshot of the current frame
+  _accept();
+
+  for (int i = 0; i < _spectator_count; i++) {
+    if (!_write(_spectators[i])) {
+      _drop(i);
+      i--;
+    }
+  }
+
+  SDL_mutexV(_lock);
+#endif
+}
+
+Relay::Frame* Relay::_acquire() {
+  Frame* frame = _free;
+
+  if (frame) {
+    _free = frame->next;
+  }
+  else {
+    frame = new Frame;
+    frame->capacity = 256;
+    frame->data = (unsigned char*)malloc(frame->capacity);
+  }
+
+  frame->refs   = 1;
+  frame->player = -1;
+  frame->length = 0;
+  frame->next   = NULL;
+
+  return frame;
+}
+
+void Relay::_release(Frame* frame) {
+  frame->refs--;
+
+  if (frame->refs == 0) {
+    frame->next = _free;
+    _free = frame;
+  }
+}
+
+void Relay::_append(Frame* frame, const unsigned char* data, size_t length) {
+  if (frame->length + length > frame->capacity) {
+    while (frame->length + length > frame->capacity) {
+      frame->capacity *= 2;
+    }
+    frame->data = (unsigned char*)realloc(frame->data, frame->capacity);
+  }
+
+  memcpy(frame->data + frame->length, data, length);
+  frame->length += length;
+}
+
+void Relay::_appendMessage(Frame* frame, int player,
+                           const unsigned char msg[MSG_HEADER_SIZE],
+                           const unsigned char* payload, size_t length) {
+  if (frame->player != player) {
+    unsigned char tag[MSG_HEADER_SIZE] = {MSG_RELAY_PLAYER,
+                                          (unsigned char)player, 0, 0};
+    _append(frame, tag, MSG_HEADER_SIZE);
+    frame->player = player;
+  }
+
+  _append(frame, msg, MSG_HEADER_SIZE);
+
+  if (payload && length) {
+    _append(frame, payload, length);
+  }
+}
+
+bool Relay::_enqueue(Spectator& spectator, Frame* frame) {
+  if (spectator.count == RELAY_MAX_QUEUED) {
+    return false;
+  }
+
+  frame->refs++;
+  spectator.queue[(spectator.head + spectator.count) % RELAY_MAX_QUEUED] = frame;
+  spectator.count++;
+
+  return true;
+}
+
+bool Relay::_write(Spectator& spectator) {
+#ifdef RELAY_SUPPORTED
+  while (spectator.count > 0) {
+    struct iovec iov[RELAY_MAX_QUEUED];
+    int n;
+
+    for (n = 0; n < spectator.count; n++) {
+      Frame* frame = spectator.queue[(spectator.head + n) % RELAY_MAX_QUEUED];
+      size_t skip  = (n == 0) ? spectator.offset : 0;
+
+      iov[n].iov_base = frame->data + skip;
+      iov[n].iov_len  = frame->length - skip;
+    }
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov    = iov;
+    message.msg_iovlen = n;
+
+    ssize_t sent = sendmsg(spectator.fd, &message, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return true;
+      }
+
+      printf("relay: spectator disconnected\n");
+      return false;
+    }
+
+    // Retire every frame that went out completely
+    while (spectator.count > 0) {
+      Frame* frame = spectator.queue[spectator.head];
+      size_t remaining = frame->length - spectator.offset;
+
+      if ((size_t)sent < remaining) {
+        spectator.offset += sent;
+        return true;
+      }
+
+      sent -= remaining;
+      spectator.offset = 0;
+
+      _release(frame);
+      spectator.head = (spectator.head + 1) % RELAY_MAX_QUEUED;
+      spectator.count--;
+    }
+  }
+#endif
+
+  return true;
+}
+
+void Relay::_accept() {
+#ifdef RELAY_SUPPORTED
+  for (;;) {
+    int fd = accept(_listen_fd, NULL, NULL);
+    if (fd < 0) {
+      return;
+    }
+
+    if (_spectator_count == RELAY_MAX_SPECTATORS) {
+      ::close(fd);
+      continue;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+
+    Spectator& spectator = _spectators[_spectator_count++];
+    spectator.fd     = fd;
+    spectator.head   = 0;
+    spectator.count  = 0;
+    spectator.offset = 0;
+
+    // Full state of both boards, so the stream can be applied from here on
+    Frame* snapshot = _acquire();
+    unsigned char payload[MSG_PAYLOAD_MAX];
+
+    for (int player = RELAY_LOCAL; player <= RELAY_REMOTE; player++) {
+      // first every board the next updates may be deltas against
+      BoardSync& sync = (player == RELAY_LOCAL) ? engine.board_sync
+                                                : engine.remote_board_sync;
+      size_t length;
+      for (int i = 0; (length = sync.encodeRemembered(i, payload, sizeof(payload))) > 0; i++) {
+        unsigned char msg[MSG_HEADER_SIZE] = {MSG_BOARDSYNC, 0,
+                                              (unsigned char)(length >> 8),
+                                              (unsigned char)(length)};
+        _appendMessage(snapshot, player, msg, payload, length);
+      }
+
+      Packet packet(payload, sizeof(payload));
+      engine.writeSnapshot(player == RELAY_LOCAL ? &engine.player1
+                                                 : &engine.player2, packet);
+
+      unsigned char msg[MSG_HEADER_SIZE] = {MSG_SNAPSHOT, 0,
+                                            (unsigned char)(packet.length() >> 8),
+                                            (unsigned char)(packet.length())};
+      _appendMessage(snapshot, player, msg, payload, packet.length());
+    }
+
+    _enqueue(spectator, snapshot);
+    _release(snapshot);
+
+    printf("relay: spectator joined (%d watching)\n", _spectator_count);
+  }
+#endif
+}
+
+void Relay::_drop(int index) {
+#ifdef RELAY_SUPPORTED
+  Spectator& spectator = _spectators[index];
+
+  while (spectator.count > 0) {
+    _release(spectator.queue[spectator.head]);
+    spectator.head = (spectator.head + 1) % RELAY_MAX_QUEUED;
+    spectator.count--;
+  }
+
+  ::close(spectator.fd);
+
+  _spectators[index] = _spectators[_spectator_count - 1];
+  _spectator_count--;
+#endif
+}
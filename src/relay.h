@@ -0,0 +1,105 @@
+#ifndef RELAY_INCLUDED
+#define RELAY_INCLUDED
+
+#include "main.h"
+
+// Which side of the match a captured message describes
+#define RELAY_LOCAL  0
+#define RELAY_REMOTE 1
+
+#define RELAY_MAX_SPECTATORS 512
+
+// Frames a spectator may fall behind before it is disconnected
+#define RELAY_MAX_QUEUED 64
+
+/*
+ * Fans the match's message stream out to spectators.
+ *
+ * Every message sent or received during a frame is appended to one shared
+ * frame buffer. At the end of the frame the buffer is handed, by reference,
+ * to every spectator's send queue and written with scatter/gather I/O, so
+ * the stream is serialized once no matter how many spectators watch.
+ *
+ * Spectators that join late are sent a snapshot of both boards first,
+ * after every board the next BoardSync updates may be deltas against.
+ *
+ * Messages may be captured from any thread; the frame buffer is locked.
+ */
+class Relay {
+public:
+  Relay();
+  ~Relay();
+
+  /*
+   * Starts accepting spectators on the given port.
+   */
+  bool listen(int port);
+
+  /*
+   * Disconnects all spectators and stops listening.
+   */
+  void close();
+
+  /*
+   * Records a message (and optional payload) for the given player.
+   */
+  void capture(int player,
+               const unsigned char msg[MSG_HEADER_SIZE],
+               const unsigned char* payload, size_t length);
+
+  /*
+   * Publishes this frame's messages, accepts new spectators and writes
+   * as much queued data as the sockets will take.
+   */
+  void flush();
+
+  int spectatorCount();
+
+  /*
+   * Frames queued for the spectator furthest behind.
+   */
+  int queueDepth();
+
+private:
+  struct Frame {
+    int            refs;
+    int            player;   // player the last appended message belongs to
+    size_t         length;
+    size_t         capacity;
+    unsigned char* data;
+    Frame*         next;     // free list
+  };
+
+  struct Spectator {
+    int    fd;
+    Frame* queue[RELAY_MAX_QUEUED];
+    int    head;
+    int    count;
+    size_t offset;           // bytes of queue[head] already written
+  };
+
+  Frame* _acquire();
+  void   _release(Frame* frame);
+  void   _append(Frame* frame, const unsigned char* data, size_t length);
+  void   _appendMessage(Frame* frame, int player,
+                        const unsigned char msg[MSG_HEADER_SIZE],
+                        const unsigned char* payload, size_t length);
+
+  bool   _enqueue(Spectator& spectator, Frame* frame);
+  bool   _write(Spectator& spectator);
+  void   _accept();
+  void   _drop(int index);
+
+  int        _listen_fd;
+
+  SDL_mutex* _lock;          // guards everything below against capture()
+
+  Frame*     _current;
+
+  Frame*     _free;
+
+  Spectator* _spectators;
+  int        _spectator_count;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef RULES_INCLUDED
+#define RULES_INCLUDED
+
+#include "main.h"
+
+/*
+ * What the board rules (tetrisrules.cpp, breakoutrules.cpp) tell the rest
+ * of the game as they play out. The game's are in engine.cpp; the bench
+ * has its own, so the rules can be run on a game_info with no engine.
+ */
+class Rules {
+public:
+  static void playSound(int sound);
+
+  /*
+   * Tells the peer our score grew, as MSG_APPENDSCORE.
+   */
+  static void appendScore(unsigned char points, unsigned char times);
+
+  /*
+   * Sends the peer an attack of the given severity.
+   */
+  static void sendAttack(int severity);
+
+  static void gameOver();
+};
+
+#endif
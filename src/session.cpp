@@ -0,0 +1,500 @@
+#include "session.h"
+#include "components.h"
+#include "trace.h"
+
+#if !defined(NO_NETWORK) && !defined(WIN32)
+#include <signal.h>
+#endif
+
+Session::Session()
+  : _state(SESSION_OFFLINE),
+    _hosting(false),
+    _quiet(false),
+    _port(0),
+    _since_send(0.0f),
+    _since_recv(0.0f),
+    _since_ping(0.0f),
+    _retry(0.0f),
+    _waiting(0.0f),
+    _buffered(0) {
+#ifndef NO_NETWORK
+  memset(&_ip, 0, sizeof(_ip));
+  _listen    = NULL;
+  _peer      = NULL;
+  _set       = NULL;
+  _dialer    = NULL;
+  _dial_lock = NULL;
+  _dialed    = NULL;
+  _dial_done = false;
+#endif
+}
+
+Session::~Session() {
+}
+
+int Session::state() {
+  return _state;
+}
+
+bool Session::active() {
+  return _state != SESSION_OFFLINE;
+}
+
+bool Session::connected() {
+  return _state == SESSION_CONNECTED;
+}
+
+bool Session::hosting() {
+  return _hosting;
+}
+
+int Session::port() {
+  return _port;
+}
+
+float Session::waiting() {
+  return _waiting;
+}
+
+int Session::buffered() {
+  return (int)_buffered;
+}
+
+bool Session::host(int port) {
+#ifndef NO_NETWORK
+  if (!_start(NULL, port)) { return false; }
+
+  _listen = SDLNet_TCP_Open(&_ip);
+  if (!_listen) {
+    printf("SDLNet_TCP_Open: %s\n", SDLNet_GetError());
+    close();
+    return false;
+  }
+
+  SDLNet_TCP_AddSocket(_set, _listen);
+
+  _hosting = true;
+  _state   = SESSION_LISTENING;
+
+  printf("waiting for client to connect...\n");
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Session::join(const char* ipname, int port) {
+#ifndef NO_NETWORK
+  if (!_start(ipname, port)) { return false; }
+
+  _state = SESSION_CONNECTING;
+  _dial();
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Session::watch(const char* ipname, int port) {
+  if (!join(ipname, port)) { return false; }
+
+  _quiet = true;
+  return true;
+}
+
+bool Session::_start(const char* ipname, int port) {
+#ifndef NO_NETWORK
+  close();
+
+  if (SDLNet_ResolveHost(&_ip, ipname, port) == -1) {
+    printf("SDLNet_ResolveHost: %s\n", SDLNet_GetError());
+    return false;
+  }
+
+  // the listening socket and the peer
+  _set = SDLNet_AllocSocketSet(2);
+  if (!_set) {
+    printf("SDLNet_AllocSocketSet: %s\n", SDLNet_GetError());
+    return false;
+  }
+
+  _dial_lock = SDL_CreateMutex();
+
+#ifndef WIN32
+  // a peer vanishing mid send should be a lost peer, not a dead process
+  signal(SIGPIPE, SIG_IGN);
+#endif
+
+  _port       = port;
+  _quiet      = false;
+  _waiting    = 0.0f;
+  _retry      = 0.0f;
+  _buffered   = 0;
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Session::close() {
+#ifndef NO_NETWORK
+  if (_dialer) {
+    // SDL_net cannot cancel a connect; let it time out
+    SDL_WaitThread(_dialer, NULL);
+    _dialer = NULL;
+  }
+  if (_dialed) {
+    SDLNet_TCP_Close(_dialed);
+    _dialed = NULL;
+  }
+  _dial_done = false;
+
+  if (_peer) {
+    SDLNet_TCP_Close(_peer);
+    _peer = NULL;
+  }
+  if (_listen) {
+    SDLNet_TCP_Close(_listen);
+    _listen = NULL;
+  }
+  if (_set) {
+    SDLNet_FreeSocketSet(_set);
+    _set = NULL;
+  }
+  if (_dial_lock) {
+    SDL_DestroyMutex(_dial_lock);
+    _dial_lock = NULL;
+  }
+#endif
+
+  _state    = SESSION_OFFLINE;
+  _hosting  = false;
+  _buffered = 0;
+}
+
+int Session::_dialThread(void* data) {
+#ifndef NO_NETWORK
+  Session* session = (Session*)data;
+
+  TRACE_THREAD("dialer");
+  TRACE_BEGIN("connect");
+  TCPsocket sock = SDLNet_TCP_Open(&session->_ip);
+  TRACE_END("connect");
+  TRACE_THREAD_END();
+
+  SDL_mutexP(session->_dial_lock);
+  session->_dialed    = sock;
+  session->_dial_done = true;
+  SDL_mutexV(session->_dial_lock);
+#endif
+
+  return 0;
+}
+
+void Session::_dial() {
+#ifndef NO_NETWORK
+  if (_dialer) { return; }
+
+  _dial_done = false;
+  _dialed    = NULL;
+
+  _dialer = SDL_CreateThread(_dialThread, this);
+  if (!_dialer) {
+    printf("session: cannot start dialing: %s\n", SDL_GetError());
+    _retry = SESSION_RETRY_INTERVAL;
+  }
+#endif
+}
+
+// Picks up the result of the dialer thread, if it has one
+void Session::_collect() {
+#ifndef NO_NETWORK
+  if (!_dialer) { return; }
+
+  SDL_mutexP(_dial_lock);
+  bool done = _dial_done;
+  TCPsocket sock = _dialed;
+  _dialed = NULL;
+  SDL_mutexV(_dial_lock);
+
+  if (!done) { return; }
+
+  SDL_WaitThread(_dialer, NULL);
+  _dialer = NULL;
+
+  if (!sock) {
+    // the host may simply not be up yet
+    _retry = SESSION_RETRY_INTERVAL;
+    return;
+  }
+
+  _peer = sock;
+  _established();
+#endif
+}
+
+void Session::_accept() {
+#ifndef NO_NETWORK
+  TCPsocket sock = SDLNet_TCP_Accept(_listen);
+  if (!sock) { return; }
+
+  if (_peer) {
+    printf("session: already playing, turning a second client away\n");
+    SDLNet_TCP_Close(sock);
+    return;
+  }
+
+  _peer = sock;
+  _established();
+#endif
+}
+
+void Session::_established() {
+#ifndef NO_NETWORK
+  SDLNet_TCP_AddSocket(_set, _peer);
+#endif
+
+  bool resumed = (_state == SESSION_RECONNECTING);
+
+  _state      = SESSION_CONNECTED;
+  _since_send = 0.0f;
+  _since_recv = 0.0f;
+  _since_ping = NETSTATS_PING_INTERVAL;
+  _waiting    = 0.0f;
+  _buffered   = 0;
+
+  printf(resumed ? "reconnected...\n" : "connected...\n");
+
+  engine.resumeSession();
+}
+
+void Session::_lost(const char* reason) {
+#ifndef NO_NETWORK
+  printf("session: lost peer (%s)\n", reason);
+
+  if (_peer) {
+    SDLNet_TCP_DelSocket(_set, _peer);
+    SDLNet_TCP_Close(_peer);
+    _peer = NULL;
+  }
+#endif
+
+  _state    = SESSION_RECONNECTING;
+  _buffered = 0;
+  _waiting  = 0.0f;
+
+  // whatever was still on the simulated wire went down with it
+  _sim.clear();
+
+  // clients redial right away, hosts wait for the peer to come back
+  _retry = 0.0f;
+}
+
+void Session::update(float deltatime) {
+#ifndef NO_NETWORK
+  if (_state == SESSION_OFFLINE) { return; }
+
+  if (_state != SESSION_CONNECTED) {
+    _waiting += deltatime;
+
+    if (!_hosting) {
+      _collect();
+
+      if (_state != SESSION_CONNECTED && !_dialer) {
+        _retry -= deltatime;
+        if (_retry <= 0.0f) {
+          _dial();
+        }
+      }
+    }
+  }
+
+  if (SDLNet_CheckSockets(_set, 0) > 0 && _listen &&
+      SDLNet_SocketReady(_listen)) {
+    _accept();
+  }
+
+  if (_state != SESSION_CONNECTED) { return; }
+
+  _receive();
+
+  if (_state != SESSION_CONNECTED) { return; }
+
+  if (_sim.enabled()) {
+    _pump();
+
+    if (_state != SESSION_CONNECTED) { return; }
+  }
+
+  _since_recv += deltatime;
+  _since_send += deltatime;
+  _since_ping += deltatime;
+
+  if (_quiet) { return; }
+
+  if (_since_recv > SESSION_TIMEOUT) {
+    _lost("timed out");
+    return;
+  }
+
+  if (_since_ping >= NETSTATS_PING_INTERVAL) {
+    _since_ping = 0.0f;
+
+    unsigned char msg[MSG_HEADER_SIZE] = {MSG_PING,
+                                          engine.net_stats.ping(SDL_GetTicks()),
+                                          0, 0};
+    send(msg, NULL, 0);
+  }
+  else if (_since_send >= SESSION_KEEPALIVE_INTERVAL) {
+    unsigned char msg[MSG_HEADER_SIZE] = {MSG_KEEPALIVE, 0, 0, 0};
+    send(msg, NULL, 0);
+  }
+#endif
+}
+
+void Session::_receive() {
+#ifndef NO_NETWORK
+  for (int reads = 0; reads < SESSION_MAX_READS; reads++) {
+    if (SDLNet_CheckSockets(_set, 0) <= 0 || !SDLNet_SocketReady(_peer)) {
+      return;
+    }
+
+    int result = SDLNet_TCP_Recv(_peer, _buffer + _buffered,
+                                 (int)(SESSION_BUFFER_SIZE - _buffered));
+    engine.net_stats.recvCall();
+    TRACE_INSTANT("recv", result);
+    if (result <= 0) {
+      _lost("disconnected");
+      return;
+    }
+
+    _buffered   += result;
+    _since_recv  = 0.0f;
+
+    _dispatch();
+
+    if (_state != SESSION_CONNECTED) {
+      return;
+    }
+  }
+#endif
+}
+
+// Hands every complete message in the buffer to the engine
+void Session::_dispatch() {
+  size_t offset = 0;
+
+  while (_buffered - offset >= MSG_HEADER_SIZE) {
+    unsigned char msg[MSG_HEADER_SIZE];
+    memcpy(msg, _buffer + offset, MSG_HEADER_SIZE);
+
+    size_t length = Engine::payloadLength(msg);
+    if (length > MSG_PAYLOAD_MAX) {
+      printf("message %d: payload too large (%d)\n", msg[0], (int)length);
+      _lost("corrupt stream");
+      return;
+    }
+
+    if (_buffered - offset < MSG_HEADER_SIZE + length) {
+      break;
+    }
+
+    const unsigned char* payload = _buffer + offset + MSG_HEADER_SIZE;
+    offset += MSG_HEADER_SIZE + length;
+
+    engine.net_stats.received(msg[0], MSG_HEADER_SIZE + length);
+
+    switch (msg[0]) {
+      case MSG_KEEPALIVE:
+        break;
+
+      case MSG_PING: {
+        unsigned char pong[MSG_HEADER_SIZE] = {MSG_PONG, msg[1], 0, 0};
+        send(pong, NULL, 0);
+        break;
+      }
+
+      case MSG_PONG:
+        engine.net_stats.pong(msg[1], SDL_GetTicks());
+        break;
+
+      default:
+        engine.processMessage(msg, payload, length);
+        break;
+    }
+
+    // answering may have failed and dropped the peer
+    if (_state != SESSION_CONNECTED) {
+      return;
+    }
+  }
+
+  _buffered -= offset;
+  memmove(_buffer, _buffer + offset, _buffered);
+}
+
+bool Session::impair(const char* spec) {
+  if (!_sim.configure(spec)) {
+    return false;
+  }
+
+  _sim.describe();
+  return true;
+}
+
+bool Session::send(const unsigned char msg[MSG_HEADER_SIZE],
+                   const unsigned char* payload, size_t length) {
+#ifndef NO_NETWORK
+  if (_state != SESSION_CONNECTED || _quiet) { return false; }
+
+  engine.net_stats.sent(msg[0], MSG_HEADER_SIZE + length);
+  TRACE_INSTANT("send", (int)(MSG_HEADER_SIZE + length));
+  _since_send = 0.0f;
+
+  if (_sim.enabled()) {
+    unsigned char data[MSG_HEADER_SIZE + MSG_PAYLOAD_MAX];
+    memcpy(data, msg, MSG_HEADER_SIZE);
+    if (length > 0) {
+      memcpy(data + MSG_HEADER_SIZE, payload, length);
+    }
+
+    return _sim.enqueue(data, MSG_HEADER_SIZE + length, SDL_GetTicks());
+  }
+
+  return _write(msg, MSG_HEADER_SIZE) &&
+         (length == 0 || _write(payload, length));
+#else
+  return false;
+#endif
+}
+
+bool Session::_write(const unsigned char* data, size_t length) {
+#ifndef NO_NETWORK
+  int result = SDLNet_TCP_Send(_peer, (void*)data, (int)length);
+  engine.net_stats.sendCall();
+
+  if (result < (int)length) {
+    _lost(SDLNet_GetError());
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Puts whatever the simulated link has delivered by now on the wire
+void Session::_pump() {
+  unsigned char data[MSG_HEADER_SIZE + MSG_PAYLOAD_MAX];
+  Uint32 now = SDL_GetTicks();
+
+  size_t length;
+  while ((length = _sim.release(now, data, sizeof(data))) > 0) {
+    if (!_write(data, length)) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,146 @@
+#ifndef SESSION_INCLUDED
+#define SESSION_INCLUDED
+
+#include "main.h"
+#include "netsim.h"
+
+// Session states
+#define SESSION_OFFLINE      0    // single player
+#define SESSION_LISTENING    1    // hosting, waiting for the first peer
+#define SESSION_CONNECTING   2    // dialing the host
+#define SESSION_CONNECTED    3
+#define SESSION_RECONNECTING 4    // lost the peer mid match
+
+// Seconds of silence before we send a keepalive
+#define SESSION_KEEPALIVE_INTERVAL 1.0f
+
+// Seconds of silence from the peer before we give up on it
+#define SESSION_TIMEOUT 5.0f
+
+// Seconds between attempts to dial the host
+#define SESSION_RETRY_INTERVAL 1.0f
+
+// Reads per frame, so a flood cannot stall rendering
+#define SESSION_MAX_READS 16
+
+#define SESSION_BUFFER_SIZE (4 * (MSG_HEADER_SIZE + MSG_PAYLOAD_MAX))
+
+/*
+ * The connection to the other player (or to a relay, when spectating).
+ *
+ * Nothing here blocks the game loop. The listening socket and the peer
+ * share a socket set that update() polls once a frame; dialing, which
+ * SDL_net can only do synchronously, happens on a short-lived thread
+ * whose result update() picks up. Received messages are reassembled here
+ * and handed to Engine::processMessage on the main thread.
+ *
+ * A silent peer is sent keepalives; a peer that stays silent too long or
+ * whose socket fails is dropped, and the session goes back to waiting
+ * for (host) or redialing (client) it. Every new connection starts with
+ * both sides sending a snapshot, so a match resumes where it left off.
+ */
+class Session {
+public:
+  Session();
+  ~Session();
+
+  /*
+   * Starts waiting for a peer on the given port.
+   */
+  bool host(int port);
+
+  /*
+   * Starts dialing the host at the given address.
+   */
+  bool join(const char* ipname, int port);
+
+  /*
+   * Like join, but we never talk: a relay does not read what spectators
+   * send, so the link is only ever judged by the relay closing it.
+   */
+  bool watch(const char* ipname, int port);
+
+  /*
+   * Runs everything we send through a simulated bad link; see NetSim.
+   */
+  bool impair(const char* spec);
+
+  /*
+   * Drops the peer and stops listening.
+   */
+  void close();
+
+  /*
+   * Accepts, dials, receives and keeps the link alive. Call once a frame.
+   */
+  void update(float deltatime);
+
+  /*
+   * Sends a message (and optional payload) to the peer.
+   */
+  bool send(const unsigned char msg[MSG_HEADER_SIZE],
+            const unsigned char* payload, size_t length);
+
+  int state();
+
+  // a match over the network, whether or not the peer is there right now
+  bool active();
+
+  // the peer is on the line
+  bool connected();
+
+  bool hosting();
+
+  int port();
+
+  // seconds spent waiting for the peer
+  float waiting();
+
+  // received bytes not yet dispatched
+  int buffered();
+
+private:
+  bool _start(const char* ipname, int port);
+  void _dial();
+  void _collect();
+  void _accept();
+  void _receive();
+  void _dispatch();
+  bool _write(const unsigned char* data, size_t length);
+  void _pump();
+  void _established();
+  void _lost(const char* reason);
+
+  static int _dialThread(void* data);
+
+  int     _state;
+  bool    _hosting;
+  bool    _quiet;
+  int     _port;
+
+  float   _since_send;
+  float   _since_recv;
+  float   _since_ping;
+  float   _retry;
+  float   _waiting;
+
+  unsigned char _buffer[SESSION_BUFFER_SIZE];
+  size_t        _buffered;
+
+  NetSim        _sim;
+
+#ifndef NO_NETWORK
+  IPaddress        _ip;
+  TCPsocket        _listen;
+  TCPsocket        _peer;
+  SDLNet_SocketSet _set;
+
+  // the dialer thread hands its socket over through these
+  SDL_Thread*      _dialer;
+  SDL_mutex*       _dial_lock;
+  TCPsocket        _dialed;
+  bool             _dial_done;
+#endif
+};
+
+#endif
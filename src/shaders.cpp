@@ -0,0 +1,555 @@
+#include "shaders.h"
+#include "profiler.h"
+
+#include "glm/gtc/type_ptr.hpp"
+
+#include <stddef.h>
+
+static
+void gl_check_errors(const char* msg) {
+  GLenum error = glGetError();
+  if (error != GL_NO_ERROR) {
+    const char* errorString;
+    switch ( error ) {
+      case GL_INVALID_ENUM: errorString = "invalid enumerant"; break;
+      case GL_INVALID_VALUE: errorString = "invalid value"; break;
+      case GL_INVALID_OPERATION: errorString = "invalid operation"; break;
+      case GL_STACK_OVERFLOW: errorString = "stack overflow"; break;
+      case GL_STACK_UNDERFLOW: errorString = "stack underflow"; break;
+      case GL_OUT_OF_MEMORY: errorString = "out of memory"; break;
+      case GL_TABLE_TOO_LARGE: errorString = "table too large"; break;
+      case GL_INVALID_FRAMEBUFFER_OPERATION: errorString = "invalid framebuffer operation"; break;
+      default: errorString = "unknown GL error"; break;
+    }
+    fprintf(stderr, "GL Error: %s: %s\n", msg, errorString);
+  }
+}
+
+/*
+ * Preludes. Sources below write GLSL 1.10 / ES 1.00 and FRAG_COLOR; the
+ * uniform buffer prelude turns that into GLSL 1.40.
+ */
+static
+const char* vertex_prelude_buffer =
+  "#version 140\n"
+  "#define attribute in\n"
+  "#define varying out\n"
+  "\n"
+  "layout(std140) uniform Camera {\n"
+  "  mat4 proj;\n"
+  "  mat4 view;\n"
+  "  vec4 time;\n"
+  "};\n";
+
+static
+const char* fragment_prelude_buffer =
+  "#version 140\n"
+  "#define varying in\n"
+  "#define texture2D texture\n"
+  "\n"
+  "out vec4 frag_color;\n"
+  "#define FRAG_COLOR frag_color\n";
+
+static
+const char* vertex_prelude_plain =
+  "#ifdef GL_ES\n"
+  "precision highp float;\n"
+  "#endif\n"
+  "\n"
+  "uniform mat4 proj;\n"
+  "uniform mat4 view;\n"
+  "uniform vec4 time;\n";
+
+static
+const char* fragment_prelude_plain =
+  "#ifdef GL_ES\n"
+  "precision highp float;\n"
+  "#endif\n"
+  "\n"
+  "#define FRAG_COLOR gl_FragColor\n";
+
+static
+const char* vertex_lit =
+  "attribute vec3 position;\n"
+  "attribute vec3 normal;\n"
+  "attribute vec2 texcoord;\n"
+  "\n"
+  "varying vec2 Texcoord;\n"
+  "varying vec3 Normal;\n"
+  "\n"
+  "uniform mat4 model;\n"
+  "\n"
+  "void main() {\n"
+  "  Texcoord = texcoord;\n"
+  "  Normal = (model * vec4(normal, 0.0)).xyz;\n"
+  "\n"
+  "  gl_Position = proj * view * model * vec4(position, 1.0);\n"
+  "}\n";
+
+static
+const char* vertex_unlit =
+  "attribute vec3 position;\n"
+  "attribute vec2 texcoord;\n"
+  "\n"
+  "varying vec2 Texcoord;\n"
+  "\n"
+  "uniform mat4 model;\n"
+  "\n"
+  "void main() {\n"
+  "  Texcoord = texcoord;\n"
+  "\n"
+  "  gl_Position = proj * view * model * vec4(position, 1.0);\n"
+  "}\n";
+
+static
+const char* fragment_lit =
+  "varying vec3 Normal;\n"
+  "varying vec2 Texcoord;\n"
+  "\n"
+  "uniform sampler2D tex;\n"
+  "uniform float opacity;\n"
+  "\n"
+  "void main() {\n"
+  "  FRAG_COLOR = texture2D(tex, Texcoord) * vec4(1.0, 1.0, 1.0, opacity);\n"
+  "}\n";
+
+static
+const char* fragment_unlit =
+  "varying vec2 Texcoord;\n"
+  "\n"
+  "uniform sampler2D tex;\n"
+  "uniform float opacity;\n"
+  "\n"
+  "void main() {\n"
+  "  FRAG_COLOR = texture2D(tex, Texcoord) * vec4(1.0, 1.0, 1.0, opacity);\n"
+  "}\n";
+
+static
+const char* vertex_sources[PROGRAM_COUNT] = {
+  vertex_lit,       // PROGRAM_MESH
+  vertex_lit,       // PROGRAM_BLOCK
+  vertex_unlit,     // PROGRAM_SPRITE
+  vertex_unlit      // PROGRAM_PARTICLE
+};
+
+static
+const char* fragment_sources[PROGRAM_COUNT] = {
+  fragment_lit,     // PROGRAM_MESH
+  fragment_lit,     // PROGRAM_BLOCK
+  fragment_unlit,   // PROGRAM_SPRITE
+  fragment_unlit    // PROGRAM_PARTICLE
+};
+
+static
+const char* program_names[PROGRAM_COUNT] = {
+  "mesh program",
+  "block program",
+  "sprite program",
+  "particle program"
+};
+
+/*
+ * In the cache file, after the header: for each program its key, the
+ * binary format GL gave, its length and then the binary.
+ */
+struct ShaderCacheHeader {
+  char   magic[8];
+  Uint32 version;
+  Uint32 count;
+};
+
+struct ShaderCacheEntry {
+  Uint64 key;
+  Uint32 format;
+  Uint32 length;
+};
+
+static Uint64 hash_string(Uint64 hash, const char* string) {
+  // FNV-1a
+  for (const char* c = string ? string : ""; *c; c++) {
+    hash ^= (Uint8)*c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static GLuint compile_shader(GLenum type, const char* prelude, const char* source) {
+  const char* code[2] = { prelude, source };
+
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 2, code, NULL);
+  glCompileShader(shader);
+
+  GLint result = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+  if (result != GL_TRUE) {
+    int infoLogLength;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+    std::vector<char> error_msg(infoLogLength + 1);
+    glGetShaderInfoLog(shader, infoLogLength, NULL, &error_msg[0]);
+    fprintf(stdout, "%s\n", &error_msg[0]);
+  }
+
+  return shader;
+}
+
+ShaderManager::ShaderManager()
+  : _current(-1),
+    _uniform_buffer(false),
+    _camera_buffer(0),
+    _camera_serial(1),
+    _opacity(1.0f),
+    _binaries(false) {
+  memset(_programs, 0, sizeof(_programs));
+  memset(&_camera, 0, sizeof(_camera));
+}
+
+void ShaderManager::init() {
+  Uint32 start = SDL_GetTicks();
+
+#ifndef EMSCRIPTEN
+  _uniform_buffer = GLEW_VERSION_3_1 != 0;
+  _binaries       = GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary;
+#endif
+
+  if (_uniform_buffer) {
+    _camera_buffer = GpuResources::create(GPU_BUFFER, "camera");
+    glBindBuffer(GL_UNIFORM_BUFFER, GpuResources::object(_camera_buffer));
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ShaderCamera), &_camera, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SHADER_CAMERA_BINDING, GpuResources::object(_camera_buffer));
+    gl_check_errors("camera uniform buffer");
+    GpuResources::setBytes(_camera_buffer, sizeof(ShaderCamera));
+  }
+
+  if (_binaries) {
+    _loadCache();
+  }
+
+  int compiled = 0;
+  for (int i = 0; i < PROGRAM_COUNT; i++) {
+    if (!_build(i)) {
+      compiled++;
+    }
+  }
+
+  if (_binaries && compiled > 0) {
+    _saveCache();
+  }
+  _cache.clear();
+
+  printf("shaders: %d programs in %ums, %d from %s, camera in %s\n",
+         PROGRAM_COUNT, (unsigned int)(SDL_GetTicks() - start), PROGRAM_COUNT - compiled,
+         SHADER_CACHE_FILE, _uniform_buffer ? "a uniform buffer" : "uniforms");
+
+  use(PROGRAM_SPRITE);
+}
+
+void ShaderManager::destroy() {
+  glUseProgram(0);
+  _current = -1;
+
+  for (int i = 0; i < PROGRAM_COUNT; i++) {
+    GpuResources::release(_programs[i].handle);
+    _programs[i].handle  = 0;
+    _programs[i].program = 0;
+  }
+
+  GpuResources::release(_camera_buffer);
+  _camera_buffer = 0;
+}
+
+// true when the program came from the cache
+bool ShaderManager::_build(int index) {
+  ShaderProgram& program = _programs[index];
+
+  const char* vertex_prelude   = _uniform_buffer ? vertex_prelude_buffer   : vertex_prelude_plain;
+  const char* fragment_prelude = _uniform_buffer ? fragment_prelude_buffer : fragment_prelude_plain;
+
+  // the same source on the same driver gives the same binary
+  Uint64 key = 14695981039346656037ULL;
+  key = hash_string(key, (const char*)glGetString(GL_VENDOR));
+  key = hash_string(key, (const char*)glGetString(GL_RENDERER));
+  key = hash_string(key, (const char*)glGetString(GL_VERSION));
+  key = hash_string(key, vertex_prelude);
+  key = hash_string(key, vertex_sources[index]);
+  key = hash_string(key, fragment_prelude);
+  key = hash_string(key, fragment_sources[index]);
+
+  program.key     = key;
+  program.handle  = GpuResources::create(GPU_PROGRAM, program_names[index]);
+  program.program = GpuResources::object(program.handle);
+
+  bool cached = _binaries && _linkCached(program);
+
+  if (!cached) {
+    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,   vertex_prelude,   vertex_sources[index]);
+    GLuint frag_shader   = compile_shader(GL_FRAGMENT_SHADER, fragment_prelude, fragment_sources[index]);
+
+    glAttachShader(program.program, vertex_shader);
+    glAttachShader(program.program, frag_shader);
+
+    // fixed locations, so meshes set their pointers once for every program
+    glBindAttribLocation(program.program, SHADER_POSITION, "position");
+    glBindAttribLocation(program.program, SHADER_NORMAL,   "normal");
+    glBindAttribLocation(program.program, SHADER_TEXCOORD, "texcoord");
+
+#ifndef EMSCRIPTEN
+    if (_binaries) {
+      glProgramParameteri(program.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+#endif
+
+    glLinkProgram(program.program);
+    gl_check_errors("glLinkProgram");
+
+    GLint result = GL_FALSE;
+    glGetProgramiv(program.program, GL_LINK_STATUS, &result);
+    if (result != GL_TRUE) {
+      int infoLogLength;
+      glGetProgramiv(program.program, GL_INFO_LOG_LENGTH, &infoLogLength);
+      std::vector<char> program_error_msg(infoLogLength + 1);
+      glGetProgramInfoLog(program.program, infoLogLength, NULL, &program_error_msg[0]);
+      fprintf(stdout, "%s\n", &program_error_msg[0]);
+    }
+
+    glDeleteShader(vertex_shader);
+    glDeleteShader(frag_shader);
+    gl_check_errors("glDeleteShader");
+  }
+
+#ifndef EMSCRIPTEN
+  // the linked binary is as close as GL says to what a program takes
+  if (_binaries) {
+    GLint length = 0;
+    glGetProgramiv(program.program, GL_PROGRAM_BINARY_LENGTH, &length);
+    GpuResources::setBytes(program.handle, length > 0 ? length : 0);
+  }
+#endif
+
+  glUseProgram(program.program);
+  gl_check_errors("glUseProgram");
+
+  /* Attach/describe uniforms */
+  program.model_uniform   = glGetUniformLocation(program.program, "model");
+  program.opacity_uniform = glGetUniformLocation(program.program, "opacity");
+
+  glUniform1i(glGetUniformLocation(program.program, "tex"), 0);
+  glm::mat4 model(1.0f);
+  glUniformMatrix4fv(program.model_uniform, 1, GL_FALSE, &model[0][0]);
+
+  program.opacity = 1.0f;
+  glUniform1f(program.opacity_uniform, program.opacity);
+
+  if (_uniform_buffer) {
+#ifndef EMSCRIPTEN
+    GLuint block = glGetUniformBlockIndex(program.program, "Camera");
+    if (block != GL_INVALID_INDEX) {
+      glUniformBlockBinding(program.program, block, SHADER_CAMERA_BINDING);
+    }
+#endif
+    program.proj_uniform = -1;
+    program.view_uniform = -1;
+    program.time_uniform = -1;
+  }
+  else {
+    program.proj_uniform = glGetUniformLocation(program.program, "proj");
+    program.view_uniform = glGetUniformLocation(program.program, "view");
+    program.time_uniform = glGetUniformLocation(program.program, "time");
+  }
+  program.camera_serial = 0;
+  gl_check_errors("glGetUniformLocation");
+
+  _current = index;
+  return cached;
+}
+
+bool ShaderManager::_linkCached(ShaderProgram& program) {
+#ifndef EMSCRIPTEN
+  if (_cache.size() < sizeof(ShaderCacheHeader)) {
+    return false;
+  }
+
+  const ShaderCacheHeader* header = (const ShaderCacheHeader*)&_cache[0];
+  size_t offset = sizeof(ShaderCacheHeader);
+
+  for (Uint32 i = 0; i < header->count; i++) {
+    if (offset + sizeof(ShaderCacheEntry) > _cache.size()) {
+      return false;
+    }
+
+    ShaderCacheEntry entry;
+    memcpy(&entry, &_cache[offset], sizeof(entry));
+    offset += sizeof(entry);
+
+    if (offset + entry.length > _cache.size()) {
+      return false;
+    }
+
+    if (entry.key == program.key) {
+      glProgramBinary(program.program, entry.format, &_cache[offset], entry.length);
+
+      // a driver update may refuse an old binary; then we compile
+      GLint result = GL_FALSE;
+      glGetProgramiv(program.program, GL_LINK_STATUS, &result);
+      glGetError();
+      return result == GL_TRUE;
+    }
+
+    offset += entry.length;
+  }
+#endif
+
+  return false;
+}
+
+void ShaderManager::_loadCache() {
+  FILE* file = fopen(SHADER_CACHE_FILE, "rb");
+  if (!file) {
+    return;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if (length >= (long)sizeof(ShaderCacheHeader)) {
+    _cache.resize(length);
+    if (fread(&_cache[0], 1, length, file) != (size_t)length) {
+      _cache.clear();
+    }
+  }
+  fclose(file);
+
+  if (_cache.empty()) {
+    return;
+  }
+
+  const ShaderCacheHeader* header = (const ShaderCacheHeader*)&_cache[0];
+  if (memcmp(header->magic, SHADER_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SHADER_CACHE_VERSION) {
+    _cache.clear();
+  }
+}
+
+void ShaderManager::_saveCache() {
+#ifndef EMSCRIPTEN
+  FILE* file = fopen(SHADER_CACHE_FILE, "wb");
+  if (!file) {
+    return;
+  }
+
+  ShaderCacheHeader header;
+  memcpy(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic));
+  header.version = SHADER_CACHE_VERSION;
+  header.count   = PROGRAM_COUNT;
+  fwrite(&header, sizeof(header), 1, file);
+
+  for (int i = 0; i < PROGRAM_COUNT; i++) {
+    GLint length = 0;
+    glGetProgramiv(_programs[i].program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    std::vector<Uint8> binary(length > 0 ? length : 1);
+    GLenum format = 0;
+    GLsizei written = 0;
+    if (length > 0) {
+      glGetProgramBinary(_programs[i].program, length, &written, &format, &binary[0]);
+    }
+    gl_check_errors("glGetProgramBinary");
+
+    ShaderCacheEntry entry;
+    entry.key    = _programs[i].key;
+    entry.format = format;
+    entry.length = written;
+    fwrite(&entry, sizeof(entry), 1, file);
+    fwrite(&binary[0], 1, written, file);
+  }
+
+  fclose(file);
+#endif
+}
+
+void ShaderManager::use(int program) {
+  if (program == _current) {
+    return;
+  }
+
+  _current = program;
+
+  ShaderProgram& p = _programs[program];
+  glUseProgram(p.program);
+  gl_check_errors("glUseProgram");
+  Profiler::count(PROFILE_STATE_CHANGES, 1);
+
+  if (p.opacity != _opacity) {
+    p.opacity = _opacity;
+    glUniform1f(p.opacity_uniform, p.opacity);
+    Profiler::count(PROFILE_UNIFORMS, 1);
+  }
+
+  if (!_uniform_buffer && p.camera_serial != _camera_serial) {
+    _uploadCamera(p);
+  }
+}
+
+int ShaderManager::current() {
+  return _current;
+}
+
+void ShaderManager::setCamera(const glm::mat4& proj, const glm::mat4& view) {
+  memcpy(_camera.proj, glm::value_ptr(proj), sizeof(_camera.proj));
+  memcpy(_camera.view, glm::value_ptr(view), sizeof(_camera.view));
+  _camera_serial++;
+
+  if (_uniform_buffer) {
+    glBindBuffer(GL_UNIFORM_BUFFER, GpuResources::object(_camera_buffer));
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(_camera.proj) + sizeof(_camera.view), &_camera);
+    gl_check_errors("glBufferSubData camera");
+    Profiler::count(PROFILE_UNIFORMS, 1);
+  }
+  else {
+    _uploadCamera(_programs[_current]);
+  }
+}
+
+void ShaderManager::setTime(float seconds) {
+  _camera.time[0] = seconds;
+  _camera_serial++;
+
+  if (_uniform_buffer) {
+    glBindBuffer(GL_UNIFORM_BUFFER, GpuResources::object(_camera_buffer));
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(ShaderCamera, time), sizeof(_camera.time), _camera.time);
+    gl_check_errors("glBufferSubData time");
+    Profiler::count(PROFILE_UNIFORMS, 1);
+  }
+  else {
+    _uploadCamera(_programs[_current]);
+  }
+}
+
+void ShaderManager::_uploadCamera(ShaderProgram& program) {
+  glUniformMatrix4fv(program.proj_uniform, 1, GL_FALSE, _camera.proj);
+  glUniformMatrix4fv(program.view_uniform, 1, GL_FALSE, _camera.view);
+  glUniform4fv(program.time_uniform, 1, _camera.time);
+  gl_check_errors("glUniform camera");
+  Profiler::count(PROFILE_UNIFORMS, 3);
+
+  program.camera_serial = _camera_serial;
+}
+
+void ShaderManager::setModel(const glm::mat4& model) {
+  glUniformMatrix4fv(_programs[_current].model_uniform, 1, GL_FALSE, &model[0][0]);
+  gl_check_errors("glUniformMatrix4fv model");
+  Profiler::count(PROFILE_UNIFORMS, 1);
+}
+
+void ShaderManager::setOpacity(float opacity) {
+  _opacity = opacity;
+
+  ShaderProgram& p = _programs[_current];
+  if (p.opacity != opacity) {
+    p.opacity = opacity;
+    glUniform1f(p.opacity_uniform, opacity);
+    gl_check_errors("glUniform1f opacity");
+    Profiler::count(PROFILE_UNIFORMS, 1);
+  }
+}
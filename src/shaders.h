@@ -0,0 +1,121 @@
+#ifndef SHADERS_INCLUDED
+#define SHADERS_INCLUDED
+
+#include "main.h"
+#include "gpu.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+// Programs
+#define PROGRAM_MESH     0    // models
+#define PROGRAM_BLOCK    1    // board and ball cubes
+#define PROGRAM_SPRITE   2    // backgrounds and the interface
+#define PROGRAM_PARTICLE 3    // flame cubes
+
+#define PROGRAM_COUNT    4
+
+// Attribute locations, the same in every program
+#define SHADER_POSITION  0
+#define SHADER_NORMAL    1
+#define SHADER_TEXCOORD  2
+
+// Where the camera block is bound
+#define SHADER_CAMERA_BINDING 0
+
+// Linked programs are kept here between runs, where GL allows it
+#define SHADER_CACHE_FILE    "shaders.bin"
+#define SHADER_CACHE_MAGIC   "OMGSHDR1"
+#define SHADER_CACHE_VERSION 1
+
+/*
+ * The camera block, laid out as std140 has it.
+ */
+struct ShaderCamera {
+  float proj[16];
+  float view[16];
+  float time[4];      // seconds, then unused
+};
+
+struct ShaderProgram {
+  GpuHandle handle;
+  GLuint    program;    // its GL name, while it lasts
+
+  GLint  model_uniform;
+  GLint  opacity_uniform;
+
+  // without a uniform buffer each program holds its own camera copy
+  GLint  proj_uniform;
+  GLint  view_uniform;
+  GLint  time_uniform;
+  int    camera_serial;
+
+  float  opacity;
+
+  Uint64 key;          // identifies the source and driver in the cache
+};
+
+/*
+ * Builds and switches between the game's GPU programs.
+ *
+ * Every program is made from its own source plus a shared prelude. On
+ * GL 3.1 and up the camera (projection, view and time) lives in one
+ * std140 uniform buffer that all programs read, so it is written once
+ * when it changes rather than into each program; older GL and WebGL get
+ * plain uniforms, refreshed as each program comes into use.
+ *
+ * Where GL can hand back linked programs (4.1, or
+ * ARB_get_program_binary) they are saved to SHADER_CACHE_FILE, and a
+ * later start with the same driver loads them rather than compiling.
+ */
+class ShaderManager {
+public:
+  ShaderManager();
+
+  /*
+   * Builds every program. Needs the GL context.
+   */
+  void init();
+
+  /*
+   * Releases every program and the camera buffer.
+   */
+  void destroy();
+
+  /*
+   * Makes the given program (PROGRAM_*) current.
+   */
+  void use(int program);
+
+  int current();
+
+  void setCamera(const glm::mat4& proj, const glm::mat4& view);
+  void setTime(float seconds);
+
+  void setModel(const glm::mat4& model);
+  void setOpacity(float opacity);
+
+private:
+  bool _build(int index);
+  bool _linkCached(ShaderProgram& program);
+  void _loadCache();
+  void _saveCache();
+  void _uploadCamera(ShaderProgram& program);
+
+  ShaderProgram _programs[PROGRAM_COUNT];
+  int           _current;
+
+  bool          _uniform_buffer;
+  GpuHandle     _camera_buffer;
+  ShaderCamera  _camera;
+  int           _camera_serial;
+
+  float         _opacity;
+
+  // GL hands back linked programs; the cache file, while building
+  bool               _binaries;
+  std::vector<Uint8> _cache;
+};
+
+#endif
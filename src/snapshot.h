@@ -0,0 +1,94 @@
+#ifndef SNAPSHOT_INCLUDED
+#define SNAPSHOT_INCLUDED
+
+#include "main.h"
+#include "flame.h"
+#include "netstats.h"
+
+/*
+ * Hands the latest of something from one thread to another without
+ * either waiting.
+ *
+ * The writer fills back() and publish()es it; the reader calls take()
+ * and reads front(), which stays put until the next take(). The third
+ * slot sits between them: publishing swaps it with the back, taking
+ * swaps it with the front if it holds something newer. So the reader
+ * always gets the newest whole thing, and things it never got to are
+ * written over.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+  TripleBuffer() : _back(0), _middle(1), _front(2) {
+  }
+
+  T& back() {
+    return _slots[_back];
+  }
+
+  void publish() {
+    // the fresh bit tells the reader the middle slot is new
+    int old = __atomic_exchange_n(&_middle, _back | TRIPLE_FRESH, __ATOMIC_ACQ_REL);
+    _back = old & ~TRIPLE_FRESH;
+  }
+
+  /*
+   * Moves to the newest published slot; returns false if there is none
+   * newer than front().
+   */
+  bool take() {
+    if (!(__atomic_load_n(&_middle, __ATOMIC_ACQUIRE) & TRIPLE_FRESH)) {
+      return false;
+    }
+
+    int old = __atomic_exchange_n(&_middle, _front, __ATOMIC_ACQ_REL);
+    _front = old & ~TRIPLE_FRESH;
+    return true;
+  }
+
+  T& front() {
+    return _slots[_front];
+  }
+
+private:
+  enum { TRIPLE_FRESH = 4 };
+
+  T   _slots[3];
+
+  int _back;      // the writer's
+  int _middle;    // shared, with TRIPLE_FRESH
+  int _front;     // the reader's
+};
+
+/*
+ * Everything Engine::draw reads of the game, as one simulation tick
+ * left it.
+ */
+struct RenderSnapshot {
+  game_info player1;
+  game_info player2;
+
+  // background
+  float bg1x;
+  float bg1y;
+  float bg_tile_opacity;
+
+  // the second board is drawn in networked games
+  bool both_boards;
+
+  bool  lobby;
+  float lobby_waiting;
+  int   lobby_port;       // -1 when not hosting
+
+  Flame ship_engine_one;
+  Flame ship_engine_two;
+
+  // overlays (F3, F2), which keyDown toggles on the simulation thread
+  bool show_netgraph;
+  bool show_profiler;
+
+  // only kept while the netgraph is up
+  NetStats net_stats;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "stream.h"
+
+// Buffer storage (GL 4.4) is newer than our glew
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT   0x0080
+#endif
+
+#ifndef EMSCRIPTEN
+#ifndef GLAPIENTRY
+#define GLAPIENTRY
+#endif
+
+typedef void (GLAPIENTRY *StreamBufferStorage)(GLenum target, GLsizeiptr size,
+                                               const void* data, GLbitfield flags);
+#endif
+
+static void gl_check_errors(const char* msg) {
+  GLenum error = glGetError();
+  if (error != GL_NO_ERROR) {
+    const char* errorString;
+    switch ( error ) {
+      case GL_INVALID_ENUM: errorString = "invalid enumerant"; break;
+      case GL_INVALID_VALUE: errorString = "invalid value"; break;
+      case GL_INVALID_OPERATION: errorString = "invalid operation"; break;
+      case GL_OUT_OF_MEMORY: errorString = "out of memory"; break;
+      default: errorString = "unknown GL error"; break;
+    }
+    fprintf(stderr, "GL Error: %s: %s\n", msg, errorString);
+  }
+}
+
+StreamBuffer::StreamBuffer()
+  : _buffer(0),
+    _capacity(0),
+    _mode(STREAM_UPLOAD),
+    _head(0),
+    _frame_start(0),
+    _mapped(NULL),
+    _map_open(false),
+    _staging(NULL),
+    _pending_start(0),
+    _pending_end(0),
+    _fence_first(0),
+    _fence_count(0),
+    _stalls(0) {
+}
+
+StreamBuffer::~StreamBuffer() {
+  // the GL side goes in destroy(), while there is a context
+  delete [] _staging;
+}
+
+void StreamBuffer::init(size_t capacity) {
+  _capacity = capacity;
+  _mode     = STREAM_UPLOAD;
+
+  _buffer = GpuResources::create(GPU_BUFFER, "stream");
+  glBindBuffer(GL_ARRAY_BUFFER, GpuResources::object(_buffer));
+  gl_check_errors("glGenBuffers stream");
+
+#ifndef EMSCRIPTEN
+  const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+
+  StreamBufferStorage storage = NULL;
+  if (extensions && strstr(extensions, "GL_ARB_buffer_storage") &&
+      (GLEW_VERSION_3_2 || GLEW_ARB_sync)) {
+    storage = (StreamBufferStorage)SDL_GL_GetProcAddress("glBufferStorage");
+  }
+
+  if (storage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    storage(GL_ARRAY_BUFFER, capacity, NULL, flags);
+    _mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, capacity, flags);
+    gl_check_errors("glBufferStorage stream");
+
+    if (_mapped) {
+      _mode = STREAM_PERSISTENT;
+    }
+    else {
+      // storage that size is fixed for good: start again with a new one
+      GpuResources::release(_buffer);
+      _buffer = GpuResources::create(GPU_BUFFER, "stream");
+      glBindBuffer(GL_ARRAY_BUFFER, GpuResources::object(_buffer));
+    }
+  }
+
+  if (_mode != STREAM_PERSISTENT && (GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range)) {
+    _mode = STREAM_MAPPED;
+  }
+#endif
+
+  if (_mode != STREAM_PERSISTENT) {
+    glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+    gl_check_errors("glBufferData stream");
+  }
+
+  if (_mode == STREAM_UPLOAD) {
+    _staging = new char[capacity];
+  }
+
+  // orphaned storage is the driver's to keep; counted once
+  GpuResources::setBytes(_buffer, capacity);
+
+  static const char* modes[] = { "persistent", "mapped", "upload" };
+  printf("stream: %u KB, %s\n", (unsigned int)(capacity / 1024), modes[_mode]);
+}
+
+void StreamBuffer::destroy() {
+  if (!_buffer) {
+    return;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, GpuResources::object(_buffer));
+  if (_mapped || _map_open) {
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
+  _mapped   = NULL;
+  _map_open = false;
+
+#ifndef EMSCRIPTEN
+  while (_fence_count > 0) {
+    glDeleteSync((GLsync)_fences[_fence_first].sync);
+    _fence_first = (_fence_first + 1) % STREAM_FENCES;
+    _fence_count--;
+  }
+#endif
+
+  GpuResources::release(_buffer);
+  _buffer = 0;
+
+  delete [] _staging;
+  _staging = NULL;
+}
+
+StreamAllocation StreamBuffer::allocate(size_t bytes, size_t stride) {
+  StreamAllocation allocation;
+  allocation.data   = NULL;
+  allocation.offset = 0;
+
+  if (bytes > _capacity || !_buffer) {
+    printf("stream: no room for %u bytes\n", (unsigned int)bytes);
+    return allocation;
+  }
+
+  size_t start = (_head + stride - 1) / stride * stride;
+  if (start + bytes > _capacity) {
+    _wrap();
+    start = 0;
+  }
+
+  switch (_mode) {
+    case STREAM_PERSISTENT:
+      _waitFor(start, start + bytes);
+      allocation.data = _mapped + start;
+      break;
+
+    case STREAM_MAPPED:
+      // nothing in use is in the way: the ring only ever moves on, and is
+      // orphaned when it comes round
+      glBindBuffer(GL_ARRAY_BUFFER, GpuResources::object(_buffer));
+      if (_map_open) {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+      }
+      allocation.data = glMapBufferRange(GL_ARRAY_BUFFER, start, bytes,
+                                         GL_MAP_WRITE_BIT |
+                                         GL_MAP_UNSYNCHRONIZED_BIT |
+                                         GL_MAP_INVALIDATE_RANGE_BIT);
+      _map_open = allocation.data != NULL;
+      gl_check_errors("glMapBufferRange stream");
+      break;
+
+    case STREAM_UPLOAD:
+      if (_pending_end == _pending_start) {
+        _pending_start = start;
+      }
+      _pending_end   = start + bytes;
+      allocation.data = _staging + start;
+      break;
+  }
+
+  if (!allocation.data) {
+    return allocation;
+  }
+
+  allocation.offset = start;
+  _head = start + bytes;
+  return allocation;
+}
+
+void StreamBuffer::bind() {
+  glBindBuffer(GL_ARRAY_BUFFER, GpuResources::object(_buffer));
+
+  if (_map_open) {
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    _map_open = false;
+  }
+
+  if (_pending_end > _pending_start) {
+    glBufferSubData(GL_ARRAY_BUFFER, _pending_start, _pending_end - _pending_start,
+                    _staging + _pending_start);
+    gl_check_errors("glBufferSubData stream");
+  }
+  _pending_start = _pending_end = 0;
+}
+
+void StreamBuffer::endFrame() {
+  if (_mode == STREAM_PERSISTENT) {
+    _fence();
+  }
+}
+
+GpuHandle StreamBuffer::buffer() {
+  return _buffer;
+}
+
+int StreamBuffer::mode() {
+  return _mode;
+}
+
+int StreamBuffer::stalls() {
+  return _stalls;
+}
+
+void StreamBuffer::_wrap() {
+  if (_mode == STREAM_PERSISTENT) {
+    // what this frame wrote so far is fenced apart from what it writes
+    // from the start again
+    _fence();
+    _head = _frame_start = 0;
+    return;
+  }
+
+  // anything staged goes in before the storage is let go
+  bind();
+
+  // new storage; the old is kept for as long as it is drawn from
+  glBufferData(GL_ARRAY_BUFFER, _capacity, NULL, GL_STREAM_DRAW);
+  gl_check_errors("glBufferData stream orphan");
+
+  _head = _frame_start = 0;
+}
+
+void StreamBuffer::_fence() {
+#ifndef EMSCRIPTEN
+  if (_head == _frame_start) {
+    return;
+  }
+
+  if (_fence_count == STREAM_FENCES) {
+    _waitOldest();
+  }
+
+  Fence& fence = _fences[(_fence_first + _fence_count) % STREAM_FENCES];
+  fence.sync  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  fence.start = _frame_start;
+  fence.end   = _head;
+  _fence_count++;
+
+  _frame_start = _head;
+#endif
+}
+
+void StreamBuffer::_waitFor(size_t start, size_t end) {
+  // the ring is written in order, so the oldest bytes in flight are the
+  // ones just ahead: wait on frames until the first clear of this range
+  while (_fence_count > 0) {
+    Fence& fence = _fences[_fence_first];
+    if (fence.end <= start || fence.start >= end) {
+      return;
+    }
+
+    _waitOldest();
+  }
+}
+
+void StreamBuffer::_waitOldest() {
+#ifndef EMSCRIPTEN
+  Fence& fence = _fences[_fence_first];
+  GLsync sync  = (GLsync)fence.sync;
+
+  GLenum result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    _stalls++;
+    do {
+      result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    } while (result == GL_TIMEOUT_EXPIRED);
+  }
+
+  glDeleteSync(sync);
+  _fence_first = (_fence_first + 1) % STREAM_FENCES;
+  _fence_count--;
+#endif
+}
@@ -0,0 +1,111 @@
+#ifndef STREAM_INCLUDED
+#define STREAM_INCLUDED
+
+#include "main.h"
+#include "gpu.h"
+
+// Bytes the stream buffer starts with, for all the frames in flight
+#define STREAM_CAPACITY (512 * 1024)
+
+// Frames (or parts of them) written but maybe not yet drawn
+#define STREAM_FENCES 8
+
+// How written bytes reach the GPU
+#define STREAM_PERSISTENT 0   // mapped once and for good (buffer storage)
+#define STREAM_MAPPED     1   // each allocation mapped unsynchronised
+#define STREAM_UPLOAD     2   // copied in with glBufferSubData (WebGL)
+
+// Room in the stream buffer
+struct StreamAllocation {
+  void*  data;      // where to write; NULL if it can never fit
+  size_t offset;    // where that is in the buffer, in bytes
+};
+
+/*
+ * A large vertex buffer for geometry that changes every frame: HUD
+ * text, graphs, anything made up as it is drawn.
+ *
+ * allocate() hands out the next bytes of a ring, to be written and then
+ * drawn from at their offset. Where the driver has buffer storage the
+ * whole ring is mapped once and left mapped: writes go straight to the
+ * GPU's copy, and a fence at the end of each frame keeps the ring from
+ * coming round onto bytes the GPU has not drawn yet. Otherwise each
+ * allocation is mapped unsynchronised, or staged and copied in (WebGL),
+ * and the buffer is orphaned when the ring comes round, so the driver
+ * keeps the old storage alive for as long as it is drawn from.
+ */
+class StreamBuffer {
+public:
+  StreamBuffer();
+  ~StreamBuffer();
+
+  /*
+   * Creates the buffer; needs the GL context.
+   */
+  void init(size_t capacity);
+
+  /*
+   * Releases the buffer and deletes its fences, while the context is
+   * still here.
+   */
+  void destroy();
+
+  /*
+   * Room for the given number of bytes, at an offset that is a multiple
+   * of stride (the size of a vertex, so the offset over the stride is a
+   * first vertex to draw from). Write it all before the next allocate()
+   * and before bind().
+   */
+  StreamAllocation allocate(size_t bytes, size_t stride);
+
+  /*
+   * Binds the buffer to GL_ARRAY_BUFFER with everything allocated so far
+   * in place, ready to draw.
+   */
+  void bind();
+
+  /*
+   * Ends the frame; what it wrote is not written over until drawn.
+   */
+  void endFrame();
+
+  GpuHandle buffer();
+  int       mode();
+
+  // times the ring came round onto bytes still being drawn, and waited
+  int       stalls();
+
+private:
+  struct Fence {
+    void*  sync;          // a GLsync; WebGL 1 has none
+    size_t start;
+    size_t end;
+  };
+
+  void _wrap();
+  void _fence();
+  void _waitFor(size_t start, size_t end);
+  void _waitOldest();
+
+  GpuHandle _buffer;
+  size_t _capacity;
+  int    _mode;
+
+  size_t _head;           // next byte to hand out
+  size_t _frame_start;    // where this frame's bytes begin
+
+  char*  _mapped;         // STREAM_PERSISTENT: the whole ring
+  bool   _map_open;       // STREAM_MAPPED: an allocation is mapped
+
+  char*  _staging;        // STREAM_UPLOAD: bytes not yet copied in
+  size_t _pending_start;
+  size_t _pending_end;
+
+  Fence  _fences[STREAM_FENCES];
+  int    _fence_first;
+  int    _fence_count;
+
+  int    _stalls;
+};
+
+#endif
@@ -1,14 +1,48 @@
 #include "main.h"
 #include "tetris.h"
 #include "components.h"
+#include "profiler.h"
+#include "trace.h"
+#include "affine.h"
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+#include <algorithm>
+
 #define GAMEOVER_SPREAD_RATE 0.1
 #define GAMEOVER_VELOCITY    3.0
 
+// A block of the board, as drawBoard lists them
+struct BoardBlock {
+  char type;
+  char i;
+  char j;
+  char faces;   // BOARD_LEFT and so on: sides with nothing next to them
+};
+
+#define BOARD_LEFT   1
+#define BOARD_RIGHT  2
+#define BOARD_TOP    4
+#define BOARD_BOTTOM 8
+
+// By texture, so drawBoard binds each once
+static bool board_block_before(const BoardBlock& a, const BoardBlock& b) {
+  return a.type < b.type;
+}
+
+// The board's rotation and scale, where everything on it starts
+static void board_base(game_info* gi, glm::mat4& base) {
+  base = glm::mat4(1.0f);
+
+  // rotate
+  Affine::rotateY(base, gi->side * gi->rot);
+  Affine::rotateX(base, -gi->rot2);
+
+  Affine::scale(base, 1.3f);
+}
+
 static void gl_check_errors(const char* msg) {
   GLenum error = glGetError();
   if (error != GL_NO_ERROR) {
@@ -43,8 +77,6 @@ void Tetris::update(game_info* gi, float deltatime) {
       gi->rot2 = 180;
       engine.changeState(gi, STATE_BREAKOUT);
     }
-
-    engine.passMessage(MSG_ROT_BOARD2, (gi->rot2 / 180.0f) * 255.0f, 0,0);
     return;
   }
 
@@ -61,11 +93,9 @@ void Tetris::update(game_info* gi, float deltatime) {
       gi->score += (10 * 100);
       engine.passMessage(MSG_APPENDSCORE, 100, 10, 0);
     }
-
-    engine.passMessage(MSG_ROT_BOARD, (gi->rot / 360.0f) * 255.0f, 0,0);
   }
 
-  if (!engine.network_thread) {
+  if (!engine.session.active()) {
     if (engine.keys[SDLK_DOWN]) {
       gi->fine += deltatime * (TETRIS_SPEED + 4.3 + 0.3 * LEVEL);
     }
@@ -93,50 +123,6 @@ void Tetris::update(game_info* gi, float deltatime) {
       addPiece(gi);
     }
   }
-
-  engine.passMessage(MSG_UPDATEPIECEY, (unsigned char)((gi->fine / 11.0f) * 255.0f), 0, 0);
-}
-
-void Tetris::dropLine(game_info* gi, int lineIndex) {
-  int j,i;
-  for (i=0; i<10; i++) {
-    for (j=lineIndex; j>1;j--) {
-      gi->board[i][j] = gi->board[i][j-1];
-    }
-  }
-
-  if (gi->side == -1) {
-    engine.passMessage(MSG_DROPLINE, (unsigned char)lineIndex, 0,0);
-  }
-}
-
-int Tetris::clearLines(game_info* gi) {
-  // check each row
-
-  int i,j;
-
-  int lines = 0;
-
-  for (j=0;j<24;j++) {
-    for (i=0; i<10; i++) {
-      if (gi->board[i][j] == -1) {
-        break;
-      }
-    }
-    if (i==10) {
-      // this line needs to be cleared!
-
-      // move everything above it down
-      lines++;
-      gi->score += (lines * 100);
-      engine.passMessage(MSG_APPENDSCORE, 100, lines, 0);
-      dropLine(gi,j);
-
-      engine.audio.playSound(SND_TINK);
-    }
-  }
-
-  return lines;
 }
 
 // init!
@@ -146,24 +132,12 @@ void Tetris::initGame(game_info* gi) {
 void Tetris::dropPiece(game_info* gi) {
   gi->fine = determineDropPosition(gi);
 
-  engine.passMessage(MSG_UPDATEPIECE, gi->pos, gi->curdir, gi->curpiece);
-  engine.passMessage(MSG_UPDATEPIECEY, (unsigned char)((gi->fine / 11.0f) * 255.0f), 0, 0);
-
   addPiece(gi);
 }
 
-float Tetris::determineDropPosition(game_info* gi) {
-  float phantom_fine = gi->fine;
-  while(!testCollision(gi, (0.5) * (double)gi->pos, phantom_fine)) {
-    phantom_fine+=0.25;
-  }
-
-  return phantom_fine - fmod(phantom_fine, 0.5f);
-}
-
 // draw 3D
 void Tetris::draw(Context* context, game_info* gi) {
-  if (!engine.network_thread && gi->side == 1) {
+  if (!engine.drawing().both_boards && gi->side == 1) {
     return;
   }
 
@@ -188,20 +162,21 @@ void Tetris::drawBlock(Context* context,
                                                                     bool hasBottom = true) {
   engine.useTexture(type);
 
-  // translate to world
-  glm::mat4 model = glm::mat4(1.0f);
-
-  // rotate
-  model = glm::rotate(model, gi->side * gi->rot, glm::vec3(0.0f, 1.0f, 0.0f));
-  model = glm::rotate(model, -gi->rot2, glm::vec3(1.0f,0.0f,0.0f));
+  glm::mat4 model;
+  board_base(gi, model);
 
-  model = glm::scale(model, glm::vec3(1.3f, 1.3f, 1.3f));
+  drawBlockFaces(gi, model, x, y, hasLeft, hasRight, hasTop, hasBottom);
+}
 
+// board is the board's rotation and scale; the texture is already bound
+void Tetris::drawBlockFaces(game_info* gi, glm::mat4& board, double x, double y,
+                            bool hasLeft, bool hasRight, bool hasTop, bool hasBottom) {
   // translate
-  model = glm::translate(model, glm::vec3(-2.25f + (x), 6.325 - (y), 0.0f));
+  glm::mat4 model = board;
+  Affine::translate(model, -2.25f + (float)x, 6.325f - (float)y, 0.0f);
 
   // scale (make them 0.5 unit cubes, since our unit cube is 2x2x2)
-  model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
+  Affine::scale(model, 0.25f);
 
   if (gi->rot2 > 90 || (gi->rot > 90 && gi->rot < 270)) {
     engine.drawQuad(model, 5); // back
@@ -422,10 +397,6 @@ void Tetris::addPiece(game_info* gi, int start_x, int start_y) {
   }
 
   if (gi->side == -1) {
-    engine.passMessage(MSG_UPDATEPIECE, gi->pos, gi->curdir, gi->curpiece);
-    //engine.passMessage(MSG_UPDATEPIECEY, , 0, 0);
-    engine.passMessage(MSG_ADDPIECE, start_x, start_y,0);
-
     int lines = clearLines(gi);
 
     gi->state_lines += lines;
@@ -447,150 +418,150 @@ void Tetris::addPiece(game_info* gi, int start_x, int start_y) {
   }
 }
 
-void Tetris::addBlock(game_info* gi, int i, int j, int type) {
-  gi->board[i][j] = type;
-}
-
 void Tetris::drawBoard(Context* context, game_info* gi) {
+  PROFILE_SCOPE(PROFILE_DRAW_BOARD);
+  TRACE_SCOPE("drawBoard");
+
   engine.useTexture(16);
 
   // left
-  glm::mat4 model;
+  glm::mat4 base;
+  board_base(gi, base);
 
-  model = glm::mat4(1.0f);
-
-  // rotate
-  model = glm::rotate(model, gi->side * gi->rot, glm::vec3(0.0f, 1.0f, 0.0f));
-  model = glm::rotate(model, -gi->rot2, glm::vec3(1.0f,0.0f,0.0f));
-
-  model = glm::scale(model, glm::vec3(1.3f, 1.3f, 1.3f));
-
-  glm::mat4 base = model;
-
-  model = glm::translate(model, glm::vec3(-2.625,0.125,0));
-  model = glm::scale(model, glm::vec3(0.25,11.5,0.5));
-  model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
+  glm::mat4 model = base;
+  Affine::translate(model, -2.625f, 0.125f, 0.0f);
+  Affine::scale(model, 0.25f, 11.5f, 0.5f);
+  Affine::scale(model, 0.5f);
 
   engine.drawCube(model);
 
   // right
   model = base;
-  model = glm::translate(model, glm::vec3(2.625,0.125,0));
-  model = glm::scale(model, glm::vec3(0.25,11.5,0.5));
-  model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
+  Affine::translate(model, 2.625f, 0.125f, 0.0f);
+  Affine::scale(model, 0.25f, 11.5f, 0.5f);
+  Affine::scale(model, 0.5f);
 
   engine.drawCube(model);
 
   // bottom
   model = base;
-  model = glm::translate(model, glm::vec3(0,-5.5,0));
-  model = glm::scale(model, glm::vec3(5,0.25,0.5));
-  model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
+  Affine::translate(model, 0.0f, -5.5f, 0.0f);
+  Affine::scale(model, 5.0f, 0.25f, 0.5f);
+  Affine::scale(model, 0.5f);
 
   engine.drawCube(model);
 
   // top
   model = base;
-  model = glm::translate(model, glm::vec3(0,5.75,0));
-  model = glm::scale(model, glm::vec3(5,0.03125,0.0625));
-  model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
+  Affine::translate(model, 0.0f, 5.75f, 0.0f);
+  Affine::scale(model, 5.0f, 0.03125f, 0.0625f);
+  Affine::scale(model, 0.5f);
 
   engine.useTexture(3);
   engine.drawCube(model);
 
+  // the blocks, listed and sorted by texture first
+  FrameSpan<BoardBlock> blocks = engine.frame_arena.span<BoardBlock>(10 * 24);
+
   int i,j;
-  if (gi->state != STATE_GAMEOVER) {
-    for (i=0; i<10; i++) {
-      for (j=0; j<24; j++) {
-        if(gi->board[i][j] != -1) {
-          bool hasLeft = true;
-          bool hasRight = true;
-          bool hasTop = true;
-          bool hasBottom = true;
-          if (i > 0 && gi->board[i-1][j] != -1) {
-            hasLeft = false;
-          }
-          if (i < 9 && gi->board[i+1][j] != -1) {
-            hasRight = false;
-          }
-          if (j > 0 && gi->board[i][j-1] != -1) {
-            hasTop = false;
-          }
-          if (j < 23 && gi->board[i][j+1] != -1) {
-            hasBottom = false;
-          }
-          drawBlock(context,
-                    gi->board[i][j], gi, 0.5 * (double)i, 0.5 * (double)j, hasLeft,
-                                                                           hasRight,
-                                                                           hasTop,
-                                                                           hasBottom);
+  for (i=0; i<10; i++) {
+    for (j=0; j<24; j++) {
+      if(gi->board[i][j] != -1) {
+        BoardBlock block;
+        block.type  = gi->board[i][j];
+        block.i     = i;
+        block.j     = j;
+        block.faces = 0;
+        if (i == 0 || gi->board[i-1][j] == -1) {
+          block.faces |= BOARD_LEFT;
         }
-      }
-    }
-  }
-  else {
-    for (i=0; i<10; i++) {
-      for (j=0; j<24; j++) {
-        if(gi->board[i][j] != -1) {
-          float offset_x = (float)(i - 5) * gi->gameover_position * GAMEOVER_SPREAD_RATE;
-          float offset_y = (float)(11 - j) * gi->gameover_position * GAMEOVER_SPREAD_RATE;
-          float z = gi->gameover_position;
-          if (gi->rot2 > 90) {
-            z = -z;
-          }
-          model = base;
-          model = glm::translate(model, glm::vec3(-2.25f + (0.5f*i) + offset_x, 6.375f - (0.5f*j) + offset_y, z));
-          model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
-          engine.useTexture(gi->board[i][j]);
-          engine.drawCube(model);
+        if (i == 9 || gi->board[i+1][j] == -1) {
+          block.faces |= BOARD_RIGHT;
+        }
+        if (j == 0 || gi->board[i][j-1] == -1) {
+          block.faces |= BOARD_TOP;
+        }
+        if (j == 23 || gi->board[i][j+1] == -1) {
+          block.faces |= BOARD_BOTTOM;
         }
+        blocks.push(block);
       }
     }
   }
 
-  for (i=0; i<10; i++) {
-    for (j=2; j<24; j++) {
-      if(gi->board[i][j] == -1) {
-        drawBackgroundBlock(context, gi, i, j);
-      }
-    }
-  }
-}
+  std::sort(blocks.begin(), blocks.end(), board_block_before);
 
-void Tetris::drawBackgroundBlock(Context* context, game_info* gi, double x, double y) {
-  engine.useTexture(17);
+  int texture = -1;
+  for (size_t b = 0; b < blocks.size(); b++) {
+    BoardBlock& block = blocks[b];
+    i = block.i;
+    j = block.j;
 
-  // translate to world
-  glm::mat4 model = glm::mat4(1.0f);
+    if (block.type != texture) {
+      texture = block.type;
+      engine.useTexture(texture);
+    }
 
-  // rotate
-  model = glm::rotate(model, gi->side * gi->rot, glm::vec3(0.0f, 1.0f, 0.0f));
-  model = glm::rotate(model, -gi->rot2, glm::vec3(1.0f,0.0f,0.0f));
+    if (gi->state != STATE_GAMEOVER) {
+      drawBlockFaces(gi, base, 0.5 * (double)i, 0.5 * (double)j,
+                     (block.faces & BOARD_LEFT)   != 0,
+                     (block.faces & BOARD_RIGHT)  != 0,
+                     (block.faces & BOARD_TOP)    != 0,
+                     (block.faces & BOARD_BOTTOM) != 0);
+    }
+    else {
+      float offset_x = (float)(i - 5) * gi->gameover_position * GAMEOVER_SPREAD_RATE;
+      float offset_y = (float)(11 - j) * gi->gameover_position * GAMEOVER_SPREAD_RATE;
+      float z = gi->gameover_position;
+      if (gi->rot2 > 90) {
+        z = -z;
+      }
+      model = base;
+      Affine::translate(model, -2.25f + (0.5f*i) + offset_x, 6.375f - (0.5f*j) + offset_y, z);
+      Affine::scale(model, 0.25f);
+      engine.drawCube(model);
+    }
+  }
 
-  model = glm::scale(model, glm::vec3(1.3f, 1.3f, 1.3f));
+  drawBackgroundBlocks(context, gi, base);
+}
 
-  float z = -0.8f;
+// The empty cells behind the board, placed all at once; board is the
+// board's rotation and scale
+void Tetris::drawBackgroundBlocks(Context* context, game_info* gi, glm::mat4& board) {
   float percent = gi->rot2 / 180.0f;
 
   if (gi->rot > 90 && gi->rot < 270) {
     percent = 1.0f;
   }
 
-  z = 1.6f * percent - 0.8f;
+  float z = 1.6f * percent - 0.8f;
 
-  // translate
-  model = glm::translate(model, glm::vec3(-2.25f + (x*0.5), 6.375f - (y*0.5), z));
+  // x, y, z of each
+  FrameSpan<float> positions = engine.frame_arena.span<float>(10 * 22 * 3);
+
+  for (int i = 0; i < 10; i++) {
+    for (int j = 2; j < 24; j++) {
+      if (gi->board[i][j] == -1) {
+        positions.push(-2.25f + i * 0.5f);
+        positions.push(6.375f - j * 0.5f);
+        positions.push(z);
+      }
+    }
+  }
 
   // scale (make them 0.5 unit cubes, since our unit cube is 2x2x2)
-  model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
+  size_t count = positions.size() / 3;
+  glm::mat4* models = engine.frame_arena.allocate<glm::mat4>(count);
+  Affine::place(board, positions.begin(), 0.25f, models, count);
 
-  context->setOpacity(engine.bg_tile_opacity);
+  int side = (gi->rot2 > 90 || (gi->rot > 90 && gi->rot < 270)) ? 5 : 0;
 
-  if (gi->rot2 > 90 || (gi->rot > 90 && gi->rot < 270)) {
-    engine.drawQuad(model, 5);
-  }
-  else {
-    engine.drawQuad(model, 0);
+  engine.useTexture(17);
+  context->setOpacity(engine.drawing().bg_tile_opacity);
+
+  for (size_t c = 0; c < count; c++) {
+    engine.drawQuad(models[c], side);
   }
 
   context->setOpacity(1.0f);
@@ -812,340 +783,6 @@ void Tetris::drawPiece(Context* context,
   }
 }
 
-bool Tetris::testCollisionBlock(game_info* gi, double x, double y) {
-  int s_x;
-  int s_y;
-
-  s_x = (x / 0.5);
-  s_y = (y / 0.5);
-  s_y++;
-
-  if (gi->board[s_x][s_y] != -1) {
-    return 1;
-  }
-
-  return 0;
-}
-
-bool Tetris::testCollision(game_info *gi) {
-  return testCollision(gi, (0.5) * (double)gi->pos, gi->fine);
-}
-
-double Tetris::testSideCollision(game_info* gi, double x, double y) {
-  int sx = x / 0.5;
-
-  switch (gi->curpiece) {
-    case 0:
-      if (gi->curdir % 2) {
-        if (sx < 2) { return 0.5; }
-      }
-      else {
-        if (sx < 0) { return 0; }
-      }
-      break;
-    case 1:
-      if (gi->curdir % 2) {
-        if (sx < 0) { return 0; }
-      }
-      else {
-        if (sx < 1) { return 0.25; }
-      }
-      break;
-    case 2:
-      if (sx < 1) { return 0.25; }
-      break;
-    case 3:
-      if (sx < 0) { return 0; }
-      break;
-    case 4:
-      if (gi->curdir == 0) {
-        if (sx < 0) { return 0; }
-      }
-      else {
-        if (sx < 1) { return 0.25; }
-      }
-      break;
-    case 5:
-      if (gi->curdir == 2) {
-        if (sx < 0) { return 0; }
-      }
-      else {
-        if (sx < 1) { return 0.25; }
-      }
-      break;
-    case 6:
-      if (gi->curdir == 1) {
-        if (sx < 0) { return 0; }
-      }
-      else {
-        if (sx < 1) { return 0.25; }
-      }
-      break;
-  }
-
-  switch (gi->curpiece) {
-    case 0:
-      if (gi->curdir % 2) {
-        if (sx > 8) { return 1; }
-      }
-      else {
-        if (sx > 9) { return 1; }
-      }
-      break;
-    case 1:
-      if (sx > 8) { return 1; }
-      break;
-    case 2:
-      if (gi->curdir % 2) {
-        if (sx > 9) { return 1; }
-      }
-      else {
-        if (sx > 8) { return 1; }
-      }
-      break;
-    case 3:
-      if (sx > 8) { return 1; }
-      break;
-    case 4:
-      if (gi->curdir == 2) {
-        if (sx > 9) { return 1; }
-      }
-      else
-      {
-        if (sx > 8) { return 1; }
-      }
-      break;
-    case 5:
-      if (gi->curdir == 0) {
-        if (sx > 9) { return 1; }
-      }
-      else {
-        if (sx > 8) { return 1; }
-      }
-      break;
-    case 6:
-      if (gi->curdir == 3) {
-        if (sx > 9) { return 1; }
-      }
-      else {
-        if (sx > 8) { return 1; }
-      }
-      break;
-  }
-
-  return -10;
-}
-
-bool Tetris::testCollision(game_info* gi, double x, double y) {
-  // check collision with bottom
-
-  static double bottom_y = (0.5) * 24;
-
-  double test_y = y;
-
-  switch (gi->curpiece) {
-    case 0:
-      if (gi->curdir % 2) {
-        test_y = 0;
-      }
-      else {
-        test_y = 2;
-      }
-      break;
-    case 1:
-    case 2:
-      if (gi->curdir % 2) {
-        test_y = 1;
-      }
-      else {
-        test_y = 0;
-      }
-      break;
-    case 3:
-      test_y = 1;
-      break;
-    case 4:
-      if (gi->curdir == 3) {
-        test_y = 0;
-      }
-      else {
-        test_y = 1;
-      }
-      break;
-    case 5:
-      if (gi->curdir == 1) {
-        test_y = 0;
-      }
-      else {
-        test_y = 1;
-      }
-      break;
-    case 6:
-      if (gi->curdir == 0) {
-        test_y = 0;
-      }
-      else {
-        test_y = 1;
-      }
-      break;
-  }
-
-  test_y++;
-
-  test_y *= 0.5;
-  test_y += y;
-
-  if (test_y > bottom_y) {
-    return 1;
-  }
-
-  // OK!
-
-  // check collision with sides
-
-  double ret = testSideCollision(gi, x, y);
-
-  if (ret!=-10) {
-    return 1;
-  }
-
-  // COLLISION AMONG BLOCKS!
-
-  bool coll = false;
-
-  switch (gi->curpiece)
-  {
-    case 0:
-      if (gi->curdir % 2) {
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x-1.0, y);
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y);
-      }
-      else {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-        coll |= testCollisionBlock(gi, x, y+1.0);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-      }
-      break;
-    case 1:
-      if (gi->curdir % 2) {
-        coll |= testCollisionBlock(gi, x+0.5, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y-0.5);
-      }
-      else {
-        coll |= testCollisionBlock(gi, x+0.5, y);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x-0.5, y-0.5);
-      }
-      break;
-    case 2:
-      if (gi->curdir % 2) {
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x-0.5, y-0.5);
-      }
-      else {
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y-0.5);
-      }
-      break;
-    case 3:
-      coll |= testCollisionBlock(gi, x+0.5, y);
-      coll |= testCollisionBlock(gi, x, y+0.5);
-      coll |= testCollisionBlock(gi, x, y);
-      coll |= testCollisionBlock(gi, x+0.5, y+0.5);
-      break;
-    case 4:
-      if (gi->curdir == 0) {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-        coll |= testCollisionBlock(gi, x+0.5, y+0.5);
-      }
-      else if (gi->curdir == 1) {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y);
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x-0.5, y+0.5);
-      }
-      else if (gi->curdir == 2) {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-        coll |= testCollisionBlock(gi, x-0.5, y-0.5);
-      }
-      else {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y);
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x+0.5, y-0.5);
-      }
-      break;
-    case 5:
-      if (gi->curdir == 0) {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-        coll |= testCollisionBlock(gi, x-0.5, y+0.5);
-      }
-      else if (gi->curdir == 1) {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y);
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x-0.5, y-0.5);
-      }
-      else if (gi->curdir == 2) {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-        coll |= testCollisionBlock(gi, x+0.5, y-0.5);
-      }
-      else {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y);
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x+0.5, y+0.5);
-      }
-      break;
-    case 6:
-      if (gi->curdir == 0) {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y);
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-      }
-      else if (gi->curdir == 1) {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-      }
-      else if (gi->curdir == 2) {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x+0.5, y);
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-      }
-      else {
-        coll |= testCollisionBlock(gi, x, y);
-        coll |= testCollisionBlock(gi, x-0.5, y);
-        coll |= testCollisionBlock(gi, x, y+0.5);
-        coll |= testCollisionBlock(gi, x, y-0.5);
-      }
-      break;
-  }
-
-  return coll;
-}
-
 void Tetris::keyRepeat(game_info* gi) {
   if (gi->state != STATE_TETRIS) {
     return;
@@ -1160,8 +797,6 @@ void Tetris::keyRepeat(game_info* gi) {
       gi->curdir += 4;
       gi->curdir %= 4;
     }
-
-    engine.passMessage(MSG_UPDATEPIECE, gi->pos, gi->curdir, gi->curpiece);
   }
   else if (engine.keys[SDLK_LEFT]) {
     gi->pos--;
@@ -1170,8 +805,6 @@ void Tetris::keyRepeat(game_info* gi) {
     if (testCollision(gi)) {
       gi->pos++;
     }
-
-    engine.passMessage(MSG_UPDATEPIECE, gi->pos, gi->curdir, gi->curpiece);
   }
   else if (engine.keys[SDLK_RIGHT]) {
     gi->pos++;
@@ -1181,8 +814,6 @@ void Tetris::keyRepeat(game_info* gi) {
     if (testCollision(gi)) {
       gi->pos--;
     }
-
-    engine.passMessage(MSG_UPDATEPIECE, gi->pos, gi->curdir, gi->curpiece);
   }
 }
 
@@ -1211,125 +842,10 @@ void Tetris::getNewPiece(game_info* gi) {
 
   gi->pos = 5;
   gi->fine = 1.0;
-
-  engine.passMessage(MSG_UPDATEPIECE, gi->pos, gi->curdir, gi->curpiece);
-  engine.passMessage(MSG_UPDATEPIECEY, 0, 0, 0);
-}
-
-void Tetris::pushUp(game_info* gi, int num) {
-  int i,j;
-  for (j=0; j<(24-num); j++) {
-    for (i=0; i<10; i++) {
-      gi->board[i][j] = gi->board[i][j+num];
-    }
-  }
 }
 
 void Tetris::attack(game_info* gi, int severity) {
-  // add a line!
-  // add two lines!!
-  // rotate board!!!
-
-  int gameover = 0;
-  int good = 0;
-
-  engine.audio.playSound(SND_ADDLINE);
-
-  if (severity == 1) {
-    // ok dokey
-    int i;
-
-    for (i=0; i<10; i++) {
-      if (gi->board[i][2] != -1) {
-        // game over!
-        gameover = 1;
-        break;
-      }
-    }
-
-    pushUp(gi, 1);
-
-    for (i=0; i<10; i++) {
-      gi->board[i][23] = rand() % 7;
-      if (gi->board[i][23] == 6) {
-        good = 1;
-        gi->board[i][23] = -1;
-      }
-    }
-
-    if (!good) {
-      gi->board[rand() % 10][23] = -1;
-    }
-
-    // send this line!
-    engine.passMessage(MSG_PUSHUP, 1,0,0);
-    engine.passMessage(MSG_ADDBLOCKS_A,gi->board[0][23], gi->board[1][23],gi->board[2][23]);
-    engine.passMessage(MSG_ADDBLOCKS_B,gi->board[3][23], gi->board[4][23],gi->board[5][23]);
-    engine.passMessage(MSG_ADDBLOCKS_C,gi->board[6][23], gi->board[7][23],gi->board[8][23]);
-    engine.passMessage(MSG_ADDBLOCKS_D,gi->board[9][23], 0,0);
-  }
-  else if (severity == 2) {
-    // move two lines
-    // ok dokey
-    int i;
-
-    for (i=0; i<10; i++) {
-      if (gi->board[i][0] != -1) {
-        // game over!
-        gameover = 1;
-        break;
-      }
-      if (gi->board[i][1] != -1) {
-        // game over!
-        gameover = 1;
-        break;
-      }
-    }
-
-    pushUp(gi, 2);
-
-    for (i=0; i<10; i++) {
-      gi->board[i][23] = rand() % 7;
-      if (gi->board[i][23] == 6) {
-        good |= 1;
-        gi->board[i][23] = -1;
-      }
-
-      gi->board[i][22] = rand() % 7;
-      if (gi->board[i][22] == 6) {
-        good |= 2;
-        gi->board[i][22] = -1;
-      }
-    }
-
-    if (!(good & 1)) {
-      gi->board[rand() % 10][23] = -1;
-    }
-
-    if (!(good & 2)) {
-      gi->board[rand() % 10][22] = -1;
-    }
-
-    // send these lines!
-    engine.passMessage(MSG_PUSHUP, 2,0,0);
-    engine.passMessage(MSG_ADDBLOCKS_A,gi->board[0][23], gi->board[1][23],gi->board[2][23]);
-    engine.passMessage(MSG_ADDBLOCKS_B,gi->board[3][23], gi->board[4][23],gi->board[5][23]);
-    engine.passMessage(MSG_ADDBLOCKS_C,gi->board[6][23], gi->board[7][23],gi->board[8][23]);
-    engine.passMessage(MSG_ADDBLOCKS_D,gi->board[9][23], 0,0);
-    engine.passMessage(MSG_ADDBLOCKS2_A,gi->board[0][22], gi->board[1][22],gi->board[2][22]);
-    engine.passMessage(MSG_ADDBLOCKS2_B,gi->board[3][22], gi->board[4][22],gi->board[5][22]);
-    engine.passMessage(MSG_ADDBLOCKS2_C,gi->board[6][22], gi->board[7][22],gi->board[8][22]);
-    engine.passMessage(MSG_ADDBLOCKS2_D,gi->board[9][22], 0,0);
-  }
-  else if (severity == 3) {
-    // rotate!
-    gi->attacking = 1;
-    gi->attack_rot = 0;
-  }
-
-  if (gameover) {
-    engine.gameOver();
-  }
+  receiveAttack(gi, severity);
 }
 
 GLfloat Tetris::board_piece_amb[4] = {0.0, 0.0, 0.0, 1};
@@ -29,33 +29,42 @@ public:
 
   void drawBoard(Context* context, game_info* gi);
   void drawPiece(Context* context, game_info* gi, double x, double y, int texture);
-  void drawBackgroundBlock(Context* context, game_info* gi, double x, double y);
+  void drawBackgroundBlocks(Context* context, game_info* gi, glm::mat4& board);
   void drawBlock(Context*,
                  int type, game_info* gi, double x, double y, bool hasLeft,
                                                               bool hasRight,
                                                               bool hasTop,
                                                               bool hasBottom);
-
-  float determineDropPosition(game_info* gi);
+  void drawBlockFaces(game_info* gi, glm::mat4& board, double x, double y,
+                      bool hasLeft, bool hasRight, bool hasTop, bool hasBottom);
 
   void addPiece(game_info* gi);
   void addPiece(game_info* gi, int start_x, int start_y);
-  void addBlock(game_info* gi, int i, int j, int type);
 
   void dropPiece(game_info* gi);
 
-  int clearLines(game_info* gi);
+  bool testGameOver(game_info* gi);
+
+  // rules (tetrisrules.cpp), which need only the game_info:
 
-  void pushUp(game_info* gi, int num);
-  void dropLine(game_info* gi, int lineIndex);
+  static float determineDropPosition(game_info* gi);
 
-  bool testGameOver(game_info* gi);
+  static void addBlock(game_info* gi, int i, int j, int type);
+  static void removeBlock(game_info* gi, int i, int j);
+
+  static int clearLines(game_info* gi);
+
+  static void pushUp(game_info* gi, int num);
+  static void dropLine(game_info* gi, int lineIndex);
+
+  static bool testCollisionBlock(game_info* gi, double x, double y);
+  static bool testCollision(game_info* gi);
+  static bool testCollision(game_info* gi, double x, double y);
 
-  bool testCollisionBlock(game_info* gi, double x, double y);
-  bool testCollision(game_info* gi);
-  bool testCollision(game_info* gi, double x, double y);
+  static double testSideCollision(game_info* gi, double x, double y);
 
-  double testSideCollision(game_info* gi, double x, double y);
+  // what attack() does, for BreakOut's ball as well
+  static void receiveAttack(game_info* gi, int severity);
 
   // materials:
 
@@ -0,0 +1,507 @@
+#include "main.h"
+#include "tetris.h"
+#include "rules.h"
+#include "zobrist.h"
+#include "trace.h"
+
+#include <math.h>
+
+void Tetris::dropLine(game_info* gi, int lineIndex) {
+  int j,i;
+  for (i=0; i<10; i++) {
+    for (j=lineIndex; j>1;j--) {
+      gi->board[i][j] = gi->board[i][j-1];
+    }
+  }
+
+  Zobrist::dropLine(gi, lineIndex);
+}
+
+int Tetris::clearLines(game_info* gi) {
+  // check each row
+
+  int i,j;
+
+  int lines = 0;
+
+  for (j=0;j<24;j++) {
+    for (i=0; i<10; i++) {
+      if (gi->board[i][j] == -1) {
+        break;
+      }
+    }
+    if (i==10) {
+      // this line needs to be cleared!
+
+      // move everything above it down
+      lines++;
+      gi->score += (lines * 100);
+      Rules::appendScore(100, lines);
+      dropLine(gi,j);
+
+      Rules::playSound(SND_TINK);
+    }
+  }
+
+  return lines;
+}
+
+float Tetris::determineDropPosition(game_info* gi) {
+  float phantom_fine = gi->fine;
+  while(!testCollision(gi, (0.5) * (double)gi->pos, phantom_fine)) {
+    phantom_fine+=0.25;
+  }
+
+  return phantom_fine - fmod(phantom_fine, 0.5f);
+}
+
+void Tetris::addBlock(game_info* gi, int i, int j, int type) {
+  Zobrist::set(gi, i, j, (char)type);
+}
+
+void Tetris::removeBlock(game_info* gi, int i, int j) {
+  Zobrist::set(gi, i, j, -1);
+}
+
+void Tetris::pushUp(game_info* gi, int num) {
+  int i,j;
+  for (j=0; j<(24-num); j++) {
+    for (i=0; i<10; i++) {
+      gi->board[i][j] = gi->board[i][j+num];
+    }
+  }
+
+  Zobrist::pushUp(gi, num);
+}
+
+bool Tetris::testCollisionBlock(game_info* gi, double x, double y) {
+  int s_x;
+  int s_y;
+
+  s_x = (x / 0.5);
+  s_y = (y / 0.5);
+  s_y++;
+
+  if (gi->board[s_x][s_y] != -1) {
+    return 1;
+  }
+
+  return 0;
+}
+
+bool Tetris::testCollision(game_info *gi) {
+  return testCollision(gi, (0.5) * (double)gi->pos, gi->fine);
+}
+
+double Tetris::testSideCollision(game_info* gi, double x, double y) {
+  int sx = x / 0.5;
+
+  switch (gi->curpiece) {
+    case 0:
+      if (gi->curdir % 2) {
+        if (sx < 2) { return 0.5; }
+      }
+      else {
+        if (sx < 0) { return 0; }
+      }
+      break;
+    case 1:
+      if (gi->curdir % 2) {
+        if (sx < 0) { return 0; }
+      }
+      else {
+        if (sx < 1) { return 0.25; }
+      }
+      break;
+    case 2:
+      if (sx < 1) { return 0.25; }
+      break;
+    case 3:
+      if (sx < 0) { return 0; }
+      break;
+    case 4:
+      if (gi->curdir == 0) {
+        if (sx < 0) { return 0; }
+      }
+      else {
+        if (sx < 1) { return 0.25; }
+      }
+      break;
+    case 5:
+      if (gi->curdir == 2) {
+        if (sx < 0) { return 0; }
+      }
+      else {
+        if (sx < 1) { return 0.25; }
+      }
+      break;
+    case 6:
+      if (gi->curdir == 1) {
+        if (sx < 0) { return 0; }
+      }
+      else {
+        if (sx < 1) { return 0.25; }
+      }
+      break;
+  }
+
+  switch (gi->curpiece) {
+    case 0:
+      if (gi->curdir % 2) {
+        if (sx > 8) { return 1; }
+      }
+      else {
+        if (sx > 9) { return 1; }
+      }
+      break;
+    case 1:
+      if (sx > 8) { return 1; }
+      break;
+    case 2:
+      if (gi->curdir % 2) {
+        if (sx > 9) { return 1; }
+      }
+      else {
+        if (sx > 8) { return 1; }
+      }
+      break;
+    case 3:
+      if (sx > 8) { return 1; }
+      break;
+    case 4:
+      if (gi->curdir == 2) {
+        if (sx > 9) { return 1; }
+      }
+      else
+      {
+        if (sx > 8) { return 1; }
+      }
+      break;
+    case 5:
+      if (gi->curdir == 0) {
+        if (sx > 9) { return 1; }
+      }
+      else {
+        if (sx > 8) { return 1; }
+      }
+      break;
+    case 6:
+      if (gi->curdir == 3) {
+        if (sx > 9) { return 1; }
+      }
+      else {
+        if (sx > 8) { return 1; }
+      }
+      break;
+  }
+
+  return -10;
+}
+
+bool Tetris::testCollision(game_info* gi, double x, double y) {
+  // check collision with bottom
+
+  static double bottom_y = (0.5) * 24;
+
+  double test_y = y;
+
+  switch (gi->curpiece) {
+    case 0:
+      if (gi->curdir % 2) {
+        test_y = 0;
+      }
+      else {
+        test_y = 2;
+      }
+      break;
+    case 1:
+    case 2:
+      if (gi->curdir % 2) {
+        test_y = 1;
+      }
+      else {
+        test_y = 0;
+      }
+      break;
+    case 3:
+      test_y = 1;
+      break;
+    case 4:
+      if (gi->curdir == 3) {
+        test_y = 0;
+      }
+      else {
+        test_y = 1;
+      }
+      break;
+    case 5:
+      if (gi->curdir == 1) {
+        test_y = 0;
+      }
+      else {
+        test_y = 1;
+      }
+      break;
+    case 6:
+      if (gi->curdir == 0) {
+        test_y = 0;
+      }
+      else {
+        test_y = 1;
+      }
+      break;
+  }
+
+  test_y++;
+
+  test_y *= 0.5;
+  test_y += y;
+
+  if (test_y > bottom_y) {
+    return 1;
+  }
+
+  // OK!
+
+  // check collision with sides
+
+  double ret = testSideCollision(gi, x, y);
+
+  if (ret!=-10) {
+    return 1;
+  }
+
+  // COLLISION AMONG BLOCKS!
+
+  bool coll = false;
+
+  switch (gi->curpiece)
+  {
+    case 0:
+      if (gi->curdir % 2) {
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x-1.0, y);
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y);
+      }
+      else {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+        coll |= testCollisionBlock(gi, x, y+1.0);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+      }
+      break;
+    case 1:
+      if (gi->curdir % 2) {
+        coll |= testCollisionBlock(gi, x+0.5, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y-0.5);
+      }
+      else {
+        coll |= testCollisionBlock(gi, x+0.5, y);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x-0.5, y-0.5);
+      }
+      break;
+    case 2:
+      if (gi->curdir % 2) {
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x-0.5, y-0.5);
+      }
+      else {
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y-0.5);
+      }
+      break;
+    case 3:
+      coll |= testCollisionBlock(gi, x+0.5, y);
+      coll |= testCollisionBlock(gi, x, y+0.5);
+      coll |= testCollisionBlock(gi, x, y);
+      coll |= testCollisionBlock(gi, x+0.5, y+0.5);
+      break;
+    case 4:
+      if (gi->curdir == 0) {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+        coll |= testCollisionBlock(gi, x+0.5, y+0.5);
+      }
+      else if (gi->curdir == 1) {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y);
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x-0.5, y+0.5);
+      }
+      else if (gi->curdir == 2) {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+        coll |= testCollisionBlock(gi, x-0.5, y-0.5);
+      }
+      else {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y);
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x+0.5, y-0.5);
+      }
+      break;
+    case 5:
+      if (gi->curdir == 0) {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+        coll |= testCollisionBlock(gi, x-0.5, y+0.5);
+      }
+      else if (gi->curdir == 1) {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y);
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x-0.5, y-0.5);
+      }
+      else if (gi->curdir == 2) {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+        coll |= testCollisionBlock(gi, x+0.5, y-0.5);
+      }
+      else {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y);
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x+0.5, y+0.5);
+      }
+      break;
+    case 6:
+      if (gi->curdir == 0) {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y);
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+      }
+      else if (gi->curdir == 1) {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+      }
+      else if (gi->curdir == 2) {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x+0.5, y);
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+      }
+      else {
+        coll |= testCollisionBlock(gi, x, y);
+        coll |= testCollisionBlock(gi, x-0.5, y);
+        coll |= testCollisionBlock(gi, x, y+0.5);
+        coll |= testCollisionBlock(gi, x, y-0.5);
+      }
+      break;
+  }
+
+  return coll;
+}
+
+void Tetris::receiveAttack(game_info* gi, int severity) {
+  TRACE_SCOPE("attack");
+
+  // add a line!
+  // add two lines!!
+  // rotate board!!!
+
+  int gameover = 0;
+  int good = 0;
+
+  Rules::playSound(SND_ADDLINE);
+
+  if (severity == 1) {
+    // ok dokey
+    int i;
+
+    for (i=0; i<10; i++) {
+      if (gi->board[i][2] != -1) {
+        // game over!
+        gameover = 1;
+        break;
+      }
+    }
+
+    pushUp(gi, 1);
+
+    for (i=0; i<10; i++) {
+      int type = rand() % 7;
+      if (type == 6) {
+        good = 1;
+        type = -1;
+      }
+      addBlock(gi, i, 23, type);
+    }
+
+    if (!good) {
+      removeBlock(gi, rand() % 10, 23);
+    }
+
+    // the new line reaches the opponent with the next board sync
+  }
+  else if (severity == 2) {
+    // move two lines
+    // ok dokey
+    int i;
+
+    for (i=0; i<10; i++) {
+      if (gi->board[i][0] != -1) {
+        // game over!
+        gameover = 1;
+        break;
+      }
+      if (gi->board[i][1] != -1) {
+        // game over!
+        gameover = 1;
+        break;
+      }
+    }
+
+    pushUp(gi, 2);
+
+    for (i=0; i<10; i++) {
+      int type = rand() % 7;
+      if (type == 6) {
+        good |= 1;
+        type = -1;
+      }
+      addBlock(gi, i, 23, type);
+
+      type = rand() % 7;
+      if (type == 6) {
+        good |= 2;
+        type = -1;
+      }
+      addBlock(gi, i, 22, type);
+    }
+
+    if (!(good & 1)) {
+      removeBlock(gi, rand() % 10, 23);
+    }
+
+    if (!(good & 2)) {
+      removeBlock(gi, rand() % 10, 22);
+    }
+
+    // the new lines reach the opponent with the next board sync
+  }
+  else if (severity == 3) {
+    // rotate!
+    gi->attacking = 1;
+    gi->attack_rot = 0;
+  }
+
+  if (gameover) {
+    Rules::gameOver();
+  }
+}
@@ -0,0 +1,429 @@
+#include "texture.h"
+
+#include <math.h>
+
+// KTX 1.1: this identifier, then 13 numbers, then key/value data (none
+// of ours has any), then each level's size and bytes
+static const Uint8 ktx_identifier[12] = {
+  0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+#define KTX_ENDIANNESS 0x04030201
+
+struct KtxHeader {
+  Uint8  identifier[12];
+  Uint32 endianness;
+  Uint32 gl_type;
+  Uint32 gl_type_size;
+  Uint32 gl_format;
+  Uint32 gl_internal_format;
+  Uint32 gl_base_internal_format;
+  Uint32 pixel_width;
+  Uint32 pixel_height;
+  Uint32 pixel_depth;
+  Uint32 array_elements;
+  Uint32 faces;
+  Uint32 mipmap_levels;
+  Uint32 key_value_bytes;
+};
+
+int Texture::levels(int width, int height) {
+  int count = 1;
+  while (width > 1 || height > 1) {
+    width  = width  > 1 ? width  / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+    count++;
+  }
+  return count;
+}
+
+void Texture::downsample(const Uint8* rgba, int width, int height,
+                         std::vector<Uint8>& half) {
+  int w = width  > 1 ? width  / 2 : 1;
+  int h = height > 1 ? height / 2 : 1;
+  half.resize(w * h * 4);
+
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      int color[3] = {0, 0, 0};
+      int alpha = 0;
+
+      // the 2x2 square, or the one row or column left at the end
+      for (int dy = 0; dy < 2; dy++) {
+        for (int dx = 0; dx < 2; dx++) {
+          int sx = x * 2 + dx; if (sx >= width)  { sx = width  - 1; }
+          int sy = y * 2 + dy; if (sy >= height) { sy = height - 1; }
+
+          const Uint8* p = rgba + (sy * width + sx) * 4;
+          color[0] += p[0] * p[3];
+          color[1] += p[1] * p[3];
+          color[2] += p[2] * p[3];
+          alpha    += p[3];
+        }
+      }
+
+      Uint8* q = &half[(y * w + x) * 4];
+      for (int c = 0; c < 3; c++) {
+        q[c] = alpha ? (Uint8)((color[c] + alpha / 2) / alpha) : 0;
+      }
+      q[3] = (Uint8)((alpha + 2) / 4);
+    }
+  }
+}
+
+Uint32 Texture::levelSize(GLenum internal_format, int width, int height) {
+  Uint32 blocks = ((width + 3) / 4) * ((height + 3) / 4);
+
+  switch (internal_format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:  return blocks * 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return blocks * 16;
+  }
+  return width * height * 4;
+}
+
+bool Texture::compressed(GLenum internal_format) {
+  return internal_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ||
+         internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+static Uint16 pack565(const int color[3]) {
+  int r = (color[0] * 31 + 127) / 255;
+  int g = (color[1] * 63 + 127) / 255;
+  int b = (color[2] * 31 + 127) / 255;
+  return (Uint16)((r << 11) | (g << 5) | b);
+}
+
+static void unpack565(Uint16 packed, int color[3]) {
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5)  & 63;
+  int b =  packed        & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+// the four colours a BC1 block in four colour mode can pick from
+static void color_palette(Uint16 c0, Uint16 c1, int palette[4][3]) {
+  unpack565(c0, palette[0]);
+  unpack565(c1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+}
+
+/*
+ * The colour half of a block. Endpoints are the pixels furthest apart
+ * along the colours' principal axis; each pixel then takes the nearest
+ * of the four colours between them.
+ */
+static void compress_color(const Uint8 block[64], Uint8 out[8]) {
+  float mean[3] = {0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 3; c++) {
+      mean[c] += block[i * 4 + c] / 16.0f;
+    }
+  }
+
+  float cov[6] = {0, 0, 0, 0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    float r = block[i * 4 + 0] - mean[0];
+    float g = block[i * 4 + 1] - mean[1];
+    float b = block[i * 4 + 2] - mean[2];
+    cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+    cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+  }
+
+  // a few rounds of power iteration find the axis well enough
+  float axis[3] = {1, 1, 1};
+  for (int round = 0; round < 4; round++) {
+    float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+
+    float largest = fabsf(x);
+    if (fabsf(y) > largest) { largest = fabsf(y); }
+    if (fabsf(z) > largest) { largest = fabsf(z); }
+    if (largest == 0.0f) {
+      break;
+    }
+
+    axis[0] = x / largest;
+    axis[1] = y / largest;
+    axis[2] = z / largest;
+  }
+
+  int lowest = 0, highest = 0;
+  float low = 1e30f, high = -1e30f;
+  for (int i = 0; i < 16; i++) {
+    float d = block[i * 4 + 0] * axis[0] +
+              block[i * 4 + 1] * axis[1] +
+              block[i * 4 + 2] * axis[2];
+    if (d < low)  { low  = d; lowest  = i; }
+    if (d > high) { high = d; highest = i; }
+  }
+
+  int ends[2][3];
+  for (int c = 0; c < 3; c++) {
+    ends[0][c] = block[highest * 4 + c];
+    ends[1][c] = block[lowest  * 4 + c];
+  }
+
+  Uint16 c0 = pack565(ends[0]);
+  Uint16 c1 = pack565(ends[1]);
+
+  // four colour mode needs the first endpoint to be the larger
+  if (c0 < c1) {
+    Uint16 swap = c0; c0 = c1; c1 = swap;
+  }
+
+  Uint32 indices = 0;
+  if (c0 != c1) {
+    int palette[4][3];
+    color_palette(c0, c1, palette);
+
+    for (int i = 0; i < 16; i++) {
+      int best = 0, best_distance = 0x7fffffff;
+      for (int k = 0; k < 4; k++) {
+        int dr = block[i * 4 + 0] - palette[k][0];
+        int dg = block[i * 4 + 1] - palette[k][1];
+        int db = block[i * 4 + 2] - palette[k][2];
+        int distance = dr * dr + dg * dg + db * db;
+        if (distance < best_distance) {
+          best_distance = distance;
+          best = k;
+        }
+      }
+      indices |= (Uint32)best << (i * 2);
+    }
+  }
+
+  out[0] = c0 & 0xff; out[1] = c0 >> 8;
+  out[2] = c1 & 0xff; out[3] = c1 >> 8;
+  out[4] = indices & 0xff;         out[5] = (indices >> 8) & 0xff;
+  out[6] = (indices >> 16) & 0xff; out[7] = indices >> 24;
+}
+
+// the eight alphas a BC3 block with a0 > a1 can pick from
+static void alpha_palette(int a0, int a1, int palette[8]) {
+  palette[0] = a0;
+  palette[1] = a1;
+  for (int k = 1; k < 7; k++) {
+    palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+  }
+}
+
+static void compress_alpha(const Uint8 block[64], Uint8 out[8]) {
+  int a0 = 0, a1 = 255;
+  for (int i = 0; i < 16; i++) {
+    int a = block[i * 4 + 3];
+    if (a > a0) { a0 = a; }
+    if (a < a1) { a1 = a; }
+  }
+
+  Uint64 indices = 0;
+  if (a0 != a1) {
+    int palette[8];
+    alpha_palette(a0, a1, palette);
+
+    for (int i = 0; i < 16; i++) {
+      int a = block[i * 4 + 3];
+      int best = 0, best_distance = 256;
+      for (int k = 0; k < 8; k++) {
+        int distance = abs(a - palette[k]);
+        if (distance < best_distance) {
+          best_distance = distance;
+          best = k;
+        }
+      }
+      indices |= (Uint64)best << (i * 3);
+    }
+  }
+
+  out[0] = (Uint8)a0;
+  out[1] = (Uint8)a1;
+  for (int i = 0; i < 6; i++) {
+    out[2 + i] = (Uint8)(indices >> (i * 8));
+  }
+}
+
+void Texture::compress(const Uint8* rgba, int width, int height, bool opaque,
+                       std::vector<Uint8>& blocks) {
+  GLenum format = opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                         : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  blocks.resize(levelSize(format, width, height));
+
+  Uint8* out = &blocks[0];
+  for (int by = 0; by < height; by += 4) {
+    for (int bx = 0; bx < width; bx += 4) {
+      // blocks hanging over the edge repeat the last row and column
+      Uint8 block[64];
+      for (int i = 0; i < 16; i++) {
+        int x = bx + (i & 3); if (x >= width)  { x = width  - 1; }
+        int y = by + (i >> 2); if (y >= height) { y = height - 1; }
+        memcpy(&block[i * 4], rgba + (y * width + x) * 4, 4);
+      }
+
+      if (!opaque) {
+        compress_alpha(block, out);
+        out += 8;
+      }
+      compress_color(block, out);
+      out += 8;
+    }
+  }
+}
+
+void Texture::decompress(GLenum internal_format, const Uint8* blocks,
+                         int width, int height, std::vector<Uint8>& rgba) {
+  bool alpha = internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  rgba.resize(width * height * 4);
+
+  const Uint8* in = blocks;
+  for (int by = 0; by < height; by += 4) {
+    for (int bx = 0; bx < width; bx += 4) {
+      int    alphas[8];
+      Uint64 alpha_indices = 0;
+      if (alpha) {
+        if (in[0] > in[1]) {
+          alpha_palette(in[0], in[1], alphas);
+        }
+        else {
+          // six alphas, then 0 and 255; we never write these
+          alphas[0] = in[0];
+          alphas[1] = in[1];
+          for (int k = 1; k < 5; k++) {
+            alphas[k + 1] = ((5 - k) * in[0] + k * in[1]) / 5;
+          }
+          alphas[6] = 0;
+          alphas[7] = 255;
+        }
+        for (int i = 0; i < 6; i++) {
+          alpha_indices |= (Uint64)in[2 + i] << (i * 8);
+        }
+        in += 8;
+      }
+
+      Uint16 c0 = in[0] | (in[1] << 8);
+      Uint16 c1 = in[2] | (in[3] << 8);
+      Uint32 indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((Uint32)in[7] << 24);
+      in += 8;
+
+      int palette[4][3];
+      bool transparent = false;
+      if (c0 > c1 || alpha) {
+        color_palette(c0, c1, palette);
+      }
+      else {
+        // three colours and transparent black
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+          palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+          palette[3][c] = 0;
+        }
+        transparent = true;
+      }
+
+      for (int i = 0; i < 16; i++) {
+        int x = bx + (i & 3);
+        int y = by + (i >> 2);
+        if (x >= width || y >= height) {
+          continue;
+        }
+
+        int k = (indices >> (i * 2)) & 3;
+        Uint8* p = &rgba[(y * width + x) * 4];
+        p[0] = palette[k][0];
+        p[1] = palette[k][1];
+        p[2] = palette[k][2];
+        p[3] = alpha ? alphas[(alpha_indices >> (i * 3)) & 7]
+                     : (transparent && k == 3) ? 0 : 255;
+      }
+    }
+  }
+}
+
+void Texture::writeKtx(const TextureImage& image, std::vector<Uint8>& out) {
+  bool blocks = compressed(image.internal_format);
+
+  KtxHeader header;
+  memcpy(header.identifier, ktx_identifier, sizeof(ktx_identifier));
+  header.endianness              = KTX_ENDIANNESS;
+  header.gl_type                 = blocks ? 0 : GL_UNSIGNED_BYTE;
+  header.gl_type_size            = 1;
+  header.gl_format               = blocks ? 0 : GL_RGBA;
+  header.gl_internal_format      = image.internal_format;
+  header.gl_base_internal_format =
+    image.internal_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? GL_RGB : GL_RGBA;
+  header.pixel_width             = image.level[0].width;
+  header.pixel_height            = image.level[0].height;
+  header.pixel_depth             = 0;
+  header.array_elements          = 0;
+  header.faces                   = 1;
+  header.mipmap_levels           = image.levels;
+  header.key_value_bytes         = 0;
+
+  out.insert(out.end(), (const Uint8*)&header, (const Uint8*)&header + sizeof(header));
+
+  for (int i = 0; i < image.levels; i++) {
+    const TextureLevel& level = image.level[i];
+    out.insert(out.end(), (const Uint8*)&level.size, (const Uint8*)&level.size + 4);
+    out.insert(out.end(), level.data, level.data + level.size);
+
+    // every level starts on a four byte boundary
+    out.resize((out.size() + 3) & ~(size_t)3, 0);
+  }
+}
+
+bool Texture::readKtx(const Uint8* bytes, size_t size, TextureImage& image) {
+  if (size < sizeof(KtxHeader)) {
+    return false;
+  }
+
+  const KtxHeader* header = (const KtxHeader*)bytes;
+  if (memcmp(header->identifier, ktx_identifier, sizeof(ktx_identifier)) != 0 ||
+      header->endianness != KTX_ENDIANNESS ||
+      header->pixel_depth > 1 || header->array_elements > 0 || header->faces != 1 ||
+      header->mipmap_levels < 1 || header->mipmap_levels > TEXTURE_MAX_LEVELS) {
+    return false;
+  }
+
+  GLenum format = header->gl_internal_format;
+  if (!compressed(format) &&
+      (format != GL_RGBA8 || header->gl_format != GL_RGBA || header->gl_type != GL_UNSIGNED_BYTE)) {
+    return false;
+  }
+
+  image.internal_format = format;
+  image.levels          = header->mipmap_levels;
+
+  size_t offset = sizeof(KtxHeader) + header->key_value_bytes;
+  int width  = header->pixel_width;
+  int height = header->pixel_height;
+
+  for (int i = 0; i < image.levels; i++) {
+    if (offset + 4 > size) {
+      return false;
+    }
+
+    Uint32 level_size;
+    memcpy(&level_size, bytes + offset, 4);
+    offset += 4;
+
+    if (level_size != levelSize(format, width, height) || offset + level_size > size) {
+      return false;
+    }
+
+    image.level[i].width  = width;
+    image.level[i].height = height;
+    image.level[i].size   = level_size;
+    image.level[i].data   = bytes + offset;
+
+    offset = (offset + level_size + 3) & ~(size_t)3;
+    width  = width  > 1 ? width  / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+
+  return true;
+}
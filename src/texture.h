@@ -0,0 +1,86 @@
+#ifndef TEXTURE_INCLUDED
+#define TEXTURE_INCLUDED
+
+#include "main.h"
+
+#include <vector>
+
+// Enough for a 32768 pixel texture
+#define TEXTURE_MAX_LEVELS 16
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+struct TextureLevel {
+  int          width;
+  int          height;
+  Uint32       size;
+  const Uint8* data;
+};
+
+/*
+ * A texture and its mip chain as GL takes it: RGBA, 8 bits a channel,
+ * or S3TC blocks (BC1 when opaque, BC3 with alpha).
+ */
+struct TextureImage {
+  GLenum       internal_format;   // GL_RGBA8 or GL_COMPRESSED_*_S3TC_*
+  int          levels;
+  TextureLevel level[TEXTURE_MAX_LEVELS];
+};
+
+/*
+ * Builds textures ahead of time (see packer.cpp) and reads them back.
+ *
+ * Textures are kept in KTX 1.1 files, so other tools can open them.
+ * Pixels are RGBA bytes with the top row first throughout.
+ */
+class Texture {
+public:
+  /*
+   * Levels in a full chain down to 1x1.
+   */
+  static int levels(int width, int height);
+
+  /*
+   * Halves an image with a box filter. Colours are weighted by alpha so
+   * transparent pixels do not bleed into the edges.
+   */
+  static void downsample(const Uint8* rgba, int width, int height,
+                         std::vector<Uint8>& half);
+
+  /*
+   * Encodes an image as BC1 (when opaque is true) or BC3 blocks.
+   */
+  static void compress(const Uint8* rgba, int width, int height, bool opaque,
+                       std::vector<Uint8>& blocks);
+
+  /*
+   * Decodes BC1 or BC3 blocks, for GL without S3TC support.
+   */
+  static void decompress(GLenum internal_format, const Uint8* blocks,
+                         int width, int height, std::vector<Uint8>& rgba);
+
+  /*
+   * Bytes in one level of the given format.
+   */
+  static Uint32 levelSize(GLenum internal_format, int width, int height);
+
+  static bool compressed(GLenum internal_format);
+
+  /*
+   * Appends the image as a KTX file.
+   */
+  static void writeKtx(const TextureImage& image, std::vector<Uint8>& out);
+
+  /*
+   * Reads a KTX file of ours. The levels point into the bytes given.
+   * False if it is not one.
+   */
+  static bool readKtx(const Uint8* bytes, size_t size, TextureImage& image);
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "trace.h"
+
+#ifdef ENABLE_TRACE
+
+#include <vector>
+
+__thread TraceBuffer* Trace::_buffer = NULL;
+
+TraceBuffer Trace::_buffers[TRACE_THREADS];
+int         Trace::_count = 0;
+
+void Trace::thread(const char* name) {
+  if (!_buffer) {
+    _attach(name);
+  }
+}
+
+void Trace::threadEnd() {
+  if (_buffer) {
+    __atomic_store_n(&_buffer->active, 0, __ATOMIC_RELEASE);
+    _buffer = NULL;
+  }
+}
+
+TraceBuffer* Trace::_attach(const char* name) {
+  // a thread that has finished leaves its track to the next of its name
+  int count = __atomic_load_n(&_count, __ATOMIC_ACQUIRE);
+  for (int i = 0; i < count && i < TRACE_THREADS; i++) {
+    TraceBuffer& buffer = _buffers[i];
+    if (__atomic_load_n(&buffer.ready, __ATOMIC_ACQUIRE) &&
+        strcmp(buffer.name, name) == 0 &&
+        __sync_bool_compare_and_swap(&buffer.active, 0, 1)) {
+      _buffer = &buffer;
+      return _buffer;
+    }
+  }
+
+  int index = __sync_fetch_and_add(&_count, 1);
+  if (index >= TRACE_THREADS) {
+    if (index == TRACE_THREADS) {
+      printf("trace: more than %d threads, not tracing '%s'\n", TRACE_THREADS, name);
+    }
+    return NULL;
+  }
+
+  TraceBuffer& buffer = _buffers[index];
+  buffer.events = new TraceEvent[TRACE_EVENTS];
+  buffer.head   = 0;
+  buffer.name   = name;
+  buffer.active = 1;
+  __atomic_store_n(&buffer.ready, 1, __ATOMIC_RELEASE);
+
+  _buffer = &buffer;
+  return _buffer;
+}
+
+bool Trace::write(const char* filename) {
+  FILE* file = fopen(filename, "w");
+  if (!file) {
+    printf("trace: cannot write '%s'\n", filename);
+    return false;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  std::vector<TraceEvent> events;
+  int  total = 0;
+  bool first = true;
+
+  int count = __atomic_load_n(&_count, __ATOMIC_ACQUIRE);
+  for (int i = 0; i < count && i < TRACE_THREADS; i++) {
+    TraceBuffer& buffer = _buffers[i];
+    if (!__atomic_load_n(&buffer.ready, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+
+    int tid = i + 1;
+
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                  "\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", tid, buffer.name);
+    first = false;
+
+    // the owner carries on writing; copy, then drop what it overwrote
+    Uint32 end   = __atomic_load_n(&buffer.head, __ATOMIC_ACQUIRE);
+    Uint32 start = end > TRACE_EVENTS ? end - TRACE_EVENTS : 0;
+
+    events.resize(end - start);
+    for (Uint32 n = start; n != end; n++) {
+      events[n - start] = buffer.events[n & (TRACE_EVENTS - 1)];
+    }
+
+    // the slot for head is being written too, hence the one extra
+    Uint32 now = __atomic_load_n(&buffer.head, __ATOMIC_ACQUIRE);
+    Uint32 valid = now + 1 > TRACE_EVENTS ? now + 1 - TRACE_EVENTS : 0;
+    if (valid < start) {
+      valid = start;
+    }
+
+    for (Uint32 n = valid; n < end; n++) {
+      const TraceEvent& event = events[n - start];
+
+      fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+              event.name, event.phase, event.time / 1000.0, tid);
+      if (event.phase == 'i') {
+        fprintf(file, ",\"s\":\"t\",\"args\":{\"value\":%d}", event.value);
+      }
+      fprintf(file, "}");
+      total++;
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  fclose(file);
+
+  printf("trace: %d events from %d threads written to %s\n", total,
+         count < TRACE_THREADS ? count : TRACE_THREADS, filename);
+  return true;
+}
+
+#endif
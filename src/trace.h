@@ -0,0 +1,120 @@
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+
+/*
+ * A timeline of what each thread did, for Chrome's about:tracing or
+ * ui.perfetto.dev. Built with -DENABLE_TRACE only; otherwise all of the
+ * TRACE_ macros are nothing at all.
+ *
+ *  TRACE_THREAD("name")   names the calling thread's track
+ *  TRACE_THREAD_END()     the thread is finishing; another of the same
+ *                         name may take over its track
+ *  TRACE_SCOPE("name")    a slice for the rest of the block
+ *  TRACE_BEGIN / TRACE_END("name")
+ *  TRACE_INSTANT("name", value)
+ *  TRACE_WRITE("file")    writes what the rings hold now
+ *
+ * Names must be string literals (or otherwise live forever).
+ */
+
+#ifdef ENABLE_TRACE
+
+#include "main.h"
+#include "profiler.h"
+
+// Threads that can have a track at once
+#define TRACE_THREADS 32
+
+// Events kept per thread, the most recent; a power of two
+#define TRACE_EVENTS  65536
+
+struct TraceEvent {
+  Uint64      time;
+  const char* name;
+  int         value;
+  char        phase;    // 'B', 'E' or 'i', as trace_event has them
+};
+
+/*
+ * One thread's ring. Only its thread writes it, and head is published
+ * after the event it covers, so a writer never waits on anything and
+ * write() can read alongside it.
+ */
+struct TraceBuffer {
+  TraceEvent* events;
+  Uint32      head;
+  const char* name;
+  int         active;
+  int         ready;
+};
+
+class Trace {
+public:
+  static void thread(const char* name);
+  static void threadEnd();
+
+  static void event(char phase, const char* name, int value) {
+    TraceBuffer* buffer = _buffer;
+    if (!buffer && !(buffer = _attach("thread"))) {
+      return;
+    }
+
+    Uint32 head = buffer->head;
+    TraceEvent& event = buffer->events[head & (TRACE_EVENTS - 1)];
+    event.time  = Profiler::now();
+    event.name  = name;
+    event.value = value;
+    event.phase = phase;
+
+    __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+  }
+
+  /*
+   * Writes every thread's events as trace_event JSON.
+   */
+  static bool write(const char* filename);
+
+private:
+  static TraceBuffer* _attach(const char* name);
+
+  static __thread TraceBuffer* _buffer;
+
+  static TraceBuffer _buffers[TRACE_THREADS];
+  static int         _count;
+};
+
+class TraceScope {
+public:
+  TraceScope(const char* name) : _name(name) {
+    Trace::event('B', name, 0);
+  }
+
+  ~TraceScope() {
+    Trace::event('E', _name, 0);
+  }
+
+private:
+  const char* _name;
+};
+
+#define TRACE_THREAD(name)          Trace::thread(name)
+#define TRACE_THREAD_END()          Trace::threadEnd()
+#define TRACE_SCOPE(name)           TraceScope trace_scope(name)
+#define TRACE_BEGIN(name)           Trace::event('B', name, 0)
+#define TRACE_END(name)             Trace::event('E', name, 0)
+#define TRACE_INSTANT(name, value)  Trace::event('i', name, value)
+#define TRACE_WRITE(filename)       Trace::write(filename)
+
+#else
+
+#define TRACE_THREAD(name)
+#define TRACE_THREAD_END()
+#define TRACE_SCOPE(name)
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+#define TRACE_INSTANT(name, value)
+#define TRACE_WRITE(filename)
+
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+#include "zobrist.h"
+
+Uint64 Zobrist::_keys[10][7];
+bool   Zobrist::_ready = false;
+
+static Uint64 rotl(Uint64 value, int bits) {
+  if (bits == 0) {
+    return value;
+  }
+  return (value << bits) | (value >> (64 - bits));
+}
+
+void Zobrist::_init() {
+  // splitmix64 from a fixed seed: the same keys on every peer
+  Uint64 state = 0x6f6d677774666164ULL;
+
+  for (int i = 0; i < 10; i++) {
+    for (int c = 0; c < 7; c++) {
+      state += 0x9e3779b97f4a7c15ULL;
+
+      Uint64 z = state;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      _keys[i][c] = z ^ (z >> 31);
+    }
+  }
+
+  _ready = true;
+}
+
+void Zobrist::set(game_info* gi, int i, int j, char type) {
+  char old = gi->board[i][j];
+  gi->board[i][j] = type;
+
+  if (old == type) {
+    return;
+  }
+
+  if (!_ready) {
+    _init();
+  }
+
+  Uint64 change = 0;
+  if (old >= 0 && old < 7) {
+    change ^= _keys[i][(int)old];
+  }
+  if (type >= 0 && type < 7) {
+    change ^= _keys[i][(int)type];
+  }
+
+  gi->row_hash[j] ^= change;
+  gi->board_hash  ^= rotl(change, j);
+}
+
+void Zobrist::dropLine(game_info* gi, int lineIndex) {
+  for (int j = lineIndex; j > 1; j--) {
+    gi->board_hash ^= rotl(gi->row_hash[j], j) ^ rotl(gi->row_hash[j-1], j);
+    gi->row_hash[j] = gi->row_hash[j-1];
+  }
+}
+
+void Zobrist::pushUp(game_info* gi, int num) {
+  for (int j = 0; j < 24 - num; j++) {
+    gi->board_hash ^= rotl(gi->row_hash[j], j) ^ rotl(gi->row_hash[j+num], j);
+    gi->row_hash[j] = gi->row_hash[j+num];
+  }
+}
+
+Uint64 Zobrist::_rowHash(game_info* gi, int j) {
+  Uint64 hash = 0;
+
+  for (int i = 0; i < 10; i++) {
+    char type = gi->board[i][j];
+    if (type >= 0 && type < 7) {
+      hash ^= _keys[i][(int)type];
+    }
+  }
+
+  return hash;
+}
+
+void Zobrist::rebuild(game_info* gi) {
+  if (!_ready) {
+    _init();
+  }
+
+  gi->board_hash = 0;
+  for (int j = 0; j < 24; j++) {
+    gi->row_hash[j] = _rowHash(gi, j);
+    gi->board_hash ^= rotl(gi->row_hash[j], j);
+  }
+}
+
+Uint64 Zobrist::compute(game_info* gi) {
+  if (!_ready) {
+    _init();
+  }
+
+  Uint64 hash = 0;
+  for (int j = 0; j < 24; j++) {
+    hash ^= rotl(_rowHash(gi, j), j);
+  }
+
+  return hash;
+}
+
+void Zobrist::dump(const char* label, game_info* gi) {
+  printf("%s: hash=%08x%08x computed=%08x%08x\n", label,
+         (unsigned int)(gi->board_hash >> 32), (unsigned int)gi->board_hash,
+         (unsigned int)(compute(gi) >> 32), (unsigned int)compute(gi));
+
+  for (int j = 0; j < 24; j++) {
+    char row[11];
+    for (int i = 0; i < 10; i++) {
+      char type = gi->board[i][j];
+      row[i] = (type < 0) ? '.' : (char)('0' + type);
+    }
+    row[10] = '\0';
+
+    printf("  %2d %s\n", j, row);
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef ZOBRIST_INCLUDED
+#define ZOBRIST_INCLUDED
+
+#include "main.h"
+
+// Frames between board hash exchanges
+#define ZOBRIST_CHECK_INTERVAL 30
+
+/*
+ * A 64-bit Zobrist hash of a board, kept up to date as the board changes
+ * so two peers can cheaply check their copies agree.
+ *
+ * The key of a block of colour c at column i, row j is rotl(key[i][c], j):
+ * each row keeps a hash of its contents alone (game_info::row_hash) and
+ * adds it to the board hash rotated by its row. Setting a cell costs two
+ * XORs; a line drop or push up moves whole rows, which only moves their
+ * row hashes. The keys come from a fixed seed so every build agrees.
+ *
+ * Every write to game_info::board must go through here (or be followed by
+ * rebuild), or the hash no longer describes the board.
+ */
+class Zobrist {
+public:
+  /*
+   * Sets a cell, -1 being empty.
+   */
+  static void set(game_info* gi, int i, int j, char type);
+
+  /*
+   * Mirrors Tetris::dropLine: rows 2..lineIndex take the row above them.
+   */
+  static void dropLine(game_info* gi, int lineIndex);
+
+  /*
+   * Mirrors Tetris::pushUp: every row takes the one num rows below it.
+   */
+  static void pushUp(game_info* gi, int num);
+
+  /*
+   * Recomputes everything after the board was written wholesale.
+   */
+  static void rebuild(game_info* gi);
+
+  /*
+   * Hashes the board from scratch without touching the cached hashes.
+   */
+  static Uint64 compute(game_info* gi);
+
+  /*
+   * Prints a board and its hashes, for desync reports.
+   */
+  static void dump(const char* label, game_info* gi);
+
+private:
+  static void _init();
+  static Uint64 _rowHash(game_info* gi, int j);
+
+  static Uint64 _keys[10][7];
+  static bool   _ready;
+};
+
+#endif